@@ -62,15 +62,18 @@ static struct bench_image load_png(char *path, enum oil_colorspace cs)
 		break;
 	case OIL_CS_RGBX:
 	case OIL_CS_RGBX_NOGAMMA:
+	case OIL_CS_RGBX_GAMMA2:
 		png_set_strip_alpha(rpng);
 		png_set_filler(rpng, 0xffff, PNG_FILLER_AFTER);
 		break;
 	case OIL_CS_RGB_NOGAMMA:
+	case OIL_CS_RGB_GAMMA2:
 		png_set_strip_alpha(rpng);
 		break;
 	case OIL_CS_CMYK: /* Kind of cheating on CMYK by giving it RGBA */
 	case OIL_CS_RGBA:
 	case OIL_CS_RGBA_NOGAMMA:
+	case OIL_CS_RGBA_GAMMA2:
 	case OIL_CS_ARGB:
 	case OIL_CS_UNKNOWN:
 		break;
@@ -141,6 +144,75 @@ clock_t resize(struct bench_image image, int out_width, int out_height,
 	return t;
 }
 
+/**
+ * Like resize(), but with the whole image fed through oil_scale_in_rows() and
+ * oil_scale_out_rows(), which use the scaler's default backend.
+ */
+clock_t resize_rows(struct bench_image image, int out_width, int out_height)
+{
+	int in_row, out_row;
+	struct oil_scale os;
+	unsigned char *outbuf;
+	size_t in_row_stride;
+	clock_t t;
+
+	in_row_stride = image.width * OIL_CMP(image.cs);
+	outbuf = malloc(out_width * OIL_CMP(image.cs));
+	if (!outbuf) {
+		fprintf(stderr, "Unable to allocate output buffer.\n");
+		exit(1);
+	}
+
+	t = clock();
+	oil_scale_init(&os, image.height, out_height, image.width, out_width,
+		image.cs);
+	in_row = out_row = 0;
+	while (out_row < out_height) {
+		in_row += oil_scale_in_rows(&os,
+			image.buffer + in_row * in_row_stride, in_row_stride,
+			image.height - in_row);
+		out_row += oil_scale_out_rows(&os, outbuf, 0,
+			out_height - out_row);
+	}
+	t = clock() - t;
+	free(outbuf);
+	oil_scale_free(&os);
+	return t;
+}
+
+/**
+ * Time a scaler that widens the image while shrinking its height, a scanline
+ * at a time and in batches. Only this geometry accumulates several x-scaled
+ * scanlines into sums_y in one pass when given batches.
+ */
+void do_bench_mixed(struct bench_image image, double x_ratio, double y_ratio,
+	int iterations, scale_in_fn do_in, scale_out_fn do_out)
+{
+	int i, out_width, out_height;
+	clock_t t_min, t_rows, t_tmp;
+
+	out_width = round(image.width * x_ratio);
+	out_height = round(image.height * y_ratio);
+	if (out_height < 1) {
+		out_height = 1;
+	}
+
+	t_min = t_rows = 0;
+	for (i=0; i<iterations; i++) {
+		t_tmp = resize(image, out_width, out_height, do_in, do_out);
+		if (!t_min || t_tmp < t_min) {
+			t_min = t_tmp;
+		}
+		t_tmp = resize_rows(image, out_width, out_height);
+		if (!t_rows || t_tmp < t_rows) {
+			t_rows = t_tmp;
+		}
+	}
+
+	printf("    to %4dx%4d %6.2fms, in rows %6.2fms\n", out_width,
+		out_height, time_to_ms(t_min), time_to_ms(t_rows));
+}
+
 void do_bench(struct bench_image image, double ratio, int iterations,
 	scale_in_fn do_in, scale_out_fn do_out)
 {
@@ -163,19 +235,30 @@ void do_bench(struct bench_image image, double ratio, int iterations,
 	printf("    to %4dx%4d %6.2fms\n", out_width, out_height, time_to_ms(t_min));
 }
 
-/* filter: 0=all, 1=downscale only (ratio<1), 2=upscale only (ratio>=1) */
+/* filter: 0=all, 1=downscale only (ratio<1), 2=upscale only (ratio>=1),
+ * 3=widen while shrinking the height */
 void do_bench_sizes(char *name, char *path, enum oil_colorspace cs,
 	int iterations, int filter, char *impl_name,
 	scale_in_fn do_in, scale_out_fn do_out)
 {
 	struct bench_image image;
 	double ratios[] = { 0.01, 0.125, 0.8, 2.14 };
+	double y_ratios[] = { 0.125, 0.5 };
 	size_t i, num_ratios;
 
 	image = load_png(path, cs);
 
 	printf("%dx%d %s [%s]\n", image.width, image.height, name, impl_name);
 
+	if (filter == 3) {
+		for (i=0; i<sizeof(y_ratios)/sizeof(y_ratios[0]); i++) {
+			do_bench_mixed(image, 2.14, y_ratios[i], iterations,
+				do_in, do_out);
+		}
+		free(image.buffer);
+		return;
+	}
+
 	num_ratios = sizeof(ratios)/sizeof(ratios[0]);
 	for (i=0; i<num_ratios; i++) {
 		if (filter == 1 && ratios[i] >= 1.0) continue;
@@ -209,6 +292,9 @@ void run_bench(char *path, char *cs_arg, int iterations, int filter,
 		OIL_CS_RGB_NOGAMMA,
 		OIL_CS_RGBA_NOGAMMA,
 		OIL_CS_RGBX_NOGAMMA,
+		OIL_CS_RGB_GAMMA2,
+		OIL_CS_RGBA_GAMMA2,
+		OIL_CS_RGBX_GAMMA2,
 	};
 
 	char *space_names[] = {
@@ -222,6 +308,9 @@ void run_bench(char *path, char *cs_arg, int iterations, int filter,
 		"RGB_NOGAMMA",
 		"RGBA_NOGAMMA",
 		"RGBX_NOGAMMA",
+		"RGB_GAMMA2",
+		"RGBA_GAMMA2",
+		"RGBX_GAMMA2",
 	};
 
 	t = clock();
@@ -267,14 +356,19 @@ static void print_help(char *prog)
 	printf("Options:\n");
 	printf("  --down            Benchmark downscale ratios only\n");
 	printf("  --up              Benchmark upscale ratios only\n");
+	printf("  --mixed           Benchmark widening while shrinking the height,\n");
+	printf("                    also fed in batches of rows\n");
 	printf("  --scalar          Run scalar implementation only\n");
+	printf("  --vec             Run portable vector implementation only\n");
 	printf("  --sse2            Run SSE2 implementation only (x86_64)\n");
+	printf("  --sse41           Run SSE4.1 implementation only (x86_64)\n");
 	printf("  --avx2            Run AVX2 implementation only (x86_64)\n");
 	printf("  --neon            Run NEON implementation only (AArch64)\n");
 	printf("  -h, --help        Show this help message and exit\n");
 	printf("\n");
 	printf("Colorspaces: G, GA, RGB, RGBX, RGBA, ARGB, CMYK,\n");
-	printf("             RGB_NOGAMMA, RGBA_NOGAMMA, RGBX_NOGAMMA\n");
+	printf("             RGB_NOGAMMA, RGBA_NOGAMMA, RGBX_NOGAMMA,\n");
+	printf("             RGB_GAMMA2, RGBA_GAMMA2, RGBX_GAMMA2\n");
 	printf("If omitted, all colorspaces are benchmarked.\n");
 	printf("\n");
 	printf("Environment:\n");
@@ -283,10 +377,10 @@ static void print_help(char *prog)
 
 int main(int argc, char *argv[])
 {
-	int iterations, filter, arg_pos, impl_mode; /* 0=all,1=scalar,3=sse2,4=avx2,5=neon */
+	int iterations, filter, arg_pos, impl_mode; /* 0=all,1=scalar,3=sse2,4=avx2,5=neon,6=sse41,7=vec */
 	char *end, *path, *cs_arg;
 	unsigned long ul;
-	struct impl impls[3];
+	struct impl impls[5];
 	int num_impls;
 
 	/* Parse flags */
@@ -298,10 +392,16 @@ int main(int argc, char *argv[])
 			filter = 1;
 		} else if (strcmp(argv[arg_pos], "--up") == 0) {
 			filter = 2;
+		} else if (strcmp(argv[arg_pos], "--mixed") == 0) {
+			filter = 3;
 		} else if (strcmp(argv[arg_pos], "--scalar") == 0) {
 			impl_mode = 1;
+		} else if (strcmp(argv[arg_pos], "--vec") == 0) {
+			impl_mode = 7;
 		} else if (strcmp(argv[arg_pos], "--sse2") == 0) {
 			impl_mode = 3;
+		} else if (strcmp(argv[arg_pos], "--sse41") == 0) {
+			impl_mode = 6;
 		} else if (strcmp(argv[arg_pos], "--avx2") == 0) {
 			impl_mode = 4;
 		} else if (strcmp(argv[arg_pos], "--neon") == 0) {
@@ -318,7 +418,7 @@ int main(int argc, char *argv[])
 	}
 
 	if (argc - arg_pos < 1 || argc - arg_pos > 2) {
-		fprintf(stderr, "Usage: %s [--up|--down] [--scalar|--sse2|--avx2|--neon] <path> [colorspace]\n",
+		fprintf(stderr, "Usage: %s [--up|--down|--mixed] [--scalar|--vec|--sse2|--sse41|--avx2|--neon] <path> [colorspace]\n",
 			argv[0]);
 		fprintf(stderr, "Try '%s --help' for more information.\n", argv[0]);
 		return 1;
@@ -343,8 +443,15 @@ int main(int argc, char *argv[])
 
 	if (impl_mode == 0 || impl_mode == 1) {
 		impls[num_impls].name = "scalar";
-		impls[num_impls].in = oil_scale_in;
-		impls[num_impls].out = oil_scale_out;
+		impls[num_impls].in = oil_scale_in_scalar;
+		impls[num_impls].out = oil_scale_out_scalar;
+		num_impls++;
+	}
+
+	if (impl_mode == 0 || impl_mode == 7) {
+		impls[num_impls].name = "vec";
+		impls[num_impls].in = oil_scale_in_vec;
+		impls[num_impls].out = oil_scale_out_vec;
 		num_impls++;
 	}
 
@@ -355,6 +462,12 @@ int main(int argc, char *argv[])
 		impls[num_impls].out = oil_scale_out_sse2;
 		num_impls++;
 	}
+	if (impl_mode == 0 || impl_mode == 6) {
+		impls[num_impls].name = "sse41";
+		impls[num_impls].in = oil_scale_in_sse41;
+		impls[num_impls].out = oil_scale_out_sse41;
+		num_impls++;
+	}
 	if (impl_mode == 0 || impl_mode == 4) {
 		impls[num_impls].name = "avx2";
 		impls[num_impls].in = oil_scale_in_avx2;
@@ -372,12 +485,12 @@ int main(int argc, char *argv[])
 		impls[num_impls].out = oil_scale_out_neon;
 		num_impls++;
 	}
-	if (impl_mode == 3 || impl_mode == 4) {
-		fprintf(stderr, "SSE2/AVX2 not available on AArch64.\n");
+	if (impl_mode == 3 || impl_mode == 4 || impl_mode == 6) {
+		fprintf(stderr, "SSE2/SSE4.1/AVX2 not available on AArch64.\n");
 		return 1;
 	}
 #else
-	if (impl_mode >= 3) {
+	if (impl_mode >= 3 && impl_mode != 7) {
 		fprintf(stderr, "No SIMD support compiled in.\n");
 		return 1;
 	}
@@ -20,7 +20,7 @@ static void bench_one(int in_w, int in_h, int out_w, int out_h,
 	clock_t t, t_min;
 
 	alloc_size = oil_scale_alloc_size(in_h, out_h, in_w, out_w, cs);
-	buf = calloc(1, alloc_size);
+	buf = malloc(alloc_size);
 	if (!buf) {
 		fprintf(stderr, "Unable to allocate buffer.\n");
 		exit(1);
@@ -35,10 +35,8 @@ static void bench_one(int in_w, int in_h, int out_w, int out_h,
 
 	t_min = 0;
 	for (i=0; i<iterations; i++) {
-		/* Reset buffer outside the timed region. Upscale borders use
-		 * += and would accumulate across runs; downscale coeffs are
-		 * scatter-written and need zeros at unwritten positions. */
-		memset(buf, 0, alloc_size);
+		/* oil_scale_init_allocated() zeroes the tables it needs, so
+		 * the buffer can be reused as is. */
 		t = clock();
 		oil_scale_init_allocated(&os, in_h, out_h, in_w, out_w, cs, buf);
 		t = clock() - t;
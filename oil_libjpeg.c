@@ -35,7 +35,7 @@ int oil_libjpeg_init(struct oil_libjpeg *ol,
 		return -1;
 	}
 
-	ol->inbuf = malloc(dinfo->output_width * dinfo->output_components);
+	ol->inbuf = oil_alloc(dinfo->output_width * dinfo->output_components);
 	if (!ol->inbuf) {
 		return -2;
 	}
@@ -43,7 +43,7 @@ int oil_libjpeg_init(struct oil_libjpeg *ol,
 	ret = oil_scale_init(&ol->os, dinfo->output_height, out_height,
 		dinfo->output_width, out_width, cs);
 	if (ret!=0) {
-		free(ol->inbuf);
+		oil_free(ol->inbuf);
 		return ret;
 	}
 
@@ -52,9 +52,7 @@ int oil_libjpeg_init(struct oil_libjpeg *ol,
 
 void oil_libjpeg_free(struct oil_libjpeg *ol)
 {
-	if (ol->inbuf) {
-		free(ol->inbuf);
-	}
+	oil_free(ol->inbuf);
 	oil_scale_free(&ol->os);
 }
 
@@ -22,37 +22,26 @@
 #include "oil_libpng.h"
 #include <stdlib.h>
 
+/**
+ * Allocate the row pointers and the rows of an image in a single block.
+ */
 static unsigned char **alloc_full_image_buf(int height, int rowbytes)
 {
-	int i, j;
-	unsigned char **imgbuf;
+	int i;
+	unsigned char **imgbuf, *rows;
 
-	imgbuf = malloc(height * sizeof(unsigned char *));
+	imgbuf = oil_alloc(height * sizeof(unsigned char *) +
+		(size_t)height * rowbytes);
 	if (!imgbuf) {
 		return NULL;
 	}
+	rows = (unsigned char *)(imgbuf + height);
 	for (i=0; i<height; i++) {
-		imgbuf[i] = malloc(rowbytes);
-		if (!imgbuf[i]) {
-			for (j=0; j<i; j++) {
-				free(imgbuf[j]);
-			}
-			free(imgbuf);
-			return NULL;
-		}
+		imgbuf[i] = rows + (size_t)i * rowbytes;
 	}
 	return imgbuf;
 }
 
-static void free_full_image_buf(unsigned char **imgbuf, int height)
-{
-	int i;
-	for (i=0; i<height; i++) {
-		free(imgbuf[i]);
-	}
-	free(imgbuf);
-}
-
 int oil_libpng_init(struct oil_libpng *ol, png_structp rpng, png_infop rinfo,
 	int out_width, int out_height)
 {
@@ -81,7 +70,7 @@ int oil_libpng_init(struct oil_libpng *ol, png_structp rpng, png_infop rinfo,
 	buf_len = png_get_rowbytes(rpng, rinfo);
 	switch (png_get_interlace_type(rpng, rinfo)) {
 	case PNG_INTERLACE_NONE:
-		ol->inbuf = malloc(buf_len);
+		ol->inbuf = oil_alloc(buf_len);
 		if (!ol->inbuf) {
 			oil_scale_free(&ol->os);
 			return -2;
@@ -102,12 +91,8 @@ int oil_libpng_init(struct oil_libpng *ol, png_structp rpng, png_infop rinfo,
 
 void oil_libpng_free(struct oil_libpng *ol)
 {
-	if (ol->inbuf) {
-		free(ol->inbuf);
-	}
-	if (ol->inimage) {
-		free_full_image_buf(ol->inimage, ol->os.in_height);
-	}
+	oil_free(ol->inbuf);
+	oil_free(ol->inimage);
 	oil_scale_free(&ol->os);
 }
 
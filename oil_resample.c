@@ -26,6 +26,10 @@
 #include <limits.h>
 #include <string.h>
 #include <stdio.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <time.h>
+#include <stdatomic.h>
 
 /**
  * When shrinking a 10 million pixel wide scanline down to a single pixel, we
@@ -40,6 +44,13 @@
  */
 #define TAPS 4
 
+/**
+ * Scanlines a downscaler that widens can x-scale before accumulating them
+ * into sums_y together, see scale_in_line_rows(). Each block of them makes one
+ * pass over sums_y rather than one pass per scanline.
+ */
+#define DOWN_LINES 4
+
 static int max(int a, int b)
 {
 	return a > b ? a : b;
@@ -80,6 +91,16 @@ static int clamp8(float x)
 	return f2i(clampf(x) * 255.0f);
 }
 
+/**
+ * Convert a float to 8-bit integer, taking the square root first to return a
+ * linear sample of the GAMMA2 colorspaces to gamma 2.0.
+ */
+static int clamp8_gamma(float x, int gamma2)
+{
+	x = clampf(x);
+	return f2i((gamma2 ? sqrtf(x) : x) * 255.0f);
+}
+
 /**
  * Return the maximum number of input samples that can contribute to any single
  * output sample. Used only for buffer allocation.
@@ -133,9 +154,12 @@ static void calc_coeffs(float *coeffs, float tx, int taps, int ltrim, int rtrim)
  * lobe can drive intermediates outside [0, 1] - and RGBA/ARGB unpremul can
  * send R_pre / alpha arbitrarily large - so every gamma-aware output path
  * clamps before the lookup.
+ *
+ * The storage carries 3 bytes of padding so SIMD backends can fetch entries
+ * with 32-bit gathers.
  */
 #define L2S_ALL_LEN 22000
-static unsigned char l2s_map_storage[L2S_ALL_LEN];
+static unsigned char l2s_map_storage[L2S_ALL_LEN + 3];
 int l2s_len = L2S_ALL_LEN;
 unsigned char *l2s_map = l2s_map_storage;
 
@@ -157,6 +181,51 @@ static void build_l2s(void)
 	}
 }
 
+#ifdef OIL_L2S_POLY
+/**
+ * Level boundaries for the polynomial linear-to-sRGB conversion. l2s_edges[i]
+ * is the smallest float whose sRGB value is at least i + 0.5 levels, so the
+ * correctly rounded level of x is the number of edges at or below it. The
+ * last entry is past the [0, 1] range and is never reached.
+ */
+float l2s_edges[256];
+
+/**
+ * The exact sRGB value of linear x, in levels.
+ */
+static long double l2s_level(float x)
+{
+	if (x <= 0.00313066844250063L) {
+		return x * 12.92L * 255;
+	}
+	return (1.055L * powl(x, 1 / 2.4L) - 0.055L) * 255;
+}
+
+static void build_l2s_edges(void)
+{
+	int i;
+	long double mid;
+	float x;
+
+	for (i=0; i<255; i++) {
+		mid = (i + 0.5L) / 255;
+		if (mid <= 0.00313066844250063L * 12.92L) {
+			x = mid / 12.92L;
+		} else {
+			x = powl((mid + 0.055L) / 1.055L, 2.4L);
+		}
+		while (x > 0 && l2s_level(nextafterf(x, 0)) >= i + 0.5L) {
+			x = nextafterf(x, 0);
+		}
+		while (l2s_level(x) < i + 0.5L) {
+			x = nextafterf(x, 2);
+		}
+		l2s_edges[i] = x;
+	}
+	l2s_edges[255] = 2.0f;
+}
+#endif
+
 /**
  * Maps the given linear RGB float to sRGB integer.
  */
@@ -212,12 +281,13 @@ static void yscale_out_linear(float *sums, int len, unsigned char *out)
 	}
 }
 
-static void yscale_out_nonlinear(float *sums, int sl_len, unsigned char *out)
+static void yscale_out_nonlinear(float *sums, int sl_len, unsigned char *out,
+	int gamma2)
 {
 	int i;
 
 	for (i=0; i<sl_len; i++) {
-		out[i] = clamp8(*sums);
+		out[i] = clamp8_gamma(*sums, gamma2);
 		shift_left_f(sums);
 		sums += 4;
 	}
@@ -323,7 +393,7 @@ static void yscale_out_rgbx(float *sums, int width, unsigned char *out, int tap)
 }
 
 static void yscale_out_rgba_nogamma(float *sums, int width, unsigned char *out,
-	int tap)
+	int tap, int gamma2)
 {
 	int i, j, tap_off;
 	float alpha, val;
@@ -336,7 +406,7 @@ static void yscale_out_rgba_nogamma(float *sums, int width, unsigned char *out,
 			if (alpha != 0) {
 				val /= alpha;
 			}
-			out[j] = f2i(clampf(val) * 255.0f);
+			out[j] = clamp8_gamma(val, gamma2);
 			sums[tap_off + j] = 0.0f;
 		}
 		out[3] = round(alpha * 255.0f);
@@ -347,14 +417,14 @@ static void yscale_out_rgba_nogamma(float *sums, int width, unsigned char *out,
 }
 
 static void yscale_out_rgbx_nogamma(float *sums, int width, unsigned char *out,
-	int tap)
+	int tap, int gamma2)
 {
 	int i, j, tap_off;
 
 	tap_off = tap * 4;
 	for (i=0; i<width; i++) {
 		for (j=0; j<3; j++) {
-			out[j] = f2i(clampf(sums[tap_off + j]) * 255.0f);
+			out[j] = clamp8_gamma(sums[tap_off + j], gamma2);
 			sums[tap_off + j] = 0.0f;
 		}
 		out[3] = 255;
@@ -373,7 +443,7 @@ static void yscale_out(float *sums, int width, unsigned char *out,
 
 	switch(cs) {
 	case OIL_CS_G:
-		yscale_out_nonlinear(sums, sl_len, out);
+		yscale_out_nonlinear(sums, sl_len, out, 0);
 		break;
 	case OIL_CS_CMYK:
 		yscale_out_cmyk(sums, width, out, tap);
@@ -394,13 +464,22 @@ static void yscale_out(float *sums, int width, unsigned char *out,
 		yscale_out_rgbx(sums, width, out, tap);
 		break;
 	case OIL_CS_RGB_NOGAMMA:
-		yscale_out_nonlinear(sums, sl_len, out);
+		yscale_out_nonlinear(sums, sl_len, out, 0);
 		break;
 	case OIL_CS_RGBA_NOGAMMA:
-		yscale_out_rgba_nogamma(sums, width, out, tap);
+		yscale_out_rgba_nogamma(sums, width, out, tap, 0);
 		break;
 	case OIL_CS_RGBX_NOGAMMA:
-		yscale_out_rgbx_nogamma(sums, width, out, tap);
+		yscale_out_rgbx_nogamma(sums, width, out, tap, 0);
+		break;
+	case OIL_CS_RGB_GAMMA2:
+		yscale_out_nonlinear(sums, sl_len, out, 1);
+		break;
+	case OIL_CS_RGBA_GAMMA2:
+		yscale_out_rgba_nogamma(sums, width, out, tap, 1);
+		break;
+	case OIL_CS_RGBX_GAMMA2:
+		yscale_out_rgbx_nogamma(sums, width, out, tap, 1);
 		break;
 	case OIL_CS_UNKNOWN:
 		break;
@@ -408,7 +487,7 @@ static void yscale_out(float *sums, int width, unsigned char *out,
 }
 
 static void yscale_up_g_cmyk(float **in, int len, float *coeffs,
-	unsigned char *out)
+	unsigned char *out, int gamma2)
 {
 	int i;
 	float sum;
@@ -418,7 +497,7 @@ static void yscale_up_g_cmyk(float **in, int len, float *coeffs,
 			coeffs[1] * in[1][i] +
 			coeffs[2] * in[2][i] +
 			coeffs[3] * in[3][i];
-		out[i] = clamp8(sum);
+		out[i] = clamp8_gamma(sum, gamma2);
 	}
 }
 
@@ -528,7 +607,7 @@ static void yscale_up_rgbx(float **in, int len, float *coeffs,
 }
 
 static void yscale_up_rgba_nogamma(float **in, int len, float *coeffs,
-	unsigned char *out)
+	unsigned char *out, int gamma2)
 {
 	int i, j;
 	float alpha, sums[4];
@@ -546,14 +625,14 @@ static void yscale_up_rgba_nogamma(float **in, int len, float *coeffs,
 				sums[j] /= alpha;
 				sums[j] = clampf(sums[j]);
 			}
-			out[i + j] = f2i(clampf(sums[j]) * 255.0f);
+			out[i + j] = clamp8_gamma(sums[j], gamma2);
 		}
 		out[i + 3] = f2i(alpha * 255.0f);
 	}
 }
 
 static void yscale_up_rgbx_nogamma(float **in, int len, float *coeffs,
-	unsigned char *out)
+	unsigned char *out, int gamma2)
 {
 	int i, j;
 	float sums[3];
@@ -566,7 +645,7 @@ static void yscale_up_rgbx_nogamma(float **in, int len, float *coeffs,
 				coeffs[3] * in[3][i + j];
 		}
 		for (j=0; j<3; j++) {
-			out[i + j] = f2i(clampf(sums[j]) * 255.0f);
+			out[i + j] = clamp8_gamma(sums[j], gamma2);
 		}
 		out[i + 3] = 255;
 	}
@@ -582,7 +661,7 @@ static void yscale_up(float **in, int len, float *coeffs, unsigned char *out,
 	switch(cs) {
 	case OIL_CS_G:
 	case OIL_CS_CMYK:
-		yscale_up_g_cmyk(in, len, coeffs, out);
+		yscale_up_g_cmyk(in, len, coeffs, out, 0);
 		break;
 	case OIL_CS_GA:
 		yscale_up_ga(in, len, coeffs, out);
@@ -600,13 +679,22 @@ static void yscale_up(float **in, int len, float *coeffs, unsigned char *out,
 		yscale_up_rgbx(in, len, coeffs, out);
 		break;
 	case OIL_CS_RGB_NOGAMMA:
-		yscale_up_g_cmyk(in, len, coeffs, out);
+		yscale_up_g_cmyk(in, len, coeffs, out, 0);
 		break;
 	case OIL_CS_RGBA_NOGAMMA:
-		yscale_up_rgba_nogamma(in, len, coeffs, out);
+		yscale_up_rgba_nogamma(in, len, coeffs, out, 0);
 		break;
 	case OIL_CS_RGBX_NOGAMMA:
-		yscale_up_rgbx_nogamma(in, len, coeffs, out);
+		yscale_up_rgbx_nogamma(in, len, coeffs, out, 0);
+		break;
+	case OIL_CS_RGB_GAMMA2:
+		yscale_up_g_cmyk(in, len, coeffs, out, 1);
+		break;
+	case OIL_CS_RGBA_GAMMA2:
+		yscale_up_rgba_nogamma(in, len, coeffs, out, 1);
+		break;
+	case OIL_CS_RGBX_GAMMA2:
+		yscale_up_rgbx_nogamma(in, len, coeffs, out, 1);
 		break;
 	case OIL_CS_UNKNOWN:
 		break;
@@ -652,6 +740,134 @@ static void build_i2f(void)
 	}
 }
 
+/**
+ * Holds the linear value of each gamma 2.0 sample, its square.
+ */
+float g2l_map[256];
+
+static void build_g2l(void)
+{
+	int i;
+
+	for (i=0; i<=255; i++) {
+		g2l_map[i] = i2f_map[i] * i2f_map[i];
+	}
+}
+
+/**
+ * Incremental state of a coefficient calculation. Output samples are calculated
+ * strictly in order, so positions accumulate exactly as they do when a whole
+ * table is built at once, and a window of coefficients produced as scaling
+ * advances is bit-identical to the matching part of the table.
+ */
+struct coeff_gen {
+	int in_dim;
+	int out_dim;
+	int next; // next output sample to calculate.
+	double step; // input samples per output sample.
+	double center; // position of the next output sample on the input axis.
+	int ends[4]; // downscale: last input sample of the previous 4 outputs.
+	int zeroed; // downscale: input samples below this have been zeroed.
+};
+
+static void coeff_gen_init(struct coeff_gen *g, int in_dim, int out_dim)
+{
+	int i;
+
+	g->in_dim = in_dim;
+	g->out_dim = out_dim;
+	g->next = 0;
+	g->step = (double)in_dim / out_dim;
+	g->center = 0.5 * g->step - 0.5;
+	for (i=0; i<4; i++) {
+		g->ends[i] = -1;
+	}
+	g->zeroed = 0;
+}
+
+/**
+ * First input sample used by the next downscale output sample.
+ */
+static int down_gen_start(struct coeff_gen *g)
+{
+	return max((int)floor(g->center - 2.0 * g->step) + 1, 0);
+}
+
+/**
+ * Calculate the coefficients of the next downscale output sample and return
+ * its border counter.
+ *
+ * Coefficients are stored 4 per input sample in a window of rows input
+ * samples, indexed by input sample modulo rows. Input samples are zeroed as
+ * they enter the window, so rows must be large enough to hold every input
+ * sample from the one being scaled to the last one used by the calculated
+ * output samples.
+ */
+static int down_gen_next(struct coeff_gen *g, float *coeff_buf, int rows,
+	float *tmp_coeffs)
+{
+	int i, j, offset, pos, smp_end, smp_start, n_samples, border;
+	float fudge;
+	double tap_mult, radius, center, left_edge, right_edge, dist;
+
+	i = g->next;
+	tap_mult = g->step;
+	center = g->center;
+	radius = 2.0 * tap_mult;
+
+	left_edge = center - radius;
+	right_edge = center + radius;
+	/* floor(left)+1 / ceil(right)-1 collapse the original ceil/floor
+	 * + equality-bump pair into one rounding op each. Excludes
+	 * samples at exactly distance +/-2 (catrom = 0 there). */
+	smp_start = (int)floor(left_edge) + 1;
+	smp_end = (int)ceil(right_edge) - 1;
+	if (smp_start < 0) {
+		smp_start = 0;
+	}
+	if (smp_end >= g->in_dim) {
+		smp_end = g->in_dim - 1;
+	}
+	n_samples = smp_end - smp_start + 1;
+
+	g->ends[i%4] = smp_end;
+	border = smp_end - g->ends[(i+3)%4];
+
+	fudge = 0.0f;
+	for (j=0; j<n_samples; j++) {
+		dist = fabs((double)(smp_start + j) - center);
+		tmp_coeffs[j] = catrom((float)(dist / tap_mult)) / (float)tap_mult;
+		fudge += tmp_coeffs[j];
+	}
+	fudge = 1.0f / fudge;
+	for (j=0; j<n_samples; j++) {
+		tmp_coeffs[j] *= fudge;
+	}
+
+	for (; g->zeroed <= smp_end; g->zeroed++) {
+		memset(coeff_buf + g->zeroed % rows * 4, 0, 4 * sizeof(float));
+	}
+
+	for (j=0; j<n_samples; j++) {
+		pos = smp_start + j;
+
+		offset = 3;
+		if (pos > g->ends[(i+3)%4]) {
+			offset = 0;
+		} else if (pos > g->ends[(i+2)%4]) {
+			offset = 1;
+		} else if (pos > g->ends[(i+1)%4]) {
+			offset = 2;
+		}
+
+		coeff_buf[pos % rows * 4 + offset] = tmp_coeffs[j];
+	}
+
+	g->center += tap_mult;
+	g->next++;
+	return border;
+}
+
 /**
  * Given input & output dimensions, populate a buffer of coefficients and border counters.
  *
@@ -665,65 +881,74 @@ static void build_i2f(void)
 static void scale_down_coeffs(int in_dim, int out_dim, float *coeff_buf, int *border_buf,
 	float *tmp_coeffs)
 {
-	int i, j, offset, pos, smp_end, smp_start, n_samples, ends[4];
-	float fudge;
-	double tap_mult, radius, center, left_edge, right_edge, dist;
-
-	tap_mult = (double)in_dim / out_dim;
-	radius = 2.0 * tap_mult;
-	center = 0.5 * tap_mult - 0.5;
+	int i;
+	struct coeff_gen g;
 
-	for (i=0; i<4; i++) {
-		ends[i] = -1;
+	coeff_gen_init(&g, in_dim, out_dim);
+	for (i=0; i<out_dim; i++) {
+		border_buf[i] = down_gen_next(&g, coeff_buf, in_dim, tmp_coeffs);
 	}
+}
 
-	for (i=0; i<out_dim; i++) {
-		left_edge = center - radius;
-		right_edge = center + radius;
-		/* floor(left)+1 / ceil(right)-1 collapse the original ceil/floor
-		 * + equality-bump pair into one rounding op each. Excludes
-		 * samples at exactly distance +/-2 (catrom = 0 there). */
-		smp_start = (int)floor(left_edge) + 1;
-		smp_end = (int)ceil(right_edge) - 1;
-		if (smp_start < 0) {
-			smp_start = 0;
-		}
-		if (smp_end >= in_dim) {
-			smp_end = in_dim - 1;
-		}
-		n_samples = smp_end - smp_start + 1;
-
-		ends[i%4] = smp_end;
-		border_buf[i] = smp_end - ends[(i+3)%4];
-
-		fudge = 0.0f;
-		for (j=0; j<n_samples; j++) {
-			dist = fabs((double)(smp_start + j) - center);
-			tmp_coeffs[j] = catrom((float)(dist / tap_mult)) / (float)tap_mult;
-			fudge += tmp_coeffs[j];
-		}
-		fudge = 1.0f / fudge;
-		for (j=0; j<n_samples; j++) {
-			tmp_coeffs[j] *= fudge;
-		}
-
-		for (j=0; j<n_samples; j++) {
-			pos = smp_start + j;
-
-			offset = 3;
-			if (pos > ends[(i+3)%4]) {
-				offset = 0;
-			} else if (pos > ends[(i+2)%4]) {
-				offset = 1;
-			} else if (pos > ends[(i+1)%4]) {
-				offset = 2;
-			}
+/**
+ * Input sample after which the next upscale output sample can be calculated.
+ */
+static int up_gen_end(struct coeff_gen *g)
+{
+	int smp_i;
 
-			coeff_buf[pos * 4 + offset] = tmp_coeffs[j];
-		}
+	/* split_map inlined: smp_i is floor toward -inf, but pos_d in
+	 * (-0.5, 0) maps to smp_i = -1. */
+	smp_i = g->center < 0.0 ? -1 : (int)g->center;
+	return min(smp_i + 2, g->in_dim - 1);
+}
+
+/**
+ * Calculate the 4 coefficients of the next upscale output sample and return
+ * the input sample after which it can be calculated.
+ */
+static int up_gen_next(struct coeff_gen *g, float *coeffs)
+{
+	int smp_i, start, end, ltrim, rtrim, safe_end, max_pos;
+	double pos_d;
+	float tx;
+
+	max_pos = g->in_dim - 1;
+	pos_d = g->center;
+
+	/* split_map inlined: smp_i is floor toward -inf, but pos_d in
+	 * (-0.5, 0) maps to smp_i = -1. */
+	if (pos_d < 0.0) {
+		smp_i = -1;
+		tx = (float)(pos_d + 1.0);
+	} else {
+		smp_i = (int)pos_d;
+		tx = (float)(pos_d - smp_i);
+	}
+	start = smp_i - 1;
+	end = smp_i + 2;
 
-		center += tap_mult;
+	// This is the border position at which we will tell the
+	// interpolator to calculate the output sample.
+	safe_end = min(end, max_pos);
+
+	ltrim = 0;
+	rtrim = 0;
+	if (start < 0) {
+		ltrim = -1 * start;
+	}
+	if (end > max_pos) {
+		rtrim = end - max_pos;
 	}
+
+	// we offset coeffs by rtrim because the interpolator won't
+	// be pushing any more samples into its sample buffer.
+	memset(coeffs, 0, 4 * sizeof(float));
+	calc_coeffs(coeffs + rtrim, tx, 4, ltrim, rtrim);
+
+	g->center += g->step;
+	g->next++;
+	return safe_end;
 }
 
 /**
@@ -739,48 +964,12 @@ static void scale_down_coeffs(int in_dim, int out_dim, float *coeff_buf, int *bo
  */
 static void scale_up_coeffs(int in_dim, int out_dim, float *coeff_buf, int *border_buf)
 {
-	int i, smp_i, start, end, ltrim, rtrim, safe_end, max_pos;
-	double pos_d, step;
-	float tx;
-
-	max_pos = in_dim - 1;
-	step = (double)in_dim / out_dim;
-	pos_d = 0.5 * step - 0.5;
+	int i;
+	struct coeff_gen g;
 
+	coeff_gen_init(&g, in_dim, out_dim);
 	for (i=0; i<out_dim; i++) {
-		/* split_map inlined: smp_i is floor toward -inf, but pos_d in
-		 * (-0.5, 0) maps to smp_i = -1. */
-		if (pos_d < 0.0) {
-			smp_i = -1;
-			tx = (float)(pos_d + 1.0);
-		} else {
-			smp_i = (int)pos_d;
-			tx = (float)(pos_d - smp_i);
-		}
-		start = smp_i - 1;
-		end = smp_i + 2;
-
-		// This is the border position at which we will tell the
-		// interpolator to calculate the output sample.
-		safe_end = min(end, max_pos);
-
-		ltrim = 0;
-		rtrim = 0;
-		if (start < 0) {
-			ltrim = -1 * start;
-		}
-		if (end > max_pos) {
-			rtrim = end - max_pos;
-		}
-
-		border_buf[safe_end] += 1;
-
-		// we offset coeff_buf by rtrim because the interpolator won't
-		// be pushing any more samples into its sample buffer.
-		calc_coeffs(coeff_buf + rtrim, tx, 4, ltrim, rtrim);
-
-		coeff_buf += 4;
-		pos_d += step;
+		border_buf[up_gen_next(&g, coeff_buf + i * 4)] += 1;
 	}
 }
 
@@ -923,7 +1112,7 @@ static void scale_down_ga(unsigned char *in, float *sums_y, int out_width, float
 }
 
 static void scale_down_rgb_nogamma(unsigned char *in, float *sums_y, int out_width, float *coeffs_x,
-	int *border_buf, float *coeffs_y)
+	int *border_buf, float *coeffs_y, float *lut)
 {
 	int i, j, k;
 	float sum[3][4] = {{ 0.0f }};
@@ -931,7 +1120,7 @@ static void scale_down_rgb_nogamma(unsigned char *in, float *sums_y, int out_wid
 	for (i=0; i<out_width; i++) {
 		for (j=0; j<border_buf[i]; j++) {
 			for (k=0; k<3; k++) {
-				add_sample_to_sum_f(i2f_map[in[k]], coeffs_x, sum[k]);
+				add_sample_to_sum_f(lut[in[k]], coeffs_x, sum[k]);
 			}
 			in += 3;
 			coeffs_x += 4;
@@ -946,7 +1135,7 @@ static void scale_down_rgb_nogamma(unsigned char *in, float *sums_y, int out_wid
 }
 
 static void scale_down_rgba_nogamma(unsigned char *in, float *sums_y, int out_width, float *coeffs_x,
-	int *border_buf, float *coeffs_y, int tap)
+	int *border_buf, float *coeffs_y, int tap, float *lut)
 {
 	int i, j, k;
 	float alpha, sum[4][4] = {{ 0.0f }};
@@ -955,7 +1144,7 @@ static void scale_down_rgba_nogamma(unsigned char *in, float *sums_y, int out_wi
 		for (j=0; j<border_buf[i]; j++) {
 			alpha = i2f_map[in[3]];
 			for (k=0; k<3; k++) {
-				add_sample_to_sum_f(i2f_map[in[k]] * alpha, coeffs_x, sum[k]);
+				add_sample_to_sum_f(lut[in[k]] * alpha, coeffs_x, sum[k]);
 			}
 			add_sample_to_sum_f(alpha, coeffs_x, sum[3]);
 			in += 4;
@@ -982,7 +1171,7 @@ static void scale_down_rgba_nogamma(unsigned char *in, float *sums_y, int out_wi
 }
 
 static void scale_down_rgbx_nogamma(unsigned char *in, float *sums_y, int out_width, float *coeffs_x,
-	int *border_buf, float *coeffs_y, int tap)
+	int *border_buf, float *coeffs_y, int tap, float *lut)
 {
 	int i, j, k;
 	float sum[4][4] = {{ 0.0f }};
@@ -990,7 +1179,7 @@ static void scale_down_rgbx_nogamma(unsigned char *in, float *sums_y, int out_wi
 	for (i=0; i<out_width; i++) {
 		for (j=0; j<border_buf[i]; j++) {
 			for (k=0; k<3; k++) {
-				add_sample_to_sum_f(i2f_map[in[k]], coeffs_x, sum[k]);
+				add_sample_to_sum_f(lut[in[k]], coeffs_x, sum[k]);
 			}
 			add_sample_to_sum_f(1.0f, coeffs_x, sum[3]);
 			in += 4;
@@ -1238,14 +1427,14 @@ static void xscale_up_g(unsigned char *in, int width_in, float *out,
 }
 
 static void xscale_up_rgb_nogamma(unsigned char *in, int width_in, float *out,
-	float *coeff_buf, int *border_buf)
+	float *coeff_buf, int *border_buf, float *lut)
 {
 	int i, j;
 	float smp[3][4] = {{0}};
 
 	for (i=0; i<width_in; i++) {
 		for (j=0; j<3; j++) {
-			push_f(smp[j], i2f_map[in[j]]);
+			push_f(smp[j], lut[in[j]]);
 		}
 		for (j=0; j<border_buf[i]; j++) {
 			xscale_up_reduce_n(smp, out, coeff_buf, 3);
@@ -1257,7 +1446,7 @@ static void xscale_up_rgb_nogamma(unsigned char *in, int width_in, float *out,
 }
 
 static void xscale_up_rgba_nogamma(unsigned char *in, int width_in, float *out,
-	float *coeff_buf, int *border_buf)
+	float *coeff_buf, int *border_buf, float *lut)
 {
 	int i, j;
 	float smp[4][4] = {{0}};
@@ -1265,7 +1454,7 @@ static void xscale_up_rgba_nogamma(unsigned char *in, int width_in, float *out,
 	for (i=0; i<width_in; i++) {
 		push_f(smp[3], in[3] / 255.0f);
 		for (j=0; j<3; j++) {
-			push_f(smp[j], smp[3][3] * i2f_map[in[j]]);
+			push_f(smp[j], smp[3][3] * lut[in[j]]);
 		}
 		for (j=0; j<border_buf[i]; j++) {
 			xscale_up_reduce_n(smp, out, coeff_buf, 4);
@@ -1277,14 +1466,14 @@ static void xscale_up_rgba_nogamma(unsigned char *in, int width_in, float *out,
 }
 
 static void xscale_up_rgbx_nogamma(unsigned char *in, int width_in, float *out,
-	float *coeff_buf, int *border_buf)
+	float *coeff_buf, int *border_buf, float *lut)
 {
 	int i, j;
 	float smp[4][4] = {{0}};
 
 	for (i=0; i<width_in; i++) {
 		for (j=0; j<3; j++) {
-			push_f(smp[j], i2f_map[in[j]]);
+			push_f(smp[j], lut[in[j]]);
 		}
 		push_f(smp[3], 1.0f);
 		for (j=0; j<border_buf[i]; j++) {
@@ -1322,357 +1511,3636 @@ static void oil_xscale_up(unsigned char *in, int width_in, float *out,
 		xscale_up_rgbx(in, width_in, out, coeff_buf, border_buf);
 		break;
 	case OIL_CS_RGB_NOGAMMA:
-		xscale_up_rgb_nogamma(in, width_in, out, coeff_buf, border_buf);
+		xscale_up_rgb_nogamma(in, width_in, out, coeff_buf, border_buf, i2f_map);
 		break;
 	case OIL_CS_RGBA_NOGAMMA:
-		xscale_up_rgba_nogamma(in, width_in, out, coeff_buf, border_buf);
+		xscale_up_rgba_nogamma(in, width_in, out, coeff_buf, border_buf, i2f_map);
 		break;
 	case OIL_CS_RGBX_NOGAMMA:
-		xscale_up_rgbx_nogamma(in, width_in, out, coeff_buf, border_buf);
+		xscale_up_rgbx_nogamma(in, width_in, out, coeff_buf, border_buf, i2f_map);
+		break;
+	case OIL_CS_RGB_GAMMA2:
+		xscale_up_rgb_nogamma(in, width_in, out, coeff_buf, border_buf, g2l_map);
+		break;
+	case OIL_CS_RGBA_GAMMA2:
+		xscale_up_rgba_nogamma(in, width_in, out, coeff_buf, border_buf, g2l_map);
+		break;
+	case OIL_CS_RGBX_GAMMA2:
+		xscale_up_rgbx_nogamma(in, width_in, out, coeff_buf, border_buf, g2l_map);
 		break;
 	case OIL_CS_UNKNOWN:
 		break;
 	}
 }
 
-/* Global functions */
-void oil_global_init(void)
-{
-	build_s2l();
-	build_l2s();
-	build_i2f();
-}
-
-#define ALIGN16(x) (((x) + 15) & ~15)
-
-static int calc_coeffs_len(int in_dim, int out_dim)
-{
-	return TAPS * max(in_dim, out_dim) * sizeof(float);
-}
+/* Mixed geometry: one axis upscales while the other downscales */
 
-static int calc_borders_len(int in_dim, int out_dim)
+/**
+ * Convert a pixel to the floats that oil_xscale_up() interpolates for it.
+ */
+static void xscale_sample(unsigned char *in, float *smp,
+	enum oil_colorspace cs)
 {
-	return min(in_dim, out_dim) * sizeof(int);
-}
+	int j;
 
-static int upscale_alloc_size(int in_height, int out_height, int in_width,
-	int out_width, enum oil_colorspace cs)
-{
-	return ALIGN16(calc_coeffs_len(in_width, out_width))
-		+ ALIGN16(calc_borders_len(in_width, out_width))
-		+ ALIGN16(calc_coeffs_len(in_height, out_height))
-		+ ALIGN16(calc_borders_len(in_height, out_height))
-		+ ALIGN16(out_width * OIL_CMP(cs) * TAPS * sizeof(float));
+	switch(cs) {
+	case OIL_CS_G:
+		smp[0] = in[0] / 255.0f;
+		break;
+	case OIL_CS_GA:
+		smp[1] = in[1] / 255.0f;
+		smp[0] = smp[1] * i2f_map[in[0]];
+		break;
+	case OIL_CS_RGB:
+		for (j=0; j<3; j++) {
+			smp[j] = s2l_map[in[j]];
+		}
+		break;
+	case OIL_CS_CMYK:
+		for (j=0; j<4; j++) {
+			smp[j] = in[j] / 255.0f;
+		}
+		break;
+	case OIL_CS_RGBA:
+		smp[3] = in[3] / 255.0f;
+		for (j=0; j<3; j++) {
+			smp[j] = smp[3] * s2l_map[in[j]];
+		}
+		break;
+	case OIL_CS_ARGB:
+		smp[3] = in[0] / 255.0f;
+		for (j=0; j<3; j++) {
+			smp[j] = smp[3] * s2l_map[in[j + 1]];
+		}
+		break;
+	case OIL_CS_RGBX:
+		for (j=0; j<3; j++) {
+			smp[j] = s2l_map[in[j]];
+		}
+		smp[3] = 1.0f;
+		break;
+	case OIL_CS_RGB_NOGAMMA:
+		for (j=0; j<3; j++) {
+			smp[j] = i2f_map[in[j]];
+		}
+		break;
+	case OIL_CS_RGBA_NOGAMMA:
+		smp[3] = in[3] / 255.0f;
+		for (j=0; j<3; j++) {
+			smp[j] = smp[3] * i2f_map[in[j]];
+		}
+		break;
+	case OIL_CS_RGBX_NOGAMMA:
+		for (j=0; j<3; j++) {
+			smp[j] = i2f_map[in[j]];
+		}
+		smp[3] = 1.0f;
+		break;
+	case OIL_CS_RGB_GAMMA2:
+		for (j=0; j<3; j++) {
+			smp[j] = g2l_map[in[j]];
+		}
+		break;
+	case OIL_CS_RGBA_GAMMA2:
+		smp[3] = in[3] / 255.0f;
+		for (j=0; j<3; j++) {
+			smp[j] = smp[3] * g2l_map[in[j]];
+		}
+		break;
+	case OIL_CS_RGBX_GAMMA2:
+		for (j=0; j<3; j++) {
+			smp[j] = g2l_map[in[j]];
+		}
+		smp[3] = 1.0f;
+		break;
+	case OIL_CS_UNKNOWN:
+		break;
+	}
 }
 
-static void upscale_init(struct oil_scale *os)
+/**
+ * Downscale a scanline horizontally into a ring buffer line, in the same
+ * format oil_xscale_up() writes, so that it can be upscaled vertically.
+ */
+static void xscale_down(unsigned char *in, int out_width, float *out,
+	enum oil_colorspace cs, float *coeffs_x, int *border_buf)
 {
-	int coeffs_x_len, coeffs_y_len, borders_x_len, borders_y_len;
-	char *p;
-
-	coeffs_x_len = ALIGN16(calc_coeffs_len(os->in_width, os->out_width));
-	borders_x_len = ALIGN16(calc_borders_len(os->in_width, os->out_width));
-	coeffs_y_len = ALIGN16(calc_coeffs_len(os->in_height, os->out_height));
-	borders_y_len = ALIGN16(calc_borders_len(os->in_height, os->out_height));
-
-	p = os->buf;
-	os->coeffs_x = (float *)p;		p += coeffs_x_len;
-	os->borders_x = (int *)p;		p += borders_x_len;
-	os->coeffs_y = (float *)p;		p += coeffs_y_len;
-	os->borders_y = (int *)p;		p += borders_y_len;
-	os->rb = (float *)p;
+	int i, j, k, cmp;
+	float smp[4], sum[4][4] = {{ 0.0f }};
 
-	scale_up_coeffs(os->in_width, os->out_width, os->coeffs_x, os->borders_x);
-	scale_up_coeffs(os->in_height, os->out_height, os->coeffs_y, os->borders_y);
-	os->slots_y = 0;
+	cmp = OIL_CMP(cs);
+	for (i=0; i<out_width; i++) {
+		for (j=0; j<border_buf[i]; j++) {
+			xscale_sample(in, smp, cs);
+			for (k=0; k<cmp; k++) {
+				add_sample_to_sum_f(smp[k], coeffs_x, sum[k]);
+			}
+			in += cmp;
+			coeffs_x += 4;
+		}
+		for (k=0; k<cmp; k++) {
+			out[k] = sum[k][0];
+			shift_left_f(sum[k]);
+		}
+		out += cmp;
+	}
 }
 
-static int downscale_alloc_size(int in_height, int out_height, int in_width,
-	int out_width, enum oil_colorspace cs)
+/**
+ * Convert a scanline to the format oil_xscale_up() writes, for a width that
+ * is not being scaled.
+ */
+static void xscale_convert(unsigned char *in, int width, float *out,
+	enum oil_colorspace cs)
 {
-	int taps_x, taps_y;
+	int i, cmp;
 
-	taps_x = max_taps(in_width, out_width);
-	taps_y = max_taps(in_height, out_height);
-
-	return ALIGN16(calc_coeffs_len(in_width, out_width))
-		+ ALIGN16(calc_borders_len(in_width, out_width))
-		+ ALIGN16(calc_coeffs_len(in_height, out_height))
-		+ ALIGN16(calc_borders_len(in_height, out_height))
-		+ ALIGN16(max(taps_x, taps_y) * sizeof(float))
-		+ ALIGN16(out_width * OIL_CMP(cs) * TAPS * sizeof(float));
+	cmp = OIL_CMP(cs);
+	for (i=0; i<width; i++) {
+		xscale_sample(in, out, cs);
+		in += cmp;
+		out += cmp;
+	}
 }
 
-static void downscale_init(struct oil_scale *os)
+/**
+ * Accumulate an x-scaled scanline into sums, which holds 4 lines of len
+ * floats. Line (tap + i) & 3 is output row out_pos + i. Zero coefficients
+ * leave a line as it is, so they are skipped.
+ */
+static void yscale_down_in(float *restrict line, int len, float *coeffs_y,
+	float *restrict sums, int tap)
 {
-	int coeffs_x_len, coeffs_y_len, borders_x_len, borders_y_len, sums_len;
-	char *p;
-
-	coeffs_x_len = ALIGN16(calc_coeffs_len(os->in_width, os->out_width));
-	borders_x_len = ALIGN16(calc_borders_len(os->in_width, os->out_width));
-	coeffs_y_len = ALIGN16(calc_coeffs_len(os->in_height, os->out_height));
-	borders_y_len = ALIGN16(calc_borders_len(os->in_height, os->out_height));
-	sums_len = ALIGN16(os->out_width * OIL_CMP(os->cs) * TAPS * sizeof(float));
-
-	p = os->buf;
-	os->coeffs_x = (float *)p;		p += coeffs_x_len;
-	os->borders_x = (int *)p;		p += borders_x_len;
-	os->coeffs_y = (float *)p;		p += coeffs_y_len;
-	os->borders_y = (int *)p;		p += borders_y_len;
-	os->sums_y = (float *)p;		p += sums_len;
-	os->tmp_coeffs = (float *)p;
-
-	scale_down_coeffs(os->in_width, os->out_width, os->coeffs_x, os->borders_x,
-		os->tmp_coeffs);
-	scale_down_coeffs(os->in_height, os->out_height, os->coeffs_y, os->borders_y,
-		os->tmp_coeffs);
-	os->slots_y = os->borders_y[0];
-}
+	int i, j;
+	float c, *restrict sum;
 
-int oil_scale_alloc_size(int in_height, int out_height, int in_width,
-	int out_width, enum oil_colorspace cs)
-{
-	if (out_width > in_width) {
-		return upscale_alloc_size(in_height, out_height, in_width,
-			out_width, cs);
-	} else {
-		return downscale_alloc_size(in_height, out_height, in_width,
-			out_width, cs);
+	for (j=0; j<4; j++) {
+		c = coeffs_y[j];
+		if (c == 0.0f) {
+			continue;
+		}
+		sum = sums + ((tap + j) & 3) * len;
+		/* groups of 4 are vectorized by the compiler */
+		for (i=0; i+3<len; i+=4) {
+			sum[i] += line[i] * c;
+			sum[i + 1] += line[i + 1] * c;
+			sum[i + 2] += line[i + 2] * c;
+			sum[i + 3] += line[i + 3] * c;
+		}
+		for (; i<len; i++) {
+			sum[i] += line[i] * c;
+		}
 	}
 }
 
-int oil_scale_init_allocated(struct oil_scale *os, int in_height,
-	int out_height, int in_width, int out_width, enum oil_colorspace cs,
+/**
+ * sum[i] += l[0][i] * c[0] + ... + l[m - 1][i] * c[m - 1], for m of at most 4,
+ * adding the terms in order.
+ */
+static void fold_lines(float *restrict sum, int len, float **l, float *c,
+	int m)
+{
+	int i, k;
+
+	i = 0;
+	switch (m) {
+	case 4:
+		/* groups of 4 are vectorized by the compiler */
+		for (; i+3<len; i+=4) {
+			for (k=0; k<4; k++) {
+				sum[i + k] = sum[i + k] + l[0][i + k] * c[0] +
+					l[1][i + k] * c[1] +
+					l[2][i + k] * c[2] +
+					l[3][i + k] * c[3];
+			}
+		}
+		for (; i<len; i++) {
+			sum[i] = sum[i] + l[0][i] * c[0] + l[1][i] * c[1] +
+				l[2][i] * c[2] + l[3][i] * c[3];
+		}
+		break;
+	case 3:
+		for (; i+3<len; i+=4) {
+			for (k=0; k<4; k++) {
+				sum[i + k] = sum[i + k] + l[0][i + k] * c[0] +
+					l[1][i + k] * c[1] +
+					l[2][i + k] * c[2];
+			}
+		}
+		for (; i<len; i++) {
+			sum[i] = sum[i] + l[0][i] * c[0] + l[1][i] * c[1] +
+				l[2][i] * c[2];
+		}
+		break;
+	case 2:
+		for (; i+3<len; i+=4) {
+			for (k=0; k<4; k++) {
+				sum[i + k] = sum[i + k] + l[0][i + k] * c[0] +
+					l[1][i + k] * c[1];
+			}
+		}
+		for (; i<len; i++) {
+			sum[i] = sum[i] + l[0][i] * c[0] + l[1][i] * c[1];
+		}
+		break;
+	case 1:
+		for (; i+3<len; i+=4) {
+			for (k=0; k<4; k++) {
+				sum[i + k] = sum[i + k] + l[0][i + k] * c[0];
+			}
+		}
+		for (; i<len; i++) {
+			sum[i] = sum[i] + l[0][i] * c[0];
+		}
+		break;
+	}
+}
+
+/**
+ * yscale_down_in() for n x-scaled scanlines at once, with 4 coefficients per
+ * scanline. Each line of sums is read and written once, the scanlines being
+ * added to it in order.
+ */
+static void yscale_down_in_rows(float **lines, int n, int len, float *coeffs,
+	float *sums, int tap)
+{
+	int j, b, m;
+	float c[DOWN_LINES], *l[DOWN_LINES];
+
+	for (j=0; j<4; j++) {
+		/* zero coefficients leave a line as it is */
+		m = 0;
+		for (b=0; b<n; b++) {
+			if (coeffs[b * 4 + j] != 0.0f) {
+				c[m] = coeffs[b * 4 + j];
+				l[m++] = lines[b];
+			}
+		}
+		fold_lines(sums + ((tap + j) & 3) * len, len, l, c, m);
+	}
+}
+
+/* Half-float storage */
+
+/**
+ * Portable version of the half_store kernel. Rounds to nearest even like the
+ * hardware conversions: the mantissa of a normal result is rounded with
+ * integer arithmetic, that of a subnormal one by a float addition that leaves
+ * it in the low bits.
+ */
+static void half_store(float *in, unsigned short *out, int n)
+{
+	int i;
+	unsigned int u, sign;
+	float f, magic;
+
+	/* 0.5f, the float whose mantissa ulp is the smallest subnormal half */
+	u = 126 << 23;
+	memcpy(&magic, &u, 4);
+	for (i=0; i<n; i++) {
+		memcpy(&u, in + i, 4);
+		sign = (u >> 16) & 0x8000;
+		u &= 0x7fffffff;
+		if (u >= 143 << 23) {
+			/* too big, infinity or NaN */
+			out[i] = sign | (u > 255 << 23 ? 0x7e00 : 0x7c00);
+		} else if (u < 113 << 23) {
+			memcpy(&f, &u, 4);
+			f += magic;
+			memcpy(&u, &f, 4);
+			out[i] = sign | (u - (126 << 23));
+		} else {
+			u = u - ((127 - 15) << 23) + 0xfff + ((u >> 13) & 1);
+			out[i] = sign | (u >> 13);
+		}
+	}
+}
+
+/**
+ * Portable version of the half_load kernel.
+ */
+static void half_load(unsigned short *in, float *out, int n)
+{
+	int i;
+	unsigned int u, e;
+	float f, magic;
+
+	u = 113 << 23;
+	memcpy(&magic, &u, 4);
+	for (i=0; i<n; i++) {
+		u = (in[i] & 0x7fff) << 13;
+		e = u & (0x7c00 << 13);
+		u += (127 - 15) << 23;
+		if (e == 0x7c00 << 13) {
+			/* infinity or NaN */
+			u += (128 - 16) << 23;
+			memcpy(&f, &u, 4);
+		} else if (e == 0) {
+			/* zero or subnormal */
+			u += 1 << 23;
+			memcpy(&f, &u, 4);
+			f -= magic;
+		} else {
+			memcpy(&f, &u, 4);
+		}
+		memcpy(&u, &f, 4);
+		u |= (unsigned int)(in[i] & 0x8000) << 16;
+		memcpy(out + i, &u, 4);
+	}
+}
+
+static void to_half(float *in, unsigned short *out, int n,
+	const struct oil_kernels *k)
+{
+	if (k->half_store) {
+		k->half_store(in, out, n);
+	} else {
+		half_store(in, out, n);
+	}
+}
+
+static void from_half(unsigned short *in, float *out, int n,
+	const struct oil_kernels *k)
+{
+	if (k->half_load) {
+		k->half_load(in, out, n);
+	} else {
+		half_load(in, out, n);
+	}
+}
+
+/* Half floats of a line that are converted to floats, accumulated into and
+ * converted back at a time, in a buffer on the stack that stays in L1.
+ */
+#define HALF_BLOCK 768
+
+/**
+ * yscale_down_in_rows() into sums held as half floats. Only the lines of sums
+ * that get a nonzero coefficient are converted. Each scanline's contribution
+ * is rounded to half floats before the next one is added, so a batch gives
+ * the same sums as its scanlines one at a time; the block of sums stays in L1
+ * between them.
+ */
+static void yscale_down_in_rows_half(float **lines, int n, int len,
+	float *coeffs, unsigned short *sums, int tap,
+	const struct oil_kernels *k)
+{
+	int i, j, b, m, blk;
+	float c[DOWN_LINES], *l[DOWN_LINES], *blk_l[DOWN_LINES];
+	float tmp[HALF_BLOCK];
+	unsigned short *sum;
+
+	for (j=0; j<4; j++) {
+		m = 0;
+		for (b=0; b<n; b++) {
+			if (coeffs[b * 4 + j] != 0.0f) {
+				c[m] = coeffs[b * 4 + j];
+				l[m++] = lines[b];
+			}
+		}
+		if (m == 0) {
+			continue;
+		}
+		sum = sums + ((tap + j) & 3) * len;
+		for (i=0; i<len; i+=HALF_BLOCK) {
+			blk = min(HALF_BLOCK, len - i);
+			for (b=0; b<m; b++) {
+				blk_l[b] = l[b] + i;
+			}
+			for (b=0; b<m; b++) {
+				from_half(sum + i, tmp, blk, k);
+				fold_lines(tmp, blk, blk_l + b, c + b, 1);
+				to_half(tmp, sum + i, blk, k);
+			}
+		}
+	}
+}
+
+/* Planar downscale */
+
+/**
+ * Whether a downscaler's x-pass runs the heavy kernels, see OIL_HEAVY_RATIO.
+ */
+static int down_heavy(struct oil_scale *os)
+{
+	return os->in_width / os->out_width >= os->heavy_ratio;
+}
+
+/**
+ * Ingest one scanline into a scaler for which down_planar() with k.
+ */
+static void scale_in_planar(struct oil_scale *os, unsigned char *in,
+	float *coeffs_y, const struct oil_kernels *k)
+{
+	k->scale_down_planar(in, down_heavy(os), os->out_width, os->sums_y,
+		os->cs, os->coeffs_x, os->borders_x, coeffs_y, os->sums_y_tap);
+}
+
+/**
+ * Emit the output row in the current line of a scaler for which
+ * down_planar() with k and free the line for the next output row.
+ */
+static void scale_out_planar(struct oil_scale *os, unsigned char *out,
+	const struct oil_kernels *k)
+{
+	k->yscale_out_planar(os->sums_y, os->out_width, out, os->cs,
+		os->sums_y_tap);
+}
+
+/* Fixed point */
+
+/**
+ * Tables of a scaler switched to fixed point by oil_scale_set_fixed_point().
+ * sums_y then holds 4 int32s per sample, one per pending output row. Slot
+ * (sums_y_tap + i) & 3 belongs to output row out_pos + i.
+ */
+struct oil_fixed {
+	short *coeffs_x; // Q14 x-coefficients, see OIL_FIXED_ONE.
+	float err_y[4]; // y-coefficient rounding error, by slot of sums_y.
+};
+
+/**
+ * Convert a pixel to the integer samples that xscale_down_fixed() weighs:
+ * bytes as they are, or premultiplied for RGBA_NOGAMMA. Alpha is scaled as a
+ * colour channel at full value would be, so opaque pixels unpremultiply
+ * exactly.
+ */
+static void fixed_sample(unsigned char *in, int *smp, enum oil_colorspace cs)
+{
+	int j, a;
+
+	switch(cs) {
+	case OIL_CS_G:
+		smp[0] = in[0];
+		break;
+	case OIL_CS_RGBA_NOGAMMA:
+		a = in[3];
+		for (j=0; j<3; j++) {
+			smp[j] = ((in[j] * a + 2) * OIL_FIXED_PREMUL) >> 16;
+		}
+		smp[3] = ((255 * a + 2) * OIL_FIXED_PREMUL) >> 16;
+		break;
+	default:
+		for (j=0; j<3; j++) {
+			smp[j] = in[j];
+		}
+		break;
+	}
+}
+
+/**
+ * Takes an array of 4 ints and shifts them left. The rightmost element is set
+ * to 0.
+ */
+static void shift_left_i(int *f)
+{
+	f[0] = f[1];
+	f[1] = f[2];
+	f[2] = f[3];
+	f[3] = 0;
+}
+
+/**
+ * Fixed-point version of the fused downscale kernels, for the colorspaces
+ * supported by oil_scale_set_fixed_point(). Each x-scaled sample is rounded
+ * to 1/64ths of a level and accumulated into sums, which holds 4 int32s per
+ * sample: one per pending output row, in the order of coeffs_y. The 4th
+ * channel of RGBX_NOGAMMA is left alone.
+ */
+static void scale_down_fixed(unsigned char *in, int out_width, int *sums,
+	enum oil_colorspace cs, short *coeffs_x, int *border_buf,
+	short *coeffs_y)
+{
+	int i, j, k, l, cmp, nch, shift, x, smp[2][4], sum[4][4] = {{ 0 }};
+
+	cmp = OIL_CMP(cs);
+	nch = cs == OIL_CS_RGBX_NOGAMMA ? 3 : cmp;
+	shift = OIL_FIXED_SHIFT(cs);
+	for (i=0; i<out_width; i++) {
+		for (j=0; j<border_buf[i]; j+=2) {
+			fixed_sample(in, smp[0], cs);
+			in += cmp;
+			if (j + 1 < border_buf[i]) {
+				fixed_sample(in, smp[1], cs);
+				in += cmp;
+			} else {
+				memset(smp[1], 0, sizeof(smp[1]));
+			}
+			for (k=0; k<nch; k++) {
+				sum[k][0] += smp[0][k] * coeffs_x[0] + smp[1][k] * coeffs_x[1];
+				sum[k][1] += smp[0][k] * coeffs_x[2] + smp[1][k] * coeffs_x[3];
+				sum[k][2] += smp[0][k] * coeffs_x[4] + smp[1][k] * coeffs_x[5];
+				sum[k][3] += smp[0][k] * coeffs_x[6] + smp[1][k] * coeffs_x[7];
+			}
+			coeffs_x += 8;
+		}
+		for (k=0; k<nch; k++) {
+			x = (sum[k][0] + (1 << (shift - 1))) >> shift;
+			for (l=0; l<4; l++) {
+				sums[k * 4 + l] += x * coeffs_y[l];
+			}
+			shift_left_i(sum[k]);
+		}
+		sums += cmp * 4;
+	}
+}
+
+/**
+ * Number of int16s in the fixed-point x-coefficient table.
+ */
+static int fixed_coeffs_len(int *border_buf, int out_width)
+{
+	int i, len;
+
+	len = 0;
+	for (i=0; i<out_width; i++) {
+		len += (border_buf[i] + 1) / 2 * 8;
+	}
+	return len;
+}
+
+/**
+ * Round a coefficient to Q14, carrying the rounding error over to the next
+ * coefficient of the same output sample in *err. An output sample's
+ * coefficients then sum to the rounded sum of the float coefficients.
+ */
+static int fixed_round(float coeff, float *err)
+{
+	float v;
+	int q;
+
+	v = coeff * OIL_FIXED_ONE + *err;
+	q = floorf(v + 0.5f);
+	*err = v - q;
+	return q;
+}
+
+/**
+ * Build the fixed-point x-coefficient table from float downscale coefficients.
+ * Lane k of the coefficients in output position i belongs to output sample
+ * i + k, so its rounding error is tracked in err[(i + k) & 3].
+ */
+static void fixed_coeffs_x(float *coeffs_x, int *border_buf, int out_width,
+	short *out)
+{
+	int i, j, k;
+	float err[4] = { 0.0f };
+
+	for (i=0; i<out_width; i++) {
+		for (j=0; j<border_buf[i]; j++) {
+			for (k=0; k<4; k++) {
+				out[k * 2 + (j & 1)] = fixed_round(coeffs_x[k],
+					&err[(i + k) & 3]);
+			}
+			coeffs_x += 4;
+			if (j & 1) {
+				out += 8;
+			}
+		}
+		if (border_buf[i] & 1) {
+			for (k=0; k<4; k++) {
+				out[k * 2 + 1] = 0;
+			}
+			out += 8;
+		}
+		err[i & 3] = 0.0f;
+	}
+}
+
+/**
+ * Produce an output scanline from slot tap of the fixed-point sums, and clear
+ * that slot for reuse. Sums are in 1/64ths of a level with Q14 coefficients.
+ */
+static void yscale_out_fixed(int *sums, int width, unsigned char *out,
+	enum oil_colorspace cs, int tap)
+{
+	int i, j, v, len;
+	float scale, alpha, val;
+
+	len = width * OIL_CMP(cs);
+	sums += tap;
+	if (cs == OIL_CS_RGBA_NOGAMMA) {
+		/* an opaque alpha sample is 255 * 255 * OIL_FIXED_PREMUL >> 16 */
+		scale = 65536.0f / (255.0f * 255.0f * OIL_FIXED_PREMUL *
+			OIL_FIXED_ONE);
+		for (i=0; i<len; i+=4) {
+			alpha = clampf(sums[(i + 3) * 4] * scale);
+			for (j=0; j<3; j++) {
+				val = sums[(i + j) * 4] * scale;
+				if (alpha != 0) {
+					val /= alpha;
+				}
+				out[i + j] = f2i(clampf(val) * 255.0f);
+			}
+			out[i + 3] = f2i(alpha * 255.0f);
+		}
+	} else {
+		for (i=0; i<len; i++) {
+			v = (sums[i * 4] + (1 << 19)) >> 20;
+			out[i] = v < 0 ? 0 : (v > 255 ? 255 : v);
+		}
+		if (cs == OIL_CS_RGBX_NOGAMMA) {
+			for (i=3; i<len; i+=4) {
+				out[i] = 255;
+			}
+		}
+	}
+	for (i=0; i<len; i++) {
+		sums[i * 4] = 0;
+	}
+}
+
+/* Unchanged geometry */
+
+/**
+ * Copy 4-byte pixels, keeping those that have any of the bits in keep set and
+ * zeroing the rest, then setting the bits in set. Blocks of 4 pixels are
+ * vectorized by the compiler.
+ */
+static void copy_px32(unsigned char *in, unsigned char *out, int width,
+	unsigned int keep, unsigned int set)
+{
+	int i, j;
+	unsigned int px[4];
+
+	for (i=0; i+3<width; i+=4) {
+		memcpy(px, in, 16);
+		for (j=0; j<4; j++) {
+			px[j] = ((px[j] & keep) ? px[j] : 0) | set;
+		}
+		memcpy(out, px, 16);
+		in += 16;
+		out += 16;
+	}
+	for (; i<width; i++) {
+		memcpy(px, in, 4);
+		px[0] = ((px[0] & keep) ? px[0] : 0) | set;
+		memcpy(out, px, 4);
+		in += 4;
+		out += 4;
+	}
+}
+
+/**
+ * Copy a scanline whose size is unchanged. The result is what scaling it
+ * would produce: colour is lost where alpha is 0, since it is premultiplied,
+ * and the padding byte of RGBX is 0xFF.
+ */
+static void copy_row(unsigned char *in, unsigned char *out, int width,
+	enum oil_colorspace cs)
+{
+	int i;
+
+	switch(cs) {
+	case OIL_CS_GA:
+		for (i=0; i<width; i++) {
+			out[0] = in[1] ? in[0] : 0;
+			out[1] = in[1];
+			in += 2;
+			out += 2;
+		}
+		break;
+	case OIL_CS_RGBA:
+	case OIL_CS_RGBA_NOGAMMA:
+	case OIL_CS_RGBA_GAMMA2:
+		copy_px32(in, out, width, 0xFF000000, 0);
+		break;
+	case OIL_CS_ARGB:
+		copy_px32(in, out, width, 0xFF, 0);
+		break;
+	case OIL_CS_RGBX:
+	case OIL_CS_RGBX_NOGAMMA:
+	case OIL_CS_RGBX_GAMMA2:
+		copy_px32(in, out, width, 0xFFFFFFFF, 0xFF000000);
+		break;
+	default:
+		memcpy(out, in, width * OIL_CMP(cs));
+		break;
+	}
+}
+
+/* Allocation */
+
+static void *default_alloc(void *ctx, size_t size)
+{
+	(void)ctx;
+	return malloc(size);
+}
+
+static void default_free(void *ctx, void *ptr)
+{
+	(void)ctx;
+	free(ptr);
+}
+
+static struct oil_allocator allocator = { default_alloc, default_free, NULL };
+
+void *oil_alloc(size_t size)
+{
+	return allocator.alloc(allocator.ctx, size);
+}
+
+void oil_free(void *ptr)
+{
+	if (ptr) {
+		allocator.free(allocator.ctx, ptr);
+	}
+}
+
+/**
+ * Buffers are recycled in power-of-two size classes from 4 KiB to 1 GiB.
+ * Every buffer from buf_alloc() is preceded by a header holding its size class
+ * (-1 if it is not poolable, as is every buffer allocated while the pool is
+ * disabled) and, while it sits in the pool, the next free
+ * buffer of its class.
+ */
+#define BUF_HEADER 16
+#define BUF_MIN_SHIFT 12
+#define BUF_CLASSES 19
+
+struct buf_header {
+	int size_class;
+	void *next;
+};
+
+static void *buf_free_list[BUF_CLASSES];
+static size_t buf_pool_bytes; // bytes of buffers sitting in the pool.
+static size_t buf_pool_limit; // 0 if the pool is disabled.
+static pthread_mutex_t buf_pool_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static size_t class_size(int size_class)
+{
+	return (size_t)1 << (size_class + BUF_MIN_SHIFT);
+}
+
+static int size_class(size_t size)
+{
+	int i;
+
+	for (i=0; i<BUF_CLASSES; i++) {
+		if (size <= class_size(i)) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+/**
+ * Release pooled buffers until the pool holds at most limit bytes. Called
+ * with buf_pool_lock held.
+ */
+static void buf_pool_trim(size_t limit)
+{
+	int i;
+	struct buf_header *h;
+
+	for (i=BUF_CLASSES-1; i>=0 && buf_pool_bytes > limit; i--) {
+		while (buf_free_list[i] && buf_pool_bytes > limit) {
+			h = buf_free_list[i];
+			buf_free_list[i] = h->next;
+			buf_pool_bytes -= class_size(i);
+			oil_free(h);
+		}
+	}
+}
+
+/**
+ * Allocate an internal buffer through the allocator hooks, reusing a pooled
+ * one if possible. The contents are not zeroed. Only while the pool is
+ * enabled are buffers rounded up to their size class, so that they can be
+ * pooled; otherwise they take no more than they need and buf_free() hands
+ * them straight back to the allocator.
+ */
+static void *buf_alloc(size_t size)
+{
+	int cls;
+	struct buf_header *h;
+
+	h = NULL;
+	cls = -1;
+
+	pthread_mutex_lock(&buf_pool_lock);
+	if (buf_pool_limit) {
+		cls = size_class(size + BUF_HEADER);
+	}
+	if (cls >= 0 && buf_free_list[cls]) {
+		h = buf_free_list[cls];
+		buf_free_list[cls] = h->next;
+		buf_pool_bytes -= class_size(cls);
+	}
+	pthread_mutex_unlock(&buf_pool_lock);
+
+	if (!h) {
+		/* round up to the class size so the buffer can be pooled */
+		h = oil_alloc(cls >= 0 ? class_size(cls) : size + BUF_HEADER);
+		if (!h) {
+			return NULL;
+		}
+	}
+	h->size_class = cls;
+	return (char *)h + BUF_HEADER;
+}
+
+static void buf_free(void *ptr)
+{
+	struct buf_header *h;
+
+	if (!ptr) {
+		return;
+	}
+	h = (struct buf_header *)((char *)ptr - BUF_HEADER);
+
+	pthread_mutex_lock(&buf_pool_lock);
+	if (h->size_class >= 0 &&
+		buf_pool_bytes + class_size(h->size_class) <= buf_pool_limit) {
+		h->next = buf_free_list[h->size_class];
+		buf_free_list[h->size_class] = h;
+		buf_pool_bytes += class_size(h->size_class);
+		h = NULL;
+	}
+	pthread_mutex_unlock(&buf_pool_lock);
+
+	oil_free(h);
+}
+
+static void *buf_alloc_zeroed(size_t size)
+{
+	void *ptr;
+
+	ptr = buf_alloc(size);
+	if (ptr) {
+		memset(ptr, 0, size);
+	}
+	return ptr;
+}
+
+void oil_set_allocator(const struct oil_allocator *a)
+{
+	static const struct oil_allocator std = { default_alloc, default_free,
+		NULL };
+
+	/* pooled buffers belong to the old allocator */
+	pthread_mutex_lock(&buf_pool_lock);
+	buf_pool_trim(0);
+	allocator = a ? *a : std;
+	pthread_mutex_unlock(&buf_pool_lock);
+}
+
+void oil_set_buffer_pool(size_t max_bytes)
+{
+	pthread_mutex_lock(&buf_pool_lock);
+	buf_pool_limit = max_bytes;
+	buf_pool_trim(max_bytes);
+	pthread_mutex_unlock(&buf_pool_lock);
+}
+
+/* Backend selection */
+
+/**
+ * Backends usable on this CPU, ordered from slowest to fastest. Populated by
+ * probe_backends().
+ */
+static const struct oil_kernels *backends[6];
+static int num_backends;
+
+/**
+ * Backend given to new scalers. The fastest available one unless overridden
+ * with the OIL_BACKEND environment variable.
+ */
+static const struct oil_kernels *default_kernels = &oil_kernels_scalar;
+
+static void probe_backends(void)
+{
+	int i;
+	char *env;
+
+	num_backends = 0;
+	backends[num_backends++] = &oil_kernels_scalar;
+	/* Portable vector code, the best choice on architectures without a
+	 * hand-written backend. */
+	backends[num_backends++] = &oil_kernels_vec;
+#if defined(__x86_64__)
+	/* SSE2 is part of the x86_64 baseline. */
+	backends[num_backends++] = &oil_kernels_sse2;
+	if (__builtin_cpu_supports("ssse3") &&
+		__builtin_cpu_supports("sse4.1")) {
+		backends[num_backends++] = &oil_kernels_sse41;
+	}
+	if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma") &&
+		__builtin_cpu_supports("f16c")) {
+		backends[num_backends++] = &oil_kernels_avx2;
+	}
+#elif defined(__aarch64__)
+	/* Advanced SIMD is mandatory on AArch64. */
+	backends[num_backends++] = &oil_kernels_neon;
+#endif
+	default_kernels = backends[num_backends - 1];
+
+	env = getenv("OIL_BACKEND");
+	if (!env) {
+		return;
+	}
+	/* Unknown or unsupported names are ignored. */
+	for (i=0; i<num_backends; i++) {
+		if (strcmp(env, backends[i]->name) == 0) {
+			default_kernels = backends[i];
+			break;
+		}
+	}
+}
+
+/* Global functions */
+/**
+ * A single-threaded downscaler whose sums_y is larger than cache_strip_bytes
+ * is split into strips of about that much sums_y on its first batch of
+ * scanlines, see oil_scale_in_rows(). Each strip is then taken through the
+ * whole batch so that its sums_y, coefficients and input stay in L2
+ * meanwhile. It is half of L2, or CACHE_STRIP_BYTES where the size of L2 is
+ * unknown.
+ */
+#define CACHE_STRIP_BYTES (256 * 1024)
+static long cache_strip_bytes = CACHE_STRIP_BYTES;
+
+static void probe_cache(void)
+{
+#ifdef _SC_LEVEL2_CACHE_SIZE
+	long l2;
+
+	l2 = sysconf(_SC_LEVEL2_CACHE_SIZE);
+	if (l2 > 0) {
+		cache_strip_bytes = l2 / 2;
+	}
+#endif
+}
+
+/* Crossover points between kernel variants, see oil_autotune(). Scalers take
+ * a copy at init, so tuning never changes a scaler that is running. */
+static int heavy_ratio = OIL_HEAVY_RATIO;
+static int planar_len = OIL_PLANAR_LEN;
+static int tuning_done;
+
+#define TUNE_VERSION 1
+
+/**
+ * Apply the crossover points in a file written by save_tuning(). Its first
+ * line holds the format version and the name of the backend they were
+ * measured with, every following line a key and a positive value. Unknown
+ * keys are skipped. Nothing is applied unless the whole file checks out.
+ */
+static int load_tuning(const char *path)
+{
+	FILE *f;
+	char name[32], key[32];
+	int version, ret, heavy, planar;
+	long value, strip;
+
+	f = fopen(path, "r");
+	if (!f) {
+		return -1;
+	}
+
+	heavy = heavy_ratio;
+	planar = planar_len;
+	strip = cache_strip_bytes;
+	ret = -1;
+	if (fscanf(f, "oil-tune %d %31s", &version, name) == 2 &&
+		version == TUNE_VERSION &&
+		strcmp(name, default_kernels->name) == 0) {
+		ret = 0;
+		while (fscanf(f, "%31s %ld", key, &value) == 2) {
+			if (value < 1 || value > INT_MAX) {
+				ret = -1;
+				break;
+			}
+			if (strcmp(key, "heavy_ratio") == 0) {
+				heavy = value;
+			} else if (strcmp(key, "planar_len") == 0) {
+				planar = value;
+			} else if (strcmp(key, "strip_bytes") == 0) {
+				strip = value;
+			}
+		}
+		if (!feof(f)) {
+			ret = -1;
+		}
+	}
+	fclose(f);
+
+	if (ret == 0) {
+		heavy_ratio = heavy;
+		planar_len = planar;
+		cache_strip_bytes = strip;
+	}
+	return ret;
+}
+
+static int save_tuning(const char *path)
+{
+	FILE *f;
+	int ret;
+
+	f = fopen(path, "w");
+	if (!f) {
+		return -1;
+	}
+	fprintf(f, "oil-tune %d %s\n", TUNE_VERSION, default_kernels->name);
+	fprintf(f, "heavy_ratio %d\n", heavy_ratio);
+	fprintf(f, "planar_len %d\n", planar_len);
+	fprintf(f, "strip_bytes %ld\n", cache_strip_bytes);
+	ret = ferror(f) ? -1 : 0;
+	if (fclose(f)) {
+		ret = -1;
+	}
+	return ret;
+}
+
+void oil_global_init(void)
+{
+	char *env;
+
+	build_s2l();
+	build_l2s();
+#ifdef OIL_L2S_POLY
+	build_l2s_edges();
+#endif
+	build_i2f();
+	build_g2l();
+	probe_backends();
+
+	/* Tuning is only picked up once, so later calls keep what
+	 * oil_autotune() or oil_autotune_load() applied. A missing or stale
+	 * file leaves the defaults in place. */
+	if (tuning_done) {
+		return;
+	}
+	tuning_done = 1;
+	probe_cache();
+	env = getenv("OIL_TUNE_FILE");
+	if (env) {
+		load_tuning(env);
+	}
+}
+
+int oil_autotune_load(const char *path)
+{
+	if (!path) {
+		return -1;
+	}
+	if (!s2l_map[128]) {
+		oil_global_init();
+	}
+	return load_tuning(path);
+}
+
+#define ALIGN16(x) (((x) + 15) & ~15)
+
+static int calc_coeffs_len(int in_dim, int out_dim)
+{
+	return TAPS * max(in_dim, out_dim) * sizeof(float);
+}
+
+static int calc_borders_len(int in_dim, int out_dim)
+{
+	return min(in_dim, out_dim) * sizeof(int);
+}
+
+static int check_dimensions(int in_height, int out_height, int in_width,
+	int out_width)
+{
+	if (in_height > MAX_DIMENSION || out_height > MAX_DIMENSION ||
+		in_height < 1 || out_height < 1 ||
+		in_width > MAX_DIMENSION || out_width > MAX_DIMENSION ||
+		in_width < 1 || out_width < 1) {
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * Size of a plan's coefficient & border tables, which must start out zeroed.
+ */
+static int plan_tables_len(int in_height, int out_height, int in_width,
+	int out_width)
+{
+	return ALIGN16(calc_coeffs_len(in_width, out_width))
+		+ ALIGN16(calc_borders_len(in_width, out_width))
+		+ ALIGN16(calc_coeffs_len(in_height, out_height))
+		+ ALIGN16(calc_borders_len(in_height, out_height));
+}
+
+static int plan_alloc_size(int in_height, int out_height, int in_width,
+	int out_width)
+{
+	int len, taps_x, taps_y;
+
+	len = plan_tables_len(in_height, out_height, in_width, out_width);
+
+	/* downscale coefficients are built in a scratch buffer */
+	if (out_width <= in_width || out_height <= in_height) {
+		taps_x = max_taps(in_width, out_width);
+		taps_y = max_taps(in_height, out_height);
+		len += ALIGN16(max(taps_x, taps_y) * sizeof(float));
+	}
+
+	return len;
+}
+
+/**
+ * Whether scanlines pass through vertically: the height is unchanged and the
+ * width does not shrink. Each input row goes straight to its output row,
+ * without any y-accumulation: x-upscaled into a float line, or copied by
+ * copy_row() when the width is unchanged too. When the width shrinks, the
+ * fused downscale kernels are faster even with their trivial y-accumulation.
+ */
+static int rows_pass(int in_height, int out_height, int in_width,
+	int out_width)
+{
+	return out_height == in_height && out_width >= in_width;
+}
+
+/**
+ * Whether a downscaler x-scales each scanline into a float line, rather than
+ * using the fused downscale kernels. That is the case when the width grows.
+ * sums_y then holds 4 lines, one per pending output row.
+ */
+static int down_uses_line(int in_height, int out_height, int in_width,
+	int out_width)
+{
+	return out_height < in_height && out_width > in_width;
+}
+
+/**
+ * Whether a downscaler's geometry suits a planar sums_y, see OIL_PLANAR_CS().
+ * It is the same size as that of the fused downscale kernels: one line of
+ * out_width samples per pending output row, rotated by sums_y_tap like their
+ * tap slots. A fixed-point scaler keeps its own layout.
+ */
+static int planar_geometry(struct oil_scale *os)
+{
+	return os->out_height <= os->in_height &&
+		os->out_width <= os->in_width &&
+		!rows_pass(os->in_height, os->out_height, os->in_width,
+			os->out_width) &&
+		OIL_PLANAR_CS(os->cs) &&
+		os->out_width * OIL_CMP(os->cs) >= os->planar_len;
+}
+
+/**
+ * Whether a downscaler run with kernels k keeps a planar sums_y. Only done
+ * when k has planar kernels; the other backends use the fused layout.
+ */
+static int down_planar(struct oil_scale *os, const struct oil_kernels *k)
+{
+	return planar_geometry(os) && k->scale_down_planar != NULL;
+}
+
+/**
+ * Size of the per-scaler buffer: sums_y when downscaling, the 4-line ring
+ * buffer when upscaling. Both hold TAPS floats per output sample. When
+ * down_uses_line(), DOWN_LINES scanline buffers follow sums_y. When
+ * rows_pass(), a scanline buffer is all there is.
+ */
+static int state_alloc_size(int in_height, int out_height, int in_width,
+	int out_width, enum oil_colorspace cs)
+{
+	int len;
+
+	len = ALIGN16(out_width * OIL_CMP(cs) * sizeof(float));
+	if (rows_pass(in_height, out_height, in_width, out_width)) {
+		return len;
+	}
+	if (down_uses_line(in_height, out_height, in_width, out_width)) {
+		return len * (TAPS + DOWN_LINES);
+	}
+	return len * TAPS;
+}
+
+/**
+ * Size of the state of a scaler switched to half floats, which is never more
+ * than state_alloc_size(): the 4 lines of its ring buffer or sums_y as half
+ * floats, then the float scanline buffers that are x-scaled into before being
+ * converted or accumulated.
+ */
+static int half_alloc_size(int in_height, int out_height, int in_width,
+	int out_width, enum oil_colorspace cs)
+{
+	int len;
+
+	len = out_width * OIL_CMP(cs);
+	return ALIGN16(TAPS * len * sizeof(unsigned short)) +
+		ALIGN16(len * sizeof(float)) *
+		(out_height > in_height ? 1 : DOWN_LINES);
+}
+
+/**
+ * Vertical coefficients of a scaler without a plan are calculated a few at a
+ * time as scaling advances, so they take a fixed amount of memory regardless
+ * of the image height.
+ *
+ * On downscale the window holds the coefficients of the input rows from the
+ * one being scaled to the last row of the calculated output rows, indexed by
+ * row modulo len. On upscale it holds the coefficients of the output rows
+ * completed by the latest input row.
+ */
+struct oil_ywin {
+	struct coeff_gen gen;
+	float *coeffs; // coefficient window.
+	float *tmp_coeffs; // downscale scratch space.
+	int len; // input rows (downscale) or output rows (upscale) in the window.
+	int borders[8]; // downscale: borders of calculated rows, by row % 8.
+	int row_first; // upscale: first output row completed by the latest input.
+};
+
+static int ywin_len(int in_height, int out_height)
+{
+	if (out_height > in_height) {
+		/* at most ~1x the ratio per input row, ~3x on the last one */
+		return min(out_height, 3 * ((out_height + in_height - 1) /
+			in_height) + 2);
+	}
+	return min(max_taps(in_height, out_height), in_height);
+}
+
+static int ywin_alloc_size(int in_height, int out_height)
+{
+	return ALIGN16(sizeof(struct oil_ywin))
+		+ ALIGN16(ywin_len(in_height, out_height) * 4 * sizeof(float))
+		+ ALIGN16(min(max_taps(in_height, out_height), in_height) *
+			sizeof(float));
+}
+
+static void ywin_reset(struct oil_ywin *w)
+{
+	coeff_gen_init(&w->gen, w->gen.in_dim, w->gen.out_dim);
+	w->row_first = 0;
+}
+
+static struct oil_ywin *ywin_setup(void *buf, int in_height, int out_height)
+{
+	struct oil_ywin *w;
+	char *p;
+
+	p = buf;
+	w = (struct oil_ywin *)p;		p += ALIGN16(sizeof(struct oil_ywin));
+	w->len = ywin_len(in_height, out_height);
+	w->coeffs = (float *)p;		p += ALIGN16(w->len * 4 * sizeof(float));
+	w->tmp_coeffs = (float *)p;
+	coeff_gen_init(&w->gen, in_height, out_height);
+	w->row_first = 0;
+	return w;
+}
+
+/**
+ * Downscale: calculate every output row that uses input row in_pos, and at
+ * least up to output row out_pos.
+ */
+static void ywin_down_fill(struct oil_ywin *w, int in_pos, int out_pos)
+{
+	struct coeff_gen *g;
+	int i;
+
+	g = &w->gen;
+	while (g->next < g->out_dim &&
+		(g->next <= out_pos || down_gen_start(g) <= in_pos)) {
+		i = g->next;
+		w->borders[i % 8] = down_gen_next(g, w->coeffs, w->len,
+			w->tmp_coeffs);
+	}
+}
+
+/**
+ * Upscale: calculate the output rows completed by input row in_row. Returns
+ * how many there are.
+ */
+static int ywin_up_fill(struct oil_ywin *w, int in_row)
+{
+	struct coeff_gen *g;
+	int n;
+
+	g = &w->gen;
+	w->row_first = g->next;
+	for (n=0; g->next < g->out_dim && up_gen_end(g) == in_row; n++) {
+		up_gen_next(g, w->coeffs + n * 4);
+	}
+	return n;
+}
+
+/**
+ * Downscale: y-coefficients for input row in_pos.
+ */
+static float *down_coeffs_y(struct oil_scale *os)
+{
+	if (!os->ywin) {
+		return os->coeffs_y + os->in_pos * 4;
+	}
+	ywin_down_fill(os->ywin, os->in_pos, os->out_pos);
+	return os->ywin->coeffs + os->in_pos % os->ywin->len * 4;
+}
+
+/**
+ * Downscale: number of input rows that complete output row out_pos.
+ */
+static int down_border_y(struct oil_scale *os)
+{
+	if (rows_pass(os->in_height, os->out_height, os->in_width,
+		os->out_width)) {
+		return 1;
+	}
+	if (!os->ywin) {
+		return os->borders_y[os->out_pos];
+	}
+	ywin_down_fill(os->ywin, os->in_pos, os->out_pos);
+	return os->ywin->borders[os->out_pos % 8];
+}
+
+/**
+ * Upscale: number of output rows completed by input row in_row, which must be
+ * the row just fed.
+ */
+static int up_border_y(struct oil_scale *os, int in_row)
+{
+	if (!os->ywin) {
+		return os->borders_y[in_row];
+	}
+	return ywin_up_fill(os->ywin, in_row);
+}
+
+/**
+ * Upscale: y-coefficients for output row out_pos.
+ */
+static float *up_coeffs_y(struct oil_scale *os)
+{
+	if (!os->ywin) {
+		return os->coeffs_y + os->out_pos * 4;
+	}
+	return os->ywin->coeffs + (os->out_pos - os->ywin->row_first) * 4;
+}
+
+/**
+ * Lay out a plan's tables in buf and calculate the coefficients. buf must be
+ * at least plan_alloc_size() bytes. Only the tables are zeroed; the scratch
+ * space after them is not.
+ */
+static void plan_setup(struct oil_plan *plan, int in_height, int out_height,
+	int in_width, int out_width, void *buf)
+{
+	int coeffs_x_len, coeffs_y_len, borders_x_len, borders_y_len;
+	float *tmp_coeffs;
+	char *p;
+
+	memset(plan, 0, sizeof(struct oil_plan));
+	plan->in_height = in_height;
+	plan->out_height = out_height;
+	plan->in_width = in_width;
+	plan->out_width = out_width;
+	plan->buf = buf;
+
+	coeffs_x_len = ALIGN16(calc_coeffs_len(in_width, out_width));
+	borders_x_len = ALIGN16(calc_borders_len(in_width, out_width));
+	coeffs_y_len = ALIGN16(calc_coeffs_len(in_height, out_height));
+	borders_y_len = ALIGN16(calc_borders_len(in_height, out_height));
+
+	memset(buf, 0, plan_tables_len(in_height, out_height, in_width,
+		out_width));
+	p = buf;
+	plan->coeffs_x = (float *)p;		p += coeffs_x_len;
+	plan->borders_x = (int *)p;		p += borders_x_len;
+	plan->coeffs_y = (float *)p;		p += coeffs_y_len;
+	plan->borders_y = (int *)p;		p += borders_y_len;
+	tmp_coeffs = (float *)p;
+
+	if (out_width > in_width) {
+		scale_up_coeffs(in_width, out_width, plan->coeffs_x,
+			plan->borders_x);
+	} else {
+		scale_down_coeffs(in_width, out_width, plan->coeffs_x,
+			plan->borders_x, tmp_coeffs);
+	}
+
+	if (out_height > in_height) {
+		scale_up_coeffs(in_height, out_height, plan->coeffs_y,
+			plan->borders_y);
+	} else {
+		scale_down_coeffs(in_height, out_height, plan->coeffs_y,
+			plan->borders_y, tmp_coeffs);
+	}
+}
+
+/**
+ * Point a scaler at a plan's tables and at its own sums_y or ring buffer in
+ * buf, which must be at least state_alloc_size() bytes, or half_alloc_size()
+ * bytes if half is set, and is zeroed here. The y-direction picks between the
+ * two; the x-direction only picks the coefficients, so the axes may scale in
+ * opposite directions.
+ * If ywin is given, y-coefficients come from it instead of the plan.
+ */
+static void scale_setup(struct oil_scale *os, const struct oil_plan *plan,
+	struct oil_ywin *ywin, enum oil_colorspace cs, void *buf, int half)
+{
+	int len;
+	char *p;
+
+	memset(os, 0, sizeof(struct oil_scale));
+	os->in_height = plan->in_height;
+	os->out_height = plan->out_height;
+	os->in_width = plan->in_width;
+	os->out_width = plan->out_width;
+	os->cs = cs;
+	os->coeffs_x = plan->coeffs_x;
+	os->borders_x = plan->borders_x;
+	os->coeffs_y = plan->coeffs_y;
+	os->borders_y = plan->borders_y;
+	os->ywin = ywin;
+	os->kernels = default_kernels;
+	os->heavy_ratio = heavy_ratio;
+	os->planar_len = planar_len;
+
+	len = ALIGN16(os->out_width * OIL_CMP(cs) * sizeof(float));
+	p = buf;
+	if (half) {
+		memset(buf, 0, half_alloc_size(os->in_height, os->out_height,
+			os->in_width, os->out_width, cs));
+		os->half = buf;
+		p += ALIGN16(TAPS * os->out_width * OIL_CMP(cs) *
+			sizeof(unsigned short));
+	} else {
+		memset(buf, 0, state_alloc_size(os->in_height, os->out_height,
+			os->in_width, os->out_width, cs));
+	}
+
+	if (os->out_height > os->in_height) {
+		/* with half floats, the scanline x-scaled into */
+		os->rb = (float *)p;
+		os->slots_y = 0;
+	} else if (rows_pass(os->in_height, os->out_height, os->in_width,
+		os->out_width)) {
+		/* a single x-scaled or copied scanline */
+		os->rb = buf;
+		os->slots_y = down_border_y(os);
+	} else {
+		os->slots_y = down_border_y(os);
+		if (!half) {
+			os->sums_y = buf;
+			p += len * TAPS;
+		}
+		if (down_uses_line(os->in_height, os->out_height,
+			os->in_width, os->out_width)) {
+			/* DOWN_LINES x-scaled scanlines */
+			os->rb = (float *)p;
+		}
+	}
+}
+
+int oil_plan_init(struct oil_plan *plan, int in_height, int out_height,
+	int in_width, int out_width)
+{
+	void *buf;
+
+	if (!plan || check_dimensions(in_height, out_height, in_width,
+		out_width)) {
+		return -1;
+	}
+
+	buf = buf_alloc(plan_alloc_size(in_height, out_height, in_width,
+		out_width));
+	if (!buf) {
+		return -2;
+	}
+
+	plan_setup(plan, in_height, out_height, in_width, out_width, buf);
+	return 0;
+}
+
+/* Coefficient cache */
+
+/**
+ * Coefficient and border tables for one axis, shared through the cache. refs
+ * counts the cache's own reference plus one for each plan using the tables.
+ *
+ * Cached entries live in axis_pool and their headers are never freed, only
+ * recycled once refs drops to zero, so a lookup that raced with an eviction
+ * can still safely try to take a reference. Entries made when every header is
+ * in use are allocated from the heap and never cached.
+ */
+struct oil_axis {
+	atomic_int refs;
+	atomic_uint last_used; // cache_clock value at the latest lookup.
+	atomic_ullong key; // axis_key() of the tables.
+	int heap; // 1 if the header was allocated with the tables.
+	void *tables;
+	float *coeffs;
+	int *borders;
+};
+
+/**
+ * The cache is set-associative: an (in, out) pair can only live in the
+ * CACHE_WAYS slots of its set, and a miss on a full set evicts the least
+ * recently used entry of that set.
+ */
+#define CACHE_SETS 16
+#define CACHE_WAYS 4
+
+static _Atomic(struct oil_axis *) cache_slots[CACHE_SETS * CACHE_WAYS];
+
+/**
+ * Entries for the cache. Twice the number of slots, so that evicted entries
+ * still used by plans don't immediately leave nothing to recycle.
+ */
+static struct oil_axis axis_pool[CACHE_SETS * CACHE_WAYS * 2];
+
+/**
+ * Only advanced on misses, so lookups merely read it. Entries used since the
+ * same miss count as equally recent.
+ */
+static atomic_uint cache_clock;
+
+/* serializes inserts & evictions */
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static unsigned long long axis_key(int in_dim, int out_dim)
+{
+	return (unsigned long long)(unsigned int)in_dim << 32 |
+		(unsigned int)out_dim;
+}
+
+/**
+ * Calculate the tables for an axis into ax, which must not be referenced.
+ * Returns -2 if unable to allocate memory.
+ */
+static int axis_fill(struct oil_axis *ax, int in_dim, int out_dim)
+{
+	int coeffs_len, borders_len;
+	char *p;
+
+	coeffs_len = ALIGN16(calc_coeffs_len(in_dim, out_dim));
+	borders_len = ALIGN16(calc_borders_len(in_dim, out_dim));
+
+	p = buf_alloc(coeffs_len + borders_len +
+		ALIGN16(max_taps(in_dim, out_dim) * sizeof(float)));
+	if (!p) {
+		return -2;
+	}
+	memset(p, 0, coeffs_len + borders_len);
+	ax->tables = p;
+	ax->coeffs = (float *)p;
+	ax->borders = (int *)(p + coeffs_len);
+	atomic_store_explicit(&ax->key, axis_key(in_dim, out_dim),
+		memory_order_relaxed);
+
+	if (out_dim > in_dim) {
+		scale_up_coeffs(in_dim, out_dim, ax->coeffs, ax->borders);
+	} else {
+		scale_down_coeffs(in_dim, out_dim, ax->coeffs, ax->borders,
+			(float *)(p + coeffs_len + borders_len));
+	}
+	return 0;
+}
+
+/**
+ * Calculate uncached tables for an axis, referenced once.
+ */
+static struct oil_axis *axis_new(int in_dim, int out_dim)
+{
+	struct oil_axis *ax;
+
+	ax = buf_alloc(sizeof(struct oil_axis));
+	if (!ax) {
+		return NULL;
+	}
+	memset(ax, 0, sizeof(struct oil_axis));
+	ax->heap = 1;
+	if (axis_fill(ax, in_dim, out_dim)) {
+		buf_free(ax);
+		return NULL;
+	}
+	atomic_store(&ax->refs, 1);
+	return ax;
+}
+
+static void axis_release(struct oil_axis *ax)
+{
+	void *tables;
+	int heap;
+
+	/* once refs is zero a pooled header may be recycled at any time */
+	tables = ax->tables;
+	heap = ax->heap;
+	if (atomic_fetch_sub(&ax->refs, 1) == 1) {
+		buf_free(tables);
+		if (heap) {
+			buf_free(ax);
+		}
+	}
+}
+
+/**
+ * Take a reference on ax unless it has none left, in which case its header is
+ * free for reuse and its tables may be gone.
+ */
+static int axis_tryref(struct oil_axis *ax)
+{
+	int refs;
+
+	refs = atomic_load_explicit(&ax->refs, memory_order_relaxed);
+	while (refs) {
+		if (atomic_compare_exchange_weak_explicit(&ax->refs, &refs,
+			refs + 1, memory_order_acquire, memory_order_relaxed)) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+static _Atomic(struct oil_axis *) *cache_set(int in_dim, int out_dim)
+{
+	unsigned int h;
+
+	h = (unsigned int)in_dim * 2654435761u ^ (unsigned int)out_dim * 40503u;
+	return cache_slots + (h >> 16) % CACHE_SETS * CACHE_WAYS;
+}
+
+/**
+ * Find cached tables and take a reference on them. Does not lock, and only
+ * writes to the entry it finds.
+ */
+static struct oil_axis *cache_lookup(int in_dim, int out_dim)
+{
+	int i;
+	unsigned int now;
+	unsigned long long key;
+	struct oil_axis *ax;
+	_Atomic(struct oil_axis *) *set;
+
+	set = cache_set(in_dim, out_dim);
+	key = axis_key(in_dim, out_dim);
+
+	for (i=0; i<CACHE_WAYS; i++) {
+		ax = atomic_load_explicit(&set[i], memory_order_acquire);
+		if (!ax || atomic_load_explicit(&ax->key,
+			memory_order_relaxed) != key || !axis_tryref(ax)) {
+			continue;
+		}
+
+		/* the header may have been recycled before we got our ref */
+		if (atomic_load_explicit(&ax->key, memory_order_relaxed) !=
+			key) {
+			axis_release(ax);
+			continue;
+		}
+
+		now = atomic_load_explicit(&cache_clock, memory_order_relaxed);
+		if (atomic_load_explicit(&ax->last_used,
+			memory_order_relaxed) != now) {
+			atomic_store_explicit(&ax->last_used, now,
+				memory_order_relaxed);
+		}
+		return ax;
+	}
+	return NULL;
+}
+
+/**
+ * Find a header in axis_pool that no slot or plan references. Called with
+ * cache_lock held; returns NULL if all are in use.
+ */
+static struct oil_axis *cache_free_header(void)
+{
+	size_t i;
+
+	for (i=0; i<sizeof(axis_pool) / sizeof(axis_pool[0]); i++) {
+		if (!atomic_load_explicit(&axis_pool[i].refs,
+			memory_order_acquire)) {
+			return axis_pool + i;
+		}
+	}
+	return NULL;
+}
+
+/**
+ * Return referenced tables for an axis, calculating and caching them on a
+ * miss. Returns NULL if unable to allocate memory.
+ */
+static struct oil_axis *cache_get(int in_dim, int out_dim)
+{
+	int i, victim;
+	struct oil_axis *ax, *old;
+	_Atomic(struct oil_axis *) *set;
+	unsigned int now, age, oldest;
+
+	ax = cache_lookup(in_dim, out_dim);
+	if (ax) {
+		return ax;
+	}
+
+	pthread_mutex_lock(&cache_lock);
+
+	/* another thread may have filled it in while we waited */
+	ax = cache_lookup(in_dim, out_dim);
+	if (ax) {
+		pthread_mutex_unlock(&cache_lock);
+		return ax;
+	}
+
+	/* pick an empty way, or the least recently used one */
+	set = cache_set(in_dim, out_dim);
+	now = atomic_fetch_add(&cache_clock, 1) + 1;
+	victim = 0;
+	oldest = 0;
+	for (i=0; i<CACHE_WAYS; i++) {
+		old = atomic_load(&set[i]);
+		if (!old) {
+			victim = i;
+			break;
+		}
+		age = now - atomic_load_explicit(&old->last_used,
+			memory_order_relaxed);
+		if (age >= oldest) {
+			oldest = age;
+			victim = i;
+		}
+	}
+
+	/* unlinking the victim may free its header for the new entry */
+	old = atomic_exchange(&set[victim], NULL);
+	if (old) {
+		axis_release(old);
+	}
+
+	ax = cache_free_header();
+	if (!ax) {
+		pthread_mutex_unlock(&cache_lock);
+		return axis_new(in_dim, out_dim);
+	}
+	if (axis_fill(ax, in_dim, out_dim)) {
+		pthread_mutex_unlock(&cache_lock);
+		return NULL;
+	}
+	atomic_store_explicit(&ax->last_used, now, memory_order_relaxed);
+	atomic_store_explicit(&ax->refs, 2, memory_order_release);
+	atomic_store_explicit(&set[victim], ax, memory_order_release);
+
+	pthread_mutex_unlock(&cache_lock);
+	return ax;
+}
+
+void oil_plan_cache_clear(void)
+{
+	int i;
+	struct oil_axis *old;
+
+	pthread_mutex_lock(&cache_lock);
+	for (i=0; i<CACHE_SETS * CACHE_WAYS; i++) {
+		old = atomic_exchange(&cache_slots[i], NULL);
+		if (old) {
+			axis_release(old);
+		}
+	}
+	pthread_mutex_unlock(&cache_lock);
+}
+
+int oil_plan_init_cached(struct oil_plan *plan, int in_height,
+	int out_height, int in_width, int out_width)
+{
+	if (!plan || check_dimensions(in_height, out_height, in_width,
+		out_width)) {
+		return -1;
+	}
+
+	memset(plan, 0, sizeof(struct oil_plan));
+	plan->axis_x = cache_get(in_width, out_width);
+	plan->axis_y = cache_get(in_height, out_height);
+	if (!plan->axis_x || !plan->axis_y) {
+		oil_plan_free(plan);
+		return -2;
+	}
+
+	plan->in_height = in_height;
+	plan->out_height = out_height;
+	plan->in_width = in_width;
+	plan->out_width = out_width;
+	plan->coeffs_x = plan->axis_x->coeffs;
+	plan->borders_x = plan->axis_x->borders;
+	plan->coeffs_y = plan->axis_y->coeffs;
+	plan->borders_y = plan->axis_y->borders;
+	return 0;
+}
+
+void oil_plan_free(struct oil_plan *plan)
+{
+	if (!plan) {
+		return;
+	}
+	if (plan->axis_x) {
+		axis_release(plan->axis_x);
+	}
+	if (plan->axis_y) {
+		axis_release(plan->axis_y);
+	}
+	buf_free(plan->buf);
+	memset(plan, 0, sizeof(struct oil_plan));
+}
+
+int oil_scale_init_plan(struct oil_scale *os, const struct oil_plan *plan,
+	enum oil_colorspace cs)
+{
+	void *buf;
+
+	if (!os || !plan || !plan->coeffs_x) {
+		return -1;
+	}
+
+	// Lazy perform global init, in case oil_global_ini() hasn't been
+	// called yet.
+	if (!s2l_map[128]) {
+		oil_global_init();
+	}
+
+	buf = buf_alloc(state_alloc_size(plan->in_height, plan->out_height,
+		plan->in_width, plan->out_width, cs));
+	if (!buf) {
+		return -2;
+	}
+
+	scale_setup(os, plan, NULL, cs, buf, 0);
+	os->buf = buf;
+	return 0;
+}
+
+/**
+ * Size of the x-tables and the scratch space used to calculate them.
+ */
+static int xtables_alloc_size(int in_width, int out_width)
+{
+	return ALIGN16(calc_coeffs_len(in_width, out_width))
+		+ ALIGN16(calc_borders_len(in_width, out_width))
+		+ ALIGN16(max_taps(in_width, out_width) * sizeof(float));
+}
+
+int oil_scale_alloc_size(int in_height, int out_height, int in_width,
+	int out_width, enum oil_colorspace cs)
+{
+	return xtables_alloc_size(in_width, out_width) +
+		ywin_alloc_size(in_height, out_height) +
+		state_alloc_size(in_height, out_height, in_width, out_width, cs);
+}
+
+/**
+ * oil_scale_init_allocated(), optionally with its state as half floats, see
+ * scale_setup().
+ */
+static int scale_init_allocated(struct oil_scale *os, int in_height,
+	int out_height, int in_width, int out_width, enum oil_colorspace cs,
+	void *buf, int half)
+{
+	struct oil_plan plan;
+	struct oil_ywin *ywin;
+	int coeffs_len, borders_len;
+	char *p;
+
+	/* sanity check on arguments */
+	if (!os || !buf || check_dimensions(in_height, out_height, in_width,
+		out_width)) {
+		return -1;
+	}
+
+	// Lazy perform global init, in case oil_global_ini() hasn't been
+	// called yet.
+	if (!s2l_map[128]) {
+		oil_global_init();
+	}
+
+	/* The x-tables, the y-coefficient window and the scaler's own buffer
+	 * share one allocation, owned by the caller. */
+	memset(&plan, 0, sizeof(struct oil_plan));
+	plan.in_height = in_height;
+	plan.out_height = out_height;
+	plan.in_width = in_width;
+	plan.out_width = out_width;
+
+	coeffs_len = ALIGN16(calc_coeffs_len(in_width, out_width));
+	borders_len = ALIGN16(calc_borders_len(in_width, out_width));
+	memset(buf, 0, coeffs_len + borders_len);
+	p = buf;
+	plan.coeffs_x = (float *)p;
+	plan.borders_x = (int *)(p + coeffs_len);
+	if (out_width > in_width) {
+		scale_up_coeffs(in_width, out_width, plan.coeffs_x,
+			plan.borders_x);
+	} else {
+		scale_down_coeffs(in_width, out_width, plan.coeffs_x,
+			plan.borders_x, (float *)(p + coeffs_len + borders_len));
+	}
+	p += xtables_alloc_size(in_width, out_width);
+
+	ywin = ywin_setup(p, in_height, out_height);
+	p += ywin_alloc_size(in_height, out_height);
+
+	scale_setup(os, &plan, ywin, cs, p, half);
+
+	return 0;
+}
+
+int oil_scale_init_allocated(struct oil_scale *os, int in_height,
+	int out_height, int in_width, int out_width, enum oil_colorspace cs,
 	void *buf)
 {
-	/* sanity check on arguments */
-	if (!os || !buf || in_height > MAX_DIMENSION || out_height > MAX_DIMENSION ||
-		in_height < 1 || out_height < 1 ||
-		in_width > MAX_DIMENSION || out_width > MAX_DIMENSION ||
-		in_width < 1 || out_width < 1) {
+	int ret;
+
+	ret = scale_init_allocated(os, in_height, out_height, in_width,
+		out_width, cs, buf, 0);
+	if (!ret) {
+		os->user_buf = buf;
+	}
+	return ret;
+}
+
+int oil_scale_init(struct oil_scale *os, int in_height, int out_height,
+	int in_width, int out_width, enum oil_colorspace cs)
+{
+	int alloc_size, ret;
+	void *buf;
+
+	alloc_size = oil_scale_alloc_size(in_height, out_height, in_width,
+		out_width, cs);
+	buf = buf_alloc(alloc_size);
+	if (!buf) {
+		return -2;
+	}
+
+	ret = scale_init_allocated(os, in_height, out_height, in_width,
+		out_width, cs, buf, 0);
+	if (ret) {
+		buf_free(buf);
+		return ret;
+	}
+	os->buf = buf;
+
+	return 0;
+}
+
+/* Column-split worker pool */
+
+/**
+ * Strips narrower than this are not worth a thread handoff per scanline.
+ */
+#define MIN_STRIP_WIDTH 64
+
+/**
+ * Most scanlines a downscale job carries, see pool_run_down_in().
+ */
+#define STRIP_ROWS 16
+
+enum pool_job {
+	JOB_DOWN_IN,
+	JOB_DOWN_OUT,
+	JOB_UP_IN,
+	JOB_UP_OUT,
+	JOB_QUIT,
+};
+
+/**
+ * A contiguous range of output columns owned by one worker. Horizontal
+ * accumulation carries state across neighbouring output samples, so a strip
+ * starts a few columns early (the lead) from a clean state; the lead columns
+ * are scaled but never copied out. From the first owned column on, a strip
+ * sees exactly the samples, coefficients and accumulation order of a
+ * full-width scanline, so its output is bit-identical.
+ *
+ * os is a shallow copy of the parent scaler with the strip's coefficient and
+ * border offsets, width, and private sums_y or ring buffer. The parent keeps
+ * all of the row bookkeeping.
+ */
+struct oil_strip {
+	struct oil_scale os;
+	struct oil_pool *pool;
+	int in_offset; // byte offset of the first input sample fed to the strip.
+	int lead; // number of leading columns that are dropped.
+	int out_offset; // byte offset of the first owned output column.
+	int out_len; // bytes of owned output columns.
+	int planar; // whether the parent scaler is planar_geometry().
+	unsigned char *line; // output scanline for the lead + owned columns.
+	void *buf; // backing allocation for the strip's buffers.
+};
+
+struct oil_pool {
+	pthread_mutex_t lock;
+	pthread_cond_t work; // signalled when a new job is posted.
+	pthread_cond_t done; // signalled when the last worker finishes a job.
+	int generation; // bumped for every posted job.
+	int pending; // workers still running the current job.
+	int num_threads; // worker threads started, not counting the caller.
+	pthread_t *threads;
+
+	/* current job */
+	enum pool_job job;
+	const struct oil_kernels *k;
+	unsigned char *data;
+	float *coeffs_y;
+	int line;
+	int tap;
+	int rows; // JOB_DOWN_IN: scanlines at data, with 4 coeffs_y each.
+	ptrdiff_t stride; // JOB_DOWN_IN: distance between those scanlines.
+
+	int num_strips;
+	struct oil_strip strips[];
+};
+
+static float *strip_rb_line(struct oil_strip *st, int line)
+{
+	return st->os.rb + line * OIL_CMP(st->os.cs) * st->os.out_width;
+}
+
+static void strip_run(struct oil_strip *st)
+{
+	int i, cmp;
+	float *in[4];
+	unsigned char *row;
+	struct oil_pool *pool;
+	const struct oil_kernels *k;
+
+	pool = st->pool;
+	k = pool->k;
+	cmp = OIL_CMP(st->os.cs);
+
+	switch (pool->job) {
+	case JOB_DOWN_IN:
+		st->os.sums_y_tap = pool->tap;
+		for (i=0; i<pool->rows; i++) {
+			row = pool->data + i * pool->stride + st->in_offset;
+			if (st->planar && k->scale_down_planar) {
+				scale_in_planar(&st->os, row,
+					pool->coeffs_y + i * 4, k);
+			} else {
+				k->scale_down(&st->os, row,
+					pool->coeffs_y + i * 4);
+			}
+		}
+		break;
+	case JOB_DOWN_OUT:
+		st->os.sums_y_tap = pool->tap;
+		if (st->planar && k->scale_down_planar) {
+			scale_out_planar(&st->os, st->line, k);
+		} else {
+			k->yscale_out(st->os.sums_y, st->os.out_width,
+				st->line, st->os.cs, pool->tap);
+		}
+		break;
+	case JOB_UP_IN:
+		k->xscale_up(pool->data + st->in_offset, st->os.in_width,
+			strip_rb_line(st, pool->line), st->os.cs,
+			st->os.coeffs_x, st->os.borders_x);
+		break;
+	case JOB_UP_OUT:
+		for (i=0; i<4; i++) {
+			in[i] = strip_rb_line(st, (pool->line + i) % 4);
+		}
+		k->yscale_up(in, st->os.out_width * cmp, pool->coeffs_y,
+			st->line, st->os.cs);
+		break;
+	case JOB_QUIT:
+		break;
+	}
+
+	if (pool->data && (pool->job == JOB_DOWN_OUT || pool->job == JOB_UP_OUT)) {
+		memcpy(pool->data + st->out_offset, st->line + st->lead * cmp,
+			st->out_len);
+	}
+}
+
+static void *pool_worker(void *arg)
+{
+	struct oil_strip *st;
+	struct oil_pool *pool;
+	int generation;
+
+	st = arg;
+	pool = st->pool;
+	generation = 0;
+
+	pthread_mutex_lock(&pool->lock);
+	for (;;) {
+		while (pool->generation == generation) {
+			pthread_cond_wait(&pool->work, &pool->lock);
+		}
+		generation = pool->generation;
+		if (pool->job == JOB_QUIT) {
+			break;
+		}
+		pthread_mutex_unlock(&pool->lock);
+
+		strip_run(st);
+
+		pthread_mutex_lock(&pool->lock);
+		if (--pool->pending == 0) {
+			pthread_cond_signal(&pool->done);
+		}
+	}
+	pthread_mutex_unlock(&pool->lock);
+	return NULL;
+}
+
+/**
+ * Run a job on every strip. The calling thread takes the first strip and
+ * returns once all of them are done. Without worker threads, as for
+ * cache-sized strips, nothing is locked.
+ */
+static void pool_run(struct oil_pool *pool, const struct oil_kernels *k,
+	enum pool_job job, unsigned char *data, float *coeffs_y, int line,
+	int tap)
+{
+	int i;
+
+	if (pool->num_threads) {
+		pthread_mutex_lock(&pool->lock);
+	}
+	pool->job = job;
+	pool->k = k;
+	pool->data = data;
+	pool->coeffs_y = coeffs_y;
+	pool->line = line;
+	pool->tap = tap;
+	if (pool->num_threads) {
+		pool->pending = pool->num_threads;
+		pool->generation++;
+		pthread_cond_broadcast(&pool->work);
+		pthread_mutex_unlock(&pool->lock);
+	}
+
+	/* strips without a thread of their own run on the caller */
+	for (i=pool->num_threads; i<pool->num_strips; i++) {
+		strip_run(&pool->strips[(i + 1) % pool->num_strips]);
+	}
+
+	if (pool->num_threads) {
+		pthread_mutex_lock(&pool->lock);
+		while (pool->pending) {
+			pthread_cond_wait(&pool->done, &pool->lock);
+		}
+		pthread_mutex_unlock(&pool->lock);
+	}
+}
+
+/**
+ * Feed rows scanlines, stride bytes apart, to every strip of a downscaler.
+ * coeffs_y holds 4 y-coefficients per scanline. Each strip takes all of them
+ * before it is done, so its sums_y is swept once per job while in cache.
+ */
+static void pool_run_down_in(struct oil_pool *pool,
+	const struct oil_kernels *k, unsigned char *in, ptrdiff_t stride,
+	int rows, float *coeffs_y, int tap)
+{
+	/* workers read these once pool_run() has posted the job */
+	pool->rows = rows;
+	pool->stride = stride;
+	pool_run(pool, k, JOB_DOWN_IN, in, coeffs_y, 0, tap);
+}
+
+static void pool_free(struct oil_pool *pool)
+{
+	int i;
+
+	if (!pool) {
+		return;
+	}
+	if (pool->num_threads) {
+		pthread_mutex_lock(&pool->lock);
+		pool->job = JOB_QUIT;
+		pool->generation++;
+		pthread_cond_broadcast(&pool->work);
+		pthread_mutex_unlock(&pool->lock);
+		for (i=0; i<pool->num_threads; i++) {
+			pthread_join(pool->threads[i], NULL);
+		}
+	}
+	pthread_mutex_destroy(&pool->lock);
+	pthread_cond_destroy(&pool->work);
+	pthread_cond_destroy(&pool->done);
+	for (i=0; i<pool->num_strips; i++) {
+		buf_free(pool->strips[i].buf);
+	}
+	buf_free(pool->threads);
+	buf_free(pool);
+}
+
+/**
+ * Set up a downscale strip for output columns [c0, c1). Its sums_y is taken
+ * from the start of the *spare floats of the parent's sums_y, which the
+ * strips replace, if there are enough of them left. With the lead columns
+ * that is all but the last strip or so, which get sums_y of their own.
+ */
+static int strip_init_down(struct oil_scale *os, struct oil_strip *st,
+	int c0, int c1, float **spare, long *spare_len)
+{
+	int i, cmp, first_out, first_in, sums_len, line_len;
+
+	cmp = OIL_CMP(os->cs);
+	first_out = max(c0 - 3, 0);
+	first_in = 0;
+	for (i=0; i<first_out; i++) {
+		first_in += os->borders_x[i];
+	}
+
+	st->os.out_width = c1 - first_out;
+	st->os.in_width = 0;
+	for (i=first_out; i<c1; i++) {
+		st->os.in_width += os->borders_x[i];
+	}
+	st->os.coeffs_x = os->coeffs_x + first_in * 4;
+	st->os.borders_x = os->borders_x + first_out;
+	st->in_offset = first_in * cmp;
+	st->lead = c0 - first_out;
+	st->planar = planar_geometry(os);
+
+	line_len = st->os.out_width * cmp;
+	if (line_len * TAPS <= *spare_len) {
+		st->buf = buf_alloc(line_len);
+		if (!st->buf) {
+			return -2;
+		}
+		st->os.sums_y = *spare;
+		memset(st->os.sums_y, 0, line_len * TAPS * sizeof(float));
+		*spare += line_len * TAPS;
+		*spare_len -= line_len * TAPS;
+		st->line = st->buf;
+		return 0;
+	}
+
+	sums_len = ALIGN16(line_len * TAPS * sizeof(float));
+	st->buf = buf_alloc(sums_len + line_len);
+	if (!st->buf) {
+		return -2;
+	}
+	memset(st->buf, 0, sums_len);
+	st->os.sums_y = st->buf;
+	st->line = (unsigned char *)st->buf + sums_len;
+	return 0;
+}
+
+/**
+ * Set up an upscale strip for output columns [c0, c1). The strip feeds input
+ * samples from 3 before the one that completes column c0 up to the one that
+ * completes column c1 - 1, with the last border trimmed to stop at c1.
+ */
+static int strip_init_up(struct oil_scale *os, struct oil_strip *st,
+	int c0, int c1)
+{
+	int i, cmp, done, start_smp, end_smp, first_out, last_done, rb_len;
+	int *borders;
+
+	cmp = OIL_CMP(os->cs);
+
+	/* input sample that completes column c0 */
+	done = 0;
+	for (i=0; done + os->borders_x[i] <= c0; i++) {
+		done += os->borders_x[i];
+	}
+	start_smp = max(i - 3, 0);
+
+	first_out = 0;
+	for (i=0; i<start_smp; i++) {
+		first_out += os->borders_x[i];
+	}
+
+	/* input sample that completes column c1 - 1 */
+	done = first_out;
+	for (i=start_smp; done + os->borders_x[i] < c1; i++) {
+		done += os->borders_x[i];
+	}
+	end_smp = i;
+	last_done = done;
+
+	st->os.in_width = end_smp - start_smp + 1;
+	st->os.out_width = c1 - first_out;
+	st->os.coeffs_x = os->coeffs_x + first_out * 4;
+	st->in_offset = start_smp * cmp;
+	st->lead = c0 - first_out;
+
+	rb_len = ALIGN16(st->os.out_width * cmp * 4 * sizeof(float));
+	st->buf = buf_alloc(rb_len + ALIGN16(st->os.in_width * sizeof(int)) +
+		st->os.out_width * cmp);
+	if (!st->buf) {
+		return -2;
+	}
+	memset(st->buf, 0, rb_len);
+	st->os.rb = st->buf;
+	borders = (int *)((char *)st->buf + rb_len);
+	memcpy(borders, os->borders_x + start_smp,
+		st->os.in_width * sizeof(int));
+	borders[st->os.in_width - 1] = c1 - last_done;
+	st->os.borders_x = borders;
+	st->line = (unsigned char *)borders +
+		ALIGN16(st->os.in_width * sizeof(int));
+	return 0;
+}
+
+/**
+ * Split a scaler into nstrips column strips, nthreads of which get a worker
+ * thread of their own. The caller runs the rest.
+ */
+static int pool_init(struct oil_scale *os, int nstrips, int nthreads)
+{
+	int i, c0, c1, ret, cmp;
+	long spare_len;
+	float *spare;
+	struct oil_pool *pool;
+	struct oil_strip *st;
+
+	pool = buf_alloc_zeroed(sizeof(struct oil_pool) +
+		nstrips * sizeof(struct oil_strip));
+	if (!pool) {
+		return -2;
+	}
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->work, NULL);
+	pthread_cond_init(&pool->done, NULL);
+	pool->num_strips = nstrips;
+
+	cmp = OIL_CMP(os->cs);
+	spare = os->sums_y;
+	spare_len = spare ? (long)os->out_width * cmp * TAPS : 0;
+	for (i=0; i<nstrips; i++) {
+		st = &pool->strips[i];
+		st->os = *os;
+		st->pool = pool;
+		c0 = (long long)os->out_width * i / nstrips;
+		c1 = (long long)os->out_width * (i + 1) / nstrips;
+		st->out_offset = c0 * cmp;
+		st->out_len = (c1 - c0) * cmp;
+		if (os->out_width > os->in_width) {
+			ret = strip_init_up(os, st, c0, c1);
+		} else {
+			ret = strip_init_down(os, st, c0, c1, &spare,
+				&spare_len);
+		}
+		if (ret) {
+			pool_free(pool);
+			return ret;
+		}
+	}
+
+	if (nthreads) {
+		pool->threads = buf_alloc(nthreads * sizeof(pthread_t));
+		if (!pool->threads) {
+			pool_free(pool);
+			return -2;
+		}
+	}
+	/* Worker i runs strip i + 1; the caller runs strip 0. If a thread
+	 * can't be started, the caller picks up the remaining strips. */
+	for (i=0; i<nthreads; i++) {
+		if (pthread_create(&pool->threads[i], NULL, pool_worker,
+			&pool->strips[i + 1])) {
+			break;
+		}
+		pool->num_threads++;
+	}
+
+	os->pool = pool;
+	return 0;
+}
+
+/**
+ * Number of strips a single-threaded scaler is split into, see
+ * cache_strip_bytes. Only the fused downscale accumulates into sums_y across
+ * scanlines.
+ */
+static int cache_strips(struct oil_scale *os)
+{
+	long long sums_len;
+
+	if (os->out_width > os->in_width || os->out_height > os->in_height ||
+		rows_pass(os->in_height, os->out_height, os->in_width,
+		os->out_width)) {
+		return 1;
+	}
+	sums_len = (long long)os->out_width * OIL_CMP(os->cs) * TAPS *
+		sizeof(float);
+	return min((sums_len + cache_strip_bytes - 1) / cache_strip_bytes,
+		os->out_width / MIN_STRIP_WIDTH);
+}
+
+int oil_scale_set_threads(struct oil_scale *os, int nthreads)
+{
+	int nstrips;
+
+	/* the strips carve up sums_y, which holds rows once input is fed */
+	if (!os || nthreads < 1 || os->in_pos) {
+		return -1;
+	}
+
+	pool_free(os->pool);
+	os->pool = NULL;
+
+	/* Axes scaling in opposite directions are not split into strips, nor
+	 * are copies or fixed-point scalers. */
+	if ((os->out_width > os->in_width) != (os->out_height > os->in_height) ||
+		(os->out_width == os->in_width &&
+		os->out_height == os->in_height) || os->fixed || os->half) {
+		return 0;
+	}
+
+	nthreads = min(nthreads, os->out_width / MIN_STRIP_WIDTH);
+	if (nthreads <= 1) {
+		/* cache-sized strips, all run by the caller */
+		nstrips = cache_strips(os);
+		return nstrips > 1 ? pool_init(os, nstrips, 0) : 0;
+	}
+	return pool_init(os, nthreads, nthreads - 1);
+}
+
+int oil_scale_set_fixed_point(struct oil_scale *os)
+{
+	int coeffs_len;
+	struct oil_fixed *f;
+
+	if (!os || os->in_pos || (os->pool && os->pool->num_threads)) {
+		return -1;
+	}
+	if (os->cs != OIL_CS_G && os->cs != OIL_CS_RGB_NOGAMMA &&
+		os->cs != OIL_CS_RGBA_NOGAMMA && os->cs != OIL_CS_RGBX_NOGAMMA) {
+		return -1;
+	}
+	/* only the fused downscale path has a fixed-point version */
+	if (os->out_width > os->in_width || os->out_height > os->in_height ||
+		rows_pass(os->in_height, os->out_height, os->in_width,
+		os->out_width)) {
+		return -1;
+	}
+	if (os->fixed) {
+		return 0;
+	}
+
+	coeffs_len = fixed_coeffs_len(os->borders_x, os->out_width);
+	f = buf_alloc(ALIGN16(sizeof(struct oil_fixed)) +
+		coeffs_len * sizeof(short));
+	if (!f) {
+		return -2;
+	}
+	memset(f, 0, sizeof(struct oil_fixed));
+	f->coeffs_x = (short *)((char *)f + ALIGN16(sizeof(struct oil_fixed)));
+	fixed_coeffs_x(os->coeffs_x, os->borders_x, os->out_width,
+		f->coeffs_x);
+	os->fixed = f;
+	/* fixed point has no strips, cache-sized ones included */
+	pool_free(os->pool);
+	os->pool = NULL;
+	return 0;
+}
+
+int oil_scale_set_half_float(struct oil_scale *os)
+{
+	int size;
+	void *buf, *old, *user;
+	struct oil_plan plan;
+	const struct oil_kernels *k;
+
+	if (!os || os->in_pos || (os->pool && os->pool->num_threads)) {
+		return -1;
+	}
+	/* only the ring buffer and the line-based sums_y are stored as half
+	 * floats, the fused downscale kernels keep their own layout */
+	if (os->out_height <= os->in_height && !down_uses_line(os->in_height,
+		os->out_height, os->in_width, os->out_width)) {
+		return -1;
+	}
+	if (os->half) {
+		return 0;
+	}
+
+	/* The scaler is set up again, in a smaller buffer if it owns one.
+	 * oil_scale_init() shares that with the x-tables & y-coefficient
+	 * window, which are calculated again. */
+	size = half_alloc_size(os->in_height, os->out_height, os->in_width,
+		os->out_width, os->cs);
+	if (os->buf && os->ywin) {
+		size += oil_scale_alloc_size(os->in_height, os->out_height,
+			os->in_width, os->out_width, os->cs) -
+			state_alloc_size(os->in_height, os->out_height,
+			os->in_width, os->out_width, os->cs);
+	}
+	buf = os->buf ? buf_alloc(size) : os->coeffs_x;
+	if (!buf) {
+		return -2;
+	}
+
+	k = os->kernels;
+	old = os->buf;
+	user = os->user_buf;
+	pool_free(os->pool);
+	if (old && !os->ywin) {
+		/* oil_scale_init_plan(): the buffer only holds the state */
+		memset(&plan, 0, sizeof(struct oil_plan));
+		plan.in_height = os->in_height;
+		plan.out_height = os->out_height;
+		plan.in_width = os->in_width;
+		plan.out_width = os->out_width;
+		plan.coeffs_x = os->coeffs_x;
+		plan.borders_x = os->borders_x;
+		plan.coeffs_y = os->coeffs_y;
+		plan.borders_y = os->borders_y;
+		scale_setup(os, &plan, NULL, os->cs, buf, 1);
+	} else {
+		scale_init_allocated(os, os->in_height, os->out_height,
+			os->in_width, os->out_width, os->cs, buf, 1);
+	}
+	buf_free(old);
+	os->buf = old ? buf : NULL;
+	os->user_buf = user;
+	os->kernels = k;
+	return 0;
+}
+
+void oil_scale_restart(struct oil_scale *os)
+{
+	int i;
+	struct oil_strip *st;
+
+	os->in_pos = os->out_pos = 0;
+	os->sums_y_tap = 0;
+	if (os->fixed) {
+		memset(os->fixed->err_y, 0, sizeof(os->fixed->err_y));
+	}
+	if (os->ywin) {
+		ywin_reset(os->ywin);
+	}
+	if (os->out_height > os->in_height) {
+		os->slots_y = 0;
+		return;
+	}
+	if (os->half) {
+		memset(os->half, 0, os->out_width * OIL_CMP(os->cs) * TAPS *
+			sizeof(unsigned short));
+	}
+	if (os->sums_y) {
+		/* downscale: sums_y accumulates partial output across input rows;
+		 * stale state from a prior pass would corrupt the next output. */
+		memset(os->sums_y, 0,
+			os->out_width * OIL_CMP(os->cs) * TAPS * sizeof(float));
+		for (i=0; os->pool && i<os->pool->num_strips; i++) {
+			st = &os->pool->strips[i];
+			memset(st->os.sums_y, 0, st->os.out_width *
+				OIL_CMP(os->cs) * TAPS * sizeof(float));
+		}
+	}
+	os->slots_y = down_border_y(os);
+}
+
+void oil_scale_free(struct oil_scale *os)
+{
+	if (!os) {
+		return;
+	}
+
+	pool_free(os->pool);
+	os->pool = NULL;
+	buf_free(os->fixed);
+	os->fixed = NULL;
+	os->half = NULL;
+	buf_free(os->buf);
+	os->buf = NULL;
+	oil_free(os->user_buf);
+	os->user_buf = NULL;
+	os->coeffs_x = NULL;
+	os->borders_x = NULL;
+	os->coeffs_y = NULL;
+	os->borders_y = NULL;
+	os->ywin = NULL;
+	os->rb = NULL;
+	os->sums_y = NULL;
+}
+
+int oil_scale_slots(struct oil_scale *ys)
+{
+	if (ys->out_height <= ys->in_height) {
+		return ys->slots_y;
+	}
+	if (ys->in_pos) {
+		return ys->slots_y == 0;
+	}
+	if (ys->ywin) {
+		return up_gen_end(&ys->ywin->gen) == 0 ? 1 : 2;
+	}
+	return ys->borders_y[0] == 0 ? 2 : 1;
+}
+
+static float *get_rb_line(struct oil_scale *os, int line)
+{
+	int sl_len;
+	sl_len = OIL_CMP(os->cs) * os->out_width;
+	return os->rb + line * sl_len;
+}
+
+/**
+ * Line of the half-float ring buffer or sums_y of a scaler switched to half
+ * floats.
+ */
+static unsigned short *get_half_line(struct oil_scale *os, int line)
+{
+	return os->half + line * OIL_CMP(os->cs) * os->out_width;
+}
+
+static void scale_down_scalar(struct oil_scale *os, unsigned char *in,
+	float *coeffs_y)
+{
+	switch(os->cs) {
+	case OIL_CS_RGB:
+		scale_down_rgb(in, os->sums_y, os->out_width, os->coeffs_x, os->borders_x, coeffs_y);
+		break;
+	case OIL_CS_G:
+		scale_down_g(in, os->sums_y, os->out_width, os->coeffs_x, os->borders_x, coeffs_y);
+		break;
+	case OIL_CS_CMYK:
+		scale_down_cmyk(in, os->sums_y, os->out_width, os->coeffs_x, os->borders_x, coeffs_y, os->sums_y_tap);
+		break;
+	case OIL_CS_RGBA:
+		scale_down_rgba(in, os->sums_y, os->out_width, os->coeffs_x, os->borders_x, coeffs_y, os->sums_y_tap);
+		break;
+	case OIL_CS_GA:
+		scale_down_ga(in, os->sums_y, os->out_width, os->coeffs_x, os->borders_x, coeffs_y);
+		break;
+	case OIL_CS_ARGB:
+		oil_scale_down_argb(in, os->sums_y, os->out_width, os->coeffs_x, os->borders_x, coeffs_y, os->sums_y_tap);
+		break;
+	case OIL_CS_RGBX:
+		scale_down_rgbx(in, os->sums_y, os->out_width, os->coeffs_x, os->borders_x, coeffs_y, os->sums_y_tap);
+		break;
+	case OIL_CS_RGB_NOGAMMA:
+		scale_down_rgb_nogamma(in, os->sums_y, os->out_width, os->coeffs_x, os->borders_x, coeffs_y, i2f_map);
+		break;
+	case OIL_CS_RGBA_NOGAMMA:
+		scale_down_rgba_nogamma(in, os->sums_y, os->out_width, os->coeffs_x, os->borders_x, coeffs_y, os->sums_y_tap, i2f_map);
+		break;
+	case OIL_CS_RGBX_NOGAMMA:
+		scale_down_rgbx_nogamma(in, os->sums_y, os->out_width, os->coeffs_x, os->borders_x, coeffs_y, os->sums_y_tap, i2f_map);
+		break;
+	case OIL_CS_RGB_GAMMA2:
+		scale_down_rgb_nogamma(in, os->sums_y, os->out_width, os->coeffs_x, os->borders_x, coeffs_y, g2l_map);
+		break;
+	case OIL_CS_RGBA_GAMMA2:
+		scale_down_rgba_nogamma(in, os->sums_y, os->out_width, os->coeffs_x, os->borders_x, coeffs_y, os->sums_y_tap, g2l_map);
+		break;
+	case OIL_CS_RGBX_GAMMA2:
+		scale_down_rgbx_nogamma(in, os->sums_y, os->out_width, os->coeffs_x, os->borders_x, coeffs_y, os->sums_y_tap, g2l_map);
+		break;
+	case OIL_CS_UNKNOWN:
+		break;
+	}
+}
+
+const struct oil_kernels oil_kernels_scalar = {
+	"scalar",
+	scale_down_scalar,
+	yscale_out,
+	oil_xscale_up,
+	yscale_up,
+	scale_down_fixed,
+	yscale_out_fixed,
+};
+
+static float ycoeffs_identity[4] = { 1.0f, 0.0f, 0.0f, 0.0f };
+
+/**
+ * x-scale a scanline into a float line in the format oil_xscale_up() writes.
+ * An unchanged width is only converted. The portable conversion and
+ * x-downscale only run for backends without kernels for them.
+ */
+static void xscale_line(struct oil_scale *os, unsigned char *in, float *out,
+	const struct oil_kernels *k)
+{
+	if (os->out_width > os->in_width) {
+		k->xscale_up(in, os->in_width, out, os->cs, os->coeffs_x,
+			os->borders_x);
+	} else if (os->out_width == os->in_width && k->xscale_convert) {
+		k->xscale_convert(in, os->in_width, out, os->cs);
+	} else if (os->out_width == os->in_width) {
+		xscale_convert(in, os->in_width, out, os->cs);
+	} else if (k->xscale_down) {
+		k->xscale_down(in, down_heavy(os), os->out_width, out, os->cs,
+			os->coeffs_x, os->borders_x);
+	} else {
+		xscale_down(in, os->out_width, out, os->cs, os->coeffs_x,
+			os->borders_x);
+	}
+}
+
+/**
+ * Convert a float line in the format oil_xscale_up() writes to an output
+ * scanline. Backends without a kernel for it run yscale_up() with the line
+ * weighed by 1.
+ */
+static void yscale_line(float *line, int len, unsigned char *out,
+	enum oil_colorspace cs, const struct oil_kernels *k)
+{
+	int i;
+	float *in[4];
+
+	if (k->yscale_line) {
+		k->yscale_line(line, len, out, cs);
+		return;
+	}
+	for (i=0; i<4; i++) {
+		in[i] = line;
+	}
+	k->yscale_up(in, len, ycoeffs_identity, out, cs);
+}
+
+/**
+ * Ingest one scanline into a fixed-point scaler. The y-coefficients are
+ * rounded as rows arrive, carrying the error for each output row, and are
+ * passed to the kernel by slot of sums_y.
+ */
+static void scale_in_fixed(struct oil_scale *os, unsigned char *in,
+	const struct oil_kernels *k)
+{
+	int j, slot;
+	short coeffs[4];
+	float *coeffs_y;
+	struct oil_fixed *f;
+
+	f = os->fixed;
+	coeffs_y = down_coeffs_y(os);
+	for (j=0; j<4; j++) {
+		slot = (os->sums_y_tap + j) & 3;
+		coeffs[slot] = fixed_round(coeffs_y[j], &f->err_y[slot]);
+	}
+	if (k->scale_down_fixed) {
+		k->scale_down_fixed(in, os->out_width, (int *)os->sums_y,
+			os->cs, f->coeffs_x, os->borders_x, coeffs);
+	} else {
+		scale_down_fixed(in, os->out_width, (int *)os->sums_y, os->cs,
+			f->coeffs_x, os->borders_x, coeffs);
+	}
+}
+
+/**
+ * Emit the output row in the current slot of a fixed-point scaler and free the
+ * slot for the next output row.
+ */
+static void scale_out_fixed(struct oil_scale *os, unsigned char *out,
+	const struct oil_kernels *k)
+{
+	if (k->yscale_out_fixed) {
+		k->yscale_out_fixed((int *)os->sums_y, os->out_width, out,
+			os->cs, os->sums_y_tap);
+	} else {
+		yscale_out_fixed((int *)os->sums_y, os->out_width, out, os->cs,
+			os->sums_y_tap);
+	}
+	os->fixed->err_y[os->sums_y_tap] = 0.0f;
+}
+
+/**
+ * Ingest one scanline. The caller has already checked oil_scale_slots().
+ */
+static void scale_in_row(struct oil_scale *os, unsigned char *in,
+	const struct oil_kernels *k)
+{
+	if (os->out_height > os->in_height) {
+		if (os->pool) {
+			pool_run(os->pool, k, JOB_UP_IN, in, NULL,
+				os->in_pos % 4, 0);
+		} else if (os->half) {
+			xscale_line(os, in, os->rb, k);
+			to_half(os->rb, get_half_line(os, os->in_pos % 4),
+				OIL_CMP(os->cs) * os->out_width, k);
+		} else {
+			xscale_line(os, in, get_rb_line(os, os->in_pos % 4), k);
+		}
+		os->in_pos++;
+		os->slots_y = up_border_y(os, os->in_pos - 1);
+	} else {
+		if (os->pool) {
+			pool_run_down_in(os->pool, k, in, 0, 1,
+				down_coeffs_y(os), os->sums_y_tap);
+		} else if (rows_pass(os->in_height, os->out_height,
+			os->in_width, os->out_width)) {
+			if (os->out_width == os->in_width) {
+				copy_row(in, (unsigned char *)os->rb,
+					os->in_width, os->cs);
+			} else {
+				xscale_line(os, in, os->rb, k);
+			}
+		} else if (os->fixed) {
+			scale_in_fixed(os, in, k);
+		} else if (down_planar(os, k)) {
+			scale_in_planar(os, in, down_coeffs_y(os), k);
+		} else if (os->out_width <= os->in_width) {
+			k->scale_down(os, in, down_coeffs_y(os));
+		} else if (os->half) {
+			xscale_line(os, in, os->rb, k);
+			yscale_down_in_rows_half(&os->rb, 1,
+				os->out_width * OIL_CMP(os->cs),
+				down_coeffs_y(os), os->half, os->sums_y_tap, k);
+		} else {
+			xscale_line(os, in, os->rb, k);
+			yscale_down_in(os->rb, os->out_width * OIL_CMP(os->cs),
+				down_coeffs_y(os), os->sums_y, os->sums_y_tap);
+		}
+		os->slots_y -= 1;
+		os->in_pos++;
+	}
+}
+
+/**
+ * Ingest n scanlines, stride bytes apart, into a scaler for which
+ * down_uses_line(). They must all feed the same pending output rows: each is
+ * x-scaled into its own line and the lines are accumulated into sums_y in a
+ * single pass.
+ */
+static void scale_in_line_rows(struct oil_scale *os, unsigned char *in,
+	ptrdiff_t stride, int n, const struct oil_kernels *k)
+{
+	int i, len;
+	float coeffs[DOWN_LINES * 4], *lines[DOWN_LINES];
+
+	len = os->out_width * OIL_CMP(os->cs);
+	for (i=0; i<n; i++) {
+		lines[i] = (float *)((char *)os->rb +
+			ALIGN16(len * sizeof(float)) * i);
+		xscale_line(os, in + i * stride, lines[i], k);
+		memcpy(coeffs + i * 4, down_coeffs_y(os), 4 * sizeof(float));
+		os->in_pos++;
+	}
+	if (os->half) {
+		yscale_down_in_rows_half(lines, n, len, coeffs, os->half,
+			os->sums_y_tap, k);
+	} else {
+		yscale_down_in_rows(lines, n, len, coeffs, os->sums_y,
+			os->sums_y_tap);
+	}
+	os->slots_y -= n;
+}
+
+/**
+ * Ingest n scanlines, stride bytes apart, into a downscaler split into strips.
+ * They must all feed the same pending output rows, so each strip takes all of
+ * them in turn.
+ */
+static void scale_in_strip_rows(struct oil_scale *os, unsigned char *in,
+	ptrdiff_t stride, int n, const struct oil_kernels *k)
+{
+	int i;
+	float coeffs[STRIP_ROWS * 4];
+
+	for (i=0; i<n; i++) {
+		memcpy(coeffs + i * 4, down_coeffs_y(os), 4 * sizeof(float));
+		os->in_pos++;
+	}
+	pool_run_down_in(os->pool, k, in, stride, n, coeffs, os->sums_y_tap);
+	os->slots_y -= n;
+}
+
+/**
+ * The completed output row of a scaler for which down_uses_line() or
+ * down_planar().
+ */
+static float *down_line_out(struct oil_scale *os)
+{
+	return os->sums_y + os->sums_y_tap * os->out_width * OIL_CMP(os->cs);
+}
+
+/**
+ * Clear the line returned by down_line_out() for reuse by the output row 4
+ * rows on.
+ */
+static void down_line_done(struct oil_scale *os)
+{
+	if (os->half) {
+		memset(get_half_line(os, os->sums_y_tap), 0,
+			os->out_width * OIL_CMP(os->cs) *
+			sizeof(unsigned short));
+	} else {
+		memset(down_line_out(os), 0,
+			os->out_width * OIL_CMP(os->cs) * sizeof(float));
+	}
+	os->sums_y_tap = (os->sums_y_tap + 1) & 3;
+}
+
+/* Upscale: columns, in floats, that yscale_up_rows() takes through all of
+ * its output rows at a time. The 4 input lines of a block stay in L1 while
+ * they are. A multiple of the 16 floats the SIMD kernels step by and of both
+ * 3 and 4 channels, so only the last block has a tail.
+ */
+#define UP_ROWS_BLOCK 768
+
+/**
+ * Interpolate one block of columns of 4 ring buffer lines into n output
+ * scanlines, stride bytes apart. Backends without a yscale_up_rows kernel get
+ * their yscale_up kernel run for each row.
+ */
+static void yscale_up_block(float **in, int len, float *coeffs, int n,
+	unsigned char *out, ptrdiff_t stride, enum oil_colorspace cs,
+	const struct oil_kernels *k)
+{
+	int j;
+
+	if (k->yscale_up_rows) {
+		k->yscale_up_rows(in, len, coeffs, n, out, stride, cs);
+		return;
+	}
+	for (j=0; j<n; j++) {
+		k->yscale_up(in, len, coeffs + j * 4, out + j * stride, cs);
+	}
+}
+
+/**
+ * Interpolate the same 4 ring buffer lines into n output scanlines, stride
+ * bytes apart, one block of columns at a time.
+ */
+static void yscale_up_rows(float **in, int len, float *coeffs, int n,
+	unsigned char *out, ptrdiff_t stride, enum oil_colorspace cs,
+	const struct oil_kernels *k)
+{
+	int i, j, blk;
+	float *blk_in[4];
+
+	for (i=0; i<len; i+=UP_ROWS_BLOCK) {
+		blk = min(UP_ROWS_BLOCK, len - i);
+		for (j=0; j<4; j++) {
+			blk_in[j] = in[j] + i;
+		}
+		yscale_up_block(blk_in, blk, coeffs, n, out + i, stride, cs, k);
+	}
+}
+
+/**
+ * yscale_up_rows() from ring buffer lines held as half floats. Each block of
+ * the 4 lines is converted to floats on the stack first.
+ */
+static void yscale_up_rows_half(unsigned short **in, int len, float *coeffs,
+	int n, unsigned char *out, ptrdiff_t stride, enum oil_colorspace cs,
+	const struct oil_kernels *k)
+{
+	int i, j, blk;
+	float tmp[4 * UP_ROWS_BLOCK], *blk_in[4];
+
+	for (i=0; i<len; i+=UP_ROWS_BLOCK) {
+		blk = min(UP_ROWS_BLOCK, len - i);
+		for (j=0; j<4; j++) {
+			blk_in[j] = tmp + j * UP_ROWS_BLOCK;
+			from_half(in[j] + i, blk_in[j], blk, k);
+		}
+		yscale_up_block(blk_in, blk, coeffs, n, out + i, stride, cs, k);
+	}
+}
+
+/**
+ * Upscale: produce the next n output scanlines, all of which must be completed
+ * by the latest input row.
+ */
+static void scale_out_up_rows(struct oil_scale *os, unsigned char *out,
+	ptrdiff_t stride, int n, const struct oil_kernels *k)
+{
+	int i, len;
+	float *in[4];
+	unsigned short *in_half[4];
+
+	len = OIL_CMP(os->cs) * os->out_width;
+	if (os->half) {
+		for (i=0; i<4; i++) {
+			in_half[i] = get_half_line(os, (os->in_pos + i) % 4);
+		}
+		yscale_up_rows_half(in_half, len, up_coeffs_y(os), n, out,
+			stride, os->cs, k);
+	} else {
+		for (i=0; i<4; i++) {
+			in[i] = get_rb_line(os, (os->in_pos + i) % 4);
+		}
+		yscale_up_rows(in, len, up_coeffs_y(os), n, out, stride,
+			os->cs, k);
+	}
+	os->slots_y -= n;
+	os->out_pos += n;
+}
+
+/**
+ * Produce one output scanline. The caller has already checked
+ * oil_scale_slots().
+ */
+static void scale_out_row(struct oil_scale *os, unsigned char *out,
+	const struct oil_kernels *k)
+{
+	int i, sl_len;
+	float *in[4];
+	unsigned short *in_half[4];
+
+	sl_len = OIL_CMP(os->cs) * os->out_width;
+	if (rows_pass(os->in_height, os->out_height, os->in_width,
+		os->out_width) && os->out_width == os->in_width) {
+		memcpy(out, os->rb, sl_len);
+	} else if (rows_pass(os->in_height, os->out_height, os->in_width,
+		os->out_width)) {
+		yscale_line(os->rb, sl_len, out, os->cs, k);
+	} else if (down_uses_line(os->in_height, os->out_height, os->in_width,
+		os->out_width)) {
+		if (os->half) {
+			/* the scanline buffers are free between input rows */
+			from_half(get_half_line(os, os->sums_y_tap), os->rb,
+				sl_len, k);
+		}
+		yscale_line(os->half ? os->rb : down_line_out(os), sl_len, out,
+			os->cs, k);
+		down_line_done(os);
+	} else if (os->out_height <= os->in_height) {
+		if (os->pool) {
+			pool_run(os->pool, k, JOB_DOWN_OUT, out, NULL, 0,
+				os->sums_y_tap);
+		} else if (os->fixed) {
+			scale_out_fixed(os, out, k);
+		} else if (down_planar(os, k)) {
+			scale_out_planar(os, out, k);
+		} else {
+			k->yscale_out(os->sums_y, os->out_width, out, os->cs,
+				os->sums_y_tap);
+		}
+		os->sums_y_tap = (os->sums_y_tap + 1) & 3;
+	} else {
+		if (os->pool) {
+			pool_run(os->pool, k, JOB_UP_OUT, out, up_coeffs_y(os),
+				os->in_pos % 4, 0);
+		} else if (os->half) {
+			for (i=0; i<4; i++) {
+				in_half[i] = get_half_line(os,
+					(os->in_pos + i) % 4);
+			}
+			yscale_up_rows_half(in_half, sl_len, up_coeffs_y(os), 1,
+				out, 0, os->cs, k);
+		} else {
+			for (i=0; i<4; i++) {
+				in[i] = get_rb_line(os, (os->in_pos + i) % 4);
+			}
+			k->yscale_up(in, sl_len, up_coeffs_y(os), out, os->cs);
+		}
+		os->slots_y -= 1;
+	}
+
+	os->out_pos++;
+	if (os->out_height <= os->in_height && os->out_pos < os->out_height) {
+		os->slots_y = down_border_y(os);
+	}
+}
+
+int oil_scale_in_kernels(struct oil_scale *os, unsigned char *in,
+	const struct oil_kernels *k)
+{
+	if (oil_scale_slots(os) == 0) {
 		return -1;
 	}
+	scale_in_row(os, in, k);
+	return 0;
+}
 
-	/* only allow upscaling if both dimensions are being upscaled */
-	if ((out_height > in_height) != (out_width > in_width)) {
+int oil_scale_out_kernels(struct oil_scale *os, unsigned char *out,
+	const struct oil_kernels *k)
+{
+	if (oil_scale_slots(os) != 0) {
 		return -1;
 	}
+	scale_out_row(os, out, k);
+	return 0;
+}
 
-	// Lazy perform global init, in case oil_global_ini() hasn't been
-	// called yet.
-	if (!s2l_map[128]) {
-		oil_global_init();
-	}
+int oil_scale_in_scalar(struct oil_scale *os, unsigned char *in)
+{
+	return oil_scale_in_kernels(os, in, &oil_kernels_scalar);
+}
 
-	memset(os, 0, sizeof(struct oil_scale));
-	os->in_height = in_height;
-	os->out_height = out_height;
-	os->in_width = in_width;
-	os->out_width = out_width;
-	os->cs = cs;
-	os->buf = buf;
+int oil_scale_out_scalar(struct oil_scale *os, unsigned char *out)
+{
+	return oil_scale_out_kernels(os, out, &oil_kernels_scalar);
+}
 
-	if (out_width > in_width) {
-		upscale_init(os);
-	} else {
-		downscale_init(os);
+int oil_scale_in(struct oil_scale *os, unsigned char *in)
+{
+	return oil_scale_in_kernels(os, in, os->kernels);
+}
+
+int oil_scale_out(struct oil_scale *os, unsigned char *out)
+{
+	return oil_scale_out_kernels(os, out, os->kernels);
+}
+
+int oil_scale_in_rows(struct oil_scale *os, unsigned char *base,
+	ptrdiff_t stride, int n)
+{
+	int i, m;
+	const struct oil_kernels *k;
+
+	k = os->kernels;
+	/* A downscaler too wide for L2 is split into cache-sized strips on its
+	 * first batch, see cache_strip_bytes. If they can't be allocated it
+	 * stays whole. Scalers on a caller-provided buffer are only split by
+	 * oil_scale_set_threads(). */
+	if (n > 1 && !os->in_pos && !os->pool && os->buf) {
+		oil_scale_set_threads(os, 1);
 	}
+	for (i=0; i<n && oil_scale_slots(os); i+=m) {
+		m = 1;
+		if (os->pool && os->out_height <= os->in_height) {
+			m = min(min(n - i, os->slots_y), STRIP_ROWS);
+			scale_in_strip_rows(os, base, stride, m, k);
+		} else if (!os->pool && down_uses_line(os->in_height,
+			os->out_height, os->in_width, os->out_width)) {
+			m = min(min(n - i, os->slots_y), DOWN_LINES);
+			scale_in_line_rows(os, base, stride, m, k);
+		} else {
+			scale_in_row(os, base, k);
+		}
+		base += m * stride;
+	}
+	return i;
+}
 
-	return 0;
+int oil_scale_out_rows(struct oil_scale *os, unsigned char *base,
+	ptrdiff_t stride, int n)
+{
+	int i, m;
+	const struct oil_kernels *k;
+
+	k = os->kernels;
+	for (i=0; i<n && os->out_pos < os->out_height &&
+		oil_scale_slots(os) == 0; i+=m) {
+		m = 1;
+		if (os->out_height > os->in_height && !os->pool) {
+			/* every row completed by the latest input in one sweep */
+			m = min(n - i, os->slots_y);
+			scale_out_up_rows(os, base, stride, m, k);
+		} else {
+			scale_out_row(os, base, k);
+		}
+		base += m * stride;
+	}
+	return i;
 }
 
-int oil_scale_init(struct oil_scale *os, int in_height, int out_height,
-	int in_width, int out_width, enum oil_colorspace cs)
+const char *oil_scale_backend(struct oil_scale *os)
 {
-	int alloc_size, ret;
-	void *buf;
+	return os->kernels->name;
+}
 
-	alloc_size = oil_scale_alloc_size(in_height, out_height, in_width,
-		out_width, cs);
-	buf = calloc(1, alloc_size);
-	if (!buf) {
-		return -2;
+int oil_scale_out_discard(struct oil_scale *os)
+{
+	if (oil_scale_slots(os) != 0) {
+		return -1;
 	}
 
-	ret = oil_scale_init_allocated(os, in_height, out_height, in_width,
-		out_width, cs, buf);
-	if (ret) {
-		free(buf);
-		return ret;
+	if (os->out_height <= os->in_height && os->pool) {
+		/* strips scale into their own scanline buffers; a NULL
+		 * destination skips the copy out */
+		pool_run(os->pool, os->kernels, JOB_DOWN_OUT, NULL, NULL, 0,
+			os->sums_y_tap);
+		os->sums_y_tap = (os->sums_y_tap + 1) & 3;
+	} else if (down_uses_line(os->in_height, os->out_height, os->in_width,
+		os->out_width)) {
+		down_line_done(os);
+	} else if (rows_pass(os->in_height, os->out_height, os->in_width,
+		os->out_width)) {
+		/* nothing is carried from one row to the next */
+	} else if (os->fixed) {
+		int sl_len = os->out_width * OIL_CMP(os->cs);
+		unsigned char tmp[sl_len];
+		scale_out_fixed(os, tmp, os->kernels);
+		os->sums_y_tap = (os->sums_y_tap + 1) & 3;
+	} else if (down_planar(os, os->kernels)) {
+		down_line_done(os);
+	} else if (os->out_height <= os->in_height) {
+		/* Use yscale_out to shift the sums_y accumulators, discarding
+		 * the output pixels. This avoids needing layout-specific shift
+		 * logic for each colorspace's sums_y memory layout. */
+		int sl_len = os->out_width * OIL_CMP(os->cs);
+		unsigned char tmp[sl_len];
+		os->kernels->yscale_out(os->sums_y, os->out_width, tmp, os->cs,
+			os->sums_y_tap);
+		os->sums_y_tap = (os->sums_y_tap + 1) & 3;
+	} else {
+		os->slots_y -= 1;
 	}
 
+	os->out_pos++;
+	if (os->out_height <= os->in_height && os->out_pos < os->out_height) {
+		os->slots_y = down_border_y(os);
+	}
 	return 0;
 }
 
-void oil_scale_restart(struct oil_scale *os)
+/* Whole-image scaling */
+
+/**
+ * Fast-forward a freshly initialized scaler so that out_row is the next
+ * output scanline it can produce exactly, skipping input scanlines that
+ * cannot contribute to it.
+ *
+ * The scaler is placed a few output rows early: up to 3 rows before out_row
+ * on downscale (sums_y holds 4 taps) and 3 input rows before the one that
+ * completes out_row on upscale (the ring buffer holds 4 lines). Output rows
+ * before out_row are incomplete and must be discarded by the caller. Every
+ * row from out_row on sees the same inputs, in the same order, as a scaler
+ * started from the top, so its output is bit-identical.
+ *
+ * The scaler must take its y-tables from a plan.
+ *
+ * Returns the index of the next input scanline to feed.
+ */
+static int scale_seek(struct oil_scale *os, int out_row)
 {
-	os->in_pos = os->out_pos = 0;
-	os->sums_y_tap = 0;
+	int i, start_out, start_in, outputs;
+
+	if (rows_pass(os->in_height, os->out_height, os->in_width,
+		os->out_width)) {
+		os->in_pos = os->out_pos = out_row;
+		os->slots_y = 1;
+		return out_row;
+	}
+
 	if (os->out_height <= os->in_height) {
-		/* downscale: sums_y accumulates partial output across input rows;
-		 * stale state from a prior pass would corrupt the next output. */
-		memset(os->sums_y, 0,
-			os->out_width * OIL_CMP(os->cs) * TAPS * sizeof(float));
-		os->slots_y = os->borders_y[0];
-	} else {
-		os->slots_y = 0;
+		start_out = max(out_row - 3, 0);
+		start_in = 0;
+		for (i=0; i<start_out; i++) {
+			start_in += os->borders_y[i];
+		}
+		os->in_pos = start_in;
+		os->out_pos = start_out;
+		os->sums_y_tap = start_out & 3;
+		os->slots_y = os->borders_y[start_out];
+		return start_in;
 	}
-}
 
-void oil_scale_free(struct oil_scale *os)
-{
-	if (!os) {
-		return;
+	/* find the input row that completes out_row */
+	outputs = 0;
+	for (i=0; i<os->in_height - 1; i++) {
+		if (outputs + os->borders_y[i] > out_row) {
+			break;
+		}
+		outputs += os->borders_y[i];
+	}
+	start_in = i - 3;
+	if (start_in < 1) {
+		return 0;
 	}
 
-	free(os->buf);
-	os->buf = NULL;
-	os->coeffs_x = NULL;
-	os->borders_x = NULL;
-	os->coeffs_y = NULL;
-	os->borders_y = NULL;
-	os->rb = NULL;
-	os->sums_y = NULL;
-	os->tmp_coeffs = NULL;
+	outputs = 0;
+	for (i=0; i<start_in; i++) {
+		outputs += os->borders_y[i];
+	}
+	os->in_pos = start_in;
+	os->out_pos = outputs;
+	os->slots_y = 0;
+	return start_in;
 }
 
-int oil_scale_slots(struct oil_scale *ys)
+struct scale_band {
+	unsigned char *src;
+	ptrdiff_t src_stride;
+	unsigned char *dst;
+	ptrdiff_t dst_stride;
+	const struct oil_plan *plan; // coefficients shared by all bands.
+	enum oil_colorspace cs;
+	int out_start, out_end; // output rows [out_start, out_end) of the band.
+	int ret;
+};
+
+static void *scale_band(void *arg)
 {
-	if (ys->out_height <= ys->in_height) {
-		return ys->slots_y;
+	struct scale_band *b;
+	struct oil_scale os;
+	int in_row, out_row;
+
+	b = arg;
+	b->ret = oil_scale_init_plan(&os, b->plan, b->cs);
+	if (b->ret) {
+		return NULL;
 	}
-	if (ys->in_pos) {
-		return ys->slots_y == 0;
+
+	in_row = scale_seek(&os, b->out_start);
+	while (os.out_pos < b->out_start) {
+		in_row += oil_scale_in_rows(&os, b->src + in_row * b->src_stride,
+			b->src_stride, os.in_height - in_row);
+		oil_scale_out_discard(&os);
 	}
-	return ys->borders_y[0] == 0 ? 2 : 1;
-}
 
-static float *get_rb_line(struct oil_scale *os, int line)
-{
-	int sl_len;
-	sl_len = OIL_CMP(os->cs) * os->out_width;
-	return os->rb + line * sl_len;
+	out_row = b->out_start;
+	while (out_row < b->out_end) {
+		in_row += oil_scale_in_rows(&os, b->src + in_row * b->src_stride,
+			b->src_stride, os.in_height - in_row);
+		out_row += oil_scale_out_rows(&os,
+			b->dst + out_row * b->dst_stride, b->dst_stride,
+			b->out_end - out_row);
+	}
+
+	oil_scale_free(&os);
+	return NULL;
 }
 
-static void down_scale_in(struct oil_scale *os, unsigned char *in)
+int oil_scale_image(unsigned char *src, ptrdiff_t src_stride,
+	unsigned char *dst, ptrdiff_t dst_stride, int in_width, int in_height,
+	int out_width, int out_height, enum oil_colorspace cs, int nthreads)
 {
-	float *coeffs_y;
+	int i, ret;
+	struct oil_plan plan;
+	struct scale_band *bands;
+	pthread_t *threads;
+	char *started;
+
+	if (!src || !dst || nthreads < 1) {
+		return -1;
+	}
+	if (in_width == out_width && in_height == out_height &&
+		!check_dimensions(in_height, out_height, in_width, out_width)) {
+		/* a copy is bound by memory bandwidth, so it runs here */
+		for (i=0; i<out_height; i++) {
+			copy_row(src + i * src_stride, dst + i * dst_stride,
+				out_width, cs);
+		}
+		return 0;
+	}
+	ret = oil_plan_init(&plan, in_height, out_height, in_width, out_width);
+	if (ret) {
+		return ret;
+	}
+	if (nthreads > out_height) {
+		nthreads = out_height;
+	}
 
-	coeffs_y = os->coeffs_y + os->in_pos * 4;
+	bands = buf_alloc_zeroed(nthreads * sizeof(struct scale_band));
+	threads = buf_alloc(nthreads * sizeof(pthread_t));
+	started = buf_alloc_zeroed(nthreads);
+	if (!bands || !threads || !started) {
+		buf_free(bands);
+		buf_free(threads);
+		buf_free(started);
+		oil_plan_free(&plan);
+		return -2;
+	}
 
-	switch(os->cs) {
-	case OIL_CS_RGB:
-		scale_down_rgb(in, os->sums_y, os->out_width, os->coeffs_x, os->borders_x, coeffs_y);
-		break;
-	case OIL_CS_G:
-		scale_down_g(in, os->sums_y, os->out_width, os->coeffs_x, os->borders_x, coeffs_y);
-		break;
-	case OIL_CS_CMYK:
-		scale_down_cmyk(in, os->sums_y, os->out_width, os->coeffs_x, os->borders_x, coeffs_y, os->sums_y_tap);
-		break;
-	case OIL_CS_RGBA:
-		scale_down_rgba(in, os->sums_y, os->out_width, os->coeffs_x, os->borders_x, coeffs_y, os->sums_y_tap);
-		break;
-	case OIL_CS_GA:
-		scale_down_ga(in, os->sums_y, os->out_width, os->coeffs_x, os->borders_x, coeffs_y);
-		break;
-	case OIL_CS_ARGB:
-		oil_scale_down_argb(in, os->sums_y, os->out_width, os->coeffs_x, os->borders_x, coeffs_y, os->sums_y_tap);
-		break;
-	case OIL_CS_RGBX:
-		scale_down_rgbx(in, os->sums_y, os->out_width, os->coeffs_x, os->borders_x, coeffs_y, os->sums_y_tap);
-		break;
-	case OIL_CS_RGB_NOGAMMA:
-		scale_down_rgb_nogamma(in, os->sums_y, os->out_width, os->coeffs_x, os->borders_x, coeffs_y);
-		break;
-	case OIL_CS_RGBA_NOGAMMA:
-		scale_down_rgba_nogamma(in, os->sums_y, os->out_width, os->coeffs_x, os->borders_x, coeffs_y, os->sums_y_tap);
-		break;
-	case OIL_CS_RGBX_NOGAMMA:
-		scale_down_rgbx_nogamma(in, os->sums_y, os->out_width, os->coeffs_x, os->borders_x, coeffs_y, os->sums_y_tap);
-		break;
-	case OIL_CS_UNKNOWN:
-		break;
+	for (i=0; i<nthreads; i++) {
+		bands[i].src = src;
+		bands[i].src_stride = src_stride;
+		bands[i].dst = dst;
+		bands[i].dst_stride = dst_stride;
+		bands[i].plan = &plan;
+		bands[i].cs = cs;
+		bands[i].out_start = (long long)out_height * i / nthreads;
+		bands[i].out_end = (long long)out_height * (i + 1) / nthreads;
+	}
+
+	/* The calling thread takes the first band. Bands whose thread can't be
+	 * started are run here too. */
+	for (i=1; i<nthreads; i++) {
+		started[i] = pthread_create(&threads[i], NULL, scale_band,
+			&bands[i]) == 0;
+	}
+	scale_band(&bands[0]);
+
+	ret = bands[0].ret;
+	for (i=1; i<nthreads; i++) {
+		if (started[i]) {
+			pthread_join(threads[i], NULL);
+		} else {
+			scale_band(&bands[i]);
+		}
+		if (bands[i].ret) {
+			ret = bands[i].ret;
+		}
 	}
 
-	os->slots_y -= 1;
-	os->in_pos++;
+	buf_free(bands);
+	buf_free(threads);
+	buf_free(started);
+	oil_plan_free(&plan);
+	return ret;
 }
 
-static void up_scale_in(struct oil_scale *os, unsigned char *in)
+/* Autotuning */
+
+/* Variants are timed in turns, TUNE_REPS times each, and the fastest run of
+ * each is compared. Taking turns keeps clock speed changes from favouring
+ * one of them.
+ */
+#define TUNE_REPS 5
+
+static double tune_now(void)
 {
-	float *tmp;
+	struct timespec ts;
 
-	tmp = get_rb_line(os, os->in_pos % 4);
-	oil_xscale_up(in, os->in_width, tmp, os->cs, os->coeffs_x, os->borders_x);
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
 
-	os->in_pos++;
-	os->slots_y = os->borders_y[os->in_pos - 1];
+static double tune_min(double best, double t)
+{
+	return best < 0 || t < best ? t : best;
 }
 
-int oil_scale_in(struct oil_scale *os, unsigned char *in)
+/**
+ * Seconds taken by a scaler with the given crossover points, fed in_height
+ * copies of the scanline in as a batch, so that it is split into cache strips
+ * where it is wide enough. Scaler setup isn't timed. Returns -1 if the scaler
+ * can't be set up.
+ */
+static double tune_scale(unsigned char *in, unsigned char *out, int in_width,
+	int in_height, int out_width, int out_height, enum oil_colorspace cs,
+	int heavy, int planar)
 {
-	if (oil_scale_slots(os) == 0) {
+	struct oil_scale os;
+	int in_pos, out_pos;
+	double start, t;
+
+	if (oil_scale_init(&os, in_height, out_height, in_width, out_width,
+		cs)) {
 		return -1;
 	}
-	if (os->out_width > os->in_width) {
-		up_scale_in(os, in);
-	} else {
-		down_scale_in(os, in);
+	os.heavy_ratio = heavy;
+	os.planar_len = planar;
+	start = tune_now();
+	in_pos = out_pos = 0;
+	while (out_pos < out_height) {
+		in_pos += oil_scale_in_rows(&os, in, 0, in_height - in_pos);
+		out_pos += oil_scale_out_rows(&os, out, 0,
+			out_height - out_pos);
 	}
-	return 0;
+	t = tune_now() - start;
+	oil_scale_free(&os);
+	return t;
 }
 
-int oil_scale_out(struct oil_scale *os, unsigned char *out)
+/**
+ * Smallest ratio from which on G downscales to narrow and to wide outputs are
+ * faster with the heavy x-pass kernels, or INT_MAX if they never are. Each
+ * ratio is timed with a crossover that forces either kernel.
+ */
+static int tune_heavy(unsigned char *in, unsigned char *out)
 {
-	int i, sl_len;
-	float *in[4];
+	static const int ratios[] = { 2, 3, 4, 5, 6, 8, 12, 16 };
+	static const int widths[] = { 128, 1024 };
+	int i, j, r, ratio;
+	double t, plain, heavy, plain_w, heavy_w;
+
+	ratio = INT_MAX;
+	for (i=sizeof(ratios)/sizeof(ratios[0]) - 1; i>=0; i--) {
+		plain = heavy = 0;
+		for (j=0; j<(int)(sizeof(widths)/sizeof(widths[0])); j++) {
+			plain_w = heavy_w = -1;
+			for (r=0; r<TUNE_REPS; r++) {
+				t = tune_scale(in, out, widths[j] * ratios[i],
+					128, widths[j], 32, OIL_CS_G, INT_MAX,
+					OIL_PLANAR_LEN);
+				if (t < 0) {
+					return -2;
+				}
+				plain_w = tune_min(plain_w, t);
+				t = tune_scale(in, out, widths[j] * ratios[i],
+					128, widths[j], 32, OIL_CS_G, 1,
+					OIL_PLANAR_LEN);
+				if (t < 0) {
+					return -2;
+				}
+				heavy_w = tune_min(heavy_w, t);
+			}
+			plain += plain_w;
+			heavy += heavy_w;
+		}
+		if (heavy >= plain) {
+			break;
+		}
+		ratio = ratios[i];
+	}
+	return ratio;
+}
 
-	if (oil_scale_slots(os) != 0) {
-		return -1;
+/**
+ * Smallest scanline length, in floats, from which on 2:1 G and GA downscales
+ * are faster with a planar sums_y, or INT_MAX if they never are. The current
+ * value is kept if the backend has no planar kernels.
+ */
+static int tune_planar(unsigned char *in, unsigned char *out)
+{
+	static const enum oil_colorspace spaces[] = { OIL_CS_G, OIL_CS_GA };
+	int i, j, r, len, best, width;
+	double t, fused, planar, best_t[2];
+
+	if (!default_kernels->scale_down_planar) {
+		return planar_len;
 	}
 
-	if (os->out_height <= os->in_height) {
-		yscale_out(os->sums_y, os->out_width, out, os->cs, os->sums_y_tap);
-		os->sums_y_tap = (os->sums_y_tap + 1) & 3;
-	} else {
-		sl_len = OIL_CMP(os->cs) * os->out_width;
+	best = INT_MAX;
+	for (len=32768; len>=1024; len/=2) {
+		fused = planar = 0;
+		for (j=0; j<2; j++) {
+			width = len / OIL_CMP(spaces[j]);
+			best_t[0] = best_t[1] = -1;
+			for (r=0; r<TUNE_REPS; r++) {
+				for (i=0; i<2; i++) {
+					t = tune_scale(in, out, width * 2, 32,
+						width, 16, spaces[j],
+						OIL_HEAVY_RATIO,
+						i ? 1 : INT_MAX);
+					if (t < 0) {
+						return -2;
+					}
+					best_t[i] = tune_min(best_t[i], t);
+				}
+			}
+			fused += best_t[0];
+			planar += best_t[1];
+		}
+		if (planar >= fused) {
+			break;
+		}
+		best = len;
+	}
+	return best;
+}
+
+/**
+ * Width of the RGB downscale that tune_strips() times: sums_y is about 4
+ * times the largest cache strip it tries, of 2 * base bytes.
+ */
+static int tune_strips_width(long base)
+{
+	long width;
+
+	width = 8 * base / (TAPS * 3 * sizeof(float));
+	return width < MAX_DIMENSION / 2 ? width : MAX_DIMENSION / 2;
+}
+
+/**
+ * Fastest of a quarter, a half, once and twice base bytes of sums_y per
+ * cache strip, for a 2:1 RGB downscale that is too wide for any of them.
+ */
+static long tune_strips(unsigned char *in, unsigned char *out, long base)
+{
+	int i, r, width;
+	double t, best_t[4];
+
+	width = tune_strips_width(base);
+	for (i=0; i<4; i++) {
+		best_t[i] = -1;
+	}
+	for (r=0; r<TUNE_REPS; r++) {
 		for (i=0; i<4; i++) {
-			in[i] = get_rb_line(os, (os->in_pos + i) % 4);
+			cache_strip_bytes = (base << i) / 4;
+			t = tune_scale(in, out, width * 2, 16, width, 8,
+				OIL_CS_RGB, OIL_HEAVY_RATIO, OIL_PLANAR_LEN);
+			if (t < 0) {
+				return -2;
+			}
+			best_t[i] = tune_min(best_t[i], t);
 		}
-		yscale_up(in, sl_len, os->coeffs_y + os->out_pos * 4, out,
-			os->cs);
-		os->slots_y -= 1;
 	}
 
-	os->out_pos++;
-	if (os->out_height <= os->in_height && os->out_pos < os->out_height) {
-		os->slots_y = os->borders_y[os->out_pos];
+	/* stay with base unless another size is clearly faster */
+	r = 2;
+	for (i=0; i<4; i++) {
+		if (best_t[i] < best_t[r] * 0.95) {
+			r = i;
+		}
 	}
-	return 0;
+	return (base << r) / 4;
 }
 
-int oil_scale_out_discard(struct oil_scale *os)
+int oil_autotune(const char *path)
 {
-	if (oil_scale_slots(os) != 0) {
-		return -1;
+	unsigned char *in, *out;
+	size_t len;
+	long base, strip;
+	int i, heavy, planar;
+
+	if (!s2l_map[128]) {
+		oil_global_init();
 	}
 
-	if (os->out_height <= os->in_height) {
-		/* Use yscale_out to shift the sums_y accumulators, discarding
-		 * the output pixels. This avoids needing layout-specific shift
-		 * logic for each colorspace's sums_y memory layout. */
-		int sl_len = os->out_width * OIL_CMP(os->cs);
-		unsigned char tmp[sl_len];
-		yscale_out(os->sums_y, os->out_width, tmp, os->cs, os->sums_y_tap);
-		os->sums_y_tap = (os->sums_y_tap + 1) & 3;
-	} else {
-		os->slots_y -= 1;
+	/* time strips around the probed size, not a previously tuned one */
+	probe_cache();
+	base = cache_strip_bytes;
+
+	len = max(tune_strips_width(base) * 2 * 3, 32768 * 2);
+	in = buf_alloc(len);
+	out = buf_alloc(len);
+	if (!in || !out) {
+		buf_free(in);
+		buf_free(out);
+		return -2;
+	}
+	for (i=0; i<(int)len; i++) {
+		in[i] = (i * 2654435761u) >> 24;
 	}
 
-	os->out_pos++;
-	if (os->out_height <= os->in_height && os->out_pos < os->out_height) {
-		os->slots_y = os->borders_y[os->out_pos];
+	heavy = tune_heavy(in, out);
+	planar = tune_planar(in, out);
+	strip = tune_strips(in, out, base);
+	cache_strip_bytes = base;
+	buf_free(in);
+	buf_free(out);
+	if (heavy < 0 || planar < 0 || strip < 0) {
+		return -2;
+	}
+
+	heavy_ratio = heavy;
+	planar_len = planar;
+	cache_strip_bytes = strip;
+	if (path) {
+		return save_tuning(path);
 	}
 	return 0;
 }
@@ -26,6 +26,8 @@
 #define OIL_VERSION_MINOR 2
 #define OIL_VERSION_PATCH 0
 
+#include <stddef.h>
+
 /**
  * Color spaces currently supported by oil.
  */
@@ -62,6 +64,16 @@ enum oil_colorspace {
 
 	// RGBX without sRGB linearization - 4 bytes per pixel, 4th byte ignored
 	OIL_CS_RGBX_NOGAMMA = 0x0704,
+
+	// RGB with gamma 2.0 standing in for sRGB - samples are squared on input
+	// and square-rooted on output, close to sRGB at NOGAMMA speed
+	OIL_CS_RGB_GAMMA2   = 0x0803,
+
+	// RGBA with gamma 2.0 - premultiplied alpha, like OIL_CS_RGB_GAMMA2
+	OIL_CS_RGBA_GAMMA2  = 0x0904,
+
+	// RGBX with gamma 2.0 - 4 bytes per pixel, 4th byte ignored
+	OIL_CS_RGBX_GAMMA2  = 0x0A04,
 };
 
 /**
@@ -69,6 +81,12 @@ enum oil_colorspace {
  */
 #define OIL_CMP(x) ((x)&0xFF)
 
+struct oil_kernels;
+struct oil_pool;
+struct oil_axis;
+struct oil_ywin;
+struct oil_fixed;
+
 /**
  * Struct to hold state for scaling. Changing these will produce unpredictable
  * results.
@@ -81,26 +99,135 @@ struct oil_scale {
 	enum oil_colorspace cs; // color space of input & output.
 	int in_pos; // current row of input image.
 	int out_pos; // current row of output image.
-	float *coeffs_y; // buffer for holding temporary y-coefficients.
+	float *coeffs_y; // y-coefficients from a plan, or NULL.
 	float *coeffs_x; // buffer for holding precalculated coefficients.
 	int *borders_x; // holds precalculated coefficient rotation points.
-	int *borders_y; // coefficient rotation points for y-scaling.
+	int *borders_y; // coefficient rotation points for y-scaling, or NULL.
+	struct oil_ywin *ywin; // y-coefficients calculated as rows advance.
 	float *sums_y; // buffer of intermediate sums for y-scaling.
-	float *rb; // ring buffer holding scanlines.
-	float *tmp_coeffs; // temporary buffer for calculating coeffs.
-	void *buf; // single backing allocation for all buffers above.
+	float *rb; // ring buffer holding scanlines, or one when only x upscales.
+	void *buf; // allocation owned by the scaler, NULL if caller-provided.
+	void *user_buf; // buffer from oil_scale_init_allocated(), or NULL.
 	int sums_y_tap; // ring buffer offset for sums_y (0-3).
 	int slots_y; // live countdown into the current borders_y entry.
+	const struct oil_kernels *kernels; // SIMD backend picked at init.
+	int heavy_ratio; // width ratio from which on heavy x-pass kernels run.
+	int planar_len; // scanline floats from which on sums_y may be planar.
+	struct oil_pool *pool; // column-split workers, if any.
+	struct oil_fixed *fixed; // fixed-point tables, if enabled.
+	unsigned short *half; // half-float ring buffer or sums_y, if enabled.
+};
+
+/**
+ * Memory allocation hooks. alloc returns at least size bytes, aligned for any
+ * type, or NULL on failure. free releases memory returned by alloc. ctx is
+ * passed through to both.
+ */
+struct oil_allocator {
+	void *(*alloc)(void *ctx, size_t size);
+	void (*free)(void *ctx, void *ptr);
+	void *ctx;
 };
 
 /**
- * Initialize static, pre-calculated tables. This only needs to be called once.
- * A call to oil_scale_init() will initialize these tables if not already done,
- * so explicityly calling oil_global_init() is only needed if there are
+ * Read-only coefficient tables for one scaling geometry. A plan does not
+ * depend on the color space and can be shared by any number of scalers,
+ * including scalers running concurrently on different threads.
+ */
+struct oil_plan {
+	int in_height; // input image height.
+	int out_height; // output image height.
+	int in_width; // input image width.
+	int out_width; // output image width.
+	float *coeffs_x; // precalculated x-coefficients.
+	int *borders_x; // coefficient rotation points for x-scaling.
+	float *coeffs_y; // precalculated y-coefficients.
+	int *borders_y; // coefficient rotation points for y-scaling.
+	void *buf; // single backing allocation for the tables above.
+	struct oil_axis *axis_x; // cached x-tables, if from the cache.
+	struct oil_axis *axis_y; // cached y-tables, if from the cache.
+};
+
+/**
+ * Initialize static, pre-calculated tables and probe the CPU for the fastest
+ * available SIMD backend. This only needs to be called once. A call to
+ * oil_scale_init() will initialize these tables if not already done, so
+ * explicityly calling oil_global_init() is only needed if there are
  * concurrency concerns.
+ *
+ * The OIL_BACKEND environment variable overrides the backend chosen for new
+ * scalers. Recognized values are "scalar", "vec", "sse2",
+ * "sse41", "avx2" and "neon"; names
+ * not supported by the current CPU are ignored.
+ *
+ * The first call loads the crossover points between kernel variants from the
+ * file named by the OIL_TUNE_FILE environment variable, if set, see
+ * oil_autotune(). Later calls keep the crossover points in effect.
  */
 void oil_global_init(void);
 
+/**
+ * Time the kernel variants of the default backend on synthetic scanlines and
+ * use the fastest for scalers initialized afterwards. This picks the
+ * downscale ratio from which greyscale switches to kernels that spread wide
+ * pixels over several accumulators, the scanline length from which G and GA
+ * downscales keep their sums planar, and the size of the strips that wide
+ * single-threaded downscales are split into to stay in cache. Takes about a
+ * second. Must not be called while other threads use liboil.
+ * @path: File to store the results in, so that oil_autotune_load() or the
+ *   OIL_TUNE_FILE environment variable can apply them in later processes,
+ *   or NULL.
+ *
+ * Returns 0 on success.
+ * Returns -1 if path can't be written. The results are still applied.
+ * Returns -2 if unable to allocate memory.
+ */
+int oil_autotune(const char *path);
+
+/**
+ * Apply results stored by oil_autotune(). Must not be called while other
+ * threads use liboil.
+ * @path: File written by oil_autotune().
+ *
+ * Returns 0 on success.
+ * Returns -1 if path can't be read, is malformed, or was measured with a
+ * different backend than the default one. Nothing is applied then.
+ */
+int oil_autotune_load(const char *path);
+
+/**
+ * Route all of liboil's allocations, including those of the libjpeg & libpng
+ * wrappers, through the given hooks. Pass NULL to restore malloc() & free().
+ * Must not be called while any scaler, plan or cached table is alive.
+ * @allocator: Pointer to the hooks, which are copied.
+ */
+void oil_set_allocator(const struct oil_allocator *allocator);
+
+/**
+ * Allocate memory through the current allocator hooks.
+ * @size: Number of bytes to allocate.
+ *
+ * Returns a pointer to uninitialized memory, or NULL on failure.
+ */
+void *oil_alloc(size_t size);
+
+/**
+ * Free memory returned by oil_alloc(). NULL is ignored.
+ * @ptr: Pointer to the memory to free.
+ */
+void oil_free(void *ptr);
+
+/**
+ * Keep buffers released by scalers, plans and worker pools for reuse by later
+ * jobs instead of returning them to the allocator. While the pool is enabled,
+ * buffers are allocated and recycled in power-of-two size classes, and
+ * recycled buffers are only zeroed where the scaler needs zeroes. Disabled by
+ * default, in which case buffers take only the size they need.
+ * @max_bytes: Upper bound on the memory held by idle buffers. 0 disables the
+ *   pool and releases everything it holds.
+ */
+void oil_set_buffer_pool(size_t max_bytes);
+
 /**
  * Calculate the buffer size needed for an oil scaler struct.
  * @in_height: Height, in pixels, of the input image.
@@ -122,7 +249,10 @@ int oil_scale_alloc_size(int in_height, int out_height, int in_width,
  * @in_width: Width, in pixels, of the input image.
  * @out_width: Width, in pixels, of the output image.
  * @cs: Color space of the input/output images.
- * @buf: Pre-allocated buffer for internal use.
+ * @buf: Pre-allocated buffer of at least oil_scale_alloc_size() bytes for
+ *   internal use. It does not need to be zeroed. oil_scale_free() releases
+ *   it with oil_free(), so it must come from oil_alloc(), or from malloc()
+ *   while no custom allocator is installed.
  *
  * Returns 0 on success.
  * Returns -1 if an argument is bad.
@@ -147,6 +277,69 @@ int oil_scale_init_allocated(struct oil_scale *os, int in_height,
 int oil_scale_init(struct oil_scale *os, int in_height, int out_height,
 	int in_width, int out_width, enum oil_colorspace cs);
 
+/**
+ * Calculate the coefficient tables for a scaling geometry.
+ * @plan: Pointer to the plan struct to be initialized.
+ * @in_height: Height, in pixels, of the input image.
+ * @out_height: Height, in pixels, of the output image.
+ * @in_width: Width, in pixels, of the input image.
+ * @out_width: Width, in pixels, of the output image.
+ *
+ * Returns 0 on success.
+ * Returns -1 if an argument is bad.
+ * Returns -2 if unable to allocate memory.
+ */
+int oil_plan_init(struct oil_plan *plan, int in_height, int out_height,
+	int in_width, int out_width);
+
+/**
+ * Free the tables of a plan. Every scaler initialized from the plan must be
+ * freed first.
+ * @plan: Pointer to the plan struct to be freed.
+ */
+void oil_plan_free(struct oil_plan *plan);
+
+/**
+ * Like oil_plan_init(), but takes the tables from a process-wide cache. The x
+ * and y tables are cached separately, keyed by their (in, out) sizes, so a
+ * plan whose axes have the same sizes uses one table for both. Looking up
+ * tables that are already cached does not take a lock. The cache keeps a few
+ * dozen tables and evicts the least recently used. Tables stay valid until
+ * every plan using them is freed, even if they are evicted.
+ * @plan: Pointer to the plan struct to be initialized.
+ * @in_height: Height, in pixels, of the input image.
+ * @out_height: Height, in pixels, of the output image.
+ * @in_width: Width, in pixels, of the input image.
+ * @out_width: Width, in pixels, of the output image.
+ *
+ * Returns 0 on success.
+ * Returns -1 if an argument is bad.
+ * Returns -2 if unable to allocate memory.
+ */
+int oil_plan_init_cached(struct oil_plan *plan, int in_height,
+	int out_height, int in_width, int out_width);
+
+/**
+ * Drop every table held by the coefficient cache. Plans that still use cached
+ * tables keep them until they are freed.
+ */
+void oil_plan_cache_clear(void);
+
+/**
+ * Initialize an oil scaler struct that uses the coefficient tables of a plan.
+ * Only the scaler's own accumulator or ring buffer is allocated. The plan is
+ * not modified and must outlive the scaler.
+ * @os: Pointer to the scaler struct to be initialized.
+ * @plan: Pointer to an initialized plan.
+ * @cs: Color space of the input/output images.
+ *
+ * Returns 0 on success.
+ * Returns -1 if an argument is bad.
+ * Returns -2 if unable to allocate memory.
+ */
+int oil_scale_init_plan(struct oil_scale *os, const struct oil_plan *plan,
+	enum oil_colorspace cs);
+
 /**
  * Reset rows counters in an oil scaler struct.
  * @os: Pointer to the scaler struct to be reseted.
@@ -170,7 +363,8 @@ void oil_scale_free(struct oil_scale *os);
 int oil_scale_slots(struct oil_scale *os);
 
 /**
- * Ingest & buffer an input scanline. Input is unsigned chars.
+ * Ingest & buffer an input scanline. Input is unsigned chars. Uses the backend
+ * selected when the scaler was initialized.
  * @os: Pointer to the scaler struct.
  * @in: Pointer to the input buffer containing a scanline.
  *
@@ -182,7 +376,7 @@ int oil_scale_in(struct oil_scale *os, unsigned char *in);
 
 /**
  * Scale previously ingested & buffered contents to produce the next scaled output
- * scanline.
+ * scanline. Uses the backend selected when the scaler was initialized.
  * @os: Pointer to the scaler struct.
  * @out: Pointer to the buffer where the output scanline will be written.
  *
@@ -191,6 +385,163 @@ int oil_scale_in(struct oil_scale *os, unsigned char *in);
  */
 int oil_scale_out(struct oil_scale *os, unsigned char *out);
 
+/**
+ * Ingest up to n input scanlines, stopping early once an output scanline is
+ * ready.
+ * @os: Pointer to the scaler struct.
+ * @base: Pointer to the first input scanline.
+ * @stride: Distance in bytes from one input scanline to the next. May be
+ *   negative for bottom-up images.
+ * @n: Maximum number of scanlines to ingest.
+ *
+ * When the height shrinks while the width grows, scanlines are accumulated a
+ * few at a time, so passing an n of more than one is faster than one call per
+ * scanline. Downscalers that shrink both axes x-scale and accumulate each
+ * scanline in a single fused pass either way. A downscaler whose intermediate rows don't fit in half of L2 is
+ * split into column strips on its first call with an n of more than one, and
+ * each strip is then taken through a batch of scanlines before the next one.
+ * Scalers initialized with oil_scale_init_allocated() are only split by
+ * oil_scale_set_threads().
+ *
+ * Returns the number of scanlines ingested, which is 0 if an output scanline
+ * must be consumed first.
+ */
+int oil_scale_in_rows(struct oil_scale *os, unsigned char *base,
+	ptrdiff_t stride, int n);
+
+/**
+ * Produce up to n output scanlines, stopping early once more input is needed
+ * or the last output scanline has been produced.
+ * @os: Pointer to the scaler struct.
+ * @base: Pointer to where the first output scanline will be written.
+ * @stride: Distance in bytes from one output scanline to the next. May be
+ *   negative for bottom-up images.
+ * @n: Maximum number of scanlines to produce.
+ *
+ * When upscaling, all the scanlines that the latest input scanline completes
+ * are produced in a single pass over the scaler's buffered input, so passing
+ * an n of at least the scale factor is faster than one call per scanline.
+ *
+ * Returns the number of scanlines produced, which is 0 if more input
+ * scanlines must be fed first.
+ */
+int oil_scale_out_rows(struct oil_scale *os, unsigned char *base,
+	ptrdiff_t stride, int n);
+
+/**
+ * Return the name of the backend used by oil_scale_in() & oil_scale_out() for
+ * the given scaler, e.g. "avx2".
+ * @os: Pointer to an initialized scaler struct.
+ */
+const char *oil_scale_backend(struct oil_scale *os);
+
+/**
+ * Split each scanline of a scaler into column strips that are scaled
+ * concurrently by a pool of worker threads. Every call to oil_scale_in() and
+ * oil_scale_out() hands one strip to each worker and waits for all of them,
+ * so callers keep streaming scanlines exactly as before. Output is
+ * bit-identical to a single-threaded scaler. Strips are at least 64 output
+ * pixels wide, so narrow images use fewer threads than requested. Scalers
+ * that upscale one axis and downscale the other stay single-threaded. The pool
+ * is torn down by oil_scale_free().
+ * @os: Pointer to an initialized scaler struct, before any scanlines are fed.
+ * @nthreads: Number of threads to use, including the calling thread. A value
+ *   of 1 stops any existing workers.
+ *
+ * With an nthreads of 1, downscalers whose intermediate rows don't fit in
+ * half of L2 are split into strips that the calling thread runs one after
+ * the other, as oil_scale_in_rows() does on its own, see there. The strips
+ * take over the scaler's intermediate rows, so the split only allocates
+ * small per-strip buffers.
+ *
+ * Returns 0 on success.
+ * Returns -1 if an argument is bad, or if scanlines have been fed since the
+ *   scaler was initialized or restarted.
+ * Returns -2 if unable to allocate memory.
+ */
+int oil_scale_set_threads(struct oil_scale *os, int nthreads);
+
+/**
+ * Switch a scaler to 16-bit fixed-point arithmetic. Samples are x-scaled with
+ * Q14 int16 coefficients into int16 samples in 1/64ths of a level, which are
+ * then accumulated into int32 sums with Q14 y-coefficients. Coefficients are
+ * rounded so that each output sample's coefficients still sum to exactly 1,
+ * so flat areas come out unchanged.
+ *
+ * Against an exact reference the error stays within 0.07 levels of that of
+ * the floating point pipeline (see test.c). The exception is
+ * OIL_CS_RGBA_NOGAMMA colour, which is premultiplied in 1/64ths of a level and
+ * may be off by about 7 / alpha more levels. Colour under a fully transparent
+ * pixel is undefined.
+ *
+ * Only OIL_CS_G, OIL_CS_RGB_NOGAMMA, OIL_CS_RGBA_NOGAMMA and
+ * OIL_CS_RGBX_NOGAMMA scalers that shrink at least one dimension and enlarge
+ * neither are supported. Fixed-point scalers stay single-threaded:
+ * oil_scale_set_threads() is a no-op on them. The tables are allocated
+ * separately, even for scalers with a caller-provided buffer, and released by
+ * oil_scale_free().
+ * @os: Pointer to an initialized scaler struct, before any scanlines are fed.
+ *
+ * Returns 0 on success, or if fixed point is already enabled.
+ * Returns -1 if an argument is bad, the scaler is not supported, scanlines
+ * have already been fed or the scaler already has worker threads.
+ * Returns -2 if unable to allocate memory.
+ */
+int oil_scale_set_fixed_point(struct oil_scale *os);
+
+/**
+ * Store a scaler's 4 intermediate rows as IEEE half floats instead of floats,
+ * halving the memory they take and the bandwidth spent reading them back.
+ * Arithmetic stays in floats: rows are converted a block at a time, with F16C
+ * on x86_64 and Advanced SIMD on AArch64. A scanline of floats is still kept
+ * to x-scale into, so the scaler's state shrinks by a quarter.
+ *
+ * Every value is rounded to 11 significant bits when stored, which costs up to
+ * about 0.5 levels against an exact reference (see test.c). Near black, the
+ * _GAMMA2 colorspaces may be off by up to 2 levels, and colour under a low
+ * alpha may be off by about 150 / alpha levels more.
+ *
+ * Only scalers that enlarge the height, or that shrink it while enlarging the
+ * width, are supported; the fused kernels of other downscalers accumulate
+ * straight into float sums. Sums are rounded after every scanline, so feeding
+ * scanlines in batches gives the same output as one at a time. Half-float
+ * scalers stay single-threaded:
+ * oil_scale_set_threads() is a no-op on them. A scaler set up by
+ * oil_scale_init() or oil_scale_init_plan() moves to a smaller buffer; one
+ * with a caller-provided buffer keeps using it.
+ * @os: Pointer to an initialized scaler struct, before any scanlines are fed.
+ *
+ * Returns 0 on success, or if half floats are already enabled.
+ * Returns -1 if an argument is bad, the scaler is not supported, scanlines
+ * have already been fed or the scaler already has worker threads.
+ * Returns -2 if unable to allocate memory.
+ */
+int oil_scale_set_half_float(struct oil_scale *os);
+
+/**
+ * Portable C version of oil_scale_in(). A scaler fed through one backend's
+ * version of oil_scale_in() must be drained through the same backend's
+ * oil_scale_out(), as backends may buffer rows in different layouts.
+ */
+int oil_scale_in_scalar(struct oil_scale *os, unsigned char *in);
+
+/**
+ * Portable C version of oil_scale_out().
+ */
+int oil_scale_out_scalar(struct oil_scale *os, unsigned char *out);
+
+/**
+ * Portable version of oil_scale_in() written with GCC/Clang vector
+ * extensions. Available on every architecture.
+ */
+int oil_scale_in_vec(struct oil_scale *os, unsigned char *in);
+
+/**
+ * Portable version of oil_scale_out() written with GCC/Clang vector
+ * extensions. Available on every architecture.
+ */
+int oil_scale_out_vec(struct oil_scale *os, unsigned char *out);
+
 /**
  * SSE2-optimized version of oil_scale_in().
  */
@@ -201,6 +552,16 @@ int oil_scale_in_sse2(struct oil_scale *os, unsigned char *in);
  */
 int oil_scale_out_sse2(struct oil_scale *os, unsigned char *out);
 
+/**
+ * SSSE3/SSE4.1-optimized version of oil_scale_in().
+ */
+int oil_scale_in_sse41(struct oil_scale *os, unsigned char *in);
+
+/**
+ * SSSE3/SSE4.1-optimized version of oil_scale_out().
+ */
+int oil_scale_out_sse41(struct oil_scale *os, unsigned char *out);
+
 
 /**
  * AVX2-optimized version of oil_scale_in().
@@ -232,6 +593,30 @@ int oil_scale_out_neon(struct oil_scale *os, unsigned char *out);
  */
 int oil_scale_out_discard(struct oil_scale *os);
 
+/**
+ * Scale a whole image that is already in memory. The output is split into
+ * horizontal bands that are scaled concurrently, each by its own scaler
+ * started at the first input row that contributes to the band. The result is
+ * bit-identical to streaming the image through a single scaler.
+ * @src: Pointer to the first input scanline.
+ * @src_stride: Distance in bytes between input scanlines.
+ * @dst: Pointer to the first output scanline.
+ * @dst_stride: Distance in bytes between output scanlines.
+ * @in_width: Width, in pixels, of the input image.
+ * @in_height: Height, in pixels, of the input image.
+ * @out_width: Width, in pixels, of the output image.
+ * @out_height: Height, in pixels, of the output image.
+ * @cs: Color space of the input/output images.
+ * @nthreads: Number of threads to use, including the calling thread.
+ *
+ * Returns 0 on success.
+ * Returns -1 if an argument is bad.
+ * Returns -2 if unable to allocate memory.
+ */
+int oil_scale_image(unsigned char *src, ptrdiff_t src_stride,
+	unsigned char *dst, ptrdiff_t dst_stride, int in_width, int in_height,
+	int out_width, int out_height, enum oil_colorspace cs, int nthreads);
+
 /**
  * Calculate an output ratio that preserves the input aspect ratio.
  * @src_width: Width, in pixels, of the input image.
@@ -22,6 +22,7 @@
 #include "oil_resample.h"
 #include "oil_resample_internal.h"
 #include <immintrin.h>
+#include <math.h>
 #include <string.h>
 
 /* Shift smp left by one float lane, zero-filling the top lane. */
@@ -65,23 +66,97 @@ static inline float oil_dot1_f_avx2(__m128 smp, __m128 coeffs)
 	return _mm_cvtss_f32(t2);
 }
 
-/* Write 3 bytes to out[0..2] by indexing lut with the low three int32 lanes
- * of idx. Used when the 4th lane is either discarded or handled separately.
+/* Write the low bytes of the low three int32 lanes of v to out[0..2]. Used
+ * when the 4th lane is either discarded or handled separately.
  */
 static inline __attribute__((always_inline))
-void oil_lut_store3_avx2(unsigned char *out, __m128i idx, unsigned char *lut)
+void oil_store3_avx2(unsigned char *out, __m128i v)
 {
-	out[0] = lut[_mm_cvtsi128_si32(idx)];
-	out[1] = lut[_mm_cvtsi128_si32(_mm_srli_si128(idx, 4))];
-	out[2] = lut[_mm_cvtsi128_si32(_mm_srli_si128(idx, 8))];
+	int px;
+
+	px = _mm_cvtsi128_si32(_mm_shuffle_epi8(v, _mm_setr_epi8(0, 4, 8, 12,
+		-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1)));
+	out[0] = px;
+	out[1] = px >> 8;
+	out[2] = px >> 16;
+}
+
+/* Write the low bytes of all four int32 lanes of v to out[0..3]. */
+static inline __attribute__((always_inline))
+void oil_store4_avx2(unsigned char *out, __m128i v)
+{
+	*(int *)out = _mm_cvtsi128_si32(_mm_shuffle_epi8(v, _mm_setr_epi8(0, 4,
+		8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1)));
+}
+
+#ifdef OIL_L2S_POLY
+/* Linear to sRGB without l2s_map: 255 * (1.055 * x^(1/2.4) - 0.055) is a
+ * degree 4 polynomial in x^(1/4), fitted for minimax error on
+ * [OIL_L2S_POLY_KNEE, 1], where it stays within 0.009 levels of the exact
+ * curve. Below the knee the curve is linear. No polynomial rounds correctly
+ * next to a level midpoint, so it is biased down by a quarter level to land
+ * on the correct level or the one below, and one compare with l2s_edges
+ * settles which. */
+#define OIL_L2S_POLY_KNEE 0.0031308f
+
+static inline __attribute__((always_inline))
+__m128i oil_l2s_poly4_avx2(__m128 v)
+{
+	__m128 u, p, lin;
+	__m128i lo;
+
+	u = _mm_sqrt_ps(_mm_sqrt_ps(v));
+	p = _mm_fmadd_ps(_mm_set1_ps(20.7388011f), u,
+		_mm_set1_ps(-85.5517969f));
+	p = _mm_fmadd_ps(p, u, _mm_set1_ps(286.282688f));
+	p = _mm_fmadd_ps(p, u, _mm_set1_ps(50.0150886f));
+	p = _mm_fmadd_ps(p, u, _mm_set1_ps(-16.4760011f + 0.25f));
+	lin = _mm_fmadd_ps(v, _mm_set1_ps(12.92f * 255.0f), _mm_set1_ps(0.25f));
+	p = _mm_blendv_ps(p, lin, _mm_cmplt_ps(v,
+		_mm_set1_ps(OIL_L2S_POLY_KNEE)));
+	lo = _mm_cvttps_epi32(p);
+	return _mm_sub_epi32(lo, _mm_castps_si128(_mm_cmpge_ps(v,
+		_mm_i32gather_ps(l2s_edges, lo, 4))));
+}
+
+/* 8-lane oil_l2s_poly4_avx2(). */
+static inline __attribute__((always_inline))
+__m256i oil_l2s_poly8_avx2(__m256 v)
+{
+	__m256 u, p, lin;
+	__m256i lo;
+
+	u = _mm256_sqrt_ps(_mm256_sqrt_ps(v));
+	p = _mm256_fmadd_ps(_mm256_set1_ps(20.7388011f), u,
+		_mm256_set1_ps(-85.5517969f));
+	p = _mm256_fmadd_ps(p, u, _mm256_set1_ps(286.282688f));
+	p = _mm256_fmadd_ps(p, u, _mm256_set1_ps(50.0150886f));
+	p = _mm256_fmadd_ps(p, u, _mm256_set1_ps(-16.4760011f + 0.25f));
+	lin = _mm256_fmadd_ps(v, _mm256_set1_ps(12.92f * 255.0f),
+		_mm256_set1_ps(0.25f));
+	p = _mm256_blendv_ps(p, lin, _mm256_cmp_ps(v,
+		_mm256_set1_ps(OIL_L2S_POLY_KNEE), _CMP_LT_OQ));
+	lo = _mm256_cvttps_epi32(p);
+	return _mm256_sub_epi32(lo, _mm256_castps_si256(_mm256_cmp_ps(v,
+		_mm256_i32gather_ps(l2s_edges, lo, 4), _CMP_GE_OQ)));
 }
+#endif
 
-/* Write 4 bytes to out[0..3] by indexing lut with all four int32 lanes of idx. */
+/* Clamp to [0,1] and map 4 linear values to sRGB, as bytes in the low bits of
+ * each int32 lane. scale is l2s_len - 1. */
 static inline __attribute__((always_inline))
-void oil_lut_store4_avx2(unsigned char *out, __m128i idx, unsigned char *lut)
+__m128i oil_l2s4_avx2(__m128 v, __m128 scale)
 {
-	oil_lut_store3_avx2(out, idx, lut);
-	out[3] = lut[_mm_cvtsi128_si32(_mm_srli_si128(idx, 12))];
+	v = _mm_min_ps(_mm_max_ps(v, _mm_setzero_ps()), _mm_set1_ps(1.0f));
+#ifdef OIL_L2S_POLY
+	(void)scale;
+	return oil_l2s_poly4_avx2(v);
+#else
+	__m128i idx;
+	idx = _mm_cvttps_epi32(_mm_mul_ps(v, scale));
+	idx = _mm_i32gather_epi32((const int *)l2s_map, idx, 1);
+	return _mm_and_si128(idx, _mm_set1_epi32(0xFF));
+#endif
 }
 
 /* 4-tap y-axis dot product: loads 4 floats from each of in[0..3] at offset
@@ -99,6 +174,19 @@ static inline __m128 oil_ydot4_load_avx2(float **in, int off,
 		_mm_add_ps(_mm_mul_ps(c2, v2), _mm_mul_ps(c3, v3)));
 }
 
+/* oil_ydot4_load_avx2(), or just the floats of in[0] when the yscale_up
+ * kernels convert a single line, see yscale_line_avx2().
+ */
+static inline __attribute__((always_inline))
+__m128 oil_yload_avx2(float **in, int off, __m128 c0, __m128 c1, __m128 c2,
+	__m128 c3, int line)
+{
+	if (line) {
+		return _mm_loadu_ps(in[0] + off);
+	}
+	return oil_ydot4_load_avx2(in, off, c0, c1, c2, c3);
+}
+
 /* Consume one output pixel across 4 stride-4 channel ring-buffer slots:
  * gather lane 0 from each of sums[0..3], sums[4..7], sums[8..11], sums[12..15]
  * into a single packed vector, then shift each slot left (discarding the
@@ -137,6 +225,20 @@ static inline __m128i oil_clamp_round_idx_avx2(__m128 v,
 	return _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(v, scale), half));
 }
 
+/* oil_clamp_round_idx_avx2(), taking the square root of the clamped value
+ * first when gamma2 is set to return a GAMMA2 sample to gamma 2.0.
+ */
+static inline __attribute__((always_inline))
+__m128i oil_clamp_round_gamma_idx_avx2(__m128 v, __m128 zero, __m128 one,
+	__m128 scale, __m128 half, int gamma2)
+{
+	v = _mm_min_ps(_mm_max_ps(v, zero), one);
+	if (gamma2) {
+		v = _mm_sqrt_ps(v);
+	}
+	return _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(v, scale), half));
+}
+
 /* Unpremultiply a pair of packed GA samples [g0, a0, g1, a1], clamping alpha
  * to [0,1] and handling alpha==0 as passthrough-with-zero-gray. Returns the
  * four components scaled to byte-rounded int32 lanes.
@@ -163,7 +265,7 @@ static inline __m128i oil_unpremul_ga_pair_idx_avx2(__m128 sum,
 	return _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(result, scale), half));
 }
 
-/* Build the 256-bit y-coefficient vectors used by oil_yacc_fma4_avx2. The
+/* Build the 256-bit y-coefficient vectors used by oil_yacc_pix_avx2. The
  * y-coefficients are permuted so each physical ring-buffer slot (0..3) receives
  * the matching coefficient for the current tap phase. Returns two __m256s:
  * cy_lo broadcasts coeffs for slots 0,1; cy_hi broadcasts for slots 2,3.
@@ -210,20 +312,16 @@ void oil_yacc_fma2_avx2(float *sums_y_out, __m128 s0, __m128 s1,
 	_mm256_storeu_ps(sums_y_out, sy256);
 }
 
-/* Vertical FMA accumulate for a 4-channel output pixel. s0..s3 each hold the
- * horizontal sum for one channel in lane 0; the four lane-0 values are packed
- * into a single 4-float channel vector and FMA'd into the 16-float ring-buffer
- * slice at sums_y_out, using the precomputed per-slot y-coefficients.
+/* Vertical FMA accumulate for a 4-channel output pixel. pix holds the
+ * horizontal sums of the four channels; it is FMA'd into the 16-float
+ * ring-buffer slice at sums_y_out, using the precomputed per-slot
+ * y-coefficients.
  */
 static inline __attribute__((always_inline))
-void oil_yacc_fma4_avx2(float *sums_y_out, __m128 s0, __m128 s1, __m128 s2,
-	__m128 s3, __m256 cy_lo, __m256 cy_hi)
+void oil_yacc_pix_avx2(float *sums_y_out, __m128 pix, __m256 cy_lo,
+	__m256 cy_hi)
 {
-	__m128 ab, cd, pix;
 	__m256 pix256, sy_lo, sy_hi;
-	ab = _mm_unpacklo_ps(s0, s1);
-	cd = _mm_unpacklo_ps(s2, s3);
-	pix = _mm_movelh_ps(ab, cd);
 	pix256 = _mm256_set_m128(pix, pix);
 	sy_lo = _mm256_loadu_ps(sums_y_out);
 	sy_hi = _mm256_loadu_ps(sums_y_out + 8);
@@ -233,12 +331,27 @@ void oil_yacc_fma4_avx2(float *sums_y_out, __m128 s0, __m128 s1, __m128 s2,
 	_mm256_storeu_ps(sums_y_out + 8, sy_hi);
 }
 
+/* Vertical FMA accumulate for a 4-channel output pixel whose channel sums
+ * s0..s3 each sit in lane 0.
+ */
+static inline __attribute__((always_inline))
+void oil_yacc_fma4_avx2(float *sums_y_out, __m128 s0, __m128 s1, __m128 s2,
+	__m128 s3, __m256 cy_lo, __m256 cy_hi)
+{
+	__m128 ab, cd;
+	ab = _mm_unpacklo_ps(s0, s1);
+	cd = _mm_unpacklo_ps(s2, s3);
+	oil_yacc_pix_avx2(sums_y_out, _mm_movelh_ps(ab, cd), cy_lo, cy_hi);
+}
+
 /* Unpremultiply a premultiplied RGBA sum (alpha in lane 3), clamp RGB and
  * alpha to [0,1], then scale to 0..255 (with rounding) for byte packing.
  * Lane 3 of the result contains the clamped alpha byte, not the reciprocal.
+ * RGB is square-rooted after clamping when gamma2 is set.
  */
-static inline __m128i oil_unpremul_rgba_idx_avx2(__m128 vals,
-	__m128 zero, __m128 one, __m128 scale, __m128 half)
+static inline __attribute__((always_inline))
+__m128i oil_unpremul_rgba_idx_avx2(__m128 vals, __m128 zero, __m128 one,
+	__m128 scale, __m128 half, int gamma2)
 {
 	__m128 alpha_v, hi;
 	alpha_v = _mm_shuffle_ps(vals, vals, _MM_SHUFFLE(3, 3, 3, 3));
@@ -246,12 +359,220 @@ static inline __m128i oil_unpremul_rgba_idx_avx2(__m128 vals,
 	if (_mm_cvtss_f32(alpha_v) != 0)
 		vals = _mm_mul_ps(vals, _mm_rcp_ps(alpha_v));
 	vals = _mm_min_ps(_mm_max_ps(vals, zero), one);
+	if (gamma2) {
+		vals = _mm_sqrt_ps(vals);
+	}
 	hi = _mm_shuffle_ps(vals, alpha_v, _MM_SHUFFLE(0, 0, 2, 2));
 	vals = _mm_shuffle_ps(vals, hi, _MM_SHUFFLE(2, 0, 1, 0));
 	return _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(vals, scale), half));
 }
 
-static void oil_yscale_out_nonlinear_avx2(float *sums, int len, unsigned char *out)
+/* 8-lane kernels.
+ *
+ * The helpers below work on two 4-channel pixels (or eight single-channel
+ * samples) per __m256. Table lookups into l2s_map use 32-bit gathers with a
+ * byte scale; l2s_map is padded so that the 4-byte read at its last entry
+ * stays in bounds, and only the low byte of each lane is kept.
+ */
+
+/* 8-lane oil_ydot4_load_avx2. */
+static inline __m256 oil_ydot4_load8_avx2(float **in, int off,
+	__m256 c0, __m256 c1, __m256 c2, __m256 c3)
+{
+	__m256 s01, s23;
+	s01 = _mm256_mul_ps(c0, _mm256_loadu_ps(in[0] + off));
+	s01 = _mm256_fmadd_ps(c1, _mm256_loadu_ps(in[1] + off), s01);
+	s23 = _mm256_mul_ps(c2, _mm256_loadu_ps(in[2] + off));
+	s23 = _mm256_fmadd_ps(c3, _mm256_loadu_ps(in[3] + off), s23);
+	return _mm256_add_ps(s01, s23);
+}
+
+/* 8-lane oil_yload_avx2(). */
+static inline __attribute__((always_inline))
+__m256 oil_yload8_avx2(float **in, int off, __m256 c0, __m256 c1, __m256 c2,
+	__m256 c3, int line)
+{
+	if (line) {
+		return _mm256_loadu_ps(in[0] + off);
+	}
+	return oil_ydot4_load8_avx2(in, off, c0, c1, c2, c3);
+}
+
+/* Load the 4-float tap slot at `off` for two adjacent tap-rotated pixels
+ * (16 floats apart) and zero both slots.
+ */
+static inline __attribute__((always_inline))
+__m256 oil_consume_slot_x2_avx2(float *sums, int off)
+{
+	__m256 vals;
+	vals = _mm256_set_m128(_mm_load_ps(sums + 16 + off),
+		_mm_load_ps(sums + off));
+	_mm_store_ps(sums + off, _mm_setzero_ps());
+	_mm_store_ps(sums + 16 + off, _mm_setzero_ps());
+	return vals;
+}
+
+/* 8-lane oil_l2s4_avx2(). */
+static inline __attribute__((always_inline))
+__m256i oil_l2s8_avx2(__m256 v, __m256 scale)
+{
+	v = _mm256_min_ps(_mm256_max_ps(v, _mm256_setzero_ps()),
+		_mm256_set1_ps(1.0f));
+#ifdef OIL_L2S_POLY
+	(void)scale;
+	return oil_l2s_poly8_avx2(v);
+#else
+	__m256i idx;
+	idx = _mm256_cvttps_epi32(_mm256_mul_ps(v, scale));
+	idx = _mm256_i32gather_epi32((const int *)l2s_map, idx, 1);
+	return _mm256_and_si256(idx, _mm256_set1_epi32(0xFF));
+#endif
+}
+
+/* 8-lane oil_clamp_round_idx_avx2 with a 0..255 scale. */
+static inline __m256i oil_clamp_round_idx8_avx2(__m256 v)
+{
+	v = _mm256_min_ps(_mm256_max_ps(v, _mm256_setzero_ps()),
+		_mm256_set1_ps(1.0f));
+	v = _mm256_fmadd_ps(v, _mm256_set1_ps(255.0f), _mm256_set1_ps(0.5f));
+	return _mm256_cvttps_epi32(v);
+}
+
+/* 8-lane oil_clamp_round_gamma_idx_avx2(). */
+static inline __attribute__((always_inline))
+__m256i oil_clamp_round_gamma_idx8_avx2(__m256 v, int gamma2)
+{
+	v = _mm256_min_ps(_mm256_max_ps(v, _mm256_setzero_ps()),
+		_mm256_set1_ps(1.0f));
+	if (gamma2) {
+		v = _mm256_sqrt_ps(v);
+	}
+	v = _mm256_fmadd_ps(v, _mm256_set1_ps(255.0f), _mm256_set1_ps(0.5f));
+	return _mm256_cvttps_epi32(v);
+}
+
+/* Pack eight int32 lanes in 0..255 into the low 8 bytes of the result. */
+static inline __m128i oil_pack8_avx2(__m256i v)
+{
+	__m128i p;
+	p = _mm_packus_epi32(_mm256_castsi256_si128(v),
+		_mm256_extracti128_si256(v, 1));
+	return _mm_packus_epi16(p, p);
+}
+
+/* Turn two premultiplied [R,G,B,A] sums into 8 output bytes: alpha as a
+ * rounded byte, RGB unpremultiplied and mapped through l2s_map. a_off == 0
+ * selects ARGB byte order.
+ */
+static inline __attribute__((always_inline))
+__m128i oil_unpremul_rgba_lut8_avx2(__m256 vals, __m256 scale, int a_off)
+{
+	__m256 alpha, one, zero;
+	__m256i rgb, a;
+	__m128i packed;
+
+	one = _mm256_set1_ps(1.0f);
+	zero = _mm256_setzero_ps();
+
+	alpha = _mm256_permute_ps(vals, _MM_SHUFFLE(3, 3, 3, 3));
+	alpha = _mm256_min_ps(_mm256_max_ps(alpha, zero), one);
+	vals = _mm256_blendv_ps(vals, _mm256_mul_ps(vals, _mm256_rcp_ps(alpha)),
+		_mm256_cmp_ps(alpha, zero, _CMP_NEQ_OQ));
+
+	rgb = oil_l2s8_avx2(vals, scale);
+	a = _mm256_cvttps_epi32(_mm256_fmadd_ps(alpha, _mm256_set1_ps(255.0f),
+		_mm256_set1_ps(0.5f)));
+	packed = oil_pack8_avx2(_mm256_blend_epi32(rgb, a, 0x88));
+	if (a_off == 0) {
+		packed = _mm_shuffle_epi8(packed, _mm_setr_epi8(3, 0, 1, 2,
+			7, 4, 5, 6, 11, 8, 9, 10, 15, 12, 13, 14));
+	}
+	return packed;
+}
+
+/* Two RGBX pixels to 8 output bytes with X forced to 255. */
+static inline __attribute__((always_inline))
+__m128i oil_rgbx_lut8_avx2(__m256 vals, __m256 scale)
+{
+	__m256i rgb;
+	rgb = oil_l2s8_avx2(vals, scale);
+	rgb = _mm256_blend_epi32(rgb, _mm256_set1_epi32(255), 0x88);
+	return oil_pack8_avx2(rgb);
+}
+
+/* Emit the outputs of one upscale window position. w0..w3 hold the four
+ * window pixels as 4-float samples duplicated into both 128-bit halves, so a
+ * pair of outputs (whose 8 coefficients are contiguous) costs four FMAs and a
+ * single store. cmp is the number of floats stored per output pixel.
+ */
+static inline __attribute__((always_inline))
+float *oil_xscale_up_out_avx2(__m256 w0, __m256 w1, __m256 w2, __m256 w3,
+	float **coeff_p, int j, float *out, int cmp)
+{
+	float *coeff_buf;
+	__m256 c, o01, o23;
+	__m128 c1, p01, p23, lo, hi;
+
+	coeff_buf = *coeff_p;
+
+	/* process pairs of outputs */
+	while (j >= 2) {
+		c = _mm256_loadu_ps(coeff_buf);
+		o01 = _mm256_mul_ps(_mm256_permute_ps(c, 0x00), w0);
+		o01 = _mm256_fmadd_ps(_mm256_permute_ps(c, 0x55), w1, o01);
+		o23 = _mm256_mul_ps(_mm256_permute_ps(c, 0xAA), w2);
+		o23 = _mm256_fmadd_ps(_mm256_permute_ps(c, 0xFF), w3, o23);
+		o01 = _mm256_add_ps(o01, o23);
+		if (cmp == 4) {
+			_mm256_storeu_ps(out, o01);
+		} else {
+			lo = _mm256_castps256_ps128(o01);
+			hi = _mm256_extractf128_ps(o01, 1);
+			_mm_storeu_ps(out, lo);
+			_mm_storel_pi((__m64 *)(out + 3), hi);
+			_mm_store_ss(out + 5, _mm_movehl_ps(hi, hi));
+		}
+		out += 2 * cmp;
+		coeff_buf += 8;
+		j -= 2;
+	}
+
+	/* process remaining single output */
+	if (j) {
+		c1 = _mm_load_ps(coeff_buf);
+		p01 = _mm_mul_ps(_mm_shuffle_ps(c1, c1, 0x00),
+			_mm256_castps256_ps128(w0));
+		p01 = _mm_fmadd_ps(_mm_shuffle_ps(c1, c1, 0x55),
+			_mm256_castps256_ps128(w1), p01);
+		p23 = _mm_mul_ps(_mm_shuffle_ps(c1, c1, 0xAA),
+			_mm256_castps256_ps128(w2));
+		p23 = _mm_fmadd_ps(_mm_shuffle_ps(c1, c1, 0xFF),
+			_mm256_castps256_ps128(w3), p23);
+		p01 = _mm_add_ps(p01, p23);
+		if (cmp == 4) {
+			_mm_storeu_ps(out, p01);
+		} else {
+			_mm_storel_pi((__m64 *)out, p01);
+			_mm_store_ss(out + 2, _mm_movehl_ps(p01, p01));
+		}
+		out += cmp;
+		coeff_buf += 4;
+	}
+
+	*coeff_p = coeff_buf;
+	return out;
+}
+
+/* Look up the four bytes of px in lut with one gather. */
+static inline __m128 oil_px4_gather_avx2(unsigned int px, float *lut)
+{
+	__m128i idx = _mm_cvtepu8_epi32(_mm_cvtsi32_si128(px));
+	return _mm_i32gather_ps(lut, idx, 4);
+}
+
+static inline __attribute__((always_inline))
+void yscale_out_nonlinear_avx2_impl(float *sums, int len, unsigned char *out,
+	int gamma2)
 {
 	int i;
 	__m128 vals, vals2;
@@ -265,10 +586,12 @@ static void oil_yscale_out_nonlinear_avx2(float *sums, int len, unsigned char *o
 
 	for (i=0; i+7<len; i+=8) {
 		vals = oil_consume_ch0_x4_avx2(sums);
-		idx = oil_clamp_round_idx_avx2(vals, zero, one, scale, half);
+		idx = oil_clamp_round_gamma_idx_avx2(vals, zero, one,
+			scale, half, gamma2);
 
 		vals2 = oil_consume_ch0_x4_avx2(sums + 16);
-		idx2 = oil_clamp_round_idx_avx2(vals2, zero, one, scale, half);
+		idx2 = oil_clamp_round_gamma_idx_avx2(vals2, zero, one,
+			scale, half, gamma2);
 
 		idx = _mm_packs_epi32(idx, idx2);
 		idx = _mm_packus_epi16(idx, idx);
@@ -279,7 +602,8 @@ static void oil_yscale_out_nonlinear_avx2(float *sums, int len, unsigned char *o
 
 	for (; i+3<len; i+=4) {
 		vals = oil_consume_ch0_x4_avx2(sums);
-		idx = oil_clamp_round_idx_avx2(vals, zero, one, scale, half);
+		idx = oil_clamp_round_gamma_idx_avx2(vals, zero, one,
+			scale, half, gamma2);
 
 		idx = _mm_packs_epi32(idx, idx);
 		idx = _mm_packus_epi16(idx, idx);
@@ -292,37 +616,50 @@ static void oil_yscale_out_nonlinear_avx2(float *sums, int len, unsigned char *o
 		float v = *sums;
 		if (v > 1.0f) v = 1.0f;
 		else if (v < 0.0f) v = 0.0f;
+		if (gamma2) v = sqrtf(v);
 		out[i] = (int)(v * 255.0f + 0.5f);
 		oil_shift_left_f_avx2(sums);
 		sums += 4;
 	}
 }
 
+static void oil_yscale_out_nonlinear_avx2(float *sums, int len, unsigned char *out)
+{
+	yscale_out_nonlinear_avx2_impl(sums, len, out, 0);
+}
+
+static void oil_yscale_out_gamma2_avx2(float *sums, int len, unsigned char *out)
+{
+	yscale_out_nonlinear_avx2_impl(sums, len, out, 1);
+}
+
 static void oil_yscale_out_linear_avx2(float *sums, int len, unsigned char *out)
 {
 	int i;
-	__m128 scale, vals, zero, one;
+	__m128 scale, vals;
+	__m256 scale8, vals8;
 	__m128i idx;
-	unsigned char *lut;
 
-	lut = l2s_map;
 	scale = _mm_set1_ps((float)(l2s_len - 1));
-	zero = _mm_setzero_ps();
-	one = _mm_set1_ps(1.0f);
+	scale8 = _mm256_set1_ps((float)(l2s_len - 1));
+
+	for (i=0; i+7<len; i+=8) {
+		vals8 = _mm256_set_m128(oil_consume_ch0_x4_avx2(sums + 16),
+			oil_consume_ch0_x4_avx2(sums));
+		idx = oil_pack8_avx2(oil_l2s8_avx2(vals8, scale8));
+		_mm_storel_epi64((__m128i *)(out + i), idx);
+		sums += 32;
+	}
 
-	for (i=0; i+3<len; i+=4) {
+	for (; i+3<len; i+=4) {
 		vals = oil_consume_ch0_x4_avx2(sums);
-		vals = _mm_min_ps(_mm_max_ps(vals, zero), one);
-		idx = _mm_cvttps_epi32(_mm_mul_ps(vals, scale));
-		oil_lut_store4_avx2(out + i, idx, lut);
+		oil_store4_avx2(out + i, oil_l2s4_avx2(vals, scale));
 		sums += 16;
 	}
 
 	for (; i<len; i++) {
-		float v = *sums;
-		if (v < 0.0f) v = 0.0f;
-		else if (v > 1.0f) v = 1.0f;
-		out[i] = lut[(int)(v * (l2s_len - 1))];
+		idx = oil_l2s4_avx2(_mm_load_ss(sums), scale);
+		out[i] = _mm_cvtsi128_si32(idx);
 		oil_shift_left_f_avx2(sums);
 		sums += 4;
 	}
@@ -360,29 +697,94 @@ static void oil_yscale_out_ga_avx2(float *sums, int width, unsigned char *out)
 	}
 }
 
+/* Planar sums_y: convert the line of a finished output row and zero it. */
+static void oil_yscale_out_planar_g_avx2(float *line, int len,
+	unsigned char *out)
+{
+	int i;
+	float v;
+	__m256 vals;
+
+	for (i=0; i+7<len; i+=8) {
+		vals = _mm256_loadu_ps(line + i);
+		_mm256_storeu_ps(line + i, _mm256_setzero_ps());
+		_mm_storel_epi64((__m128i *)(out + i), oil_pack8_avx2(
+			oil_clamp_round_gamma_idx8_avx2(vals, 0)));
+	}
+
+	for (; i<len; i++) {
+		v = line[i];
+		if (v > 1.0f) v = 1.0f;
+		else if (v < 0.0f) v = 0.0f;
+		out[i] = (int)(v * 255.0f + 0.5f);
+		line[i] = 0.0f;
+	}
+}
+
+static void oil_yscale_out_planar_ga_avx2(float *line, int len,
+	unsigned char *out)
+{
+	int i;
+	float gray, alpha;
+	__m128 vals, vals2, scale, half, zero, one;
+	__m128i idx, idx2;
+
+	scale = _mm_set1_ps(255.0f);
+	half = _mm_set1_ps(0.5f);
+	zero = _mm_setzero_ps();
+	one = _mm_set1_ps(1.0f);
+
+	for (i=0; i+7<len; i+=8) {
+		vals = _mm_loadu_ps(line + i);
+		vals2 = _mm_loadu_ps(line + i + 4);
+		_mm256_storeu_ps(line + i, _mm256_setzero_ps());
+		idx = oil_unpremul_ga_pair_idx_avx2(vals, zero, one, scale, half);
+		idx2 = oil_unpremul_ga_pair_idx_avx2(vals2, zero, one, scale,
+			half);
+		idx = _mm_packs_epi32(idx, idx2);
+		idx = _mm_packus_epi16(idx, idx);
+		_mm_storel_epi64((__m128i *)(out + i), idx);
+	}
+
+	for (; i<len; i+=2) {
+		gray = line[i];
+		alpha = line[i + 1];
+		if (alpha > 1.0f) alpha = 1.0f;
+		else if (alpha < 0.0f) alpha = 0.0f;
+		if (alpha != 0) gray /= alpha;
+		if (gray > 1.0f) gray = 1.0f;
+		else if (gray < 0.0f) gray = 0.0f;
+		out[i] = (int)(gray * 255.0f + 0.5f);
+		out[i + 1] = (int)(alpha * 255.0f + 0.5f);
+		line[i] = line[i + 1] = 0.0f;
+	}
+}
+
 static void oil_yscale_out_rgbx_avx2(float *sums, int width, unsigned char *out,
 	int tap)
 {
 	int i, tap_off;
-	__m128 scale, vals, zero, one;
+	__m128 scale, vals;
+	__m256 scale8;
 	__m128i idx;
 	__m128i z;
-	unsigned char *lut;
 
-	lut = l2s_map;
 	tap_off = tap * 4;
 	scale = _mm_set1_ps((float)(l2s_len - 1));
-	zero = _mm_setzero_ps();
-	one = _mm_set1_ps(1.0f);
+	scale8 = _mm256_set1_ps((float)(l2s_len - 1));
 	z = _mm_setzero_si128();
 
-	for (i=0; i<width; i++) {
-		vals = _mm_load_ps(sums + tap_off);
-		vals = _mm_min_ps(_mm_max_ps(vals, zero), one);
-
-		idx = _mm_cvttps_epi32(_mm_mul_ps(vals, scale));
+	for (i=0; i+1<width; i+=2) {
+		idx = oil_rgbx_lut8_avx2(oil_consume_slot_x2_avx2(sums, tap_off),
+			scale8);
+		_mm_storel_epi64((__m128i *)out, idx);
+		sums += 32;
+		out += 8;
+	}
 
-		oil_lut_store3_avx2(out, idx, lut);
+	for (; i<width; i++) {
+		vals = _mm_load_ps(sums + tap_off);
+		oil_store3_avx2(out, oil_l2s4_avx2(vals, scale));
 		out[3] = 255;
 
 		/* Zero consumed tap */
@@ -471,8 +873,9 @@ static void oil_xscale_up_ga_avx2(unsigned char *in, int width_in, float *out,
 	}
 }
 
-static void oil_yscale_up_ga_avx2(float **in, int len, float *coeffs,
-	unsigned char *out)
+static inline __attribute__((always_inline))
+void yscale_up_ga_avx2_impl(float **in, int len, float *coeffs,
+	unsigned char *out, int line)
 {
 	int i;
 	__m128 c0, c1, c2, c3;
@@ -491,8 +894,8 @@ static void oil_yscale_up_ga_avx2(float **in, int len, float *coeffs,
 
 	/* Process 4 GA pixels (8 floats) at a time */
 	for (i=0; i+7<len; i+=8) {
-		sum = oil_ydot4_load_avx2(in, i, c0, c1, c2, c3);
-		sum2 = oil_ydot4_load_avx2(in, i + 4, c0, c1, c2, c3);
+		sum = oil_yload_avx2(in, i, c0, c1, c2, c3, line);
+		sum2 = oil_yload_avx2(in, i + 4, c0, c1, c2, c3, line);
 
 		idx = oil_unpremul_ga_pair_idx_avx2(sum, zero, one, scale, half);
 		idx2 = oil_unpremul_ga_pair_idx_avx2(sum2, zero, one, scale, half);
@@ -504,7 +907,7 @@ static void oil_yscale_up_ga_avx2(float **in, int len, float *coeffs,
 
 	/* Process 2 GA pixels (4 floats) at a time */
 	for (; i+3<len; i+=4) {
-		sum = oil_ydot4_load_avx2(in, i, c0, c1, c2, c3);
+		sum = oil_yload_avx2(in, i, c0, c1, c2, c3, line);
 
 		idx = oil_unpremul_ga_pair_idx_avx2(sum, zero, one, scale, half);
 		idx = _mm_packs_epi32(idx, idx);
@@ -529,330 +932,214 @@ static void oil_yscale_up_ga_avx2(float **in, int len, float *coeffs,
 	}
 }
 
-static void oil_yscale_up_rgb_avx2(float **in, int len, float *coeffs,
+static void oil_yscale_up_ga_avx2(float **in, int len, float *coeffs,
 	unsigned char *out)
 {
-	int i;
-	__m128 c0, c1, c2, c3;
-	__m128 sum;
-	__m128 scale, zero, one;
-	__m128i idx;
-	unsigned char *lut;
-
-	c0 = _mm_set1_ps(coeffs[0]);
-	c1 = _mm_set1_ps(coeffs[1]);
-	c2 = _mm_set1_ps(coeffs[2]);
-	c3 = _mm_set1_ps(coeffs[3]);
-	lut = l2s_map;
-	scale = _mm_set1_ps((float)(l2s_len - 1));
-	zero = _mm_setzero_ps();
-	one = _mm_set1_ps(1.0f);
-
-	for (i=0; i+7<len; i+=8) {
-		__m128i idx2;
-		__m128 sum2;
+	yscale_up_ga_avx2_impl(in, len, coeffs, out, 0);
+}
 
-		sum = oil_ydot4_load_avx2(in, i, c0, c1, c2, c3);
-		sum = _mm_min_ps(_mm_max_ps(sum, zero), one);
-		idx = _mm_cvttps_epi32(_mm_mul_ps(sum, scale));
+static inline __attribute__((always_inline))
+void yscale_up_rgb_avx2_impl(float **in, int len, float *coeffs,
+	unsigned char *out, int line)
+{
+	int i;
+	__m256 c0, c1, c2, c3;
+	__m256 sum, sum2, scale;
+	__m128i idx, idx2;
 
-		sum2 = oil_ydot4_load_avx2(in, i + 4, c0, c1, c2, c3);
-		sum2 = _mm_min_ps(_mm_max_ps(sum2, zero), one);
-		idx2 = _mm_cvttps_epi32(_mm_mul_ps(sum2, scale));
+	c0 = _mm256_set1_ps(coeffs[0]);
+	c1 = _mm256_set1_ps(coeffs[1]);
+	c2 = _mm256_set1_ps(coeffs[2]);
+	c3 = _mm256_set1_ps(coeffs[3]);
+	scale = _mm256_set1_ps((float)(l2s_len - 1));
 
-		oil_lut_store4_avx2(out + i, idx, lut);
-		oil_lut_store4_avx2(out + i + 4, idx2, lut);
+	for (i=0; i+15<len; i+=16) {
+		sum = oil_yload8_avx2(in, i, c0, c1, c2, c3, line);
+		sum2 = oil_yload8_avx2(in, i + 8, c0, c1, c2, c3, line);
+		idx = oil_pack8_avx2(oil_l2s8_avx2(sum, scale));
+		idx2 = oil_pack8_avx2(oil_l2s8_avx2(sum2, scale));
+		_mm_storeu_si128((__m128i *)(out + i),
+			_mm_unpacklo_epi64(idx, idx2));
 	}
 
-	for (; i+3<len; i+=4) {
-		sum = oil_ydot4_load_avx2(in, i, c0, c1, c2, c3);
-		sum = _mm_min_ps(_mm_max_ps(sum, zero), one);
-		idx = _mm_cvttps_epi32(_mm_mul_ps(sum, scale));
-		oil_lut_store4_avx2(out + i, idx, lut);
+	for (; i+7<len; i+=8) {
+		sum = oil_yload8_avx2(in, i, c0, c1, c2, c3, line);
+		idx = oil_pack8_avx2(oil_l2s8_avx2(sum, scale));
+		_mm_storel_epi64((__m128i *)(out + i), idx);
 	}
 
 	for (; i<len; i++) {
 		float v = coeffs[0] * in[0][i] + coeffs[1] * in[1][i] +
 			coeffs[2] * in[2][i] + coeffs[3] * in[3][i];
-		if (v < 0.0f) v = 0.0f;
-		else if (v > 1.0f) v = 1.0f;
-		out[i] = lut[(int)(v * (l2s_len - 1))];
+		idx = oil_l2s4_avx2(_mm_set_ss(v),
+			_mm256_castps256_ps128(scale));
+		out[i] = _mm_cvtsi128_si32(idx);
 	}
 }
 
-static void oil_yscale_up_rgbx_avx2(float **in, int len, float *coeffs,
+static void oil_yscale_up_rgb_avx2(float **in, int len, float *coeffs,
 	unsigned char *out)
+{
+	yscale_up_rgb_avx2_impl(in, len, coeffs, out, 0);
+}
+
+static inline __attribute__((always_inline))
+void yscale_up_rgbx_avx2_impl(float **in, int len, float *coeffs,
+	unsigned char *out, int line)
 {
 	int i;
 	__m128 c0, c1, c2, c3;
 	__m128 sum;
-	__m128 scale, zero, one;
-	__m128i idx;
-	unsigned char *lut;
+	__m128 scale;
+	__m256 c0_8, c1_8, c2_8, c3_8, sum8, scale8;
 
 	c0 = _mm_set1_ps(coeffs[0]);
 	c1 = _mm_set1_ps(coeffs[1]);
 	c2 = _mm_set1_ps(coeffs[2]);
 	c3 = _mm_set1_ps(coeffs[3]);
-	lut = l2s_map;
+	c0_8 = _mm256_set1_ps(coeffs[0]);
+	c1_8 = _mm256_set1_ps(coeffs[1]);
+	c2_8 = _mm256_set1_ps(coeffs[2]);
+	c3_8 = _mm256_set1_ps(coeffs[3]);
 	scale = _mm_set1_ps((float)(l2s_len - 1));
-	zero = _mm_setzero_ps();
-	one = _mm_set1_ps(1.0f);
+	scale8 = _mm256_set1_ps((float)(l2s_len - 1));
 
 	for (i=0; i+7<len; i+=8) {
-		sum = oil_ydot4_load_avx2(in, i, c0, c1, c2, c3);
-		sum = _mm_min_ps(_mm_max_ps(sum, zero), one);
-		idx = _mm_cvttps_epi32(_mm_mul_ps(sum, scale));
-		oil_lut_store3_avx2(out + i, idx, lut);
-		out[i+3] = 255;
-
-		sum = oil_ydot4_load_avx2(in, i + 4, c0, c1, c2, c3);
-		sum = _mm_min_ps(_mm_max_ps(sum, zero), one);
-		idx = _mm_cvttps_epi32(_mm_mul_ps(sum, scale));
-		oil_lut_store3_avx2(out + i + 4, idx, lut);
-		out[i+7] = 255;
+		sum8 = oil_yload8_avx2(in, i, c0_8, c1_8, c2_8, c3_8, line);
+		_mm_storel_epi64((__m128i *)(out + i),
+			oil_rgbx_lut8_avx2(sum8, scale8));
 	}
 
 	for (; i+3<len; i+=4) {
-		sum = oil_ydot4_load_avx2(in, i, c0, c1, c2, c3);
-		sum = _mm_min_ps(_mm_max_ps(sum, zero), one);
-		idx = _mm_cvttps_epi32(_mm_mul_ps(sum, scale));
-		oil_lut_store3_avx2(out + i, idx, lut);
+		sum = oil_yload_avx2(in, i, c0, c1, c2, c3, line);
+		oil_store3_avx2(out + i, oil_l2s4_avx2(sum, scale));
 		out[i+3] = 255;
 	}
 }
 
+static void oil_yscale_up_rgbx_avx2(float **in, int len, float *coeffs,
+	unsigned char *out)
+{
+	yscale_up_rgbx_avx2_impl(in, len, coeffs, out, 0);
+}
+
 static inline __attribute__((always_inline))
 void oil_xscale_up_rgb_avx2(unsigned char *in, int width_in, float *out,
 	float *coeff_buf, int *border_buf, float *lut)
 {
-	int i, j;
-	__m128 smp_r, smp_g, smp_b;
+	int i;
+	__m128 smp;
+	__m256 w0, w1, w2, w3;
 
-	smp_r = _mm_setzero_ps();
-	smp_g = _mm_setzero_ps();
-	smp_b = _mm_setzero_ps();
+	w1 = w2 = w3 = _mm256_setzero_ps();
 
 	for (i=0; i<width_in; i++) {
-		smp_r = oil_push_f_avx2(smp_r, lut[in[0]]);
-		smp_g = oil_push_f_avx2(smp_g, lut[in[1]]);
-		smp_b = oil_push_f_avx2(smp_b, lut[in[2]]);
-
-		j = border_buf[i];
-
-		/* process pairs of outputs */
-		while (j >= 2) {
-			__m128 c0 = _mm_load_ps(coeff_buf);
-			__m128 c1 = _mm_load_ps(coeff_buf + 4);
-			__m128 t2_r = oil_dot2_f_avx2(smp_r, c0, c1);
-			__m128 t2_g = oil_dot2_f_avx2(smp_g, c0, c1);
-			__m128 t2_b = oil_dot2_f_avx2(smp_b, c0, c1);
-
-			/* Store interleaved: [R0, G0, B0, R1, G1, B1] */
-			__m128 rg = _mm_unpacklo_ps(t2_r, t2_g);
-			_mm_storel_pi((__m64 *)out, rg);
-			_mm_store_ss(out + 2, t2_b);
-			_mm_storeh_pi((__m64 *)(out + 3), rg);
-			_mm_store_ss(out + 5,
-				_mm_shuffle_ps(t2_b, t2_b, _MM_SHUFFLE(1,1,1,1)));
-
-			out += 6;
-			coeff_buf += 8;
-			j -= 2;
-		}
-
-		/* process remaining single output */
-		if (j) {
-			__m128 coeffs = _mm_load_ps(coeff_buf);
-			out[0] = oil_dot1_f_avx2(smp_r, coeffs);
-			out[1] = oil_dot1_f_avx2(smp_g, coeffs);
-			out[2] = oil_dot1_f_avx2(smp_b, coeffs);
-			out += 3;
-			coeff_buf += 4;
-		}
-
+		smp = _mm_setr_ps(lut[in[0]], lut[in[1]], lut[in[2]], 0.0f);
+		w0 = w1;
+		w1 = w2;
+		w2 = w3;
+		w3 = _mm256_set_m128(smp, smp);
+		out = oil_xscale_up_out_avx2(w0, w1, w2, w3, &coeff_buf,
+			border_buf[i], out, 3);
 		in += 3;
 	}
 }
 
 /* The X slot emitted here is unused downstream: both y-path consumers
- * (oil_yscale_up_rgbx_avx2 and its nogamma variant) overwrite it with 255.
- * We pack t2_b into the X lane as a harmless finite filler and skip the
- * smp_x push + dot product entirely.
+ * (oil_yscale_up_rgbx_avx2 and its nogamma variant) overwrite it with 255, so
+ * it is left as whatever the X byte maps to.
  */
 static inline __attribute__((always_inline))
 void oil_xscale_up_rgbx_avx2(unsigned char *in, int width_in, float *out,
 	float *coeff_buf, int *border_buf, float *lut)
 {
-	int i, j;
-	__m128 smp_r, smp_g, smp_b;
+	int i;
+	unsigned int px;
+	__m128 smp;
+	__m256 w0, w1, w2, w3;
 
-	smp_r = _mm_setzero_ps();
-	smp_g = _mm_setzero_ps();
-	smp_b = _mm_setzero_ps();
+	w1 = w2 = w3 = _mm256_setzero_ps();
 
 	for (i=0; i<width_in; i++) {
-		smp_r = oil_push_f_avx2(smp_r, lut[in[0]]);
-		smp_g = oil_push_f_avx2(smp_g, lut[in[1]]);
-		smp_b = oil_push_f_avx2(smp_b, lut[in[2]]);
+		memcpy(&px, in, 4);
+		smp = oil_px4_gather_avx2(px, lut);
+		w0 = w1;
+		w1 = w2;
+		w2 = w3;
+		w3 = _mm256_set_m128(smp, smp);
+		out = oil_xscale_up_out_avx2(w0, w1, w2, w3, &coeff_buf,
+			border_buf[i], out, 4);
+		in += 4;
+	}
+}
 
-		j = border_buf[i];
+static void oil_xscale_up_cmyk_avx2(unsigned char *in, int width_in, float *out,
+	float *coeff_buf, int *border_buf)
+{
+	int i;
+	unsigned int px;
+	__m128 smp, inv255;
+	__m256 w0, w1, w2, w3;
 
-		while (j >= 2) {
-			__m128 c0 = _mm_load_ps(coeff_buf);
-			__m128 c1 = _mm_load_ps(coeff_buf + 4);
-			__m128 t2_r = oil_dot2_f_avx2(smp_r, c0, c1);
-			__m128 t2_g = oil_dot2_f_avx2(smp_g, c0, c1);
-			__m128 t2_b = oil_dot2_f_avx2(smp_b, c0, c1);
-
-			__m128 rg = _mm_unpacklo_ps(t2_r, t2_g);
-			__m128 bx = _mm_unpacklo_ps(t2_b, t2_b);
-			_mm_storeu_ps(out, _mm_movelh_ps(rg, bx));
-			_mm_storeu_ps(out + 4, _mm_movehl_ps(bx, rg));
-
-			out += 8;
-			coeff_buf += 8;
-			j -= 2;
-		}
-
-		if (j) {
-			__m128 coeffs = _mm_load_ps(coeff_buf);
-			out[0] = oil_dot1_f_avx2(smp_r, coeffs);
-			out[1] = oil_dot1_f_avx2(smp_g, coeffs);
-			out[2] = oil_dot1_f_avx2(smp_b, coeffs);
-			out[3] = 1.0f;
-			out += 4;
-			coeff_buf += 4;
-		}
-
-		in += 4;
-	}
-}
-
-/* Dot product of four [C,M,Y,K] sample vectors with per-tap coefficients
- * packed as lanes [c0,c1,c2,c3] of `coeffs`: c0*smp0 + c1*smp1 + c2*smp2 +
- * c3*smp3. Uses a parallel mul + tree add to keep the dependency chain short.
- */
-static inline __attribute__((always_inline))
-__m128 oil_cmyk_dot4_avx2(__m128 smp0, __m128 smp1, __m128 smp2, __m128 smp3,
-	__m128 coeffs)
-{
-	__m128 p0, p1, p2, p3;
-	p0 = _mm_mul_ps(smp0, _mm_shuffle_ps(coeffs, coeffs, _MM_SHUFFLE(0,0,0,0)));
-	p1 = _mm_mul_ps(smp1, _mm_shuffle_ps(coeffs, coeffs, _MM_SHUFFLE(1,1,1,1)));
-	p2 = _mm_mul_ps(smp2, _mm_shuffle_ps(coeffs, coeffs, _MM_SHUFFLE(2,2,2,2)));
-	p3 = _mm_mul_ps(smp3, _mm_shuffle_ps(coeffs, coeffs, _MM_SHUFFLE(3,3,3,3)));
-	return _mm_add_ps(_mm_add_ps(p0, p1), _mm_add_ps(p2, p3));
-}
-
-static void oil_xscale_up_cmyk_avx2(unsigned char *in, int width_in, float *out,
-	float *coeff_buf, int *border_buf)
-{
-	int i, j;
-	__m128 smp0, smp1, smp2, smp3, inv255;
-	__m128i zero_i;
-
-	/* Interleaved layout: each smpN = [C, M, Y, K] for one tap position */
-	smp0 = _mm_setzero_ps();
-	smp1 = _mm_setzero_ps();
-	smp2 = _mm_setzero_ps();
-	smp3 = _mm_setzero_ps();
+	w1 = w2 = w3 = _mm256_setzero_ps();
 	inv255 = _mm_set1_ps(1.0f / 255.0f);
-	zero_i = _mm_setzero_si128();
 
 	for (i=0; i<width_in; i++) {
-		/* Push new pixel: load 4 bytes [C,M,Y,K], convert to floats */
-		__m128i px = _mm_cvtsi32_si128(*(int *)in);
-		px = _mm_unpacklo_epi8(px, zero_i);
-		px = _mm_unpacklo_epi16(px, zero_i);
-		smp0 = smp1;
-		smp1 = smp2;
-		smp2 = smp3;
-		smp3 = _mm_mul_ps(_mm_cvtepi32_ps(px), inv255);
-
-		j = border_buf[i];
-
-		/* process pairs of outputs */
-		while (j >= 2) {
-			_mm_storeu_ps(out, oil_cmyk_dot4_avx2(smp0, smp1, smp2,
-				smp3, _mm_load_ps(coeff_buf)));
-			_mm_storeu_ps(out + 4, oil_cmyk_dot4_avx2(smp0, smp1, smp2,
-				smp3, _mm_load_ps(coeff_buf + 4)));
-			out += 8;
-			coeff_buf += 8;
-			j -= 2;
-		}
-
-		/* process remaining single output */
-		if (j) {
-			_mm_storeu_ps(out, oil_cmyk_dot4_avx2(smp0, smp1, smp2,
-				smp3, _mm_load_ps(coeff_buf)));
-			out += 4;
-			coeff_buf += 4;
-		}
-
+		memcpy(&px, in, 4);
+		smp = _mm_cvtepi32_ps(_mm_cvtepu8_epi32(_mm_cvtsi32_si128(px)));
+		smp = _mm_mul_ps(smp, inv255);
+		w0 = w1;
+		w1 = w2;
+		w2 = w3;
+		w3 = _mm256_set_m128(smp, smp);
+		out = oil_xscale_up_out_avx2(w0, w1, w2, w3, &coeff_buf,
+			border_buf[i], out, 4);
 		in += 4;
 	}
 }
 
-static void oil_yscale_up_g_cmyk_avx2(float **in, int len, float *coeffs,
-	unsigned char *out)
+static inline __attribute__((always_inline))
+void yscale_up_g_cmyk_avx2_impl(float **in, int len, float *coeffs,
+	unsigned char *out, int gamma2, int line)
 {
 	int i;
 	__m128 c0, c1, c2, c3;
 	__m128 sum;
 	__m128 scale, half, zero, one;
-	__m128i idx;
+	__m256 c0_8, c1_8, c2_8, c3_8, sum8, sum8_2;
+	__m128i idx, idx2;
 
 	c0 = _mm_set1_ps(coeffs[0]);
 	c1 = _mm_set1_ps(coeffs[1]);
 	c2 = _mm_set1_ps(coeffs[2]);
 	c3 = _mm_set1_ps(coeffs[3]);
+	c0_8 = _mm256_set1_ps(coeffs[0]);
+	c1_8 = _mm256_set1_ps(coeffs[1]);
+	c2_8 = _mm256_set1_ps(coeffs[2]);
+	c3_8 = _mm256_set1_ps(coeffs[3]);
 	scale = _mm_set1_ps(255.0f);
 	half = _mm_set1_ps(0.5f);
 	zero = _mm_setzero_ps();
 	one = _mm_set1_ps(1.0f);
 
 	for (i=0; i+15<len; i+=16) {
-		__m128i idx2, idx3, idx4;
-		__m128 sum2;
-
-		sum = oil_ydot4_load_avx2(in, i, c0, c1, c2, c3);
-		idx = oil_clamp_round_idx_avx2(sum, zero, one, scale, half);
-
-		sum2 = oil_ydot4_load_avx2(in, i + 4, c0, c1, c2, c3);
-		idx2 = oil_clamp_round_idx_avx2(sum2, zero, one, scale, half);
-
-		sum = oil_ydot4_load_avx2(in, i + 8, c0, c1, c2, c3);
-		idx3 = oil_clamp_round_idx_avx2(sum, zero, one, scale, half);
-
-		sum2 = oil_ydot4_load_avx2(in, i + 12, c0, c1, c2, c3);
-		idx4 = oil_clamp_round_idx_avx2(sum2, zero, one, scale, half);
-
-		idx = _mm_packs_epi32(idx, idx2);
-		idx3 = _mm_packs_epi32(idx3, idx4);
-		idx = _mm_packus_epi16(idx, idx3);
-		_mm_storeu_si128((__m128i *)(out + i), idx);
+		sum8 = oil_yload8_avx2(in, i, c0_8, c1_8, c2_8, c3_8, line);
+		sum8_2 = oil_yload8_avx2(in, i + 8, c0_8, c1_8, c2_8, c3_8, line);
+		idx = oil_pack8_avx2(oil_clamp_round_gamma_idx8_avx2(sum8, gamma2));
+		idx2 = oil_pack8_avx2(oil_clamp_round_gamma_idx8_avx2(sum8_2, gamma2));
+		_mm_storeu_si128((__m128i *)(out + i), _mm_unpacklo_epi64(idx, idx2));
 	}
 
 	for (; i+7<len; i+=8) {
-		__m128i idx2;
-		__m128 sum2;
-
-		sum = oil_ydot4_load_avx2(in, i, c0, c1, c2, c3);
-		idx = oil_clamp_round_idx_avx2(sum, zero, one, scale, half);
-
-		sum2 = oil_ydot4_load_avx2(in, i + 4, c0, c1, c2, c3);
-		idx2 = oil_clamp_round_idx_avx2(sum2, zero, one, scale, half);
-
-		idx = _mm_packs_epi32(idx, idx2);
-		idx = _mm_packus_epi16(idx, idx);
+		sum8 = oil_yload8_avx2(in, i, c0_8, c1_8, c2_8, c3_8, line);
+		idx = oil_pack8_avx2(oil_clamp_round_gamma_idx8_avx2(sum8, gamma2));
 		_mm_storel_epi64((__m128i *)(out + i), idx);
 	}
 
 	for (; i+3<len; i+=4) {
-		sum = oil_ydot4_load_avx2(in, i, c0, c1, c2, c3);
-		idx = oil_clamp_round_idx_avx2(sum, zero, one, scale, half);
+		sum = oil_yload_avx2(in, i, c0, c1, c2, c3, line);
+		idx = oil_clamp_round_gamma_idx_avx2(sum, zero, one,
+			scale, half, gamma2);
 		idx = _mm_packs_epi32(idx, idx);
 		idx = _mm_packus_epi16(idx, idx);
 		*(int *)(out + i) = _mm_cvtsi128_si32(idx);
@@ -863,12 +1150,102 @@ static void oil_yscale_up_g_cmyk_avx2(float **in, int len, float *coeffs,
 			coeffs[2] * in[2][i] + coeffs[3] * in[3][i];
 		if (s > 1.0f) s = 1.0f;
 		else if (s < 0.0f) s = 0.0f;
+		if (gamma2) s = sqrtf(s);
 		out[i] = (int)(s * 255.0f + 0.5f);
 	}
 }
 
+static void oil_yscale_up_g_cmyk_avx2(float **in, int len, float *coeffs,
+	unsigned char *out)
+{
+	yscale_up_g_cmyk_avx2_impl(in, len, coeffs, out, 0, 0);
+}
+
+static void oil_yscale_up_gamma2_avx2(float **in, int len, float *coeffs,
+	unsigned char *out)
+{
+	yscale_up_g_cmyk_avx2_impl(in, len, coeffs, out, 1, 0);
+}
+
+/* oil_ydot4_load8_avx2() of 4 lines already loaded, with the coefficients
+ * of one output row.
+ */
+static inline __m256 oil_ydot4_8_avx2(__m256 v0, __m256 v1, __m256 v2,
+	__m256 v3, float *coeffs)
+{
+	__m256 s01, s23;
+	s01 = _mm256_mul_ps(_mm256_broadcast_ss(coeffs), v0);
+	s01 = _mm256_fmadd_ps(_mm256_broadcast_ss(coeffs + 1), v1, s01);
+	s23 = _mm256_mul_ps(_mm256_broadcast_ss(coeffs + 2), v2);
+	s23 = _mm256_fmadd_ps(_mm256_broadcast_ss(coeffs + 3), v3, s23);
+	return _mm256_add_ps(s01, s23);
+}
+
+/* Several output rows from the same 4 lines: each 16 columns are loaded once
+ * and kept in registers for all n rows. The tail is left to the single-row
+ * kernel.
+ */
+static inline __attribute__((always_inline))
+void yscale_up_rows_avx2_impl(float **in, int len, float *coeffs, int n,
+	unsigned char *out, ptrdiff_t stride, int srgb, int gamma2)
+{
+	int i, j;
+	float *tail_in[4];
+	__m256 a0, a1, a2, a3, b0, b1, b2, b3, scale;
+	__m128i idx, idx2;
+
+	scale = _mm256_set1_ps((float)(l2s_len - 1));
+
+	for (i=0; i+15<len; i+=16) {
+		a0 = _mm256_loadu_ps(in[0] + i);
+		a1 = _mm256_loadu_ps(in[1] + i);
+		a2 = _mm256_loadu_ps(in[2] + i);
+		a3 = _mm256_loadu_ps(in[3] + i);
+		b0 = _mm256_loadu_ps(in[0] + i + 8);
+		b1 = _mm256_loadu_ps(in[1] + i + 8);
+		b2 = _mm256_loadu_ps(in[2] + i + 8);
+		b3 = _mm256_loadu_ps(in[3] + i + 8);
+		for (j=0; j<n; j++) {
+			if (srgb) {
+				idx = oil_pack8_avx2(oil_l2s8_avx2(oil_ydot4_8_avx2(
+					a0, a1, a2, a3, coeffs + j * 4), scale));
+				idx2 = oil_pack8_avx2(oil_l2s8_avx2(oil_ydot4_8_avx2(
+					b0, b1, b2, b3, coeffs + j * 4), scale));
+			} else {
+				idx = oil_pack8_avx2(oil_clamp_round_gamma_idx8_avx2(
+					oil_ydot4_8_avx2(a0, a1, a2, a3,
+					coeffs + j * 4), gamma2));
+				idx2 = oil_pack8_avx2(oil_clamp_round_gamma_idx8_avx2(
+					oil_ydot4_8_avx2(b0, b1, b2, b3,
+					coeffs + j * 4), gamma2));
+			}
+			_mm_storeu_si128((__m128i *)(out + j * stride + i),
+				_mm_unpacklo_epi64(idx, idx2));
+		}
+	}
+
+	if (i == len) {
+		return;
+	}
+	for (j=0; j<4; j++) {
+		tail_in[j] = in[j] + i;
+	}
+	for (j=0; j<n; j++) {
+		if (srgb) {
+			oil_yscale_up_rgb_avx2(tail_in, len - i, coeffs + j * 4,
+				out + j * stride + i);
+		} else {
+			yscale_up_g_cmyk_avx2_impl(tail_in, len - i,
+				coeffs + j * 4, out + j * stride + i, gamma2, 0);
+		}
+	}
+}
+
+#define PX_BYTE(px, idx) (((px) >> ((idx) * 8)) & 0xFF)
+
 /* Accumulate `count` horizontal G samples into `sum`, using a 4-way unrolled
- * inner loop with a 1-way scalar tail. Advances *in_p and *coeffs_x_f_p past
+ * inner loop with a 1-way scalar tail. The unrolled loop reads its four
+ * samples with one 32-bit load instead of four byte loads. Advances *in_p and *coeffs_x_f_p past
  * the consumed samples/coefficients. `sum` carries the partial sum shifted in
  * from the previous output position; the four parallel accumulators are
  * reduced before returning.
@@ -887,20 +1264,23 @@ __m128 oil_xacc_g_heavy_avx2(unsigned char **in_p, float **coeffs_x_f_p,
 	sum4 = _mm_setzero_ps();
 
 	for (j=0; j+3<count; j+=4) {
+		unsigned int px;
+		memcpy(&px, in, 4);
+
 		coeffs_x = _mm_load_ps(coeffs_x_f);
-		sample_x = _mm_set1_ps(i2f_map[in[0]]);
+		sample_x = _mm_set1_ps(i2f_map[PX_BYTE(px, 0)]);
 		sum = _mm_add_ps(_mm_mul_ps(coeffs_x, sample_x), sum);
 
 		coeffs_x = _mm_load_ps(coeffs_x_f + 4);
-		sample_x = _mm_set1_ps(i2f_map[in[1]]);
+		sample_x = _mm_set1_ps(i2f_map[PX_BYTE(px, 1)]);
 		sum2 = _mm_add_ps(_mm_mul_ps(coeffs_x, sample_x), sum2);
 
 		coeffs_x = _mm_load_ps(coeffs_x_f + 8);
-		sample_x = _mm_set1_ps(i2f_map[in[2]]);
+		sample_x = _mm_set1_ps(i2f_map[PX_BYTE(px, 2)]);
 		sum3 = _mm_add_ps(_mm_mul_ps(coeffs_x, sample_x), sum3);
 
 		coeffs_x = _mm_load_ps(coeffs_x_f + 12);
-		sample_x = _mm_set1_ps(i2f_map[in[3]]);
+		sample_x = _mm_set1_ps(i2f_map[PX_BYTE(px, 3)]);
 		sum4 = _mm_add_ps(_mm_mul_ps(coeffs_x, sample_x), sum4);
 
 		in += 4;
@@ -919,16 +1299,73 @@ __m128 oil_xacc_g_heavy_avx2(unsigned char **in_p, float **coeffs_x_f_p,
 	return _mm_add_ps(_mm_add_ps(sum, sum2), _mm_add_ps(sum3, sum4));
 }
 
-static void __attribute__((noinline)) oil_scale_down_g_heavy_avx2(
-	unsigned char *in, float *sums_y_out,
-	int out_width, float *coeffs_x_f, int *border_buf, float *coeffs_y_f)
+/* Accumulate n x-scaled samples at blk into the lines of a planar sums_y,
+ * starting at sums in line 0. Line (tap + j) & 3 is weighed by coeffs_y_f[j].
+ */
+static inline __attribute__((always_inline))
+void oil_yacc_lines_avx2(float *blk, int n, float *sums, int len,
+	float *coeffs_y_f, int tap)
 {
+	int i, j;
+	float c, *line;
+	__m256 cv;
+
+	for (j=0; j<4; j++) {
+		c = coeffs_y_f[j];
+		if (c == 0.0f) {
+			continue;
+		}
+		line = sums + ((tap + j) & 3) * len;
+		cv = _mm256_set1_ps(c);
+		for (i=0; i+7<n; i+=8) {
+			_mm256_storeu_ps(line + i, _mm256_fmadd_ps(
+				_mm256_loadu_ps(blk + i), cv,
+				_mm256_loadu_ps(line + i)));
+		}
+		for (; i<n; i++) {
+			line[i] += blk[i] * c;
+		}
+	}
+}
+
+/* Samples gathered by the planar downscale kernels between calls to
+ * oil_yacc_lines_avx2(). */
+#define PLANAR_BLK 64
+
+/* Accumulate the gathered samples once there are at least min of them. */
+static inline __attribute__((always_inline))
+void oil_planar_flush_avx2(float *blk, int *nb, float **sums, int len,
+	float *coeffs_y_f, int tap, int min)
+{
+	if (*nb >= min) {
+		oil_yacc_lines_avx2(blk, *nb, *sums, len, coeffs_y_f, tap);
+		*sums += *nb;
+		*nb = 0;
+	}
+}
+
+/* The G and GA downscale kernels below also serve a planar sums_y. With
+ * planar set they gather the x-scaled samples and accumulate them a block at
+ * a time into sums_y_out, which holds a line of out_width samples per
+ * pending output row.
+ */
+static inline __attribute__((always_inline))
+void scale_down_g_heavy_avx2_impl(unsigned char *in, float *sums_y_out,
+	int out_width, float *coeffs_x_f, int *border_buf, float *coeffs_y_f,
+	int planar, int tap)
+{
+	float blk[PLANAR_BLK + 4];
+	int nb = 0;
+
 	int i;
 	__m128 sum;
 	__m256 coeffs_y256, sums_y256, sample_y256;
 	__m128 result_lo, result_hi;
 
-	coeffs_y256 = _mm256_broadcast_ps((__m128 const *)coeffs_y_f);
+	coeffs_y256 = _mm256_setzero_ps();
+	if (!planar) {
+		coeffs_y256 = _mm256_broadcast_ps((__m128 const *)coeffs_y_f);
+	}
 	sum = _mm_setzero_ps();
 
 	for (i=0; i+1<out_width; i+=2) {
@@ -940,6 +1377,14 @@ static void __attribute__((noinline)) oil_scale_down_g_heavy_avx2(
 		result_hi = _mm_shuffle_ps(sum, sum, _MM_SHUFFLE(0, 0, 0, 0));
 		sum = oil_shift_f_left_avx2(sum);
 
+		if (planar) {
+			_mm_store_ss(blk + nb, result_lo);
+			_mm_store_ss(blk + nb + 1, result_hi);
+			nb += 2;
+			oil_planar_flush_avx2(blk, &nb, &sums_y_out, out_width,
+				coeffs_y_f, tap, PLANAR_BLK);
+			continue;
+		}
 		sums_y256 = _mm256_loadu_ps(sums_y_out);
 		sample_y256 = _mm256_set_m128(result_hi, result_lo);
 		sums_y256 = _mm256_add_ps(_mm256_mul_ps(coeffs_y256, sample_y256), sums_y256);
@@ -950,21 +1395,54 @@ static void __attribute__((noinline)) oil_scale_down_g_heavy_avx2(
 	for (; i<out_width; i++) {
 		__m128 coeffs_y = _mm256_castps256_ps128(coeffs_y256);
 		sum = oil_xacc_g_heavy_avx2(&in, &coeffs_x_f, border_buf[i], sum);
-		oil_yacc_fma1_avx2(sums_y_out, sum, coeffs_y);
-		sums_y_out += 4;
+		if (planar) {
+			_mm_store_ss(blk + nb, sum);
+			nb += 1;
+		} else {
+			oil_yacc_fma1_avx2(sums_y_out, sum, coeffs_y);
+			sums_y_out += 4;
+		}
 		sum = oil_shift_f_left_avx2(sum);
 	}
+	if (planar) {
+		oil_planar_flush_avx2(blk, &nb, &sums_y_out, out_width,
+			coeffs_y_f, tap, 1);
+	}
 }
 
-static void oil_scale_down_g_avx2(unsigned char *in, float *sums_y_out,
+static void __attribute__((noinline)) oil_scale_down_g_heavy_avx2(
+	unsigned char *in, float *sums_y_out,
 	int out_width, float *coeffs_x_f, int *border_buf, float *coeffs_y_f)
 {
+	scale_down_g_heavy_avx2_impl(in, sums_y_out, out_width, coeffs_x_f,
+		border_buf, coeffs_y_f, 0, 0);
+}
+
+static void __attribute__((noinline)) oil_scale_down_g_heavy_planar_avx2(
+	unsigned char *in, float *sums, int out_width, float *coeffs_x_f,
+	int *border_buf, float *coeffs_y_f, int tap)
+{
+	scale_down_g_heavy_avx2_impl(in, sums, out_width, coeffs_x_f,
+		border_buf, coeffs_y_f, 1, tap);
+}
+
+static inline __attribute__((always_inline))
+void scale_down_g_avx2_impl(unsigned char *in, float *sums_y_out,
+	int out_width, float *coeffs_x_f, int *border_buf, float *coeffs_y_f,
+	int planar, int tap)
+{
+	float blk[PLANAR_BLK + 4];
+	int nb = 0;
+
 	int i, j;
 	__m128 coeffs_x, sample_x, sum;
 	__m256 coeffs_y256, sums_y256, sample_y256;
 	__m128 result_lo, result_hi;
 
-	coeffs_y256 = _mm256_broadcast_ps((__m128 const *)coeffs_y_f);
+	coeffs_y256 = _mm256_setzero_ps();
+	if (!planar) {
+		coeffs_y256 = _mm256_broadcast_ps((__m128 const *)coeffs_y_f);
+	}
 	sum = _mm_setzero_ps();
 
 	for (i=0; i+1<out_width; i+=2) {
@@ -988,6 +1466,14 @@ static void oil_scale_down_g_avx2(unsigned char *in, float *sums_y_out,
 		result_hi = _mm_shuffle_ps(sum, sum, _MM_SHUFFLE(0, 0, 0, 0));
 		sum = oil_shift_f_left_avx2(sum);
 
+		if (planar) {
+			_mm_store_ss(blk + nb, result_lo);
+			_mm_store_ss(blk + nb + 1, result_hi);
+			nb += 2;
+			oil_planar_flush_avx2(blk, &nb, &sums_y_out, out_width,
+				coeffs_y_f, tap, PLANAR_BLK);
+			continue;
+		}
 		sums_y256 = _mm256_loadu_ps(sums_y_out);
 		sample_y256 = _mm256_set_m128(result_hi, result_lo);
 		sums_y256 = _mm256_add_ps(_mm256_mul_ps(coeffs_y256, sample_y256), sums_y256);
@@ -1004,22 +1490,54 @@ static void oil_scale_down_g_avx2(unsigned char *in, float *sums_y_out,
 			in += 1;
 			coeffs_x_f += 4;
 		}
-		oil_yacc_fma1_avx2(sums_y_out, sum, coeffs_y);
-		sums_y_out += 4;
+		if (planar) {
+			_mm_store_ss(blk + nb, sum);
+			nb += 1;
+		} else {
+			oil_yacc_fma1_avx2(sums_y_out, sum, coeffs_y);
+			sums_y_out += 4;
+		}
 		sum = oil_shift_f_left_avx2(sum);
 	}
+	if (planar) {
+		oil_planar_flush_avx2(blk, &nb, &sums_y_out, out_width,
+			coeffs_y_f, tap, 1);
+	}
 }
 
-static void oil_scale_down_ga_avx2(unsigned char *in, float *sums_y_out,
+static void oil_scale_down_g_avx2(unsigned char *in, float *sums_y_out,
 	int out_width, float *coeffs_x_f, int *border_buf, float *coeffs_y_f)
 {
+	scale_down_g_avx2_impl(in, sums_y_out, out_width, coeffs_x_f,
+		border_buf, coeffs_y_f, 0, 0);
+}
+
+static void oil_scale_down_g_planar_avx2(unsigned char *in, float *sums,
+	int out_width, float *coeffs_x_f, int *border_buf, float *coeffs_y_f,
+	int tap)
+{
+	scale_down_g_avx2_impl(in, sums, out_width, coeffs_x_f, border_buf,
+		coeffs_y_f, 1, tap);
+}
+
+static inline __attribute__((always_inline))
+void scale_down_ga_avx2_impl(unsigned char *in, float *sums_y_out,
+	int out_width, float *coeffs_x_f, int *border_buf, float *coeffs_y_f,
+	int planar, int tap)
+{
+	float blk[PLANAR_BLK + 4];
+	int nb = 0;
+
 	int i, j;
 	float alpha;
 	__m128 coeffs_x, coeffs_x2, sample_x, sum_g, sum_a;
 	__m128 sum_g2, sum_a2;
 	__m128 coeffs_y;
 
-	coeffs_y = _mm_load_ps(coeffs_y_f);
+	coeffs_y = _mm_setzero_ps();
+	if (!planar) {
+		coeffs_y = _mm_load_ps(coeffs_y_f);
+	}
 
 	sum_g = _mm_setzero_ps();
 	sum_a = _mm_setzero_ps();
@@ -1075,12 +1593,39 @@ static void oil_scale_down_ga_avx2(unsigned char *in, float *sums_y_out,
 			}
 		}
 
-		oil_yacc_fma2_avx2(sums_y_out, sum_g, sum_a, coeffs_y);
-		sums_y_out += 8;
+		if (planar) {
+			_mm_store_ss(blk + nb, sum_g);
+			_mm_store_ss(blk + nb + 1, sum_a);
+			nb += 2;
+			oil_planar_flush_avx2(blk, &nb, &sums_y_out,
+				out_width * 2, coeffs_y_f, tap, PLANAR_BLK);
+		} else {
+			oil_yacc_fma2_avx2(sums_y_out, sum_g, sum_a, coeffs_y);
+			sums_y_out += 8;
+		}
 
 		sum_g = oil_shift_f_left_avx2(sum_g);
 		sum_a = oil_shift_f_left_avx2(sum_a);
 	}
+	if (planar) {
+		oil_planar_flush_avx2(blk, &nb, &sums_y_out, out_width * 2,
+			coeffs_y_f, tap, 1);
+	}
+}
+
+static void oil_scale_down_ga_avx2(unsigned char *in, float *sums_y_out,
+	int out_width, float *coeffs_x_f, int *border_buf, float *coeffs_y_f)
+{
+	scale_down_ga_avx2_impl(in, sums_y_out, out_width, coeffs_x_f,
+		border_buf, coeffs_y_f, 0, 0);
+}
+
+static void oil_scale_down_ga_planar_avx2(unsigned char *in, float *sums,
+	int out_width, float *coeffs_x_f, int *border_buf, float *coeffs_y_f,
+	int tap)
+{
+	scale_down_ga_avx2_impl(in, sums, out_width, coeffs_x_f, border_buf,
+		coeffs_y_f, 1, tap);
 }
 
 static void oil_scale_down_rgb_avx2(unsigned char *in, float *sums_y_out,
@@ -1179,16 +1724,14 @@ static void oil_scale_down_rgb_avx2(unsigned char *in, float *sums_y_out,
 }
 
 /* Unpremultiply a premultiplied RGBA sum (alpha in lane 3) and emit one
- * output pixel: alpha as a rounded byte, RGB via the linear-to-sRGB LUT.
+ * output pixel: alpha as a rounded byte, RGB mapped to sRGB.
  * a_off/rgb_off select RGBA vs ARGB output layout.
  */
 static inline __attribute__((always_inline))
 void oil_unpremul_rgba_lut_avx2(__m128 vals, __m128 zero, __m128 one,
-	__m128 scale, unsigned char *lut, unsigned char *out,
-	int a_off, int rgb_off)
+	__m128 scale, unsigned char *out, int a_off, int rgb_off)
 {
 	__m128 alpha_v;
-	__m128i idx;
 	float alpha;
 
 	alpha_v = _mm_shuffle_ps(vals, vals, _MM_SHUFFLE(3, 3, 3, 3));
@@ -1199,11 +1742,8 @@ void oil_unpremul_rgba_lut_avx2(__m128 vals, __m128 zero, __m128 one,
 		vals = _mm_mul_ps(vals, _mm_rcp_ps(alpha_v));
 	}
 
-	vals = _mm_min_ps(_mm_max_ps(vals, zero), one);
-	idx = _mm_cvttps_epi32(_mm_mul_ps(vals, scale));
-
 	out[a_off] = (int)(alpha * 255.0f + 0.5f);
-	oil_lut_store3_avx2(out + rgb_off, idx, lut);
+	oil_store3_avx2(out + rgb_off, oil_l2s4_avx2(vals, scale));
 }
 
 static inline __attribute__((always_inline))
@@ -1212,19 +1752,27 @@ void oil_yscale_out_rgba_avx2(float *sums, int width, unsigned char *out,
 {
 	int i, tap_off;
 	__m128 scale, one, zero;
-	__m128i z;
-	unsigned char *lut;
+	__m256 scale8;
+	__m128i z, packed;
 
-	lut = l2s_map;
 	tap_off = tap * 4;
 	scale = _mm_set1_ps((float)(l2s_len - 1));
+	scale8 = _mm256_set1_ps((float)(l2s_len - 1));
 	one = _mm_set1_ps(1.0f);
 	zero = _mm_setzero_ps();
 	z = _mm_setzero_si128();
 
-	for (i=0; i<width; i++) {
+	for (i=0; i+1<width; i+=2) {
+		packed = oil_unpremul_rgba_lut8_avx2(
+			oil_consume_slot_x2_avx2(sums, tap_off), scale8, a_off);
+		_mm_storel_epi64((__m128i *)out, packed);
+		sums += 32;
+		out += 8;
+	}
+
+	for (; i<width; i++) {
 		oil_unpremul_rgba_lut_avx2(_mm_load_ps(sums + tap_off),
-			zero, one, scale, lut, out, a_off, rgb_off);
+			zero, one, scale, out, a_off, rgb_off);
 		_mm_store_si128((__m128i *)(sums + tap_off), z);
 		sums += 16;
 		out += 4;
@@ -1233,27 +1781,37 @@ void oil_yscale_out_rgba_avx2(float *sums, int width, unsigned char *out,
 
 static inline __attribute__((always_inline))
 void oil_yscale_up_rgba_avx2(float **in, int len, float *coeffs,
-	unsigned char *out, int a_off, int rgb_off)
+	unsigned char *out, int a_off, int rgb_off, int line)
 {
 	int i;
 	__m128 c0, c1, c2, c3;
 	__m128 sum;
 	__m128 scale, one, zero;
-	unsigned char *lut;
+	__m256 c0_8, c1_8, c2_8, c3_8, sum8, scale8;
 
 	c0 = _mm_set1_ps(coeffs[0]);
 	c1 = _mm_set1_ps(coeffs[1]);
 	c2 = _mm_set1_ps(coeffs[2]);
 	c3 = _mm_set1_ps(coeffs[3]);
-	lut = l2s_map;
+	c0_8 = _mm256_set1_ps(coeffs[0]);
+	c1_8 = _mm256_set1_ps(coeffs[1]);
+	c2_8 = _mm256_set1_ps(coeffs[2]);
+	c3_8 = _mm256_set1_ps(coeffs[3]);
 	scale = _mm_set1_ps((float)(l2s_len - 1));
+	scale8 = _mm256_set1_ps((float)(l2s_len - 1));
 	one = _mm_set1_ps(1.0f);
 	zero = _mm_setzero_ps();
 
-	for (i=0; i<len; i+=4) {
-		sum = oil_ydot4_load_avx2(in, i, c0, c1, c2, c3);
-		oil_unpremul_rgba_lut_avx2(sum, zero, one, scale, lut,
-			out + i, a_off, rgb_off);
+	for (i=0; i+7<len; i+=8) {
+		sum8 = oil_yload8_avx2(in, i, c0_8, c1_8, c2_8, c3_8, line);
+		_mm_storel_epi64((__m128i *)(out + i),
+			oil_unpremul_rgba_lut8_avx2(sum8, scale8, a_off));
+	}
+
+	for (; i<len; i+=4) {
+		sum = oil_yload_avx2(in, i, c0, c1, c2, c3, line);
+		oil_unpremul_rgba_lut_avx2(sum, zero, one, scale, out + i,
+			a_off, rgb_off);
 	}
 }
 
@@ -1261,57 +1819,25 @@ static inline __attribute__((always_inline))
 void oil_xscale_up_rgba_avx2(unsigned char *in, int width_in, float *out,
 	float *coeff_buf, int *border_buf, int a_off, int rgb_off, float *rgb_lut)
 {
-	int i, j;
-	__m128 smp_r, smp_g, smp_b, smp_a;
+	int i;
+	unsigned int px;
+	__m128 smp, one;
+	__m256 w0, w1, w2, w3;
 
-	smp_r = _mm_setzero_ps();
-	smp_g = _mm_setzero_ps();
-	smp_b = _mm_setzero_ps();
-	smp_a = _mm_setzero_ps();
+	w1 = w2 = w3 = _mm256_setzero_ps();
+	one = _mm_set1_ps(1.0f);
 
 	for (i=0; i<width_in; i++) {
-		float alpha_new = i2f_map[in[a_off]];
-
-		smp_a = oil_push_f_avx2(smp_a, alpha_new);
-		smp_r = oil_push_f_avx2(smp_r, alpha_new * rgb_lut[in[rgb_off]]);
-		smp_g = oil_push_f_avx2(smp_g, alpha_new * rgb_lut[in[rgb_off + 1]]);
-		smp_b = oil_push_f_avx2(smp_b, alpha_new * rgb_lut[in[rgb_off + 2]]);
-
-		j = border_buf[i];
-
-		/* process pairs of outputs */
-		while (j >= 2) {
-			__m128 c0 = _mm_load_ps(coeff_buf);
-			__m128 c1 = _mm_load_ps(coeff_buf + 4);
-			__m128 t2_r = oil_dot2_f_avx2(smp_r, c0, c1);
-			__m128 t2_g = oil_dot2_f_avx2(smp_g, c0, c1);
-			__m128 t2_b = oil_dot2_f_avx2(smp_b, c0, c1);
-			__m128 t2_a = oil_dot2_f_avx2(smp_a, c0, c1);
-
-			/* Store interleaved: [R0, G0, B0, A0, R1, G1, B1, A1] */
-			{
-				__m128 rg = _mm_unpacklo_ps(t2_r, t2_g);
-				__m128 ba = _mm_unpacklo_ps(t2_b, t2_a);
-				_mm_storeu_ps(out, _mm_movelh_ps(rg, ba));
-				_mm_storeu_ps(out + 4, _mm_movehl_ps(ba, rg));
-			}
-
-			out += 8;
-			coeff_buf += 8;
-			j -= 2;
-		}
-
-		/* process remaining single output */
-		if (j) {
-			__m128 coeffs = _mm_load_ps(coeff_buf);
-			out[0] = oil_dot1_f_avx2(smp_r, coeffs);
-			out[1] = oil_dot1_f_avx2(smp_g, coeffs);
-			out[2] = oil_dot1_f_avx2(smp_b, coeffs);
-			out[3] = oil_dot1_f_avx2(smp_a, coeffs);
-			out += 4;
-			coeff_buf += 4;
-		}
-
+		memcpy(&px, in, 4);
+		smp = oil_px4_gather_avx2(px >> (rgb_off * 8), rgb_lut);
+		smp = _mm_blend_ps(smp, one, 0x8);
+		smp = _mm_mul_ps(smp, _mm_set1_ps(i2f_map[in[a_off]]));
+		w0 = w1;
+		w1 = w2;
+		w2 = w3;
+		w3 = _mm256_set_m128(smp, smp);
+		out = oil_xscale_up_out_avx2(w0, w1, w2, w3, &coeff_buf,
+			border_buf[i], out, 4);
 		in += 4;
 	}
 }
@@ -1447,6 +1973,7 @@ static void oil_yscale_out_cmyk_avx2(float *sums, int width, unsigned char *out,
 {
 	int i, tap_off;
 	__m128 scale, half, vals, one, zero;
+	__m256 vals8;
 	__m128i idx, clamped, z;
 
 	tap_off = tap * 4;
@@ -1456,7 +1983,15 @@ static void oil_yscale_out_cmyk_avx2(float *sums, int width, unsigned char *out,
 	zero = _mm_setzero_ps();
 	z = _mm_setzero_si128();
 
-	for (i=0; i<width; i++) {
+	for (i=0; i+1<width; i+=2) {
+		vals8 = oil_consume_slot_x2_avx2(sums, tap_off);
+		clamped = oil_pack8_avx2(oil_clamp_round_idx8_avx2(vals8));
+		_mm_storel_epi64((__m128i *)out, clamped);
+		sums += 32;
+		out += 8;
+	}
+
+	for (; i<width; i++) {
 		vals = _mm_load_ps(sums + tap_off);
 		idx = oil_clamp_round_idx_avx2(vals, zero, one, scale, half);
 
@@ -1472,127 +2007,104 @@ static void oil_yscale_out_cmyk_avx2(float *sums, int width, unsigned char *out,
 	}
 }
 
+/* Shift each 4-tap half of an x accumulator left by one tap. */
+static inline __m256 oil_shift_taps_avx2(__m256 acc)
+{
+	return _mm256_castsi256_ps(_mm256_srli_si256(_mm256_castps_si256(acc), 4));
+}
+
+/* CMYK samples are plain i/255 values, so instead of table lookups two
+ * pixels are widened and converted at once and each channel is spread over
+ * its accumulator half with a cross-lane permute.
+ */
 static void oil_scale_down_cmyk_avx2(unsigned char *in, float *sums_y_out,
 	int out_width, float *coeffs_x_f, int *border_buf, float *coeffs_y_f,
 	int tap)
 {
 	int i, j;
-	__m128 coeffs_x, coeffs_x2, sample_x, sum_c, sum_m, sum_y, sum_k;
-	__m128 sum_c2, sum_m2, sum_y2, sum_k2;
+	unsigned int px1;
+	__m256 acc01, acc23, acc01_2, acc23_2, t, c, c2, smp, inv255;
+	__m256i sel0, sel1, sel2, sel3;
 	__m256 cy_lo, cy_hi;
+	__m128 pix;
 
 	oil_yacc_build_coeffs_avx2(coeffs_y_f, tap, &cy_lo, &cy_hi);
 
-	sum_c = _mm_setzero_ps();
-	sum_m = _mm_setzero_ps();
-	sum_y = _mm_setzero_ps();
-	sum_k = _mm_setzero_ps();
-
-	for (i=0; i<out_width; i++) {
-		if (border_buf[i] >= 2) {
-			sum_c2 = _mm_setzero_ps();
-			sum_m2 = _mm_setzero_ps();
-			sum_y2 = _mm_setzero_ps();
-			sum_k2 = _mm_setzero_ps();
-
-			for (j=0; j+1<border_buf[i]; j+=2) {
-				coeffs_x = _mm_load_ps(coeffs_x_f);
-				coeffs_x2 = _mm_load_ps(coeffs_x_f + 4);
-
-				sample_x = _mm_set1_ps(i2f_map[in[0]]);
-				sum_c = _mm_add_ps(_mm_mul_ps(coeffs_x, sample_x), sum_c);
-
-				sample_x = _mm_set1_ps(i2f_map[in[1]]);
-				sum_m = _mm_add_ps(_mm_mul_ps(coeffs_x, sample_x), sum_m);
-
-				sample_x = _mm_set1_ps(i2f_map[in[2]]);
-				sum_y = _mm_add_ps(_mm_mul_ps(coeffs_x, sample_x), sum_y);
-
-				sample_x = _mm_set1_ps(i2f_map[in[3]]);
-				sum_k = _mm_add_ps(_mm_mul_ps(coeffs_x, sample_x), sum_k);
+	inv255 = _mm256_set1_ps(1.0f / 255.0f);
+	sel0 = _mm256_setr_epi32(0, 0, 0, 0, 1, 1, 1, 1);
+	sel1 = _mm256_setr_epi32(2, 2, 2, 2, 3, 3, 3, 3);
+	sel2 = _mm256_setr_epi32(4, 4, 4, 4, 5, 5, 5, 5);
+	sel3 = _mm256_setr_epi32(6, 6, 6, 6, 7, 7, 7, 7);
 
-				sample_x = _mm_set1_ps(i2f_map[in[4]]);
-				sum_c2 = _mm_add_ps(_mm_mul_ps(coeffs_x2, sample_x), sum_c2);
+	acc01 = _mm256_setzero_ps();
+	acc23 = _mm256_setzero_ps();
 
-				sample_x = _mm_set1_ps(i2f_map[in[5]]);
-				sum_m2 = _mm_add_ps(_mm_mul_ps(coeffs_x2, sample_x), sum_m2);
-
-				sample_x = _mm_set1_ps(i2f_map[in[6]]);
-				sum_y2 = _mm_add_ps(_mm_mul_ps(coeffs_x2, sample_x), sum_y2);
-
-				sample_x = _mm_set1_ps(i2f_map[in[7]]);
-				sum_k2 = _mm_add_ps(_mm_mul_ps(coeffs_x2, sample_x), sum_k2);
+	for (i=0; i<out_width; i++) {
+		j = border_buf[i];
 
+		if (j >= 2) {
+			acc01_2 = _mm256_setzero_ps();
+			acc23_2 = _mm256_setzero_ps();
+
+			for (; j>=2; j-=2) {
+				smp = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(
+					_mm_loadl_epi64((__m128i *)in)));
+				smp = _mm256_mul_ps(smp, inv255);
+				c = _mm256_broadcast_ps((__m128 const *)coeffs_x_f);
+				c2 = _mm256_broadcast_ps(
+					(__m128 const *)(coeffs_x_f + 4));
+				acc01 = _mm256_fmadd_ps(c,
+					_mm256_permutevar8x32_ps(smp, sel0), acc01);
+				acc23 = _mm256_fmadd_ps(c,
+					_mm256_permutevar8x32_ps(smp, sel1), acc23);
+				acc01_2 = _mm256_fmadd_ps(c2,
+					_mm256_permutevar8x32_ps(smp, sel2), acc01_2);
+				acc23_2 = _mm256_fmadd_ps(c2,
+					_mm256_permutevar8x32_ps(smp, sel3), acc23_2);
 				in += 8;
 				coeffs_x_f += 8;
 			}
 
-			for (; j<border_buf[i]; j++) {
-				coeffs_x = _mm_load_ps(coeffs_x_f);
+			acc01 = _mm256_add_ps(acc01, acc01_2);
+			acc23 = _mm256_add_ps(acc23, acc23_2);
+		}
 
-				sample_x = _mm_set1_ps(i2f_map[in[0]]);
-				sum_c = _mm_add_ps(_mm_mul_ps(coeffs_x, sample_x), sum_c);
+		if (j) {
+			memcpy(&px1, in, 4);
+			smp = _mm256_castps128_ps256(_mm_cvtepi32_ps(
+				_mm_cvtepu8_epi32(_mm_cvtsi32_si128(px1))));
+			smp = _mm256_mul_ps(smp, inv255);
+			c = _mm256_broadcast_ps((__m128 const *)coeffs_x_f);
+			acc01 = _mm256_fmadd_ps(c,
+				_mm256_permutevar8x32_ps(smp, sel0), acc01);
+			acc23 = _mm256_fmadd_ps(c,
+				_mm256_permutevar8x32_ps(smp, sel1), acc23);
+			in += 4;
+			coeffs_x_f += 4;
+		}
 
-				sample_x = _mm_set1_ps(i2f_map[in[1]]);
-				sum_m = _mm_add_ps(_mm_mul_ps(coeffs_x, sample_x), sum_m);
+		t = _mm256_shuffle_ps(acc01, acc23, _MM_SHUFFLE(0, 0, 0, 0));
+		pix = _mm_blend_ps(_mm256_castps256_ps128(t),
+			_mm256_extractf128_ps(t, 1), 0xA);
+		oil_yacc_pix_avx2(sums_y_out, pix, cy_lo, cy_hi);
+		sums_y_out += 16;
 
-				sample_x = _mm_set1_ps(i2f_map[in[2]]);
-				sum_y = _mm_add_ps(_mm_mul_ps(coeffs_x, sample_x), sum_y);
+		acc01 = oil_shift_taps_avx2(acc01);
+		acc23 = oil_shift_taps_avx2(acc23);
+	}
+}
 
-				sample_x = _mm_set1_ps(i2f_map[in[3]]);
-				sum_k = _mm_add_ps(_mm_mul_ps(coeffs_x, sample_x), sum_k);
+static inline __attribute__((always_inline))
+void oil_scale_down_rgbx_avx2(unsigned char *in, float *sums_y_out,
+	int out_width, float *coeffs_x_f, int *border_buf, float *coeffs_y_f,
+	int tap, float *lut)
+{
+	int i, j;
+	__m128 coeffs_x, coeffs_x2, sample_x, sum_r, sum_g, sum_b;
+	__m128 sum_r2, sum_g2, sum_b2;
+	__m256 cy_lo, cy_hi;
 
-				in += 4;
-				coeffs_x_f += 4;
-			}
-
-			sum_c = _mm_add_ps(sum_c, sum_c2);
-			sum_m = _mm_add_ps(sum_m, sum_m2);
-			sum_y = _mm_add_ps(sum_y, sum_y2);
-			sum_k = _mm_add_ps(sum_k, sum_k2);
-		} else {
-			for (j=0; j<border_buf[i]; j++) {
-				coeffs_x = _mm_load_ps(coeffs_x_f);
-
-				sample_x = _mm_set1_ps(i2f_map[in[0]]);
-				sum_c = _mm_add_ps(_mm_mul_ps(coeffs_x, sample_x), sum_c);
-
-				sample_x = _mm_set1_ps(i2f_map[in[1]]);
-				sum_m = _mm_add_ps(_mm_mul_ps(coeffs_x, sample_x), sum_m);
-
-				sample_x = _mm_set1_ps(i2f_map[in[2]]);
-				sum_y = _mm_add_ps(_mm_mul_ps(coeffs_x, sample_x), sum_y);
-
-				sample_x = _mm_set1_ps(i2f_map[in[3]]);
-				sum_k = _mm_add_ps(_mm_mul_ps(coeffs_x, sample_x), sum_k);
-
-				in += 4;
-				coeffs_x_f += 4;
-			}
-		}
-
-		oil_yacc_fma4_avx2(sums_y_out, sum_c, sum_m, sum_y, sum_k,
-			cy_lo, cy_hi);
-		sums_y_out += 16;
-
-		sum_c = oil_shift_f_left_avx2(sum_c);
-		sum_m = oil_shift_f_left_avx2(sum_m);
-		sum_y = oil_shift_f_left_avx2(sum_y);
-		sum_k = oil_shift_f_left_avx2(sum_k);
-	}
-}
-
-static inline __attribute__((always_inline))
-void oil_scale_down_rgbx_avx2(unsigned char *in, float *sums_y_out,
-	int out_width, float *coeffs_x_f, int *border_buf, float *coeffs_y_f,
-	int tap, float *lut)
-{
-	int i, j;
-	__m128 coeffs_x, coeffs_x2, sample_x, sum_r, sum_g, sum_b;
-	__m128 sum_r2, sum_g2, sum_b2;
-	__m256 cy_lo, cy_hi;
-
-	oil_yacc_build_coeffs_avx2(coeffs_y_f, tap, &cy_lo, &cy_hi);
+	oil_yacc_build_coeffs_avx2(coeffs_y_f, tap, &cy_lo, &cy_hi);
 
 	sum_r = _mm_setzero_ps();
 	sum_g = _mm_setzero_ps();
@@ -1687,8 +2199,9 @@ void oil_scale_down_rgbx_avx2(unsigned char *in, float *sums_y_out,
 	}
 }
 
-static void oil_yscale_out_rgbx_nogamma_avx2(float *sums, int width,
-	unsigned char *out, int tap)
+static inline __attribute__((always_inline))
+void yscale_out_rgbx_nogamma_avx2_impl(float *sums, int width,
+	unsigned char *out, int tap, int gamma2)
 {
 	int i, tap_off;
 	__m128 scale, half, one, zero;
@@ -1714,10 +2227,14 @@ static void oil_yscale_out_rgbx_nogamma_avx2(float *sums, int width,
 		v2 = _mm_load_ps(sums + 32 + tap_off);
 		v3 = _mm_load_ps(sums + 48 + tap_off);
 
-		i0 = oil_clamp_round_idx_avx2(v0, zero, one, scale, half);
-		i1 = oil_clamp_round_idx_avx2(v1, zero, one, scale, half);
-		i2 = oil_clamp_round_idx_avx2(v2, zero, one, scale, half);
-		i3 = oil_clamp_round_idx_avx2(v3, zero, one, scale, half);
+		i0 = oil_clamp_round_gamma_idx_avx2(v0, zero, one,
+			scale, half, gamma2);
+		i1 = oil_clamp_round_gamma_idx_avx2(v1, zero, one,
+			scale, half, gamma2);
+		i2 = oil_clamp_round_gamma_idx_avx2(v2, zero, one,
+			scale, half, gamma2);
+		i3 = oil_clamp_round_gamma_idx_avx2(v3, zero, one,
+			scale, half, gamma2);
 
 		i0 = _mm_or_si128(_mm_and_si128(i0, mask), x_val);
 		i1 = _mm_or_si128(_mm_and_si128(i1, mask), x_val);
@@ -1740,7 +2257,8 @@ static void oil_yscale_out_rgbx_nogamma_avx2(float *sums, int width,
 
 	for (; i<width; i++) {
 		vals = _mm_load_ps(sums + tap_off);
-		idx = oil_clamp_round_idx_avx2(vals, zero, one, scale, half);
+		idx = oil_clamp_round_gamma_idx_avx2(vals, zero, one,
+			scale, half, gamma2);
 		idx = _mm_or_si128(_mm_and_si128(idx, mask), x_val);
 		packed = _mm_packs_epi32(idx, idx);
 		packed = _mm_packus_epi16(packed, packed);
@@ -1753,8 +2271,19 @@ static void oil_yscale_out_rgbx_nogamma_avx2(float *sums, int width,
 	}
 }
 
-static void oil_yscale_out_rgba_nogamma_avx2(float *sums, int width,
-	unsigned char *out, int tap)
+static void oil_yscale_out_rgbx_nogamma_avx2(float *sums, int width,
+	unsigned char *out, int tap, int gamma2)
+{
+	if (gamma2) {
+		yscale_out_rgbx_nogamma_avx2_impl(sums, width, out, tap, 1);
+	} else {
+		yscale_out_rgbx_nogamma_avx2_impl(sums, width, out, tap, 0);
+	}
+}
+
+static inline __attribute__((always_inline))
+void yscale_out_rgba_nogamma_avx2_impl(float *sums, int width,
+	unsigned char *out, int tap, int gamma2)
 {
 	int i, tap_off;
 	__m128 scale, half, one, zero;
@@ -1772,21 +2301,21 @@ static void oil_yscale_out_rgba_nogamma_avx2(float *sums, int width,
 		__m128i idx2, idx3, idx4, packed2;
 
 		idx = oil_unpremul_rgba_idx_avx2(_mm_load_ps(sums + tap_off),
-			zero, one, scale, half);
+			zero, one, scale, half, gamma2);
 		_mm_store_si128((__m128i *)(sums + tap_off), z);
 
 		idx2 = oil_unpremul_rgba_idx_avx2(_mm_load_ps(sums + 16 + tap_off),
-			zero, one, scale, half);
+			zero, one, scale, half, gamma2);
 		_mm_store_si128((__m128i *)(sums + 16 + tap_off), z);
 
 		packed = _mm_packs_epi32(idx, idx2);
 
 		idx3 = oil_unpremul_rgba_idx_avx2(_mm_load_ps(sums + 32 + tap_off),
-			zero, one, scale, half);
+			zero, one, scale, half, gamma2);
 		_mm_store_si128((__m128i *)(sums + 32 + tap_off), z);
 
 		idx4 = oil_unpremul_rgba_idx_avx2(_mm_load_ps(sums + 48 + tap_off),
-			zero, one, scale, half);
+			zero, one, scale, half, gamma2);
 		_mm_store_si128((__m128i *)(sums + 48 + tap_off), z);
 
 		packed2 = _mm_packs_epi32(idx3, idx4);
@@ -1799,7 +2328,7 @@ static void oil_yscale_out_rgba_nogamma_avx2(float *sums, int width,
 
 	for (; i<width; i++) {
 		idx = oil_unpremul_rgba_idx_avx2(_mm_load_ps(sums + tap_off),
-			zero, one, scale, half);
+			zero, one, scale, half, gamma2);
 		packed = _mm_packs_epi32(idx, idx);
 		packed = _mm_packus_epi16(packed, packed);
 		*(int *)out = _mm_cvtsi128_si32(packed);
@@ -1811,8 +2340,19 @@ static void oil_yscale_out_rgba_nogamma_avx2(float *sums, int width,
 	}
 }
 
-static void oil_yscale_up_rgba_nogamma_avx2(float **in, int len, float *coeffs,
-	unsigned char *out)
+static void oil_yscale_out_rgba_nogamma_avx2(float *sums, int width,
+	unsigned char *out, int tap, int gamma2)
+{
+	if (gamma2) {
+		yscale_out_rgba_nogamma_avx2_impl(sums, width, out, tap, 1);
+	} else {
+		yscale_out_rgba_nogamma_avx2_impl(sums, width, out, tap, 0);
+	}
+}
+
+static inline __attribute__((always_inline))
+void yscale_up_rgba_nogamma_avx2_impl(float **in, int len, float *coeffs,
+	unsigned char *out, int gamma2, int line)
 {
 	int i;
 	__m128 c0, c1, c2, c3;
@@ -1830,11 +2370,13 @@ static void oil_yscale_up_rgba_nogamma_avx2(float **in, int len, float *coeffs,
 	zero = _mm_setzero_ps();
 
 	for (i=0; i+7<len; i+=8) {
-		sum_a = oil_ydot4_load_avx2(in, i, c0, c1, c2, c3);
-		sum_b = oil_ydot4_load_avx2(in, i + 4, c0, c1, c2, c3);
+		sum_a = oil_yload_avx2(in, i, c0, c1, c2, c3, line);
+		sum_b = oil_yload_avx2(in, i + 4, c0, c1, c2, c3, line);
 
-		idx_a = oil_unpremul_rgba_idx_avx2(sum_a, zero, one, scale, half);
-		idx_b = oil_unpremul_rgba_idx_avx2(sum_b, zero, one, scale, half);
+		idx_a = oil_unpremul_rgba_idx_avx2(sum_a, zero, one, scale,
+			half, gamma2);
+		idx_b = oil_unpremul_rgba_idx_avx2(sum_b, zero, one, scale,
+			half, gamma2);
 
 		packed = _mm_packs_epi32(idx_a, idx_b);
 		packed = _mm_packus_epi16(packed, packed);
@@ -1842,17 +2384,29 @@ static void oil_yscale_up_rgba_nogamma_avx2(float **in, int len, float *coeffs,
 	}
 
 	for (; i<len; i+=4) {
-		sum_a = oil_ydot4_load_avx2(in, i, c0, c1, c2, c3);
+		sum_a = oil_yload_avx2(in, i, c0, c1, c2, c3, line);
 
-		idx_a = oil_unpremul_rgba_idx_avx2(sum_a, zero, one, scale, half);
+		idx_a = oil_unpremul_rgba_idx_avx2(sum_a, zero, one, scale,
+			half, gamma2);
 		packed = _mm_packs_epi32(idx_a, idx_a);
 		packed = _mm_packus_epi16(packed, packed);
 		*(int *)(out + i) = _mm_cvtsi128_si32(packed);
 	}
 }
 
-static void oil_yscale_up_rgbx_nogamma_avx2(float **in, int len, float *coeffs,
-	unsigned char *out)
+static void oil_yscale_up_rgba_nogamma_avx2(float **in, int len, float *coeffs,
+	unsigned char *out, int gamma2)
+{
+	if (gamma2) {
+		yscale_up_rgba_nogamma_avx2_impl(in, len, coeffs, out, 1, 0);
+	} else {
+		yscale_up_rgba_nogamma_avx2_impl(in, len, coeffs, out, 0, 0);
+	}
+}
+
+static inline __attribute__((always_inline))
+void yscale_up_rgbx_nogamma_avx2_impl(float **in, int len, float *coeffs,
+	unsigned char *out, int gamma2, int line)
 {
 	int i;
 	__m128 c0, c1, c2, c3;
@@ -1874,16 +2428,18 @@ static void oil_yscale_up_rgbx_nogamma_avx2(float **in, int len, float *coeffs,
 
 	for (i=0; i+7<len; i+=8) {
 		/* Pixel 1: 4 floats [R, G, B, X] */
-		sum_a = oil_ydot4_load_avx2(in, i, c0, c1, c2, c3);
+		sum_a = oil_yload_avx2(in, i, c0, c1, c2, c3, line);
 
 		/* Pixel 2 */
-		sum_b = oil_ydot4_load_avx2(in, i + 4, c0, c1, c2, c3);
+		sum_b = oil_yload_avx2(in, i + 4, c0, c1, c2, c3, line);
 
 		/* Clamp, scale, and force X=255 for each pixel */
-		idx_a = oil_clamp_round_idx_avx2(sum_a, zero, one, scale, half);
+		idx_a = oil_clamp_round_gamma_idx_avx2(sum_a, zero, one,
+			scale, half, gamma2);
 		idx_a = _mm_or_si128(_mm_and_si128(idx_a, mask), x_val);
 
-		idx_b = oil_clamp_round_idx_avx2(sum_b, zero, one, scale, half);
+		idx_b = oil_clamp_round_gamma_idx_avx2(sum_b, zero, one,
+			scale, half, gamma2);
 		idx_b = _mm_or_si128(_mm_and_si128(idx_b, mask), x_val);
 
 		/* Pack both pixels to bytes and store 8 bytes */
@@ -1893,9 +2449,10 @@ static void oil_yscale_up_rgbx_nogamma_avx2(float **in, int len, float *coeffs,
 	}
 
 	for (; i<len; i+=4) {
-		sum_a = oil_ydot4_load_avx2(in, i, c0, c1, c2, c3);
+		sum_a = oil_yload_avx2(in, i, c0, c1, c2, c3, line);
 
-		idx_a = oil_clamp_round_idx_avx2(sum_a, zero, one, scale, half);
+		idx_a = oil_clamp_round_gamma_idx_avx2(sum_a, zero, one,
+			scale, half, gamma2);
 		idx_a = _mm_or_si128(_mm_and_si128(idx_a, mask), x_val);
 		packed = _mm_packs_epi32(idx_a, idx_a);
 		packed = _mm_packus_epi16(packed, packed);
@@ -1903,15 +2460,386 @@ static void oil_yscale_up_rgbx_nogamma_avx2(float **in, int len, float *coeffs,
 	}
 }
 
-/* AVX2 dispatch functions */
+static void oil_yscale_up_rgbx_nogamma_avx2(float **in, int len, float *coeffs,
+	unsigned char *out, int gamma2)
+{
+	if (gamma2) {
+		yscale_up_rgbx_nogamma_avx2_impl(in, len, coeffs, out, 1, 0);
+	} else {
+		yscale_up_rgbx_nogamma_avx2_impl(in, len, coeffs, out, 0, 0);
+	}
+}
+
+/* Fixed point */
 
-static float *get_rb_line(struct oil_scale *os, int line)
+/* Round lane 0 of a fixed-point x-sum to a sample (see OIL_FIXED_SHIFT()),
+ * accumulate the sample into the 4 sums at sums weighed by coeffs_y, and
+ * shift the x-sum left by one lane. coeffs_y holds one y-coefficient in the
+ * low int16 of each 32-bit lane. */
+static inline __attribute__((always_inline))
+__m128i fixed_out_avx2(__m128i sum, int *sums, __m128i coeffs_y, int shift)
 {
-	int sl_len;
-	sl_len = OIL_CMP(os->cs) * os->out_width;
-	return os->rb + line * sl_len;
+	__m128i smp;
+
+	smp = _mm_add_epi32(sum, _mm_set1_epi32(1 << (shift - 1)));
+	smp = _mm_shuffle_epi32(_mm_srai_epi32(smp, shift), 0x00);
+	_mm_storeu_si128((__m128i *)sums, _mm_add_epi32(
+		_mm_loadu_si128((__m128i *)sums), _mm_madd_epi16(smp, coeffs_y)));
+	return _mm_srli_si128(sum, 4);
+}
+
+/* Broadcast samples a & b as a pair of int16s into every 32-bit lane, to be
+ * weighed by a pair of taps with _mm_madd_epi16(). */
+static inline __attribute__((always_inline))
+__m128i fixed_pair_avx2(int a, int b)
+{
+	return _mm_set1_epi32(a | b << 16);
+}
+
+static void oil_scale_down_fixed_g_avx2(unsigned char *in, int out_width,
+	int *sums, short *coeffs_x, int *border_buf, __m128i coeffs_y)
+{
+	int i, j, n, px4;
+	__m128i sum, px, zero;
+
+	zero = _mm_setzero_si128();
+	sum = zero;
+	for (i=0; i<out_width; i++) {
+		n = border_buf[i];
+		/* 4 taps: two pairs from one 32-bit load */
+		for (j=0; j+3<n; j+=4) {
+			memcpy(&px4, in, 4);
+			px = _mm_unpacklo_epi8(_mm_cvtsi32_si128(px4), zero);
+			sum = _mm_add_epi32(sum, _mm_madd_epi16(
+				_mm_shuffle_epi32(px, 0x00),
+				_mm_loadu_si128((__m128i *)coeffs_x)));
+			sum = _mm_add_epi32(sum, _mm_madd_epi16(
+				_mm_shuffle_epi32(px, 0x55),
+				_mm_loadu_si128((__m128i *)(coeffs_x + 8))));
+			in += 4;
+			coeffs_x += 16;
+		}
+		if (j + 1 < n) {
+			sum = _mm_add_epi32(sum, _mm_madd_epi16(
+				fixed_pair_avx2(in[0], in[1]),
+				_mm_loadu_si128((__m128i *)coeffs_x)));
+			in += 2;
+			coeffs_x += 8;
+			j += 2;
+		}
+		if (j < n) {
+			sum = _mm_add_epi32(sum, _mm_madd_epi16(
+				fixed_pair_avx2(in[0], 0),
+				_mm_loadu_si128((__m128i *)coeffs_x)));
+			in += 1;
+			coeffs_x += 8;
+		}
+		sum = fixed_out_avx2(sum, sums, coeffs_y, 8);
+		sums += 4;
+	}
+}
+
+/* Load 1 or 2 pixels of cmp bytes each, zeroing the rest of the vector. */
+static inline __attribute__((always_inline))
+__m128i fixed_load_avx2(unsigned char *in, int npix, int cmp)
+{
+	int px4;
+	short px2;
+
+	if (npix == 1 && cmp == 3) {
+		memcpy(&px2, in, 2);
+		return _mm_insert_epi8(_mm_cvtsi32_si128((unsigned short)px2),
+			in[2], 2);
+	} else if (npix == 1 || cmp == 3) {
+		memcpy(&px4, in, 4);
+		if (cmp == 3) {
+			memcpy(&px2, in + 4, 2);
+			return _mm_insert_epi16(_mm_cvtsi32_si128(px4), px2, 2);
+		}
+		return _mm_cvtsi32_si128(px4);
+	}
+	return _mm_loadl_epi64((__m128i *)in);
+}
+
+/* RGB_NOGAMMA when cmp is 3, RGBX_NOGAMMA when cmp is 4 */
+static inline __attribute__((always_inline))
+void scale_down_fixed_rgb_avx2_impl(unsigned char *in, int out_width,
+	int *sums, short *coeffs_x, int *border_buf, __m128i coeffs_y, int cmp)
+{
+	int i, j, n;
+	__m128i sum_r, sum_g, sum_b, coeffs, px, shuf_r, shuf_g, shuf_b;
+
+	/* broadcast the pair of each channel as int16s, as for
+	 * fixed_pair_avx2() */
+	shuf_r = _mm_set1_epi32((int)(0x80008000u | cmp << 16));
+	shuf_g = _mm_add_epi32(shuf_r, _mm_set1_epi32(1 << 16 | 1));
+	shuf_b = _mm_add_epi32(shuf_g, _mm_set1_epi32(1 << 16 | 1));
+	sum_r = sum_g = sum_b = _mm_setzero_si128();
+	for (i=0; i<out_width; i++) {
+		n = border_buf[i];
+		for (j=0; j<n; j+=2) {
+			coeffs = _mm_loadu_si128((__m128i *)coeffs_x);
+			if (j + 1 < n) {
+				px = fixed_load_avx2(in, 2, cmp);
+				in += 2 * cmp;
+			} else {
+				px = fixed_load_avx2(in, 1, cmp);
+				in += cmp;
+			}
+			sum_r = _mm_add_epi32(sum_r, _mm_madd_epi16(
+				_mm_shuffle_epi8(px, shuf_r), coeffs));
+			sum_g = _mm_add_epi32(sum_g, _mm_madd_epi16(
+				_mm_shuffle_epi8(px, shuf_g), coeffs));
+			sum_b = _mm_add_epi32(sum_b, _mm_madd_epi16(
+				_mm_shuffle_epi8(px, shuf_b), coeffs));
+			coeffs_x += 8;
+		}
+		sum_r = fixed_out_avx2(sum_r, sums, coeffs_y, 8);
+		sum_g = fixed_out_avx2(sum_g, sums + 4, coeffs_y, 8);
+		sum_b = fixed_out_avx2(sum_b, sums + 8, coeffs_y, 8);
+		sums += cmp * 4;
+	}
+}
+
+static void oil_scale_down_fixed_rgb_avx2(unsigned char *in, int out_width,
+	int *sums, short *coeffs_x, int *border_buf, __m128i coeffs_y)
+{
+	scale_down_fixed_rgb_avx2_impl(in, out_width, sums, coeffs_x,
+		border_buf, coeffs_y, 3);
+}
+
+static void oil_scale_down_fixed_rgbx_avx2(unsigned char *in, int out_width,
+	int *sums, short *coeffs_x, int *border_buf, __m128i coeffs_y)
+{
+	scale_down_fixed_rgb_avx2_impl(in, out_width, sums, coeffs_x,
+		border_buf, coeffs_y, 4);
+}
+
+static void oil_scale_down_fixed_rgba_avx2(unsigned char *in, int out_width,
+	int *sums, short *coeffs_x, int *border_buf, __m128i coeffs_y)
+{
+	int i, j, n, px4;
+	__m128i sum_r, sum_g, sum_b, sum_a, coeffs, zero, px, alpha, rgb_mask,
+		alpha_255, two, premul;
+
+	zero = _mm_setzero_si128();
+	sum_r = sum_g = sum_b = sum_a = zero;
+	rgb_mask = _mm_set_epi32(0, -1, -1, -1);
+	alpha_255 = _mm_set_epi32(255 | 255 << 16, 0, 0, 0);
+	two = _mm_set1_epi16(2);
+	premul = _mm_set1_epi16((short)OIL_FIXED_PREMUL);
+	for (i=0; i<out_width; i++) {
+		n = border_buf[i];
+		for (j=0; j<n; j+=2) {
+			if (j + 1 < n) {
+				px = _mm_loadl_epi64((__m128i *)in);
+				in += 8;
+			} else {
+				memcpy(&px4, in, 4);
+				px = _mm_cvtsi32_si128(px4);
+				in += 4;
+			}
+			/* [r0 r1 g0 g1 b0 b1 a0 a1] as int16s */
+			px = _mm_unpacklo_epi8(px, zero);
+			px = _mm_unpacklo_epi16(px, _mm_srli_si128(px, 8));
+			/* premultiply, treating alpha as a colour at 255 */
+			alpha = _mm_shuffle_epi32(px, 0xFF);
+			alpha = _mm_or_si128(_mm_and_si128(alpha, rgb_mask),
+				alpha_255);
+			px = _mm_mulhi_epu16(_mm_add_epi16(_mm_mullo_epi16(px,
+				alpha), two), premul);
+
+			coeffs = _mm_loadu_si128((__m128i *)coeffs_x);
+			sum_r = _mm_add_epi32(sum_r, _mm_madd_epi16(
+				_mm_shuffle_epi32(px, 0x00), coeffs));
+			sum_g = _mm_add_epi32(sum_g, _mm_madd_epi16(
+				_mm_shuffle_epi32(px, 0x55), coeffs));
+			sum_b = _mm_add_epi32(sum_b, _mm_madd_epi16(
+				_mm_shuffle_epi32(px, 0xAA), coeffs));
+			sum_a = _mm_add_epi32(sum_a, _mm_madd_epi16(
+				_mm_shuffle_epi32(px, 0xFF), coeffs));
+			coeffs_x += 8;
+		}
+		sum_r = fixed_out_avx2(sum_r, sums, coeffs_y, 14);
+		sum_g = fixed_out_avx2(sum_g, sums + 4, coeffs_y, 14);
+		sum_b = fixed_out_avx2(sum_b, sums + 8, coeffs_y, 14);
+		sum_a = fixed_out_avx2(sum_a, sums + 12, coeffs_y, 14);
+		sums += 16;
+	}
+}
+
+/* Gather lane tap of the 4 sums at each of a, b, c & d into one vector. */
+static inline __attribute__((always_inline))
+__m128i fixed_lane_avx2(__m128i a, __m128i b, __m128i c, __m128i d, int tap)
+{
+	__m128i ab, cd;
+
+	if (tap < 2) {
+		ab = _mm_unpacklo_epi32(a, b);
+		cd = _mm_unpacklo_epi32(c, d);
+	} else {
+		ab = _mm_unpackhi_epi32(a, b);
+		cd = _mm_unpackhi_epi32(c, d);
+	}
+	return tap & 1 ? _mm_unpackhi_epi64(ab, cd) : _mm_unpacklo_epi64(ab, cd);
+}
+
+/* Load lane tap of 4 consecutive samples' sums, zeroing it in memory. */
+static inline __attribute__((always_inline))
+__m128i fixed_take4_avx2(int *sums, __m128i keep, int tap)
+{
+	__m128i a, b, c, d;
+
+	a = _mm_loadu_si128((__m128i *)sums);
+	b = _mm_loadu_si128((__m128i *)(sums + 4));
+	c = _mm_loadu_si128((__m128i *)(sums + 8));
+	d = _mm_loadu_si128((__m128i *)(sums + 12));
+	_mm_storeu_si128((__m128i *)sums, _mm_and_si128(a, keep));
+	_mm_storeu_si128((__m128i *)(sums + 4), _mm_and_si128(b, keep));
+	_mm_storeu_si128((__m128i *)(sums + 8), _mm_and_si128(c, keep));
+	_mm_storeu_si128((__m128i *)(sums + 12), _mm_and_si128(d, keep));
+	return fixed_lane_avx2(a, b, c, d, tap);
 }
 
+/* G, RGB_NOGAMMA & RGBX_NOGAMMA. len is the number of samples. */
+static inline __attribute__((always_inline))
+void yscale_out_fixed_avx2_impl(int *sums, int len, unsigned char *out,
+	int tap, int is_rgbx)
+{
+	int i, v;
+	__m128i keep, round, x_mask, a, b, c, d;
+
+	keep = _mm_cmpeq_epi32(_mm_set_epi32(3, 2, 1, 0), _mm_set1_epi32(tap));
+	keep = _mm_xor_si128(keep, _mm_set1_epi32(-1));
+	round = _mm_set1_epi32(1 << 19);
+	x_mask = _mm_set1_epi32(is_rgbx ? 0xFF000000 : 0);
+	for (i=0; i+15<len; i+=16) {
+		a = fixed_take4_avx2(sums, keep, tap);
+		b = fixed_take4_avx2(sums + 16, keep, tap);
+		c = fixed_take4_avx2(sums + 32, keep, tap);
+		d = fixed_take4_avx2(sums + 48, keep, tap);
+		a = _mm_srai_epi32(_mm_add_epi32(a, round), 20);
+		b = _mm_srai_epi32(_mm_add_epi32(b, round), 20);
+		c = _mm_srai_epi32(_mm_add_epi32(c, round), 20);
+		d = _mm_srai_epi32(_mm_add_epi32(d, round), 20);
+		a = _mm_packus_epi16(_mm_packs_epi32(a, b),
+			_mm_packs_epi32(c, d));
+		_mm_storeu_si128((__m128i *)(out + i), _mm_or_si128(a, x_mask));
+		sums += 64;
+	}
+	for (; i<len; i++) {
+		v = (sums[tap] + (1 << 19)) >> 20;
+		out[i] = v < 0 ? 0 : (v > 255 ? 255 : v);
+		if (is_rgbx && (i & 3) == 3) {
+			out[i] = 255;
+		}
+		sums[tap] = 0;
+		sums += 4;
+	}
+}
+
+static inline __attribute__((always_inline))
+void yscale_out_fixed_rgba_avx2_impl(int *sums, int width, unsigned char *out,
+	int tap)
+{
+	int i;
+	__m128i keep, idx;
+	__m128 scale, zero, one, half, f255, val, alpha, rgb_mask;
+
+	keep = _mm_cmpeq_epi32(_mm_set_epi32(3, 2, 1, 0), _mm_set1_epi32(tap));
+	keep = _mm_xor_si128(keep, _mm_set1_epi32(-1));
+	/* same arithmetic as the C version, so the output is identical */
+	scale = _mm_set1_ps(65536.0f / (255.0f * 255.0f * OIL_FIXED_PREMUL *
+		OIL_FIXED_ONE));
+	zero = _mm_setzero_ps();
+	one = _mm_set1_ps(1.0f);
+	half = _mm_set1_ps(0.5f);
+	f255 = _mm_set1_ps(255.0f);
+	rgb_mask = _mm_castsi128_ps(_mm_set_epi32(0, -1, -1, -1));
+	for (i=0; i<width; i++) {
+		val = _mm_mul_ps(_mm_cvtepi32_ps(fixed_take4_avx2(sums, keep,
+			tap)), scale);
+		alpha = _mm_shuffle_ps(val, val, _MM_SHUFFLE(3, 3, 3, 3));
+		alpha = _mm_min_ps(_mm_max_ps(alpha, zero), one);
+		/* divide by alpha unless it is 0 */
+		val = _mm_div_ps(val, _mm_or_ps(
+			_mm_and_ps(_mm_cmpneq_ps(alpha, zero), alpha),
+			_mm_and_ps(_mm_cmpeq_ps(alpha, zero), one)));
+		val = _mm_min_ps(_mm_max_ps(val, zero), one);
+		val = _mm_or_ps(_mm_and_ps(val, rgb_mask),
+			_mm_andnot_ps(rgb_mask, alpha));
+		idx = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(val, f255), half));
+		idx = _mm_packs_epi32(idx, idx);
+		idx = _mm_packus_epi16(idx, idx);
+		*(int *)(out + i * 4) = _mm_cvtsi128_si32(idx);
+		sums += 16;
+	}
+}
+
+static void scale_down_fixed_avx2(unsigned char *in, int out_width,
+	int *sums, enum oil_colorspace cs, short *coeffs_x, int *border_buf,
+	short *coeffs_y)
+{
+	__m128i cy;
+
+	cy = _mm_unpacklo_epi16(_mm_loadl_epi64((__m128i *)coeffs_y),
+		_mm_setzero_si128());
+	switch(cs) {
+	case OIL_CS_G:
+		oil_scale_down_fixed_g_avx2(in, out_width, sums, coeffs_x,
+			border_buf, cy);
+		break;
+	case OIL_CS_RGB_NOGAMMA:
+		oil_scale_down_fixed_rgb_avx2(in, out_width, sums, coeffs_x,
+			border_buf, cy);
+		break;
+	case OIL_CS_RGBA_NOGAMMA:
+		oil_scale_down_fixed_rgba_avx2(in, out_width, sums, coeffs_x,
+			border_buf, cy);
+		break;
+	case OIL_CS_RGBX_NOGAMMA:
+		oil_scale_down_fixed_rgbx_avx2(in, out_width, sums, coeffs_x,
+			border_buf, cy);
+		break;
+	default:
+		break;
+	}
+}
+
+/* Expand the tap to a constant in each copy of the kernel. */
+static inline __attribute__((always_inline))
+void yscale_out_fixed_tap_avx2(int *sums, int width, unsigned char *out,
+	enum oil_colorspace cs, int tap)
+{
+	if (cs == OIL_CS_RGBA_NOGAMMA) {
+		yscale_out_fixed_rgba_avx2_impl(sums, width, out, tap);
+	} else {
+		yscale_out_fixed_avx2_impl(sums, width * OIL_CMP(cs), out, tap,
+			cs == OIL_CS_RGBX_NOGAMMA);
+	}
+}
+
+static void yscale_out_fixed_avx2(int *sums, int width, unsigned char *out,
+	enum oil_colorspace cs, int tap)
+{
+	switch(tap) {
+	case 0:
+		yscale_out_fixed_tap_avx2(sums, width, out, cs, 0);
+		break;
+	case 1:
+		yscale_out_fixed_tap_avx2(sums, width, out, cs, 1);
+		break;
+	case 2:
+		yscale_out_fixed_tap_avx2(sums, width, out, cs, 2);
+		break;
+	case 3:
+		yscale_out_fixed_tap_avx2(sums, width, out, cs, 3);
+		break;
+	}
+}
+
+/* AVX2 dispatch functions */
+
 static void yscale_out_avx2(float *sums, int width, unsigned char *out,
 	enum oil_colorspace cs, int tap)
 {
@@ -1945,10 +2873,19 @@ static void yscale_out_avx2(float *sums, int width, unsigned char *out,
 		oil_yscale_out_nonlinear_avx2(sums, sl_len, out);
 		break;
 	case OIL_CS_RGBA_NOGAMMA:
-		oil_yscale_out_rgba_nogamma_avx2(sums, width, out, tap);
+		oil_yscale_out_rgba_nogamma_avx2(sums, width, out, tap, 0);
 		break;
 	case OIL_CS_RGBX_NOGAMMA:
-		oil_yscale_out_rgbx_nogamma_avx2(sums, width, out, tap);
+		oil_yscale_out_rgbx_nogamma_avx2(sums, width, out, tap, 0);
+		break;
+	case OIL_CS_RGB_GAMMA2:
+		oil_yscale_out_gamma2_avx2(sums, sl_len, out);
+		break;
+	case OIL_CS_RGBA_GAMMA2:
+		oil_yscale_out_rgba_nogamma_avx2(sums, width, out, tap, 1);
+		break;
+	case OIL_CS_RGBX_GAMMA2:
+		oil_yscale_out_rgbx_nogamma_avx2(sums, width, out, tap, 1);
 		break;
 	case OIL_CS_UNKNOWN:
 		break;
@@ -1970,10 +2907,10 @@ static void yscale_up_avx2(float **in, int len, float *coeffs,
 		oil_yscale_up_rgb_avx2(in, len, coeffs, out);
 		break;
 	case OIL_CS_RGBA:
-		oil_yscale_up_rgba_avx2(in, len, coeffs, out, 3, 0);
+		oil_yscale_up_rgba_avx2(in, len, coeffs, out, 3, 0, 0);
 		break;
 	case OIL_CS_ARGB:
-		oil_yscale_up_rgba_avx2(in, len, coeffs, out, 0, 1);
+		oil_yscale_up_rgba_avx2(in, len, coeffs, out, 0, 1, 0);
 		break;
 	case OIL_CS_RGBX:
 		oil_yscale_up_rgbx_avx2(in, len, coeffs, out);
@@ -1982,10 +2919,19 @@ static void yscale_up_avx2(float **in, int len, float *coeffs,
 		oil_yscale_up_g_cmyk_avx2(in, len, coeffs, out);
 		break;
 	case OIL_CS_RGBA_NOGAMMA:
-		oil_yscale_up_rgba_nogamma_avx2(in, len, coeffs, out);
+		oil_yscale_up_rgba_nogamma_avx2(in, len, coeffs, out, 0);
 		break;
 	case OIL_CS_RGBX_NOGAMMA:
-		oil_yscale_up_rgbx_nogamma_avx2(in, len, coeffs, out);
+		oil_yscale_up_rgbx_nogamma_avx2(in, len, coeffs, out, 0);
+		break;
+	case OIL_CS_RGB_GAMMA2:
+		oil_yscale_up_gamma2_avx2(in, len, coeffs, out);
+		break;
+	case OIL_CS_RGBA_GAMMA2:
+		oil_yscale_up_rgba_nogamma_avx2(in, len, coeffs, out, 1);
+		break;
+	case OIL_CS_RGBX_GAMMA2:
+		oil_yscale_up_rgbx_nogamma_avx2(in, len, coeffs, out, 1);
 		break;
 	case OIL_CS_UNKNOWN:
 		break;
@@ -2026,24 +2972,29 @@ static void xscale_up_avx2(unsigned char *in, int width_in, float *out,
 	case OIL_CS_RGBX_NOGAMMA:
 		oil_xscale_up_rgbx_avx2(in, width_in, out, coeff_buf, border_buf, i2f_map);
 		break;
+	case OIL_CS_RGB_GAMMA2:
+		oil_xscale_up_rgb_avx2(in, width_in, out, coeff_buf, border_buf, g2l_map);
+		break;
+	case OIL_CS_RGBA_GAMMA2:
+		oil_xscale_up_rgba_avx2(in, width_in, out, coeff_buf, border_buf, 3, 0, g2l_map);
+		break;
+	case OIL_CS_RGBX_GAMMA2:
+		oil_xscale_up_rgbx_avx2(in, width_in, out, coeff_buf, border_buf, g2l_map);
+		break;
 	case OIL_CS_UNKNOWN:
 		break;
 	}
 }
 
-static inline __attribute__((always_inline))
-void down_scale_in_avx2(struct oil_scale *os, unsigned char *in)
+static void scale_down_avx2(struct oil_scale *os, unsigned char *in,
+	float *coeffs_y)
 {
-	float *coeffs_y;
-
-	coeffs_y = os->coeffs_y + os->in_pos * 4;
-
 	switch(os->cs) {
 	case OIL_CS_RGB:
 		oil_scale_down_rgb_avx2(in, os->sums_y, os->out_width, os->coeffs_x, os->borders_x, coeffs_y, s2l_map);
 		break;
 	case OIL_CS_G:
-		if (os->in_width >= os->out_width * 2) {
+		if (os->in_width / os->out_width >= os->heavy_ratio) {
 			oil_scale_down_g_heavy_avx2(in, os->sums_y, os->out_width, os->coeffs_x, os->borders_x, coeffs_y);
 		} else {
 			oil_scale_down_g_avx2(in, os->sums_y, os->out_width, os->coeffs_x, os->borders_x, coeffs_y);
@@ -2073,65 +3024,452 @@ void down_scale_in_avx2(struct oil_scale *os, unsigned char *in)
 	case OIL_CS_RGBX_NOGAMMA:
 		oil_scale_down_rgbx_avx2(in, os->sums_y, os->out_width, os->coeffs_x, os->borders_x, coeffs_y, os->sums_y_tap, i2f_map);
 		break;
+	case OIL_CS_RGB_GAMMA2:
+		oil_scale_down_rgb_avx2(in, os->sums_y, os->out_width, os->coeffs_x, os->borders_x, coeffs_y, g2l_map);
+		break;
+	case OIL_CS_RGBA_GAMMA2:
+		oil_scale_down_rgba_avx2(in, os->sums_y, os->out_width, os->coeffs_x, os->borders_x, coeffs_y, os->sums_y_tap, 3, 0, g2l_map);
+		break;
+	case OIL_CS_RGBX_GAMMA2:
+		oil_scale_down_rgbx_avx2(in, os->sums_y, os->out_width, os->coeffs_x, os->borders_x, coeffs_y, os->sums_y_tap, g2l_map);
+		break;
 	case OIL_CS_UNKNOWN:
 		break;
 	}
+}
 
-	os->slots_y -= 1;
-	os->in_pos++;
+static void scale_down_planar_avx2(unsigned char *in, int heavy,
+	int out_width, float *sums, enum oil_colorspace cs, float *coeffs_x,
+	int *border_buf, float *coeffs_y, int tap)
+{
+	switch(cs) {
+	case OIL_CS_G:
+		if (heavy) {
+			oil_scale_down_g_heavy_planar_avx2(in, sums, out_width, coeffs_x, border_buf, coeffs_y, tap);
+		} else {
+			oil_scale_down_g_planar_avx2(in, sums, out_width, coeffs_x, border_buf, coeffs_y, tap);
+		}
+		break;
+	case OIL_CS_GA:
+		oil_scale_down_ga_planar_avx2(in, sums, out_width, coeffs_x, border_buf, coeffs_y, tap);
+		break;
+	default:
+		break;
+	}
 }
 
-static void up_scale_in_avx2(struct oil_scale *os, unsigned char *in)
+static void yscale_out_planar_avx2(float *sums, int width,
+	unsigned char *out, enum oil_colorspace cs, int tap)
 {
-	float *tmp;
+	int sl_len;
+	float *line;
 
-	tmp = get_rb_line(os, os->in_pos % 4);
-	xscale_up_avx2(in, os->in_width, tmp, os->cs, os->coeffs_x, os->borders_x);
+	sl_len = width * OIL_CMP(cs);
+	line = sums + tap * sl_len;
 
-	os->in_pos++;
-	os->slots_y = os->borders_y[os->in_pos - 1];
+	switch(cs) {
+	case OIL_CS_G:
+		oil_yscale_out_planar_g_avx2(line, sl_len, out);
+		break;
+	case OIL_CS_GA:
+		oil_yscale_out_planar_ga_avx2(line, sl_len, out);
+		break;
+	default:
+		break;
+	}
 }
 
-int oil_scale_in_avx2(struct oil_scale *os, unsigned char *in)
+static void yscale_up_rows_avx2(float **in, int len, float *coeffs, int n,
+	unsigned char *out, ptrdiff_t stride, enum oil_colorspace cs)
 {
-	if (oil_scale_slots(os) == 0) {
-		return -1;
-	}
-	if (os->out_width > os->in_width) {
-		up_scale_in_avx2(os, in);
-	} else {
-		down_scale_in_avx2(os, in);
+	int j;
+
+	switch(cs) {
+	case OIL_CS_G:
+	case OIL_CS_CMYK:
+	case OIL_CS_RGB_NOGAMMA:
+		yscale_up_rows_avx2_impl(in, len, coeffs, n, out, stride, 0, 0);
+		break;
+	case OIL_CS_RGB_GAMMA2:
+		yscale_up_rows_avx2_impl(in, len, coeffs, n, out, stride, 0, 1);
+		break;
+	case OIL_CS_RGB:
+		yscale_up_rows_avx2_impl(in, len, coeffs, n, out, stride, 1, 0);
+		break;
+	default:
+		for (j=0; j<n; j++) {
+			yscale_up_avx2(in, len, coeffs + j * 4,
+				out + j * stride, cs);
+		}
+		break;
 	}
-	return 0;
 }
 
-int oil_scale_out_avx2(struct oil_scale *os, unsigned char *out)
+/* Mixed geometry */
+
+/* The sample xscale_up_avx2() interpolates for the pixel at in: OIL_CMP(cs)
+ * floats, linear and premultiplied. The lanes past those are unused.
+ */
+static inline __attribute__((always_inline))
+__m128 oil_xsample_avx2(unsigned char *in, enum oil_colorspace cs,
+	float *lut)
 {
-	int i, sl_len;
-	float *in[4];
+	unsigned int px;
+	__m128 smp;
 
-	if (oil_scale_slots(os) != 0) {
-		return -1;
+	switch(cs) {
+	case OIL_CS_G:
+		return _mm_set_ss(i2f_map[in[0]]);
+	case OIL_CS_GA:
+		return _mm_mul_ps(_mm_set1_ps(i2f_map[in[1]]),
+			_mm_setr_ps(i2f_map[in[0]], 1.0f, 0.0f, 0.0f));
+	case OIL_CS_CMYK:
+		memcpy(&px, in, 4);
+		smp = _mm_cvtepi32_ps(_mm_cvtepu8_epi32(_mm_cvtsi32_si128(px)));
+		return _mm_mul_ps(smp, _mm_set1_ps(1.0f / 255.0f));
+	case OIL_CS_RGBA:
+	case OIL_CS_RGBA_NOGAMMA:
+	case OIL_CS_RGBA_GAMMA2:
+		memcpy(&px, in, 4);
+		smp = _mm_blend_ps(oil_px4_gather_avx2(px, lut),
+			_mm_set1_ps(1.0f), 0x8);
+		return _mm_mul_ps(smp, _mm_set1_ps(i2f_map[in[3]]));
+	case OIL_CS_ARGB:
+		memcpy(&px, in, 4);
+		smp = _mm_blend_ps(oil_px4_gather_avx2(px >> 8, lut),
+			_mm_set1_ps(1.0f), 0x8);
+		return _mm_mul_ps(smp, _mm_set1_ps(i2f_map[in[0]]));
+	case OIL_CS_RGBX:
+	case OIL_CS_RGBX_NOGAMMA:
+	case OIL_CS_RGBX_GAMMA2:
+		memcpy(&px, in, 4);
+		return _mm_blend_ps(oil_px4_gather_avx2(px, lut),
+			_mm_set1_ps(1.0f), 0x8);
+	case OIL_CS_RGB:
+	case OIL_CS_RGB_NOGAMMA:
+	case OIL_CS_RGB_GAMMA2:
+		return _mm_setr_ps(lut[in[0]], lut[in[1]], lut[in[2]], 0.0f);
+	default:
+		return _mm_setzero_ps();
 	}
+}
 
-	if (os->out_height <= os->in_height) {
-		yscale_out_avx2(os->sums_y, os->out_width, out, os->cs, os->sums_y_tap);
-		os->sums_y_tap = (os->sums_y_tap + 1) & 3;
-	} else {
-		sl_len = OIL_CMP(os->cs) * os->out_width;
-		for (i=0; i<4; i++) {
-			in[i] = get_rb_line(os, (os->in_pos + i) % 4);
+/* Store the first cmp floats of v. */
+static inline __attribute__((always_inline))
+void oil_store_smp_avx2(float *out, __m128 v, int cmp)
+{
+	switch(cmp) {
+	case 1:
+		_mm_store_ss(out, v);
+		break;
+	case 2:
+		_mm_storel_pi((__m64 *)out, v);
+		break;
+	case 3:
+		_mm_storel_pi((__m64 *)out, v);
+		_mm_store_ss(out + 2, _mm_movehl_ps(v, v));
+		break;
+	default:
+		_mm_storeu_ps(out, v);
+		break;
+	}
+}
+
+/* x-downscale a scanline into a line of out_width samples. The sums of the 4
+ * pending output positions are kept as [t0|t1] and [t2|t3], one vector of
+ * components each, so every input sample costs two FMAs whatever the number
+ * of components. The samples of an output position go into fresh even & odd
+ * accumulators, which are added to the carried sums once.
+ */
+static inline __attribute__((always_inline))
+void xscale_down_avx2_impl(unsigned char *in, int out_width, float *out,
+	float *coeffs_x, int *border_buf, enum oil_colorspace cs, float *lut)
+{
+	int i, j, cmp;
+	__m128 smp;
+	__m256 s01, s23, a01, a23, b01, b23, c, smp2;
+	__m256i sel01, sel23;
+
+	cmp = OIL_CMP(cs);
+	sel01 = _mm256_setr_epi32(0, 0, 0, 0, 1, 1, 1, 1);
+	sel23 = _mm256_setr_epi32(2, 2, 2, 2, 3, 3, 3, 3);
+	s01 = _mm256_setzero_ps();
+	s23 = _mm256_setzero_ps();
+
+	for (i=0; i<out_width; i++) {
+		a01 = a23 = b01 = b23 = _mm256_setzero_ps();
+		for (j=0; j+1<border_buf[i]; j+=2) {
+			smp = oil_xsample_avx2(in, cs, lut);
+			smp2 = _mm256_set_m128(smp, smp);
+			c = _mm256_broadcast_ps((__m128 const *)coeffs_x);
+			a01 = _mm256_fmadd_ps(_mm256_permutevar_ps(c, sel01),
+				smp2, a01);
+			a23 = _mm256_fmadd_ps(_mm256_permutevar_ps(c, sel23),
+				smp2, a23);
+
+			smp = oil_xsample_avx2(in + cmp, cs, lut);
+			smp2 = _mm256_set_m128(smp, smp);
+			c = _mm256_broadcast_ps((__m128 const *)(coeffs_x + 4));
+			b01 = _mm256_fmadd_ps(_mm256_permutevar_ps(c, sel01),
+				smp2, b01);
+			b23 = _mm256_fmadd_ps(_mm256_permutevar_ps(c, sel23),
+				smp2, b23);
+
+			in += 2 * cmp;
+			coeffs_x += 8;
+		}
+		if (j < border_buf[i]) {
+			smp = oil_xsample_avx2(in, cs, lut);
+			smp2 = _mm256_set_m128(smp, smp);
+			c = _mm256_broadcast_ps((__m128 const *)coeffs_x);
+			a01 = _mm256_fmadd_ps(_mm256_permutevar_ps(c, sel01),
+				smp2, a01);
+			a23 = _mm256_fmadd_ps(_mm256_permutevar_ps(c, sel23),
+				smp2, a23);
+			in += cmp;
+			coeffs_x += 4;
 		}
-		yscale_up_avx2(in, sl_len, os->coeffs_y + os->out_pos * 4, out,
-			os->cs);
-		os->slots_y -= 1;
+
+		s01 = _mm256_add_ps(s01, _mm256_add_ps(a01, b01));
+		s23 = _mm256_add_ps(s23, _mm256_add_ps(a23, b23));
+		oil_store_smp_avx2(out, _mm256_castps256_ps128(s01), cmp);
+		out += cmp;
+
+		/* shift to [t1|t2], [t3|0] */
+		s01 = _mm256_permute2f128_ps(s01, s23, 0x21);
+		s23 = _mm256_permute2f128_ps(s23, s23, 0x81);
 	}
+}
 
-	os->out_pos++;
-	if (os->out_height <= os->in_height && os->out_pos < os->out_height) {
-		os->slots_y = os->borders_y[os->out_pos];
+static void xscale_down_avx2(unsigned char *in, int heavy, int out_width,
+	float *out, enum oil_colorspace cs, float *coeffs_x, int *border_buf)
+{
+	/* G & GA reuse the planar downscale kernels, weighing line 0 by 1 */
+	static float coeffs_y[4] = { 1.0f, 0.0f, 0.0f, 0.0f };
+
+	switch(cs) {
+	case OIL_CS_G:
+	case OIL_CS_GA:
+		memset(out, 0, out_width * OIL_CMP(cs) * sizeof(float));
+		scale_down_planar_avx2(in, heavy, out_width, out, cs,
+			coeffs_x, border_buf, coeffs_y, 0);
+		break;
+	case OIL_CS_RGB:
+		xscale_down_avx2_impl(in, out_width, out, coeffs_x, border_buf, OIL_CS_RGB, s2l_map);
+		break;
+	case OIL_CS_CMYK:
+		xscale_down_avx2_impl(in, out_width, out, coeffs_x, border_buf, OIL_CS_CMYK, NULL);
+		break;
+	case OIL_CS_RGBA:
+		xscale_down_avx2_impl(in, out_width, out, coeffs_x, border_buf, OIL_CS_RGBA, s2l_map);
+		break;
+	case OIL_CS_ARGB:
+		xscale_down_avx2_impl(in, out_width, out, coeffs_x, border_buf, OIL_CS_ARGB, s2l_map);
+		break;
+	case OIL_CS_RGBX:
+		xscale_down_avx2_impl(in, out_width, out, coeffs_x, border_buf, OIL_CS_RGBX, s2l_map);
+		break;
+	case OIL_CS_RGB_NOGAMMA:
+		xscale_down_avx2_impl(in, out_width, out, coeffs_x, border_buf, OIL_CS_RGB_NOGAMMA, i2f_map);
+		break;
+	case OIL_CS_RGBA_NOGAMMA:
+		xscale_down_avx2_impl(in, out_width, out, coeffs_x, border_buf, OIL_CS_RGBA_NOGAMMA, i2f_map);
+		break;
+	case OIL_CS_RGBX_NOGAMMA:
+		xscale_down_avx2_impl(in, out_width, out, coeffs_x, border_buf, OIL_CS_RGBX_NOGAMMA, i2f_map);
+		break;
+	case OIL_CS_RGB_GAMMA2:
+		xscale_down_avx2_impl(in, out_width, out, coeffs_x, border_buf, OIL_CS_RGB_GAMMA2, g2l_map);
+		break;
+	case OIL_CS_RGBA_GAMMA2:
+		xscale_down_avx2_impl(in, out_width, out, coeffs_x, border_buf, OIL_CS_RGBA_GAMMA2, g2l_map);
+		break;
+	case OIL_CS_RGBX_GAMMA2:
+		xscale_down_avx2_impl(in, out_width, out, coeffs_x, border_buf, OIL_CS_RGBX_GAMMA2, g2l_map);
+		break;
+	case OIL_CS_UNKNOWN:
+		break;
+	}
+}
+
+/* Convert len bytes to floats through lut, 8 at a time with a gather. */
+static void oil_convert_lut_avx2(unsigned char *in, int len, float *out,
+	float *lut)
+{
+	int i;
+	long long px;
+
+	for (i=0; i+7<len; i+=8) {
+		memcpy(&px, in + i, 8);
+		_mm256_storeu_ps(out + i, _mm256_i32gather_ps(lut,
+			_mm256_cvtepu8_epi32(_mm_cvtsi64_si128(px)), 4));
+	}
+	for (; i<len; i++) {
+		out[i] = lut[in[i]];
+	}
+}
+
+/* Convert the pixels with alpha or a padding byte one at a time. */
+static inline __attribute__((always_inline))
+void xscale_convert_px_avx2(unsigned char *in, int width, float *out,
+	enum oil_colorspace cs, float *lut)
+{
+	int i, cmp;
+
+	cmp = OIL_CMP(cs);
+	for (i=0; i<width; i++) {
+		oil_store_smp_avx2(out, oil_xsample_avx2(in, cs, lut), cmp);
+		in += cmp;
+		out += cmp;
+	}
+}
+
+static void xscale_convert_avx2(unsigned char *in, int width, float *out,
+	enum oil_colorspace cs)
+{
+	switch(cs) {
+	case OIL_CS_G:
+	case OIL_CS_CMYK:
+	case OIL_CS_RGB_NOGAMMA:
+		oil_convert_lut_avx2(in, width * OIL_CMP(cs), out, i2f_map);
+		break;
+	case OIL_CS_RGB:
+		oil_convert_lut_avx2(in, width * 3, out, s2l_map);
+		break;
+	case OIL_CS_RGB_GAMMA2:
+		oil_convert_lut_avx2(in, width * 3, out, g2l_map);
+		break;
+	case OIL_CS_GA:
+		xscale_convert_px_avx2(in, width, out, OIL_CS_GA, NULL);
+		break;
+	case OIL_CS_RGBA:
+		xscale_convert_px_avx2(in, width, out, OIL_CS_RGBA, s2l_map);
+		break;
+	case OIL_CS_ARGB:
+		xscale_convert_px_avx2(in, width, out, OIL_CS_ARGB, s2l_map);
+		break;
+	case OIL_CS_RGBX:
+		xscale_convert_px_avx2(in, width, out, OIL_CS_RGBX, s2l_map);
+		break;
+	case OIL_CS_RGBA_NOGAMMA:
+		xscale_convert_px_avx2(in, width, out, OIL_CS_RGBA_NOGAMMA, i2f_map);
+		break;
+	case OIL_CS_RGBX_NOGAMMA:
+		xscale_convert_px_avx2(in, width, out, OIL_CS_RGBX_NOGAMMA, i2f_map);
+		break;
+	case OIL_CS_RGBA_GAMMA2:
+		xscale_convert_px_avx2(in, width, out, OIL_CS_RGBA_GAMMA2, g2l_map);
+		break;
+	case OIL_CS_RGBX_GAMMA2:
+		xscale_convert_px_avx2(in, width, out, OIL_CS_RGBX_GAMMA2, g2l_map);
+		break;
+	case OIL_CS_UNKNOWN:
+		break;
+	}
+}
+
+/* Convert a line in the format xscale_up_avx2() writes to an output scanline:
+ * the yscale_up kernels on that single line, without weighing it. Their
+ * scalar tails still weigh in by coefficients, {1, 0, 0, 0}.
+ */
+static void yscale_line_avx2(float *line, int len, unsigned char *out,
+	enum oil_colorspace cs)
+{
+	float *in[4] = { line, line, line, line };
+	float coeffs[4] = { 1.0f, 0.0f, 0.0f, 0.0f };
+
+	switch(cs) {
+	case OIL_CS_G:
+	case OIL_CS_CMYK:
+	case OIL_CS_RGB_NOGAMMA:
+		yscale_up_g_cmyk_avx2_impl(in, len, coeffs, out, 0, 1);
+		break;
+	case OIL_CS_GA:
+		yscale_up_ga_avx2_impl(in, len, coeffs, out, 1);
+		break;
+	case OIL_CS_RGB:
+		yscale_up_rgb_avx2_impl(in, len, coeffs, out, 1);
+		break;
+	case OIL_CS_RGBA:
+		oil_yscale_up_rgba_avx2(in, len, coeffs, out, 3, 0, 1);
+		break;
+	case OIL_CS_ARGB:
+		oil_yscale_up_rgba_avx2(in, len, coeffs, out, 0, 1, 1);
+		break;
+	case OIL_CS_RGBX:
+		yscale_up_rgbx_avx2_impl(in, len, coeffs, out, 1);
+		break;
+	case OIL_CS_RGBA_NOGAMMA:
+		yscale_up_rgba_nogamma_avx2_impl(in, len, coeffs, out, 0, 1);
+		break;
+	case OIL_CS_RGBX_NOGAMMA:
+		yscale_up_rgbx_nogamma_avx2_impl(in, len, coeffs, out, 0, 1);
+		break;
+	case OIL_CS_RGB_GAMMA2:
+		yscale_up_g_cmyk_avx2_impl(in, len, coeffs, out, 1, 1);
+		break;
+	case OIL_CS_RGBA_GAMMA2:
+		yscale_up_rgba_nogamma_avx2_impl(in, len, coeffs, out, 1, 1);
+		break;
+	case OIL_CS_RGBX_GAMMA2:
+		yscale_up_rgbx_nogamma_avx2_impl(in, len, coeffs, out, 1, 1);
+		break;
+	case OIL_CS_UNKNOWN:
+		break;
+	}
+}
+
+static void half_store_avx2(float *in, unsigned short *out, int n)
+{
+	int i;
+
+	for (i=0; i+7<n; i+=8) {
+		_mm_storeu_si128((__m128i *)(out + i),
+			_mm256_cvtps_ph(_mm256_loadu_ps(in + i),
+			_MM_FROUND_TO_NEAREST_INT));
+	}
+	for (; i<n; i++) {
+		out[i] = _cvtss_sh(in[i], _MM_FROUND_TO_NEAREST_INT);
+	}
+}
+
+static void half_load_avx2(unsigned short *in, float *out, int n)
+{
+	int i;
+
+	for (i=0; i+7<n; i+=8) {
+		_mm256_storeu_ps(out + i,
+			_mm256_cvtph_ps(_mm_loadu_si128((__m128i *)(in + i))));
+	}
+	for (; i<n; i++) {
+		out[i] = _cvtsh_ss(in[i]);
 	}
-	return 0;
 }
 
+const struct oil_kernels oil_kernels_avx2 = {
+	"avx2",
+	scale_down_avx2,
+	yscale_out_avx2,
+	xscale_up_avx2,
+	yscale_up_avx2,
+	scale_down_fixed_avx2,
+	yscale_out_fixed_avx2,
+	scale_down_planar_avx2,
+	yscale_out_planar_avx2,
+	yscale_up_rows_avx2,
+	half_store_avx2,
+	half_load_avx2,
+	xscale_down_avx2,
+	yscale_line_avx2,
+	xscale_convert_avx2,
+};
+
+int oil_scale_in_avx2(struct oil_scale *os, unsigned char *in)
+{
+	return oil_scale_in_kernels(os, in, &oil_kernels_avx2);
+}
 
+int oil_scale_out_avx2(struct oil_scale *os, unsigned char *out)
+{
+	return oil_scale_out_kernels(os, out, &oil_kernels_avx2);
+}
@@ -1,11 +1,151 @@
 #ifndef OIL_RESAMPLE_INTERNAL_H
 #define OIL_RESAMPLE_INTERNAL_H
 
+#include "oil_resample.h"
+
 /* Lookup tables shared between oil_resample.c and arch-specific files. */
 extern float s2l_map[256];
 extern float i2f_map[256];
+extern float g2l_map[256];
 extern unsigned char *l2s_map;
 extern int l2s_len;
+#ifdef OIL_L2S_POLY
+extern float l2s_edges[256];
+#endif
+
+/* Smallest in_width / out_width ratio at which scale_down switches to the
+ * heavy x-pass kernels. These spread each output position's taps over
+ * several independent accumulators, which only pays off once an output
+ * consumes enough input samples to fill the unrolled loop. Each scaler takes
+ * its ratio, OIL_HEAVY_RATIO unless changed by oil_autotune(), at init.
+ */
+#define OIL_HEAVY_RATIO 4
+
+/* Colorspaces that backends with planar downscale kernels downscale into a
+ * planar sums_y once a scanline holds at least OIL_PLANAR_LEN floats: one
+ * contiguous line per pending output row instead of a window of 4 y-sums per
+ * sample. The output row is then converted straight from its line, without
+ * the per-sample shift of the fused layout. For G and GA that outweighs the
+ * cost of gathering the x-scaled samples, for the 3-channel colorspaces it
+ * does not.
+ */
+#define OIL_PLANAR_CS(cs) ((cs) == OIL_CS_G || (cs) == OIL_CS_GA)
+#define OIL_PLANAR_LEN 4096
+
+/* Fixed-point downscale, see oil_scale_set_fixed_point(). x-coefficients are
+ * Q14 and stored in pairs of taps: for each output position, 8 int16s per
+ * pair of input samples, lane k of the first sample followed by lane k of
+ * the second. An odd last sample is paired with a zero coefficient. Each
+ * x-scaled sample is rounded to 1/64ths of a level before it is weighed by
+ * the Q14 y-coefficients: G and the unpremultiplied channels are sums of
+ * bytes shifted down by 8, RGBA_NOGAMMA is premultiplied with
+ * OIL_FIXED_PREMUL first and its sums are shifted down by 14.
+ */
+#define OIL_FIXED_ONE 16384
+#define OIL_FIXED_SHIFT(cs) ((cs) == OIL_CS_RGBA_NOGAMMA ? 14 : 8)
+
+/* (c * a * OIL_FIXED_PREMUL) >> 16 is about c * a * 64 / 255 */
+#define OIL_FIXED_PREMUL 16448
+
+/**
+ * Kernels provided by a backend. The row bookkeeping (slots, ring buffer
+ * positions, sums_y rotation) lives in oil_resample.c and is shared by every
+ * backend; a backend only supplies the per-scanline work.
+ */
+struct oil_kernels {
+	const char *name;
+
+	/* downscale: x-scale a scanline and accumulate it into sums_y */
+	void (*scale_down)(struct oil_scale *os, unsigned char *in,
+		float *coeffs_y);
+
+	/* downscale: produce an output scanline from sums_y */
+	void (*yscale_out)(float *sums, int width, unsigned char *out,
+		enum oil_colorspace cs, int tap);
+
+	/* upscale: x-scale a scanline into a ring buffer line */
+	void (*xscale_up)(unsigned char *in, int width_in, float *out,
+		enum oil_colorspace cs, float *coeff_buf, int *border_buf);
+
+	/* upscale: interpolate 4 ring buffer lines into an output scanline */
+	void (*yscale_up)(float **in, int len, float *coeffs,
+		unsigned char *out, enum oil_colorspace cs);
+
+	/* fixed-point downscale: x-scale a scanline and accumulate it into
+	 * 4 int32 sums per sample, weighed by coeffs_y. NULL if the backend has
+	 * none, in which case the portable C version runs */
+	void (*scale_down_fixed)(unsigned char *in, int out_width, int *sums,
+		enum oil_colorspace cs, short *coeffs_x, int *border_buf,
+		short *coeffs_y);
+
+	/* fixed-point downscale: produce an output scanline from the int32
+	 * sums, zeroing them. NULL if the backend has none */
+	void (*yscale_out_fixed)(int *sums, int width, unsigned char *out,
+		enum oil_colorspace cs, int tap);
+
+	/* planar downscale: x-scale a scanline and accumulate it into sums,
+	 * which holds one line of out_width samples per pending output row.
+	 * Line (tap + i) & 3 is weighed by coeffs_y[i]. Only called for the
+	 * colorspaces of OIL_PLANAR_CS(). heavy is nonzero for the heavy
+	 * x-pass kernels, see OIL_HEAVY_RATIO. NULL if the backend has none */
+	void (*scale_down_planar)(unsigned char *in, int heavy,
+		int out_width, float *sums, enum oil_colorspace cs,
+		float *coeffs_x, int *border_buf, float *coeffs_y, int tap);
+
+	/* planar downscale: produce an output scanline from line tap of sums,
+	 * zeroing it. Only called for the colorspaces of OIL_PLANAR_CS().
+	 * NULL exactly when scale_down_planar is */
+	void (*yscale_out_planar)(float *sums, int width, unsigned char *out,
+		enum oil_colorspace cs, int tap);
+
+	/* upscale: interpolate the same 4 ring buffer lines into n output
+	 * scanlines, stride bytes apart, with 4 coefficients per scanline.
+	 * NULL if the backend has none */
+	void (*yscale_up_rows)(float **in, int len, float *coeffs, int n,
+		unsigned char *out, ptrdiff_t stride, enum oil_colorspace cs);
+
+	/* half-float storage, see oil_scale_set_half_float(): convert n floats
+	 * to IEEE half floats, rounding to nearest even. NULL if the backend
+	 * has none */
+	void (*half_store)(float *in, unsigned short *out, int n);
+
+	/* half-float storage: convert n IEEE half floats to floats. NULL if the
+	 * backend has none */
+	void (*half_load)(unsigned short *in, float *out, int n);
+
+	/* mixed geometry: x-downscale a scanline into a line of out_width
+	 * samples in the format xscale_up writes, for the y-axis to upscale.
+	 * heavy is as for scale_down_planar. NULL if the backend has none */
+	void (*xscale_down)(unsigned char *in, int heavy, int out_width,
+		float *out, enum oil_colorspace cs, float *coeffs_x,
+		int *border_buf);
+
+	/* convert a line of len floats in the format xscale_up writes to an
+	 * output scanline, as yscale_up does with coefficients {1, 0, 0, 0}.
+	 * NULL if the backend has none */
+	void (*yscale_line)(float *in, int len, unsigned char *out,
+		enum oil_colorspace cs);
+
+	/* unchanged width: convert a scanline of width pixels to the format
+	 * xscale_up writes. NULL if the backend has none */
+	void (*xscale_convert)(unsigned char *in, int width, float *out,
+		enum oil_colorspace cs);
+};
+
+extern const struct oil_kernels oil_kernels_scalar;
+extern const struct oil_kernels oil_kernels_vec;
+#if defined(__x86_64__)
+extern const struct oil_kernels oil_kernels_sse2;
+extern const struct oil_kernels oil_kernels_sse41;
+extern const struct oil_kernels oil_kernels_avx2;
+#elif defined(__aarch64__)
+extern const struct oil_kernels oil_kernels_neon;
+#endif
 
+/* Shared implementations of oil_scale_in() & oil_scale_out(). */
+int oil_scale_in_kernels(struct oil_scale *os, unsigned char *in,
+	const struct oil_kernels *k);
+int oil_scale_out_kernels(struct oil_scale *os, unsigned char *out,
+	const struct oil_kernels *k);
 
 #endif
@@ -22,6 +22,7 @@
 #include "oil_resample.h"
 #include "oil_resample_internal.h"
 
+#include <math.h>
 #include <string.h>
 #include <arm_neon.h>
 
@@ -140,12 +141,43 @@ static inline int32x4_t oil_clamp_round_idx_neon(float32x4_t v,
 	return vcvtq_s32_f32(vfmaq_f32(half, v, scale));
 }
 
+/* oil_clamp_round_idx_neon(), taking the square root of the clamped value
+ * first when gamma2 is set to return a GAMMA2 sample to gamma 2.0.
+ */
+static inline __attribute__((always_inline))
+int32x4_t oil_clamp_round_gamma_idx_neon(float32x4_t v, float32x4_t zero,
+	float32x4_t one, float32x4_t scale, float32x4_t half, int gamma2)
+{
+	v = vminq_f32(vmaxq_f32(v, zero), one);
+	if (gamma2) {
+		v = vsqrtq_f32(v);
+	}
+	return vcvtq_s32_f32(vfmaq_f32(half, v, scale));
+}
+
+/* Round v * scale to the nearest int32. Out of range values saturate when
+ * narrowed to bytes, so v is only clamped when gamma2 is set and its square
+ * root is taken to return a GAMMA2 sample to gamma 2.0.
+ */
+static inline __attribute__((always_inline))
+int32x4_t oil_round_gamma_idx_neon(float32x4_t v, float32x4_t scale,
+	int gamma2)
+{
+	if (gamma2) {
+		v = vminq_f32(vmaxq_f32(v, vdupq_n_f32(0.0f)), vdupq_n_f32(1.0f));
+		v = vsqrtq_f32(v);
+	}
+	return vcvtnq_s32_f32(vmulq_f32(v, scale));
+}
+
 /* Unpremultiply a premultiplied RGBA sum (alpha in lane 3), clamp RGB and
  * alpha to [0,1], then scale to 0..255 (with rounding) for byte packing.
  * Lane 3 of the result contains the clamped alpha byte, not the reciprocal.
+ * RGB is square-rooted after clamping when gamma2 is set.
  */
-static inline int32x4_t oil_unpremul_rgba_idx_neon(float32x4_t vals,
-	float32x4_t zero, float32x4_t one, float32x4_t scale, float32x4_t half)
+static inline __attribute__((always_inline))
+int32x4_t oil_unpremul_rgba_idx_neon(float32x4_t vals, float32x4_t zero,
+	float32x4_t one, float32x4_t scale, float32x4_t half, int gamma2)
 {
 	float32x4_t alpha_v;
 	float alpha;
@@ -157,6 +189,9 @@ static inline int32x4_t oil_unpremul_rgba_idx_neon(float32x4_t vals,
 		vals = vdivq_f32(vals, alpha_v);
 	}
 	vals = vminq_f32(vmaxq_f32(vals, zero), one);
+	if (gamma2) {
+		vals = vsqrtq_f32(vals);
+	}
 	vals = vsetq_lane_f32(alpha, vals, 3);
 	return vcvtq_s32_f32(vfmaq_f32(half, vals, scale));
 }
@@ -243,7 +278,9 @@ static inline float32x4_t oil_cmyk_dot4_neon(float32x4_t smp0, float32x4_t smp1,
 	return result;
 }
 
-static void oil_yscale_out_nonlinear_neon(float *sums, int len, unsigned char *out)
+static inline __attribute__((always_inline))
+void yscale_out_nonlinear_neon_impl(float *sums, int len, unsigned char *out,
+	int gamma2)
 {
 	int i;
 	float32x4_t vals;
@@ -257,7 +294,8 @@ static void oil_yscale_out_nonlinear_neon(float *sums, int len, unsigned char *o
 
 	for (i=0; i+3<len; i+=4) {
 		vals = oil_consume_ch0_x4_neon(sums);
-		idx = oil_clamp_round_idx_neon(vals, zero, one, scale, half);
+		idx = oil_clamp_round_gamma_idx_neon(vals, zero, one, scale,
+			half, gamma2);
 
 		out[i]   = (unsigned char)vgetq_lane_s32(idx, 0);
 		out[i+1] = (unsigned char)vgetq_lane_s32(idx, 1);
@@ -271,12 +309,23 @@ static void oil_yscale_out_nonlinear_neon(float *sums, int len, unsigned char *o
 		float v = *sums;
 		if (v > 1.0f) v = 1.0f;
 		else if (v < 0.0f) v = 0.0f;
+		if (gamma2) v = sqrtf(v);
 		out[i] = (int)(v * 255.0f + 0.5f);
 		oil_shift_left_f_neon(sums);
 		sums += 4;
 	}
 }
 
+static void oil_yscale_out_nonlinear_neon(float *sums, int len, unsigned char *out)
+{
+	yscale_out_nonlinear_neon_impl(sums, len, out, 0);
+}
+
+static void oil_yscale_out_gamma2_neon(float *sums, int len, unsigned char *out)
+{
+	yscale_out_nonlinear_neon_impl(sums, len, out, 1);
+}
+
 static void oil_yscale_out_linear_neon(float *sums, int len, unsigned char *out)
 {
 	int i;
@@ -469,8 +518,9 @@ static void oil_yscale_out_cmyk_neon(float *sums, int width, unsigned char *out,
 	}
 }
 
-static void oil_yscale_up_g_cmyk_neon(float **in, int len, float *coeffs,
-	unsigned char *out)
+static inline __attribute__((always_inline))
+void yscale_up_g_cmyk_neon_impl(float **in, int len, float *coeffs,
+	unsigned char *out, int gamma2)
 {
 	int i;
 	float32x4_t c0, c1, c2, c3;
@@ -489,28 +539,28 @@ static void oil_yscale_up_g_cmyk_neon(float **in, int len, float *coeffs,
 		float32x4_t sum2;
 
 		sum = oil_ydot4_load_neon(in, i, c0, c1, c2, c3);
-		idx = vcvtnq_s32_f32(vmulq_f32(sum, scale));
+		idx = oil_round_gamma_idx_neon(sum, scale, gamma2);
 
 		sum2 = oil_ydot4_load_neon(in, i + 4, c0, c1, c2, c3);
-		idx2 = vcvtnq_s32_f32(vmulq_f32(sum2, scale));
+		idx2 = oil_round_gamma_idx_neon(sum2, scale, gamma2);
 
 		sum = oil_ydot4_load_neon(in, i + 8, c0, c1, c2, c3);
-		idx3 = vcvtnq_s32_f32(vmulq_f32(sum, scale));
+		idx3 = oil_round_gamma_idx_neon(sum, scale, gamma2);
 
 		sum2 = oil_ydot4_load_neon(in, i + 12, c0, c1, c2, c3);
-		idx4 = vcvtnq_s32_f32(vmulq_f32(sum2, scale));
+		idx4 = oil_round_gamma_idx_neon(sum2, scale, gamma2);
 
 		sum = oil_ydot4_load_neon(in, i + 16, c0, c1, c2, c3);
-		idx5 = vcvtnq_s32_f32(vmulq_f32(sum, scale));
+		idx5 = oil_round_gamma_idx_neon(sum, scale, gamma2);
 
 		sum2 = oil_ydot4_load_neon(in, i + 20, c0, c1, c2, c3);
-		idx6 = vcvtnq_s32_f32(vmulq_f32(sum2, scale));
+		idx6 = oil_round_gamma_idx_neon(sum2, scale, gamma2);
 
 		sum = oil_ydot4_load_neon(in, i + 24, c0, c1, c2, c3);
-		idx7 = vcvtnq_s32_f32(vmulq_f32(sum, scale));
+		idx7 = oil_round_gamma_idx_neon(sum, scale, gamma2);
 
 		sum2 = oil_ydot4_load_neon(in, i + 28, c0, c1, c2, c3);
-		idx8 = vcvtnq_s32_f32(vmulq_f32(sum2, scale));
+		idx8 = oil_round_gamma_idx_neon(sum2, scale, gamma2);
 
 		/* Pack 8x4 int32 -> 4x8 int16 -> 2x16 uint8 */
 		{
@@ -531,16 +581,16 @@ static void oil_yscale_up_g_cmyk_neon(float **in, int len, float *coeffs,
 		float32x4_t sum2;
 
 		sum = oil_ydot4_load_neon(in, i, c0, c1, c2, c3);
-		idx = vcvtnq_s32_f32(vmulq_f32(sum, scale));
+		idx = oil_round_gamma_idx_neon(sum, scale, gamma2);
 
 		sum2 = oil_ydot4_load_neon(in, i + 4, c0, c1, c2, c3);
-		idx2 = vcvtnq_s32_f32(vmulq_f32(sum2, scale));
+		idx2 = oil_round_gamma_idx_neon(sum2, scale, gamma2);
 
 		sum = oil_ydot4_load_neon(in, i + 8, c0, c1, c2, c3);
-		idx3 = vcvtnq_s32_f32(vmulq_f32(sum, scale));
+		idx3 = oil_round_gamma_idx_neon(sum, scale, gamma2);
 
 		sum2 = oil_ydot4_load_neon(in, i + 12, c0, c1, c2, c3);
-		idx4 = vcvtnq_s32_f32(vmulq_f32(sum2, scale));
+		idx4 = oil_round_gamma_idx_neon(sum2, scale, gamma2);
 
 		/* Pack 4x4 int32 -> 2x8 int16 -> 16 uint8 */
 		{
@@ -556,10 +606,10 @@ static void oil_yscale_up_g_cmyk_neon(float **in, int len, float *coeffs,
 		float32x4_t sum2;
 
 		sum = oil_ydot4_load_neon(in, i, c0, c1, c2, c3);
-		idx = vcvtnq_s32_f32(vmulq_f32(sum, scale));
+		idx = oil_round_gamma_idx_neon(sum, scale, gamma2);
 
 		sum2 = oil_ydot4_load_neon(in, i + 4, c0, c1, c2, c3);
-		idx2 = vcvtnq_s32_f32(vmulq_f32(sum2, scale));
+		idx2 = oil_round_gamma_idx_neon(sum2, scale, gamma2);
 
 		{
 			int16x8_t n16 = vcombine_s16(vqmovn_s32(idx), vqmovn_s32(idx2));
@@ -570,7 +620,7 @@ static void oil_yscale_up_g_cmyk_neon(float **in, int len, float *coeffs,
 
 	for (; i+3<len; i+=4) {
 		sum = oil_ydot4_load_neon(in, i, c0, c1, c2, c3);
-		idx = vcvtnq_s32_f32(vmulq_f32(sum, scale));
+		idx = oil_round_gamma_idx_neon(sum, scale, gamma2);
 		{
 			int16x4_t n16 = vqmovn_s32(idx);
 			uint8x8_t n8 = vqmovun_s16(vcombine_s16(n16, n16));
@@ -584,10 +634,23 @@ static void oil_yscale_up_g_cmyk_neon(float **in, int len, float *coeffs,
 			coeffs[2] * in[2][i] + coeffs[3] * in[3][i];
 		if (s > 1.0f) s = 1.0f;
 		else if (s < 0.0f) s = 0.0f;
+		if (gamma2) s = sqrtf(s);
 		out[i] = (int)(s * 255.0f + 0.5f);
 	}
 }
 
+static void oil_yscale_up_g_cmyk_neon(float **in, int len, float *coeffs,
+	unsigned char *out)
+{
+	yscale_up_g_cmyk_neon_impl(in, len, coeffs, out, 0);
+}
+
+static void oil_yscale_up_gamma2_neon(float **in, int len, float *coeffs,
+	unsigned char *out)
+{
+	yscale_up_g_cmyk_neon_impl(in, len, coeffs, out, 1);
+}
+
 static void oil_yscale_up_ga_neon(float **in, int len, float *coeffs,
 	unsigned char *out)
 {
@@ -1371,8 +1434,10 @@ void oil_scale_down_rgb_neon(unsigned char *in, float *sums_y_out,
 	float *lut)
 {
 	int i, j;
-	float32x4_t coeffs_x, coeffs_x2, sample_x, sum_r, sum_g, sum_b;
-	float32x4_t sum_r2, sum_g2, sum_b2;
+	float32x4_t coeffs_x, coeffs_x2, coeffs_x3, coeffs_x4;
+	float32x4_t sample_x, sum_r, sum_g, sum_b;
+	float32x4_t sum_r2, sum_g2, sum_b2, sum_r3, sum_g3, sum_b3;
+	float32x4_t sum_r4, sum_g4, sum_b4;
 	float32x4_t coeffs_y, sums_y, sample_y;
 
 	coeffs_y = vld1q_f32(coeffs_y_f);
@@ -1385,7 +1450,62 @@ void oil_scale_down_rgb_neon(unsigned char *in, float *sums_y_out,
 		int n = border_buf[i];
 		j = 0;
 
-		if (n >= 4) {
+		if (n >= 8) {
+			sum_r2 = vdupq_n_f32(0.0f);
+			sum_g2 = vdupq_n_f32(0.0f);
+			sum_b2 = vdupq_n_f32(0.0f);
+			sum_r3 = vdupq_n_f32(0.0f);
+			sum_g3 = vdupq_n_f32(0.0f);
+			sum_b3 = vdupq_n_f32(0.0f);
+			sum_r4 = vdupq_n_f32(0.0f);
+			sum_g4 = vdupq_n_f32(0.0f);
+			sum_b4 = vdupq_n_f32(0.0f);
+
+			for (; j+3<n; j+=4) {
+				coeffs_x = vld1q_f32(coeffs_x_f);
+				coeffs_x2 = vld1q_f32(coeffs_x_f + 4);
+				coeffs_x3 = vld1q_f32(coeffs_x_f + 8);
+				coeffs_x4 = vld1q_f32(coeffs_x_f + 12);
+
+				sample_x = vdupq_n_f32(lut[in[0]]);
+				sum_r = vaddq_f32(vmulq_f32(coeffs_x, sample_x), sum_r);
+				sample_x = vdupq_n_f32(lut[in[1]]);
+				sum_g = vaddq_f32(vmulq_f32(coeffs_x, sample_x), sum_g);
+				sample_x = vdupq_n_f32(lut[in[2]]);
+				sum_b = vaddq_f32(vmulq_f32(coeffs_x, sample_x), sum_b);
+
+				sample_x = vdupq_n_f32(lut[in[3]]);
+				sum_r2 = vaddq_f32(vmulq_f32(coeffs_x2, sample_x), sum_r2);
+				sample_x = vdupq_n_f32(lut[in[4]]);
+				sum_g2 = vaddq_f32(vmulq_f32(coeffs_x2, sample_x), sum_g2);
+				sample_x = vdupq_n_f32(lut[in[5]]);
+				sum_b2 = vaddq_f32(vmulq_f32(coeffs_x2, sample_x), sum_b2);
+
+				sample_x = vdupq_n_f32(lut[in[6]]);
+				sum_r3 = vaddq_f32(vmulq_f32(coeffs_x3, sample_x), sum_r3);
+				sample_x = vdupq_n_f32(lut[in[7]]);
+				sum_g3 = vaddq_f32(vmulq_f32(coeffs_x3, sample_x), sum_g3);
+				sample_x = vdupq_n_f32(lut[in[8]]);
+				sum_b3 = vaddq_f32(vmulq_f32(coeffs_x3, sample_x), sum_b3);
+
+				sample_x = vdupq_n_f32(lut[in[9]]);
+				sum_r4 = vaddq_f32(vmulq_f32(coeffs_x4, sample_x), sum_r4);
+				sample_x = vdupq_n_f32(lut[in[10]]);
+				sum_g4 = vaddq_f32(vmulq_f32(coeffs_x4, sample_x), sum_g4);
+				sample_x = vdupq_n_f32(lut[in[11]]);
+				sum_b4 = vaddq_f32(vmulq_f32(coeffs_x4, sample_x), sum_b4);
+
+				in += 12;
+				coeffs_x_f += 16;
+			}
+
+			sum_r = vaddq_f32(vaddq_f32(sum_r, sum_r2),
+				vaddq_f32(sum_r3, sum_r4));
+			sum_g = vaddq_f32(vaddq_f32(sum_g, sum_g2),
+				vaddq_f32(sum_g3, sum_g4));
+			sum_b = vaddq_f32(vaddq_f32(sum_b, sum_b2),
+				vaddq_f32(sum_b3, sum_b4));
+		} else if (n >= 4) {
 			sum_r2 = vdupq_n_f32(0.0f);
 			sum_g2 = vdupq_n_f32(0.0f);
 			sum_b2 = vdupq_n_f32(0.0f);
@@ -1599,10 +1719,10 @@ static void oil_scale_down_argb_neon(unsigned char *in, float *sums_y_out,
 
 static void oil_scale_down_rgba_nogamma_neon(unsigned char *in, float *sums_y_out,
 	int out_width, float *coeffs_x_f, int *border_buf, float *coeffs_y_f,
-	int tap)
+	int tap, float *lut)
 {
 	scale_down_alpha_neon_impl(in, sums_y_out, out_width, coeffs_x_f,
-		border_buf, coeffs_y_f, tap, 3, 0, i2f_map);
+		border_buf, coeffs_y_f, tap, 3, 0, lut);
 }
 
 static inline __attribute__((always_inline))
@@ -1802,8 +1922,9 @@ static void oil_scale_down_cmyk_neon(unsigned char *in, float *sums_y_out,
 	}
 }
 
-static void oil_yscale_out_rgba_nogamma_neon(float *sums, int width, unsigned char *out,
-	int tap)
+static inline __attribute__((always_inline))
+void yscale_out_rgba_nogamma_neon_impl(float *sums, int width,
+	unsigned char *out, int tap, int gamma2)
 {
 	int i, tap_off;
 	float32x4_t scale_v, one, zero, half, z;
@@ -1818,7 +1939,7 @@ static void oil_yscale_out_rgba_nogamma_neon(float *sums, int width, unsigned ch
 
 	for (i=0; i<width; i++) {
 		idx = oil_unpremul_rgba_idx_neon(vld1q_f32(sums + tap_off),
-			zero, one, scale_v, half);
+			zero, one, scale_v, half, gamma2);
 		out[0] = vgetq_lane_s32(idx, 0);
 		out[1] = vgetq_lane_s32(idx, 1);
 		out[2] = vgetq_lane_s32(idx, 2);
@@ -1830,8 +1951,19 @@ static void oil_yscale_out_rgba_nogamma_neon(float *sums, int width, unsigned ch
 	}
 }
 
-static void oil_yscale_up_rgba_nogamma_neon(float **in, int len, float *coeffs,
-	unsigned char *out)
+static void oil_yscale_out_rgba_nogamma_neon(float *sums, int width, unsigned char *out,
+	int tap, int gamma2)
+{
+	if (gamma2) {
+		yscale_out_rgba_nogamma_neon_impl(sums, width, out, tap, 1);
+	} else {
+		yscale_out_rgba_nogamma_neon_impl(sums, width, out, tap, 0);
+	}
+}
+
+static inline __attribute__((always_inline))
+void yscale_up_rgba_nogamma_neon_impl(float **in, int len, float *coeffs,
+	unsigned char *out, int gamma2)
 {
 	int i;
 	float32x4_t c0, c1, c2, c3;
@@ -1848,7 +1980,8 @@ static void oil_yscale_up_rgba_nogamma_neon(float **in, int len, float *coeffs,
 	half = vdupq_n_f32(0.5f);
 
 #define UNPREMUL_STORE_NOGAMMA(s, dst) do { \
-		idx = oil_unpremul_rgba_idx_neon((s), zero, one, scale_v, half); \
+		idx = oil_unpremul_rgba_idx_neon((s), zero, one, scale_v, half, \
+			gamma2); \
 		(dst)[0] = vgetq_lane_s32(idx, 0); \
 		(dst)[1] = vgetq_lane_s32(idx, 1); \
 		(dst)[2] = vgetq_lane_s32(idx, 2); \
@@ -1874,8 +2007,19 @@ static void oil_yscale_up_rgba_nogamma_neon(float **in, int len, float *coeffs,
 #undef UNPREMUL_STORE_NOGAMMA
 }
 
-static void oil_xscale_up_rgbx_nogamma_neon(unsigned char *in, int width_in, float *out,
-	float *coeff_buf, int *border_buf)
+static void oil_yscale_up_rgba_nogamma_neon(float **in, int len, float *coeffs,
+	unsigned char *out, int gamma2)
+{
+	if (gamma2) {
+		yscale_up_rgba_nogamma_neon_impl(in, len, coeffs, out, 1);
+	} else {
+		yscale_up_rgba_nogamma_neon_impl(in, len, coeffs, out, 0);
+	}
+}
+
+static inline __attribute__((always_inline))
+void xscale_up_rgbx_nogamma_neon_impl(unsigned char *in, int width_in,
+	float *out, float *coeff_buf, int *border_buf, int gamma2)
 {
 	int i, j;
 	float32x4_t smp0, smp1, smp2, smp3, inv255;
@@ -1898,6 +2042,9 @@ static void oil_xscale_up_rgbx_nogamma_neon(unsigned char *in, int width_in, flo
 		smp2 = smp3;
 
 		pixel = vmulq_f32(vcvtq_f32_u32(px32), inv255);
+		if (gamma2) {
+			pixel = vmulq_f32(pixel, pixel);
+		}
 		pixel = vsetq_lane_f32(1.0f, pixel, 3);
 		smp3 = pixel;
 
@@ -1924,8 +2071,21 @@ static void oil_xscale_up_rgbx_nogamma_neon(unsigned char *in, int width_in, flo
 	}
 }
 
-static void oil_xscale_up_rgba_nogamma_neon(unsigned char *in, int width_in, float *out,
-	float *coeff_buf, int *border_buf)
+static void oil_xscale_up_rgbx_nogamma_neon(unsigned char *in, int width_in, float *out,
+	float *coeff_buf, int *border_buf, int gamma2)
+{
+	if (gamma2) {
+		xscale_up_rgbx_nogamma_neon_impl(in, width_in, out, coeff_buf,
+			border_buf, 1);
+	} else {
+		xscale_up_rgbx_nogamma_neon_impl(in, width_in, out, coeff_buf,
+			border_buf, 0);
+	}
+}
+
+static inline __attribute__((always_inline))
+void xscale_up_rgba_nogamma_neon_impl(unsigned char *in, int width_in,
+	float *out, float *coeff_buf, int *border_buf, int gamma2)
 {
 	int i, j;
 	float32x4_t smp0, smp1, smp2, smp3, inv255;
@@ -1950,6 +2110,9 @@ static void oil_xscale_up_rgba_nogamma_neon(unsigned char *in, int width_in, flo
 
 		pxf = vmulq_f32(vcvtq_f32_u32(px32), inv255);
 		alpha_new = vgetq_lane_f32(pxf, 3);
+		if (gamma2) {
+			pxf = vmulq_f32(pxf, pxf);
+		}
 		pixel = vmulq_n_f32(pxf, alpha_new);
 		pixel = vsetq_lane_f32(alpha_new, pixel, 3);
 		smp3 = pixel;
@@ -1977,8 +2140,21 @@ static void oil_xscale_up_rgba_nogamma_neon(unsigned char *in, int width_in, flo
 	}
 }
 
-static void oil_yscale_out_rgbx_nogamma_neon(float *sums, int width, unsigned char *out,
-	int tap)
+static void oil_xscale_up_rgba_nogamma_neon(unsigned char *in, int width_in, float *out,
+	float *coeff_buf, int *border_buf, int gamma2)
+{
+	if (gamma2) {
+		xscale_up_rgba_nogamma_neon_impl(in, width_in, out, coeff_buf,
+			border_buf, 1);
+	} else {
+		xscale_up_rgba_nogamma_neon_impl(in, width_in, out, coeff_buf,
+			border_buf, 0);
+	}
+}
+
+static inline __attribute__((always_inline))
+void yscale_out_rgbx_nogamma_neon_impl(float *sums, int width,
+	unsigned char *out, int tap, int gamma2)
 {
 	int i, tap_off;
 	float32x4_t scale_v, one, zero, half;
@@ -2015,6 +2191,12 @@ static void oil_yscale_out_rgbx_nogamma_neon(float *sums, int width, unsigned ch
 		v1 = vminq_f32(vmaxq_f32(v1, zero), one);
 		v2 = vminq_f32(vmaxq_f32(v2, zero), one);
 		v3 = vminq_f32(vmaxq_f32(v3, zero), one);
+		if (gamma2) {
+			v0 = vsqrtq_f32(v0);
+			v1 = vsqrtq_f32(v1);
+			v2 = vsqrtq_f32(v2);
+			v3 = vsqrtq_f32(v3);
+		}
 
 		i0 = vcvtq_s32_f32(vaddq_f32(vmulq_f32(v0, scale_v), half));
 		i1 = vcvtq_s32_f32(vaddq_f32(vmulq_f32(v1, scale_v), half));
@@ -2048,8 +2230,8 @@ static void oil_yscale_out_rgbx_nogamma_neon(float *sums, int width, unsigned ch
 	}
 
 	for (; i<width; i++) {
-		int32x4_t idx = oil_clamp_round_idx_neon(vld1q_f32(sums + tap_off),
-			zero, one, scale_v, half);
+		int32x4_t idx = oil_clamp_round_gamma_idx_neon(
+			vld1q_f32(sums + tap_off), zero, one, scale_v, half, gamma2);
 
 		out[0] = vgetq_lane_s32(idx, 0);
 		out[1] = vgetq_lane_s32(idx, 1);
@@ -2063,8 +2245,19 @@ static void oil_yscale_out_rgbx_nogamma_neon(float *sums, int width, unsigned ch
 	}
 }
 
-static void oil_yscale_up_rgbx_nogamma_neon(float **in, int len, float *coeffs,
-	unsigned char *out)
+static void oil_yscale_out_rgbx_nogamma_neon(float *sums, int width, unsigned char *out,
+	int tap, int gamma2)
+{
+	if (gamma2) {
+		yscale_out_rgbx_nogamma_neon_impl(sums, width, out, tap, 1);
+	} else {
+		yscale_out_rgbx_nogamma_neon_impl(sums, width, out, tap, 0);
+	}
+}
+
+static inline __attribute__((always_inline))
+void yscale_up_rgbx_nogamma_neon_impl(float **in, int len, float *coeffs,
+	unsigned char *out, int gamma2)
 {
 	int i;
 	float32x4_t c0, c1, c2, c3;
@@ -2097,15 +2290,19 @@ static void oil_yscale_up_rgbx_nogamma_neon(float **in, int len, float *coeffs,
 			int32x4_t idx2, idx3, idx4;
 
 			clamped = vminq_f32(vmaxq_f32(sum, zero), one);
+			if (gamma2) clamped = vsqrtq_f32(clamped);
 			idx = vcvtq_s32_f32(vaddq_f32(vmulq_f32(clamped, scale_v), half));
 
 			clamped = vminq_f32(vmaxq_f32(sum2, zero), one);
+			if (gamma2) clamped = vsqrtq_f32(clamped);
 			idx2 = vcvtq_s32_f32(vaddq_f32(vmulq_f32(clamped, scale_v), half));
 
 			clamped = vminq_f32(vmaxq_f32(sum3, zero), one);
+			if (gamma2) clamped = vsqrtq_f32(clamped);
 			idx3 = vcvtq_s32_f32(vaddq_f32(vmulq_f32(clamped, scale_v), half));
 
 			clamped = vminq_f32(vmaxq_f32(sum4, zero), one);
+			if (gamma2) clamped = vsqrtq_f32(clamped);
 			idx4 = vcvtq_s32_f32(vaddq_f32(vmulq_f32(clamped, scale_v), half));
 
 			{
@@ -2140,9 +2337,11 @@ static void oil_yscale_up_rgbx_nogamma_neon(float **in, int len, float *coeffs,
 		sum2 = oil_ydot4_load_neon(in, i + 4, c0, c1, c2, c3);
 
 		clamped = vminq_f32(vmaxq_f32(sum, zero), one);
+		if (gamma2) clamped = vsqrtq_f32(clamped);
 		idx = vcvtq_s32_f32(vaddq_f32(vmulq_f32(clamped, scale_v), half));
 
 		clamped = vminq_f32(vmaxq_f32(sum2, zero), one);
+		if (gamma2) clamped = vsqrtq_f32(clamped);
 		idx2 = vcvtq_s32_f32(vaddq_f32(vmulq_f32(clamped, scale_v), half));
 
 		out[i]   = vgetq_lane_s32(idx, 0);
@@ -2161,6 +2360,7 @@ static void oil_yscale_up_rgbx_nogamma_neon(float **in, int len, float *coeffs,
 		sum = oil_ydot4_load_neon(in, i, c0, c1, c2, c3);
 
 		clamped = vminq_f32(vmaxq_f32(sum, zero), one);
+		if (gamma2) clamped = vsqrtq_f32(clamped);
 		idx = vcvtq_s32_f32(vaddq_f32(vmulq_f32(clamped, scale_v), half));
 
 		out[i]   = vgetq_lane_s32(idx, 0);
@@ -2170,15 +2370,18 @@ static void oil_yscale_up_rgbx_nogamma_neon(float **in, int len, float *coeffs,
 	}
 }
 
-/* NEON dispatch functions */
-
-static float *get_rb_line(struct oil_scale *os, int line)
+static void oil_yscale_up_rgbx_nogamma_neon(float **in, int len, float *coeffs,
+	unsigned char *out, int gamma2)
 {
-	int sl_len;
-	sl_len = OIL_CMP(os->cs) * os->out_width;
-	return os->rb + line * sl_len;
+	if (gamma2) {
+		yscale_up_rgbx_nogamma_neon_impl(in, len, coeffs, out, 1);
+	} else {
+		yscale_up_rgbx_nogamma_neon_impl(in, len, coeffs, out, 0);
+	}
 }
 
+/* NEON dispatch functions */
+
 static void yscale_out_neon(float *sums, int width, unsigned char *out,
 	enum oil_colorspace cs, int tap)
 {
@@ -2212,10 +2415,19 @@ static void yscale_out_neon(float *sums, int width, unsigned char *out,
 		oil_yscale_out_nonlinear_neon(sums, sl_len, out);
 		break;
 	case OIL_CS_RGBA_NOGAMMA:
-		oil_yscale_out_rgba_nogamma_neon(sums, width, out, tap);
+		oil_yscale_out_rgba_nogamma_neon(sums, width, out, tap, 0);
 		break;
 	case OIL_CS_RGBX_NOGAMMA:
-		oil_yscale_out_rgbx_nogamma_neon(sums, width, out, tap);
+		oil_yscale_out_rgbx_nogamma_neon(sums, width, out, tap, 0);
+		break;
+	case OIL_CS_RGB_GAMMA2:
+		oil_yscale_out_gamma2_neon(sums, sl_len, out);
+		break;
+	case OIL_CS_RGBA_GAMMA2:
+		oil_yscale_out_rgba_nogamma_neon(sums, width, out, tap, 1);
+		break;
+	case OIL_CS_RGBX_GAMMA2:
+		oil_yscale_out_rgbx_nogamma_neon(sums, width, out, tap, 1);
 		break;
 	case OIL_CS_UNKNOWN:
 		break;
@@ -2249,10 +2461,19 @@ static void yscale_up_neon(float **in, int len, float *coeffs,
 		oil_yscale_up_g_cmyk_neon(in, len, coeffs, out);
 		break;
 	case OIL_CS_RGBA_NOGAMMA:
-		oil_yscale_up_rgba_nogamma_neon(in, len, coeffs, out);
+		oil_yscale_up_rgba_nogamma_neon(in, len, coeffs, out, 0);
 		break;
 	case OIL_CS_RGBX_NOGAMMA:
-		oil_yscale_up_rgbx_nogamma_neon(in, len, coeffs, out);
+		oil_yscale_up_rgbx_nogamma_neon(in, len, coeffs, out, 0);
+		break;
+	case OIL_CS_RGB_GAMMA2:
+		oil_yscale_up_gamma2_neon(in, len, coeffs, out);
+		break;
+	case OIL_CS_RGBA_GAMMA2:
+		oil_yscale_up_rgba_nogamma_neon(in, len, coeffs, out, 1);
+		break;
+	case OIL_CS_RGBX_GAMMA2:
+		oil_yscale_up_rgbx_nogamma_neon(in, len, coeffs, out, 1);
 		break;
 	case OIL_CS_UNKNOWN:
 		break;
@@ -2288,22 +2509,28 @@ static void xscale_up_neon(unsigned char *in, int width_in, float *out,
 		oil_xscale_up_rgb_neon(in, width_in, out, coeff_buf, border_buf, i2f_map);
 		break;
 	case OIL_CS_RGBA_NOGAMMA:
-		oil_xscale_up_rgba_nogamma_neon(in, width_in, out, coeff_buf, border_buf);
+		oil_xscale_up_rgba_nogamma_neon(in, width_in, out, coeff_buf, border_buf, 0);
 		break;
 	case OIL_CS_RGBX_NOGAMMA:
-		oil_xscale_up_rgbx_nogamma_neon(in, width_in, out, coeff_buf, border_buf);
+		oil_xscale_up_rgbx_nogamma_neon(in, width_in, out, coeff_buf, border_buf, 0);
+		break;
+	case OIL_CS_RGB_GAMMA2:
+		oil_xscale_up_rgb_neon(in, width_in, out, coeff_buf, border_buf, g2l_map);
+		break;
+	case OIL_CS_RGBA_GAMMA2:
+		oil_xscale_up_rgba_nogamma_neon(in, width_in, out, coeff_buf, border_buf, 1);
+		break;
+	case OIL_CS_RGBX_GAMMA2:
+		oil_xscale_up_rgbx_nogamma_neon(in, width_in, out, coeff_buf, border_buf, 1);
 		break;
 	case OIL_CS_UNKNOWN:
 		break;
 	}
 }
 
-static void down_scale_in_neon(struct oil_scale *os, unsigned char *in)
+static void scale_down_neon(struct oil_scale *os, unsigned char *in,
+	float *coeffs_y)
 {
-	float *coeffs_y;
-
-	coeffs_y = os->coeffs_y + os->in_pos * 4;
-
 	switch(os->cs) {
 	case OIL_CS_RGB:
 		oil_scale_down_rgb_neon(in, os->sums_y, os->out_width, os->coeffs_x, os->borders_x, coeffs_y, s2l_map);
@@ -2330,68 +2557,82 @@ static void down_scale_in_neon(struct oil_scale *os, unsigned char *in)
 		oil_scale_down_rgb_neon(in, os->sums_y, os->out_width, os->coeffs_x, os->borders_x, coeffs_y, i2f_map);
 		break;
 	case OIL_CS_RGBA_NOGAMMA:
-		oil_scale_down_rgba_nogamma_neon(in, os->sums_y, os->out_width, os->coeffs_x, os->borders_x, coeffs_y, os->sums_y_tap);
+		oil_scale_down_rgba_nogamma_neon(in, os->sums_y, os->out_width, os->coeffs_x, os->borders_x, coeffs_y, os->sums_y_tap, i2f_map);
 		break;
 	case OIL_CS_RGBX_NOGAMMA:
 		oil_scale_down_rgbx_neon(in, os->sums_y, os->out_width, os->coeffs_x, os->borders_x, coeffs_y, os->sums_y_tap, i2f_map);
 		break;
+	case OIL_CS_RGB_GAMMA2:
+		oil_scale_down_rgb_neon(in, os->sums_y, os->out_width, os->coeffs_x, os->borders_x, coeffs_y, g2l_map);
+		break;
+	case OIL_CS_RGBA_GAMMA2:
+		oil_scale_down_rgba_nogamma_neon(in, os->sums_y, os->out_width, os->coeffs_x, os->borders_x, coeffs_y, os->sums_y_tap, g2l_map);
+		break;
+	case OIL_CS_RGBX_GAMMA2:
+		oil_scale_down_rgbx_neon(in, os->sums_y, os->out_width, os->coeffs_x, os->borders_x, coeffs_y, os->sums_y_tap, g2l_map);
+		break;
 	case OIL_CS_UNKNOWN:
 		break;
 	}
-
-	os->slots_y -= 1;
-	os->in_pos++;
 }
 
-static void up_scale_in_neon(struct oil_scale *os, unsigned char *in)
+static void half_store_neon(float *in, unsigned short *out, int n)
 {
-	float *tmp;
-
-	tmp = get_rb_line(os, os->in_pos % 4);
-	xscale_up_neon(in, os->in_width, tmp, os->cs, os->coeffs_x, os->borders_x);
-
-	os->in_pos++;
-	os->slots_y = os->borders_y[os->in_pos - 1];
-}
+	int i;
+	float tail[4] = { 0.0f };
+	unsigned short tail_out[4];
 
-int oil_scale_in_neon(struct oil_scale *os, unsigned char *in)
-{
-	if (oil_scale_slots(os) == 0) {
-		return -1;
+	for (i=0; i+3<n; i+=4) {
+		vst1_u16(out + i, vreinterpret_u16_f16(vcvt_f16_f32(
+			vld1q_f32(in + i))));
 	}
-	if (os->out_width > os->in_width) {
-		up_scale_in_neon(os, in);
-	} else {
-		down_scale_in_neon(os, in);
+	if (i < n) {
+		memcpy(tail, in + i, (n - i) * sizeof(float));
+		vst1_u16(tail_out, vreinterpret_u16_f16(vcvt_f16_f32(
+			vld1q_f32(tail))));
+		memcpy(out + i, tail_out, (n - i) * sizeof(unsigned short));
 	}
-	return 0;
 }
 
-int oil_scale_out_neon(struct oil_scale *os, unsigned char *out)
+static void half_load_neon(unsigned short *in, float *out, int n)
 {
-	int i, sl_len;
-	float *in[4];
+	int i;
+	unsigned short tail[4] = { 0 };
+	float tail_out[4];
 
-	if (oil_scale_slots(os) != 0) {
-		return -1;
+	for (i=0; i+3<n; i+=4) {
+		vst1q_f32(out + i, vcvt_f32_f16(vreinterpret_f16_u16(
+			vld1_u16(in + i))));
 	}
-
-	if (os->out_height <= os->in_height) {
-		yscale_out_neon(os->sums_y, os->out_width, out, os->cs, os->sums_y_tap);
-		os->sums_y_tap = (os->sums_y_tap + 1) & 3;
-	} else {
-		sl_len = OIL_CMP(os->cs) * os->out_width;
-		for (i=0; i<4; i++) {
-			in[i] = get_rb_line(os, (os->in_pos + i) % 4);
-		}
-		yscale_up_neon(in, sl_len, os->coeffs_y + os->out_pos * 4, out,
-			os->cs);
-		os->slots_y -= 1;
+	if (i < n) {
+		memcpy(tail, in + i, (n - i) * sizeof(unsigned short));
+		vst1q_f32(tail_out, vcvt_f32_f16(vreinterpret_f16_u16(
+			vld1_u16(tail))));
+		memcpy(out + i, tail_out, (n - i) * sizeof(float));
 	}
+}
 
-	os->out_pos++;
-	if (os->out_height <= os->in_height && os->out_pos < os->out_height) {
-		os->slots_y = os->borders_y[os->out_pos];
-	}
-	return 0;
+const struct oil_kernels oil_kernels_neon = {
+	"neon",
+	scale_down_neon,
+	yscale_out_neon,
+	xscale_up_neon,
+	yscale_up_neon,
+	NULL,
+	NULL,
+	NULL,
+	NULL,
+	NULL,
+	half_store_neon,
+	half_load_neon,
+};
+
+int oil_scale_in_neon(struct oil_scale *os, unsigned char *in)
+{
+	return oil_scale_in_kernels(os, in, &oil_kernels_neon);
+}
+
+int oil_scale_out_neon(struct oil_scale *os, unsigned char *out)
+{
+	return oil_scale_out_kernels(os, out, &oil_kernels_neon);
 }
@@ -22,6 +22,7 @@
 #include "oil_resample.h"
 #include "oil_resample_internal.h"
 #include <immintrin.h>
+#include <math.h>
 #include <string.h>
 
 /* Shift smp left by one float lane, zero-filling the top lane. */
@@ -144,6 +145,19 @@ __m128 oil_ydot4_load_sse2(float **in, int off,
 		_mm_add_ps(_mm_mul_ps(c2, v2), _mm_mul_ps(c3, v3)));
 }
 
+/* The 4-tap sum of oil_ydot4_load_sse2(), or with `line` set, the 4 floats of
+ * in[0] as they are. yscale_line_sse2() converts single lines that way.
+ */
+static inline __attribute__((always_inline))
+__m128 oil_yload_sse2(float **in, int off, __m128 c0, __m128 c1, __m128 c2,
+	__m128 c3, int line)
+{
+	if (line) {
+		return _mm_loadu_ps(in[0] + off);
+	}
+	return oil_ydot4_load_sse2(in, off, c0, c1, c2, c3);
+}
+
 /* Clamp v to [0,1], multiply by `scale`, round to nearest, and truncate to
  * int32. Produces the byte-range index used by sRGB byte packing and LUTs.
  */
@@ -155,13 +169,28 @@ __m128i oil_clamp_round_idx_sse2(__m128 v,
 	return _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(v, scale), half));
 }
 
+/* oil_clamp_round_idx_sse2(), taking the square root of the clamped value
+ * first when gamma2 is set to return a GAMMA2 sample to gamma 2.0.
+ */
+static inline __attribute__((always_inline))
+__m128i oil_clamp_round_gamma_idx_sse2(__m128 v, __m128 zero, __m128 one,
+	__m128 scale, __m128 half, int gamma2)
+{
+	v = _mm_min_ps(_mm_max_ps(v, zero), one);
+	if (gamma2) {
+		v = _mm_sqrt_ps(v);
+	}
+	return _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(v, scale), half));
+}
+
 /* Unpremultiply a premultiplied RGBA sum (alpha in lane 3), clamp RGB and
  * alpha to [0,1], then scale to 0..255 (with rounding) for byte packing.
  * Lane 3 of the result contains the clamped alpha byte, not the reciprocal.
+ * RGB is square-rooted after clamping when gamma2 is set.
  */
 static inline __attribute__((always_inline))
 __m128i oil_unpremul_rgba_idx_sse2(__m128 vals,
-	__m128 zero, __m128 one, __m128 scale, __m128 half)
+	__m128 zero, __m128 one, __m128 scale, __m128 half, int gamma2)
 {
 	__m128 alpha_v, hi;
 	alpha_v = _mm_shuffle_ps(vals, vals, _MM_SHUFFLE(3, 3, 3, 3));
@@ -169,6 +198,9 @@ __m128i oil_unpremul_rgba_idx_sse2(__m128 vals,
 	if (_mm_cvtss_f32(alpha_v) != 0)
 		vals = _mm_mul_ps(vals, _mm_rcp_ps(alpha_v));
 	vals = _mm_min_ps(_mm_max_ps(vals, zero), one);
+	if (gamma2) {
+		vals = _mm_sqrt_ps(vals);
+	}
 	hi = _mm_shuffle_ps(vals, alpha_v, _MM_SHUFFLE(0, 0, 2, 2));
 	vals = _mm_shuffle_ps(vals, hi, _MM_SHUFFLE(2, 0, 1, 0));
 	return _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(vals, scale), half));
@@ -244,7 +276,9 @@ static inline __m128 unpremul_clamp_ga_sse2(__m128 sum, __m128 zero, __m128 one,
 		_mm_and_ps(blend_mask, alpha_spread));
 }
 
-static void oil_yscale_out_nonlinear_sse2(float *sums, int len, unsigned char *out)
+static inline __attribute__((always_inline))
+void yscale_out_nonlinear_sse2_impl(float *sums, int len, unsigned char *out,
+	int gamma2)
 {
 	int i;
 	__m128 vals, vals2;
@@ -258,12 +292,12 @@ static void oil_yscale_out_nonlinear_sse2(float *sums, int len, unsigned char *o
 
 	for (i=0; i+7<len; i+=8) {
 		vals = oil_consume_ch0_x4_sse2(sums);
-		vals = _mm_min_ps(_mm_max_ps(vals, zero), one);
-		idx = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(vals, scale), half));
+		idx = oil_clamp_round_gamma_idx_sse2(vals, zero, one, scale, half,
+			gamma2);
 
 		vals2 = oil_consume_ch0_x4_sse2(sums + 16);
-		vals2 = _mm_min_ps(_mm_max_ps(vals2, zero), one);
-		idx2 = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(vals2, scale), half));
+		idx2 = oil_clamp_round_gamma_idx_sse2(vals2, zero, one, scale, half,
+			gamma2);
 
 		idx = _mm_packs_epi32(idx, idx2);
 		idx = _mm_packus_epi16(idx, idx);
@@ -274,8 +308,8 @@ static void oil_yscale_out_nonlinear_sse2(float *sums, int len, unsigned char *o
 
 	for (; i+3<len; i+=4) {
 		vals = oil_consume_ch0_x4_sse2(sums);
-		vals = _mm_min_ps(_mm_max_ps(vals, zero), one);
-		idx = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(vals, scale), half));
+		idx = oil_clamp_round_gamma_idx_sse2(vals, zero, one, scale, half,
+			gamma2);
 
 		idx = _mm_packs_epi32(idx, idx);
 		idx = _mm_packus_epi16(idx, idx);
@@ -288,12 +322,23 @@ static void oil_yscale_out_nonlinear_sse2(float *sums, int len, unsigned char *o
 		float v = *sums;
 		if (v > 1.0f) v = 1.0f;
 		else if (v < 0.0f) v = 0.0f;
+		if (gamma2) v = sqrtf(v);
 		out[i] = (int)(v * 255.0f + 0.5f);
 		oil_shift_left_f_sse2(sums);
 		sums += 4;
 	}
 }
 
+static void oil_yscale_out_nonlinear_sse2(float *sums, int len, unsigned char *out)
+{
+	yscale_out_nonlinear_sse2_impl(sums, len, out, 0);
+}
+
+static void oil_yscale_out_gamma2_sse2(float *sums, int len, unsigned char *out)
+{
+	yscale_out_nonlinear_sse2_impl(sums, len, out, 1);
+}
+
 static void oil_yscale_out_linear_sse2(float *sums, int len, unsigned char *out)
 {
 	int i;
@@ -467,8 +512,9 @@ static void oil_xscale_up_ga_sse2(unsigned char *in, int width_in, float *out,
 	}
 }
 
-static void oil_yscale_up_ga_sse2(float **in, int len, float *coeffs,
-	unsigned char *out)
+static inline __attribute__((always_inline))
+void yscale_up_ga_sse2_impl(float **in, int len, float *coeffs,
+	unsigned char *out, int line)
 {
 	int i;
 	__m128 c0, c1, c2, c3;
@@ -490,8 +536,8 @@ static void oil_yscale_up_ga_sse2(float **in, int len, float *coeffs,
 
 	/* Process 4 GA pixels (8 floats) at a time */
 	for (i=0; i+7<len; i+=8) {
-		sum = oil_ydot4_load_sse2(in, i, c0, c1, c2, c3);
-		sum2 = oil_ydot4_load_sse2(in, i + 4, c0, c1, c2, c3);
+		sum = oil_yload_sse2(in, i, c0, c1, c2, c3, line);
+		sum2 = oil_yload_sse2(in, i + 4, c0, c1, c2, c3, line);
 
 		/* sum = [g0, a0, g1, a1], sum2 = [g2, a2, g3, a3] */
 		result = unpremul_clamp_ga_sse2(sum, zero, one, blend_mask);
@@ -509,7 +555,7 @@ static void oil_yscale_up_ga_sse2(float **in, int len, float *coeffs,
 
 	/* Process 2 GA pixels (4 floats) at a time */
 	for (; i+3<len; i+=4) {
-		sum = oil_ydot4_load_sse2(in, i, c0, c1, c2, c3);
+		sum = oil_yload_sse2(in, i, c0, c1, c2, c3, line);
 
 		result = unpremul_clamp_ga_sse2(sum, zero, one, blend_mask);
 		idx = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(result, scale), half));
@@ -535,8 +581,15 @@ static void oil_yscale_up_ga_sse2(float **in, int len, float *coeffs,
 	}
 }
 
+static void oil_yscale_up_ga_sse2(float **in, int len, float *coeffs,
+	unsigned char *out)
+{
+	yscale_up_ga_sse2_impl(in, len, coeffs, out, 0);
+}
+
 static inline __attribute__((always_inline)) void yscale_up_gamma_sse2_impl(
-	float **in, int len, float *coeffs, unsigned char *out, int is_rgbx)
+	float **in, int len, float *coeffs, unsigned char *out, int is_rgbx,
+	int line)
 {
 	int i;
 	__m128 c0, c1, c2, c3;
@@ -555,10 +608,10 @@ static inline __attribute__((always_inline)) void yscale_up_gamma_sse2_impl(
 	one = _mm_set1_ps(1.0f);
 
 	for (i=0; i+7<len; i+=8) {
-		sum = oil_ydot4_load_sse2(in, i, c0, c1, c2, c3);
+		sum = oil_yload_sse2(in, i, c0, c1, c2, c3, line);
 		sum = _mm_min_ps(_mm_max_ps(sum, zero), one);
 		idx = _mm_cvttps_epi32(_mm_mul_ps(sum, scale));
-		sum2 = oil_ydot4_load_sse2(in, i + 4, c0, c1, c2, c3);
+		sum2 = oil_yload_sse2(in, i + 4, c0, c1, c2, c3, line);
 		sum2 = _mm_min_ps(_mm_max_ps(sum2, zero), one);
 		idx2 = _mm_cvttps_epi32(_mm_mul_ps(sum2, scale));
 
@@ -574,7 +627,7 @@ static inline __attribute__((always_inline)) void yscale_up_gamma_sse2_impl(
 	}
 
 	for (; i+3<len; i+=4) {
-		sum = oil_ydot4_load_sse2(in, i, c0, c1, c2, c3);
+		sum = oil_yload_sse2(in, i, c0, c1, c2, c3, line);
 		sum = _mm_min_ps(_mm_max_ps(sum, zero), one);
 		idx = _mm_cvttps_epi32(_mm_mul_ps(sum, scale));
 		if (is_rgbx) {
@@ -600,13 +653,13 @@ static inline __attribute__((always_inline)) void yscale_up_gamma_sse2_impl(
 static void oil_yscale_up_rgb_sse2(float **in, int len, float *coeffs,
 	unsigned char *out)
 {
-	yscale_up_gamma_sse2_impl(in, len, coeffs, out, 0);
+	yscale_up_gamma_sse2_impl(in, len, coeffs, out, 0, 0);
 }
 
 static void oil_yscale_up_rgbx_sse2(float **in, int len, float *coeffs,
 	unsigned char *out)
 {
-	yscale_up_gamma_sse2_impl(in, len, coeffs, out, 1);
+	yscale_up_gamma_sse2_impl(in, len, coeffs, out, 1, 0);
 }
 
 static inline __attribute__((always_inline))
@@ -782,8 +835,9 @@ static void oil_xscale_up_cmyk_sse2(unsigned char *in, int width_in, float *out,
 	}
 }
 
-static void oil_yscale_up_g_cmyk_sse2(float **in, int len, float *coeffs,
-	unsigned char *out)
+static inline __attribute__((always_inline))
+void yscale_up_g_cmyk_sse2_impl(float **in, int len, float *coeffs,
+	unsigned char *out, int gamma2, int line)
 {
 	int i;
 	__m128 c0, c1, c2, c3;
@@ -804,17 +858,21 @@ static void oil_yscale_up_g_cmyk_sse2(float **in, int len, float *coeffs,
 		__m128i idx2, idx3, idx4;
 		__m128 sum2;
 
-		sum = oil_ydot4_load_sse2(in, i, c0, c1, c2, c3);
-		idx = oil_clamp_round_idx_sse2(sum, zero, one, scale, half);
+		sum = oil_yload_sse2(in, i, c0, c1, c2, c3, line);
+		idx = oil_clamp_round_gamma_idx_sse2(sum, zero, one, scale,
+			half, gamma2);
 
-		sum2 = oil_ydot4_load_sse2(in, i + 4, c0, c1, c2, c3);
-		idx2 = oil_clamp_round_idx_sse2(sum2, zero, one, scale, half);
+		sum2 = oil_yload_sse2(in, i + 4, c0, c1, c2, c3, line);
+		idx2 = oil_clamp_round_gamma_idx_sse2(sum2, zero, one, scale,
+			half, gamma2);
 
-		sum = oil_ydot4_load_sse2(in, i + 8, c0, c1, c2, c3);
-		idx3 = oil_clamp_round_idx_sse2(sum, zero, one, scale, half);
+		sum = oil_yload_sse2(in, i + 8, c0, c1, c2, c3, line);
+		idx3 = oil_clamp_round_gamma_idx_sse2(sum, zero, one, scale,
+			half, gamma2);
 
-		sum2 = oil_ydot4_load_sse2(in, i + 12, c0, c1, c2, c3);
-		idx4 = oil_clamp_round_idx_sse2(sum2, zero, one, scale, half);
+		sum2 = oil_yload_sse2(in, i + 12, c0, c1, c2, c3, line);
+		idx4 = oil_clamp_round_gamma_idx_sse2(sum2, zero, one, scale,
+			half, gamma2);
 
 		idx = _mm_packs_epi32(idx, idx2);
 		idx3 = _mm_packs_epi32(idx3, idx4);
@@ -826,11 +884,13 @@ static void oil_yscale_up_g_cmyk_sse2(float **in, int len, float *coeffs,
 		__m128i idx2;
 		__m128 sum2;
 
-		sum = oil_ydot4_load_sse2(in, i, c0, c1, c2, c3);
-		idx = oil_clamp_round_idx_sse2(sum, zero, one, scale, half);
+		sum = oil_yload_sse2(in, i, c0, c1, c2, c3, line);
+		idx = oil_clamp_round_gamma_idx_sse2(sum, zero, one, scale,
+			half, gamma2);
 
-		sum2 = oil_ydot4_load_sse2(in, i + 4, c0, c1, c2, c3);
-		idx2 = oil_clamp_round_idx_sse2(sum2, zero, one, scale, half);
+		sum2 = oil_yload_sse2(in, i + 4, c0, c1, c2, c3, line);
+		idx2 = oil_clamp_round_gamma_idx_sse2(sum2, zero, one, scale,
+			half, gamma2);
 
 		idx = _mm_packs_epi32(idx, idx2);
 		idx = _mm_packus_epi16(idx, idx);
@@ -838,8 +898,9 @@ static void oil_yscale_up_g_cmyk_sse2(float **in, int len, float *coeffs,
 	}
 
 	for (; i+3<len; i+=4) {
-		sum = oil_ydot4_load_sse2(in, i, c0, c1, c2, c3);
-		idx = oil_clamp_round_idx_sse2(sum, zero, one, scale, half);
+		sum = oil_yload_sse2(in, i, c0, c1, c2, c3, line);
+		idx = oil_clamp_round_gamma_idx_sse2(sum, zero, one, scale,
+			half, gamma2);
 		idx = _mm_packs_epi32(idx, idx);
 		idx = _mm_packus_epi16(idx, idx);
 		*(int *)(out + i) = _mm_cvtsi128_si32(idx);
@@ -850,10 +911,99 @@ static void oil_yscale_up_g_cmyk_sse2(float **in, int len, float *coeffs,
 			coeffs[2] * in[2][i] + coeffs[3] * in[3][i];
 		if (s > 1.0f) s = 1.0f;
 		else if (s < 0.0f) s = 0.0f;
+		if (gamma2) s = sqrtf(s);
 		out[i] = (int)(s * 255.0f + 0.5f);
 	}
 }
 
+static void oil_yscale_up_g_cmyk_sse2(float **in, int len, float *coeffs,
+	unsigned char *out)
+{
+	yscale_up_g_cmyk_sse2_impl(in, len, coeffs, out, 0, 0);
+}
+
+static void oil_yscale_up_gamma2_sse2(float **in, int len, float *coeffs,
+	unsigned char *out)
+{
+	yscale_up_g_cmyk_sse2_impl(in, len, coeffs, out, 1, 0);
+}
+
+/* Accumulate `count` horizontal G samples into `sum`, using a 4-way unrolled
+ * inner loop with a 1-way scalar tail. Advances *in_p and *coeffs_x_f_p past
+ * the consumed samples/coefficients. `sum` carries the partial sum shifted in
+ * from the previous output position; the four parallel accumulators are
+ * reduced before returning.
+ */
+static inline __attribute__((always_inline))
+__m128 oil_xacc_g_heavy_sse2(unsigned char **in_p, float **coeffs_x_f_p,
+	int count, __m128 sum)
+{
+	int j;
+	unsigned char *in = *in_p;
+	float *coeffs_x_f = *coeffs_x_f_p;
+	__m128 coeffs_x, sample_x, sum2, sum3, sum4;
+
+	sum2 = _mm_setzero_ps();
+	sum3 = _mm_setzero_ps();
+	sum4 = _mm_setzero_ps();
+
+	for (j=0; j+3<count; j+=4) {
+		coeffs_x = _mm_load_ps(coeffs_x_f);
+		sample_x = _mm_set1_ps(i2f_map[in[0]]);
+		sum = _mm_add_ps(_mm_mul_ps(coeffs_x, sample_x), sum);
+
+		coeffs_x = _mm_load_ps(coeffs_x_f + 4);
+		sample_x = _mm_set1_ps(i2f_map[in[1]]);
+		sum2 = _mm_add_ps(_mm_mul_ps(coeffs_x, sample_x), sum2);
+
+		coeffs_x = _mm_load_ps(coeffs_x_f + 8);
+		sample_x = _mm_set1_ps(i2f_map[in[2]]);
+		sum3 = _mm_add_ps(_mm_mul_ps(coeffs_x, sample_x), sum3);
+
+		coeffs_x = _mm_load_ps(coeffs_x_f + 12);
+		sample_x = _mm_set1_ps(i2f_map[in[3]]);
+		sum4 = _mm_add_ps(_mm_mul_ps(coeffs_x, sample_x), sum4);
+
+		in += 4;
+		coeffs_x_f += 16;
+	}
+	for (; j<count; j++) {
+		coeffs_x = _mm_load_ps(coeffs_x_f);
+		sample_x = _mm_set1_ps(i2f_map[in[0]]);
+		sum = _mm_add_ps(_mm_mul_ps(coeffs_x, sample_x), sum);
+		in += 1;
+		coeffs_x_f += 4;
+	}
+
+	*in_p = in;
+	*coeffs_x_f_p = coeffs_x_f;
+	return _mm_add_ps(_mm_add_ps(sum, sum2), _mm_add_ps(sum3, sum4));
+}
+
+static void __attribute__((noinline)) oil_scale_down_g_heavy_sse2(
+	unsigned char *in, float *sums_y_out,
+	int out_width, float *coeffs_x_f, int *border_buf, float *coeffs_y_f)
+{
+	int i;
+	__m128 sum;
+	__m128 coeffs_y, sums_y, sample_y;
+
+	coeffs_y = _mm_load_ps(coeffs_y_f);
+	sum = _mm_setzero_ps();
+
+	for (i=0; i<out_width; i++) {
+		sum = oil_xacc_g_heavy_sse2(&in, &coeffs_x_f, border_buf[i], sum);
+
+		sums_y = _mm_load_ps(sums_y_out);
+		sample_y = _mm_shuffle_ps(sum, sum, _MM_SHUFFLE(0, 0, 0, 0));
+		sums_y = _mm_add_ps(_mm_mul_ps(coeffs_y, sample_y), sums_y);
+		_mm_store_ps(sums_y_out, sums_y);
+		sums_y_out += 4;
+
+		sum = oil_shift_f_left_sse2(sum);
+	}
+}
+
 static void oil_scale_down_g_sse2(unsigned char *in, float *sums_y_out,
 	int out_width, float *coeffs_x_f, int *border_buf, float *coeffs_y_f)
 {
@@ -1094,7 +1244,7 @@ static void oil_yscale_out_rgba_sse2(float *sums, int width, unsigned char *out,
 
 static inline __attribute__((always_inline)) void yscale_up_alpha_sse2_impl(
 	float **in, int len, float *coeffs, unsigned char *out,
-	int a_off, int rgb_off)
+	int a_off, int rgb_off, int line)
 {
 	int i;
 	__m128 c0, c1, c2, c3;
@@ -1112,7 +1262,7 @@ static inline __attribute__((always_inline)) void yscale_up_alpha_sse2_impl(
 	zero = _mm_setzero_ps();
 
 	for (i=0; i<len; i+=4) {
-		sum = oil_ydot4_load_sse2(in, i, c0, c1, c2, c3);
+		sum = oil_yload_sse2(in, i, c0, c1, c2, c3, line);
 		oil_unpremul_rgba_lut_sse2(sum, zero, one, scale, lut,
 			out + i, a_off, rgb_off);
 	}
@@ -1121,7 +1271,7 @@ static inline __attribute__((always_inline)) void yscale_up_alpha_sse2_impl(
 static void oil_yscale_up_rgba_sse2(float **in, int len, float *coeffs,
 	unsigned char *out)
 {
-	yscale_up_alpha_sse2_impl(in, len, coeffs, out, 3, 0);
+	yscale_up_alpha_sse2_impl(in, len, coeffs, out, 3, 0, 0);
 }
 
 static inline __attribute__((always_inline)) void xscale_up_alpha_sse2_impl(
@@ -1338,7 +1488,7 @@ static void oil_yscale_out_argb_sse2(float *sums, int width, unsigned char *out,
 static void oil_yscale_up_argb_sse2(float **in, int len, float *coeffs,
 	unsigned char *out)
 {
-	yscale_up_alpha_sse2_impl(in, len, coeffs, out, 0, 1);
+	yscale_up_alpha_sse2_impl(in, len, coeffs, out, 0, 1, 0);
 }
 
 static void oil_xscale_up_argb_sse2(unsigned char *in, int width_in, float *out,
@@ -1624,19 +1774,20 @@ void oil_scale_down_rgbx_sse2(unsigned char *in, float *sums_y_out,
 static inline __attribute__((always_inline))
 __m128i yscale_out_nogamma_idx_sse2(__m128 vals, __m128 zero, __m128 one,
 	__m128 scale, __m128 half, __m128i rgbx_mask, __m128i rgbx_x_val,
-	int is_rgbx)
+	int is_rgbx, int gamma2)
 {
 	__m128i idx;
 	if (is_rgbx) {
-		idx = oil_clamp_round_idx_sse2(vals, zero, one, scale, half);
+		idx = oil_clamp_round_gamma_idx_sse2(vals, zero, one, scale, half,
+			gamma2);
 		return _mm_or_si128(_mm_and_si128(idx, rgbx_mask), rgbx_x_val);
 	}
-	return oil_unpremul_rgba_idx_sse2(vals, zero, one, scale, half);
+	return oil_unpremul_rgba_idx_sse2(vals, zero, one, scale, half, gamma2);
 }
 
 static inline __attribute__((always_inline))
 void yscale_out_nogamma_sse2_impl(float *sums, int width, unsigned char *out,
-	int tap, int is_rgbx)
+	int tap, int is_rgbx, int gamma2)
 {
 	int i, tap_off;
 	__m128 scale, half, one, zero;
@@ -1653,11 +1804,11 @@ void yscale_out_nogamma_sse2_impl(float *sums, int width, unsigned char *out,
 
 	for (i=0; i+1<width; i+=2) {
 		idx = yscale_out_nogamma_idx_sse2(_mm_load_ps(sums + tap_off),
-			zero, one, scale, half, mask, x_val, is_rgbx);
+			zero, one, scale, half, mask, x_val, is_rgbx, gamma2);
 		_mm_store_si128((__m128i *)(sums + tap_off), z);
 
 		idx2 = yscale_out_nogamma_idx_sse2(_mm_load_ps(sums + 16 + tap_off),
-			zero, one, scale, half, mask, x_val, is_rgbx);
+			zero, one, scale, half, mask, x_val, is_rgbx, gamma2);
 		_mm_store_si128((__m128i *)(sums + 16 + tap_off), z);
 
 		packed = _mm_packs_epi32(idx, idx2);
@@ -1670,7 +1821,7 @@ void yscale_out_nogamma_sse2_impl(float *sums, int width, unsigned char *out,
 
 	for (; i<width; i++) {
 		idx = yscale_out_nogamma_idx_sse2(_mm_load_ps(sums + tap_off),
-			zero, one, scale, half, mask, x_val, is_rgbx);
+			zero, one, scale, half, mask, x_val, is_rgbx, gamma2);
 		packed = _mm_packs_epi32(idx, idx);
 		packed = _mm_packus_epi16(packed, packed);
 		*(int *)out = _mm_cvtsi128_si32(packed);
@@ -1683,19 +1834,28 @@ void yscale_out_nogamma_sse2_impl(float *sums, int width, unsigned char *out,
 }
 
 static void oil_yscale_out_rgbx_nogamma_sse2(float *sums, int width,
-	unsigned char *out, int tap)
+	unsigned char *out, int tap, int gamma2)
 {
-	yscale_out_nogamma_sse2_impl(sums, width, out, tap, 1);
+	if (gamma2) {
+		yscale_out_nogamma_sse2_impl(sums, width, out, tap, 1, 1);
+	} else {
+		yscale_out_nogamma_sse2_impl(sums, width, out, tap, 1, 0);
+	}
 }
 
 static void oil_yscale_out_rgba_nogamma_sse2(float *sums, int width,
-	unsigned char *out, int tap)
+	unsigned char *out, int tap, int gamma2)
 {
-	yscale_out_nogamma_sse2_impl(sums, width, out, tap, 0);
+	if (gamma2) {
+		yscale_out_nogamma_sse2_impl(sums, width, out, tap, 0, 1);
+	} else {
+		yscale_out_nogamma_sse2_impl(sums, width, out, tap, 0, 0);
+	}
 }
 
 static inline __attribute__((always_inline)) void yscale_up_nogamma_sse2_impl(
-	float **in, int len, float *coeffs, unsigned char *out, int is_rgbx)
+	float **in, int len, float *coeffs, unsigned char *out, int is_rgbx,
+	int gamma2, int line)
 {
 	int i;
 	__m128 c0, c1, c2, c3;
@@ -1715,13 +1875,13 @@ static inline __attribute__((always_inline)) void yscale_up_nogamma_sse2_impl(
 	x_val = _mm_set_epi32(255, 0, 0, 0);
 
 	for (i=0; i+7<len; i+=8) {
-		sum_a = oil_ydot4_load_sse2(in, i, c0, c1, c2, c3);
-		sum_b = oil_ydot4_load_sse2(in, i + 4, c0, c1, c2, c3);
+		sum_a = oil_yload_sse2(in, i, c0, c1, c2, c3, line);
+		sum_b = oil_yload_sse2(in, i + 4, c0, c1, c2, c3, line);
 
 		idx_a = yscale_out_nogamma_idx_sse2(sum_a, zero, one, scale, half,
-			mask, x_val, is_rgbx);
+			mask, x_val, is_rgbx, gamma2);
 		idx_b = yscale_out_nogamma_idx_sse2(sum_b, zero, one, scale, half,
-			mask, x_val, is_rgbx);
+			mask, x_val, is_rgbx, gamma2);
 
 		packed = _mm_packs_epi32(idx_a, idx_b);
 		packed = _mm_packus_epi16(packed, packed);
@@ -1729,10 +1889,10 @@ static inline __attribute__((always_inline)) void yscale_up_nogamma_sse2_impl(
 	}
 
 	for (; i<len; i+=4) {
-		sum_a = oil_ydot4_load_sse2(in, i, c0, c1, c2, c3);
+		sum_a = oil_yload_sse2(in, i, c0, c1, c2, c3, line);
 
 		idx_a = yscale_out_nogamma_idx_sse2(sum_a, zero, one, scale, half,
-			mask, x_val, is_rgbx);
+			mask, x_val, is_rgbx, gamma2);
 		packed = _mm_packs_epi32(idx_a, idx_a);
 		packed = _mm_packus_epi16(packed, packed);
 		*(int *)(out + i) = _mm_cvtsi128_si32(packed);
@@ -1740,41 +1900,387 @@ static inline __attribute__((always_inline)) void yscale_up_nogamma_sse2_impl(
 }
 
 static void oil_yscale_up_rgba_nogamma_sse2(float **in, int len, float *coeffs,
-	unsigned char *out)
+	unsigned char *out, int gamma2)
 {
-	yscale_up_nogamma_sse2_impl(in, len, coeffs, out, 0);
+	if (gamma2) {
+		yscale_up_nogamma_sse2_impl(in, len, coeffs, out, 0, 1, 0);
+	} else {
+		yscale_up_nogamma_sse2_impl(in, len, coeffs, out, 0, 0, 0);
+	}
 }
 
 static void oil_yscale_up_rgbx_nogamma_sse2(float **in, int len, float *coeffs,
-	unsigned char *out)
+	unsigned char *out, int gamma2)
 {
-	yscale_up_nogamma_sse2_impl(in, len, coeffs, out, 1);
+	if (gamma2) {
+		yscale_up_nogamma_sse2_impl(in, len, coeffs, out, 1, 1, 0);
+	} else {
+		yscale_up_nogamma_sse2_impl(in, len, coeffs, out, 1, 0, 0);
+	}
 }
 
 static void oil_xscale_up_rgba_nogamma_sse2(unsigned char *in, int width_in, float *out,
-	float *coeff_buf, int *border_buf)
+	float *coeff_buf, int *border_buf, float *lut)
 {
 	xscale_up_alpha_sse2_impl(in, width_in, out, coeff_buf, border_buf,
-		3, 0, i2f_map);
+		3, 0, lut);
 }
 
 static void oil_scale_down_rgba_nogamma_sse2(unsigned char *in, float *sums_y_out,
 	int out_width, float *coeffs_x_f, int *border_buf, float *coeffs_y_f,
-	int tap)
+	int tap, float *lut)
 {
 	scale_down_alpha_sse2_impl(in, sums_y_out, out_width, coeffs_x_f,
-		border_buf, coeffs_y_f, tap, 3, 0, i2f_map);
+		border_buf, coeffs_y_f, tap, 3, 0, lut);
 }
 
-/* SSE2 dispatch functions */
+/* Fixed point */
 
-static float *get_rb_line(struct oil_scale *os, int line)
+/* Round lane 0 of a fixed-point x-sum to a sample (see OIL_FIXED_SHIFT()),
+ * accumulate the sample into the 4 sums at sums weighed by coeffs_y, and
+ * shift the x-sum left by one lane. coeffs_y holds one y-coefficient in the
+ * low int16 of each 32-bit lane. */
+static inline __attribute__((always_inline))
+__m128i fixed_out_sse2(__m128i sum, int *sums, __m128i coeffs_y, int shift)
 {
-	int sl_len;
-	sl_len = OIL_CMP(os->cs) * os->out_width;
-	return os->rb + line * sl_len;
+	__m128i smp;
+
+	smp = _mm_add_epi32(sum, _mm_set1_epi32(1 << (shift - 1)));
+	smp = _mm_shuffle_epi32(_mm_srai_epi32(smp, shift), 0x00);
+	_mm_storeu_si128((__m128i *)sums, _mm_add_epi32(
+		_mm_loadu_si128((__m128i *)sums), _mm_madd_epi16(smp, coeffs_y)));
+	return _mm_srli_si128(sum, 4);
+}
+
+/* Broadcast samples a & b as a pair of int16s into every 32-bit lane, to be
+ * weighed by a pair of taps with _mm_madd_epi16(). */
+static inline __attribute__((always_inline))
+__m128i fixed_pair_sse2(int a, int b)
+{
+	return _mm_set1_epi32(a | b << 16);
+}
+
+static void oil_scale_down_fixed_g_sse2(unsigned char *in, int out_width,
+	int *sums, short *coeffs_x, int *border_buf, __m128i coeffs_y)
+{
+	int i, j, n, px4;
+	__m128i sum, px, zero;
+
+	zero = _mm_setzero_si128();
+	sum = zero;
+	for (i=0; i<out_width; i++) {
+		n = border_buf[i];
+		/* 4 taps: two pairs from one 32-bit load */
+		for (j=0; j+3<n; j+=4) {
+			memcpy(&px4, in, 4);
+			px = _mm_unpacklo_epi8(_mm_cvtsi32_si128(px4), zero);
+			sum = _mm_add_epi32(sum, _mm_madd_epi16(
+				_mm_shuffle_epi32(px, 0x00),
+				_mm_loadu_si128((__m128i *)coeffs_x)));
+			sum = _mm_add_epi32(sum, _mm_madd_epi16(
+				_mm_shuffle_epi32(px, 0x55),
+				_mm_loadu_si128((__m128i *)(coeffs_x + 8))));
+			in += 4;
+			coeffs_x += 16;
+		}
+		if (j + 1 < n) {
+			sum = _mm_add_epi32(sum, _mm_madd_epi16(
+				fixed_pair_sse2(in[0], in[1]),
+				_mm_loadu_si128((__m128i *)coeffs_x)));
+			in += 2;
+			coeffs_x += 8;
+			j += 2;
+		}
+		if (j < n) {
+			sum = _mm_add_epi32(sum, _mm_madd_epi16(
+				fixed_pair_sse2(in[0], 0),
+				_mm_loadu_si128((__m128i *)coeffs_x)));
+			in += 1;
+			coeffs_x += 8;
+		}
+		sum = fixed_out_sse2(sum, sums, coeffs_y, 8);
+		sums += 4;
+	}
+}
+
+/* RGB_NOGAMMA when cmp is 3, RGBX_NOGAMMA when cmp is 4 */
+static inline __attribute__((always_inline))
+void scale_down_fixed_rgb_sse2_impl(unsigned char *in, int out_width,
+	int *sums, short *coeffs_x, int *border_buf, __m128i coeffs_y, int cmp)
+{
+	int i, j, n;
+	__m128i sum_r, sum_g, sum_b, coeffs;
+
+	sum_r = sum_g = sum_b = _mm_setzero_si128();
+	for (i=0; i<out_width; i++) {
+		n = border_buf[i];
+		for (j=0; j<n; j+=2) {
+			coeffs = _mm_loadu_si128((__m128i *)coeffs_x);
+			if (j + 1 < n) {
+				sum_r = _mm_add_epi32(sum_r, _mm_madd_epi16(
+					fixed_pair_sse2(in[0], in[cmp]), coeffs));
+				sum_g = _mm_add_epi32(sum_g, _mm_madd_epi16(
+					fixed_pair_sse2(in[1], in[cmp + 1]), coeffs));
+				sum_b = _mm_add_epi32(sum_b, _mm_madd_epi16(
+					fixed_pair_sse2(in[2], in[cmp + 2]), coeffs));
+				in += 2 * cmp;
+			} else {
+				sum_r = _mm_add_epi32(sum_r, _mm_madd_epi16(
+					fixed_pair_sse2(in[0], 0), coeffs));
+				sum_g = _mm_add_epi32(sum_g, _mm_madd_epi16(
+					fixed_pair_sse2(in[1], 0), coeffs));
+				sum_b = _mm_add_epi32(sum_b, _mm_madd_epi16(
+					fixed_pair_sse2(in[2], 0), coeffs));
+				in += cmp;
+			}
+			coeffs_x += 8;
+		}
+		sum_r = fixed_out_sse2(sum_r, sums, coeffs_y, 8);
+		sum_g = fixed_out_sse2(sum_g, sums + 4, coeffs_y, 8);
+		sum_b = fixed_out_sse2(sum_b, sums + 8, coeffs_y, 8);
+		sums += cmp * 4;
+	}
+}
+
+static void oil_scale_down_fixed_rgb_sse2(unsigned char *in, int out_width,
+	int *sums, short *coeffs_x, int *border_buf, __m128i coeffs_y)
+{
+	scale_down_fixed_rgb_sse2_impl(in, out_width, sums, coeffs_x,
+		border_buf, coeffs_y, 3);
+}
+
+static void oil_scale_down_fixed_rgbx_sse2(unsigned char *in, int out_width,
+	int *sums, short *coeffs_x, int *border_buf, __m128i coeffs_y)
+{
+	scale_down_fixed_rgb_sse2_impl(in, out_width, sums, coeffs_x,
+		border_buf, coeffs_y, 4);
+}
+
+static void oil_scale_down_fixed_rgba_sse2(unsigned char *in, int out_width,
+	int *sums, short *coeffs_x, int *border_buf, __m128i coeffs_y)
+{
+	int i, j, n, px4;
+	__m128i sum_r, sum_g, sum_b, sum_a, coeffs, zero, px, alpha, rgb_mask,
+		alpha_255, two, premul;
+
+	zero = _mm_setzero_si128();
+	sum_r = sum_g = sum_b = sum_a = zero;
+	rgb_mask = _mm_set_epi32(0, -1, -1, -1);
+	alpha_255 = _mm_set_epi32(255 | 255 << 16, 0, 0, 0);
+	two = _mm_set1_epi16(2);
+	premul = _mm_set1_epi16((short)OIL_FIXED_PREMUL);
+	for (i=0; i<out_width; i++) {
+		n = border_buf[i];
+		for (j=0; j<n; j+=2) {
+			if (j + 1 < n) {
+				px = _mm_loadl_epi64((__m128i *)in);
+				in += 8;
+			} else {
+				memcpy(&px4, in, 4);
+				px = _mm_cvtsi32_si128(px4);
+				in += 4;
+			}
+			/* [r0 r1 g0 g1 b0 b1 a0 a1] as int16s */
+			px = _mm_unpacklo_epi8(px, zero);
+			px = _mm_unpacklo_epi16(px, _mm_srli_si128(px, 8));
+			/* premultiply, treating alpha as a colour at 255 */
+			alpha = _mm_shuffle_epi32(px, 0xFF);
+			alpha = _mm_or_si128(_mm_and_si128(alpha, rgb_mask),
+				alpha_255);
+			px = _mm_mulhi_epu16(_mm_add_epi16(_mm_mullo_epi16(px,
+				alpha), two), premul);
+
+			coeffs = _mm_loadu_si128((__m128i *)coeffs_x);
+			sum_r = _mm_add_epi32(sum_r, _mm_madd_epi16(
+				_mm_shuffle_epi32(px, 0x00), coeffs));
+			sum_g = _mm_add_epi32(sum_g, _mm_madd_epi16(
+				_mm_shuffle_epi32(px, 0x55), coeffs));
+			sum_b = _mm_add_epi32(sum_b, _mm_madd_epi16(
+				_mm_shuffle_epi32(px, 0xAA), coeffs));
+			sum_a = _mm_add_epi32(sum_a, _mm_madd_epi16(
+				_mm_shuffle_epi32(px, 0xFF), coeffs));
+			coeffs_x += 8;
+		}
+		sum_r = fixed_out_sse2(sum_r, sums, coeffs_y, 14);
+		sum_g = fixed_out_sse2(sum_g, sums + 4, coeffs_y, 14);
+		sum_b = fixed_out_sse2(sum_b, sums + 8, coeffs_y, 14);
+		sum_a = fixed_out_sse2(sum_a, sums + 12, coeffs_y, 14);
+		sums += 16;
+	}
+}
+
+/* Gather lane tap of the 4 sums at each of a, b, c & d into one vector. */
+static inline __attribute__((always_inline))
+__m128i fixed_lane_sse2(__m128i a, __m128i b, __m128i c, __m128i d, int tap)
+{
+	__m128i ab, cd;
+
+	if (tap < 2) {
+		ab = _mm_unpacklo_epi32(a, b);
+		cd = _mm_unpacklo_epi32(c, d);
+	} else {
+		ab = _mm_unpackhi_epi32(a, b);
+		cd = _mm_unpackhi_epi32(c, d);
+	}
+	return tap & 1 ? _mm_unpackhi_epi64(ab, cd) : _mm_unpacklo_epi64(ab, cd);
+}
+
+/* Load lane tap of 4 consecutive samples' sums, zeroing it in memory. */
+static inline __attribute__((always_inline))
+__m128i fixed_take4_sse2(int *sums, __m128i keep, int tap)
+{
+	__m128i a, b, c, d;
+
+	a = _mm_loadu_si128((__m128i *)sums);
+	b = _mm_loadu_si128((__m128i *)(sums + 4));
+	c = _mm_loadu_si128((__m128i *)(sums + 8));
+	d = _mm_loadu_si128((__m128i *)(sums + 12));
+	_mm_storeu_si128((__m128i *)sums, _mm_and_si128(a, keep));
+	_mm_storeu_si128((__m128i *)(sums + 4), _mm_and_si128(b, keep));
+	_mm_storeu_si128((__m128i *)(sums + 8), _mm_and_si128(c, keep));
+	_mm_storeu_si128((__m128i *)(sums + 12), _mm_and_si128(d, keep));
+	return fixed_lane_sse2(a, b, c, d, tap);
+}
+
+/* G, RGB_NOGAMMA & RGBX_NOGAMMA. len is the number of samples. */
+static inline __attribute__((always_inline))
+void yscale_out_fixed_sse2_impl(int *sums, int len, unsigned char *out,
+	int tap, int is_rgbx)
+{
+	int i, v;
+	__m128i keep, round, x_mask, a, b, c, d;
+
+	keep = _mm_cmpeq_epi32(_mm_set_epi32(3, 2, 1, 0), _mm_set1_epi32(tap));
+	keep = _mm_xor_si128(keep, _mm_set1_epi32(-1));
+	round = _mm_set1_epi32(1 << 19);
+	x_mask = _mm_set1_epi32(is_rgbx ? 0xFF000000 : 0);
+	for (i=0; i+15<len; i+=16) {
+		a = fixed_take4_sse2(sums, keep, tap);
+		b = fixed_take4_sse2(sums + 16, keep, tap);
+		c = fixed_take4_sse2(sums + 32, keep, tap);
+		d = fixed_take4_sse2(sums + 48, keep, tap);
+		a = _mm_srai_epi32(_mm_add_epi32(a, round), 20);
+		b = _mm_srai_epi32(_mm_add_epi32(b, round), 20);
+		c = _mm_srai_epi32(_mm_add_epi32(c, round), 20);
+		d = _mm_srai_epi32(_mm_add_epi32(d, round), 20);
+		a = _mm_packus_epi16(_mm_packs_epi32(a, b),
+			_mm_packs_epi32(c, d));
+		_mm_storeu_si128((__m128i *)(out + i), _mm_or_si128(a, x_mask));
+		sums += 64;
+	}
+	for (; i<len; i++) {
+		v = (sums[tap] + (1 << 19)) >> 20;
+		out[i] = v < 0 ? 0 : (v > 255 ? 255 : v);
+		if (is_rgbx && (i & 3) == 3) {
+			out[i] = 255;
+		}
+		sums[tap] = 0;
+		sums += 4;
+	}
+}
+
+static inline __attribute__((always_inline))
+void yscale_out_fixed_rgba_sse2_impl(int *sums, int width, unsigned char *out,
+	int tap)
+{
+	int i;
+	__m128i keep, idx;
+	__m128 scale, zero, one, half, f255, val, alpha, rgb_mask;
+
+	keep = _mm_cmpeq_epi32(_mm_set_epi32(3, 2, 1, 0), _mm_set1_epi32(tap));
+	keep = _mm_xor_si128(keep, _mm_set1_epi32(-1));
+	/* same arithmetic as the C version, so the output is identical */
+	scale = _mm_set1_ps(65536.0f / (255.0f * 255.0f * OIL_FIXED_PREMUL *
+		OIL_FIXED_ONE));
+	zero = _mm_setzero_ps();
+	one = _mm_set1_ps(1.0f);
+	half = _mm_set1_ps(0.5f);
+	f255 = _mm_set1_ps(255.0f);
+	rgb_mask = _mm_castsi128_ps(_mm_set_epi32(0, -1, -1, -1));
+	for (i=0; i<width; i++) {
+		val = _mm_mul_ps(_mm_cvtepi32_ps(fixed_take4_sse2(sums, keep,
+			tap)), scale);
+		alpha = _mm_shuffle_ps(val, val, _MM_SHUFFLE(3, 3, 3, 3));
+		alpha = _mm_min_ps(_mm_max_ps(alpha, zero), one);
+		/* divide by alpha unless it is 0 */
+		val = _mm_div_ps(val, _mm_or_ps(
+			_mm_and_ps(_mm_cmpneq_ps(alpha, zero), alpha),
+			_mm_and_ps(_mm_cmpeq_ps(alpha, zero), one)));
+		val = _mm_min_ps(_mm_max_ps(val, zero), one);
+		val = _mm_or_ps(_mm_and_ps(val, rgb_mask),
+			_mm_andnot_ps(rgb_mask, alpha));
+		idx = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(val, f255), half));
+		idx = _mm_packs_epi32(idx, idx);
+		idx = _mm_packus_epi16(idx, idx);
+		*(int *)(out + i * 4) = _mm_cvtsi128_si32(idx);
+		sums += 16;
+	}
+}
+
+static void scale_down_fixed_sse2(unsigned char *in, int out_width,
+	int *sums, enum oil_colorspace cs, short *coeffs_x, int *border_buf,
+	short *coeffs_y)
+{
+	__m128i cy;
+
+	cy = _mm_unpacklo_epi16(_mm_loadl_epi64((__m128i *)coeffs_y),
+		_mm_setzero_si128());
+	switch(cs) {
+	case OIL_CS_G:
+		oil_scale_down_fixed_g_sse2(in, out_width, sums, coeffs_x,
+			border_buf, cy);
+		break;
+	case OIL_CS_RGB_NOGAMMA:
+		oil_scale_down_fixed_rgb_sse2(in, out_width, sums, coeffs_x,
+			border_buf, cy);
+		break;
+	case OIL_CS_RGBA_NOGAMMA:
+		oil_scale_down_fixed_rgba_sse2(in, out_width, sums, coeffs_x,
+			border_buf, cy);
+		break;
+	case OIL_CS_RGBX_NOGAMMA:
+		oil_scale_down_fixed_rgbx_sse2(in, out_width, sums, coeffs_x,
+			border_buf, cy);
+		break;
+	default:
+		break;
+	}
+}
+
+/* Expand the tap to a constant in each copy of the kernel. */
+static inline __attribute__((always_inline))
+void yscale_out_fixed_tap_sse2(int *sums, int width, unsigned char *out,
+	enum oil_colorspace cs, int tap)
+{
+	if (cs == OIL_CS_RGBA_NOGAMMA) {
+		yscale_out_fixed_rgba_sse2_impl(sums, width, out, tap);
+	} else {
+		yscale_out_fixed_sse2_impl(sums, width * OIL_CMP(cs), out, tap,
+			cs == OIL_CS_RGBX_NOGAMMA);
+	}
+}
+
+static void yscale_out_fixed_sse2(int *sums, int width, unsigned char *out,
+	enum oil_colorspace cs, int tap)
+{
+	switch(tap) {
+	case 0:
+		yscale_out_fixed_tap_sse2(sums, width, out, cs, 0);
+		break;
+	case 1:
+		yscale_out_fixed_tap_sse2(sums, width, out, cs, 1);
+		break;
+	case 2:
+		yscale_out_fixed_tap_sse2(sums, width, out, cs, 2);
+		break;
+	case 3:
+		yscale_out_fixed_tap_sse2(sums, width, out, cs, 3);
+		break;
+	}
 }
 
+/* SSE2 dispatch functions */
+
 static void yscale_out_sse2(float *sums, int width, unsigned char *out,
 	enum oil_colorspace cs, int tap)
 {
@@ -1808,10 +2314,19 @@ static void yscale_out_sse2(float *sums, int width, unsigned char *out,
 		oil_yscale_out_nonlinear_sse2(sums, sl_len, out);
 		break;
 	case OIL_CS_RGBA_NOGAMMA:
-		oil_yscale_out_rgba_nogamma_sse2(sums, width, out, tap);
+		oil_yscale_out_rgba_nogamma_sse2(sums, width, out, tap, 0);
 		break;
 	case OIL_CS_RGBX_NOGAMMA:
-		oil_yscale_out_rgbx_nogamma_sse2(sums, width, out, tap);
+		oil_yscale_out_rgbx_nogamma_sse2(sums, width, out, tap, 0);
+		break;
+	case OIL_CS_RGB_GAMMA2:
+		oil_yscale_out_gamma2_sse2(sums, sl_len, out);
+		break;
+	case OIL_CS_RGBA_GAMMA2:
+		oil_yscale_out_rgba_nogamma_sse2(sums, width, out, tap, 1);
+		break;
+	case OIL_CS_RGBX_GAMMA2:
+		oil_yscale_out_rgbx_nogamma_sse2(sums, width, out, tap, 1);
 		break;
 	case OIL_CS_UNKNOWN:
 		break;
@@ -1845,10 +2360,19 @@ static void yscale_up_sse2(float **in, int len, float *coeffs,
 		oil_yscale_up_g_cmyk_sse2(in, len, coeffs, out);
 		break;
 	case OIL_CS_RGBA_NOGAMMA:
-		oil_yscale_up_rgba_nogamma_sse2(in, len, coeffs, out);
+		oil_yscale_up_rgba_nogamma_sse2(in, len, coeffs, out, 0);
 		break;
 	case OIL_CS_RGBX_NOGAMMA:
-		oil_yscale_up_rgbx_nogamma_sse2(in, len, coeffs, out);
+		oil_yscale_up_rgbx_nogamma_sse2(in, len, coeffs, out, 0);
+		break;
+	case OIL_CS_RGB_GAMMA2:
+		oil_yscale_up_gamma2_sse2(in, len, coeffs, out);
+		break;
+	case OIL_CS_RGBA_GAMMA2:
+		oil_yscale_up_rgba_nogamma_sse2(in, len, coeffs, out, 1);
+		break;
+	case OIL_CS_RGBX_GAMMA2:
+		oil_yscale_up_rgbx_nogamma_sse2(in, len, coeffs, out, 1);
 		break;
 	case OIL_CS_UNKNOWN:
 		break;
@@ -1884,28 +2408,38 @@ static void xscale_up_sse2(unsigned char *in, int width_in, float *out,
 		oil_xscale_up_rgb_sse2(in, width_in, out, coeff_buf, border_buf, i2f_map);
 		break;
 	case OIL_CS_RGBA_NOGAMMA:
-		oil_xscale_up_rgba_nogamma_sse2(in, width_in, out, coeff_buf, border_buf);
+		oil_xscale_up_rgba_nogamma_sse2(in, width_in, out, coeff_buf, border_buf, i2f_map);
 		break;
 	case OIL_CS_RGBX_NOGAMMA:
 		oil_xscale_up_rgbx_sse2(in, width_in, out, coeff_buf, border_buf, i2f_map);
 		break;
+	case OIL_CS_RGB_GAMMA2:
+		oil_xscale_up_rgb_sse2(in, width_in, out, coeff_buf, border_buf, g2l_map);
+		break;
+	case OIL_CS_RGBA_GAMMA2:
+		oil_xscale_up_rgba_nogamma_sse2(in, width_in, out, coeff_buf, border_buf, g2l_map);
+		break;
+	case OIL_CS_RGBX_GAMMA2:
+		oil_xscale_up_rgbx_sse2(in, width_in, out, coeff_buf, border_buf, g2l_map);
+		break;
 	case OIL_CS_UNKNOWN:
 		break;
 	}
 }
 
-static void down_scale_in_sse2(struct oil_scale *os, unsigned char *in)
+static void scale_down_sse2(struct oil_scale *os, unsigned char *in,
+	float *coeffs_y)
 {
-	float *coeffs_y;
-
-	coeffs_y = os->coeffs_y + os->in_pos * 4;
-
 	switch(os->cs) {
 	case OIL_CS_RGB:
 		oil_scale_down_rgb_sse2(in, os->sums_y, os->out_width, os->coeffs_x, os->borders_x, coeffs_y, s2l_map);
 		break;
 	case OIL_CS_G:
-		oil_scale_down_g_sse2(in, os->sums_y, os->out_width, os->coeffs_x, os->borders_x, coeffs_y);
+		if (os->in_width / os->out_width >= os->heavy_ratio) {
+			oil_scale_down_g_heavy_sse2(in, os->sums_y, os->out_width, os->coeffs_x, os->borders_x, coeffs_y);
+		} else {
+			oil_scale_down_g_sse2(in, os->sums_y, os->out_width, os->coeffs_x, os->borders_x, coeffs_y);
+		}
 		break;
 	case OIL_CS_CMYK:
 		oil_scale_down_cmyk_sse2(in, os->sums_y, os->out_width, os->coeffs_x, os->borders_x, coeffs_y, os->sums_y_tap);
@@ -1926,70 +2460,363 @@ static void down_scale_in_sse2(struct oil_scale *os, unsigned char *in)
 		oil_scale_down_rgb_sse2(in, os->sums_y, os->out_width, os->coeffs_x, os->borders_x, coeffs_y, i2f_map);
 		break;
 	case OIL_CS_RGBA_NOGAMMA:
-		oil_scale_down_rgba_nogamma_sse2(in, os->sums_y, os->out_width, os->coeffs_x, os->borders_x, coeffs_y, os->sums_y_tap);
+		oil_scale_down_rgba_nogamma_sse2(in, os->sums_y, os->out_width, os->coeffs_x, os->borders_x, coeffs_y, os->sums_y_tap, i2f_map);
 		break;
 	case OIL_CS_RGBX_NOGAMMA:
 		oil_scale_down_rgbx_sse2(in, os->sums_y, os->out_width, os->coeffs_x, os->borders_x, coeffs_y, os->sums_y_tap, i2f_map);
 		break;
+	case OIL_CS_RGB_GAMMA2:
+		oil_scale_down_rgb_sse2(in, os->sums_y, os->out_width, os->coeffs_x, os->borders_x, coeffs_y, g2l_map);
+		break;
+	case OIL_CS_RGBA_GAMMA2:
+		oil_scale_down_rgba_nogamma_sse2(in, os->sums_y, os->out_width, os->coeffs_x, os->borders_x, coeffs_y, os->sums_y_tap, g2l_map);
+		break;
+	case OIL_CS_RGBX_GAMMA2:
+		oil_scale_down_rgbx_sse2(in, os->sums_y, os->out_width, os->coeffs_x, os->borders_x, coeffs_y, os->sums_y_tap, g2l_map);
+		break;
 	case OIL_CS_UNKNOWN:
 		break;
 	}
+}
 
-	os->slots_y -= 1;
-	os->in_pos++;
+/* Mixed geometry */
+
+/* The sample xscale_up_sse2() interpolates for the pixel at in: OIL_CMP(cs)
+ * floats, linear and premultiplied.
+ */
+static inline __attribute__((always_inline))
+__m128 oil_xsample_sse2(unsigned char *in, enum oil_colorspace cs, float *lut)
+{
+	int px;
+	__m128i idx;
+
+	switch(cs) {
+	case OIL_CS_G:
+		return _mm_set_ss(i2f_map[in[0]]);
+	case OIL_CS_GA:
+		return _mm_mul_ps(_mm_set1_ps(i2f_map[in[1]]),
+			_mm_setr_ps(i2f_map[in[0]], 1.0f, 0.0f, 0.0f));
+	case OIL_CS_CMYK:
+		memcpy(&px, in, 4);
+		idx = _mm_unpacklo_epi8(_mm_cvtsi32_si128(px), _mm_setzero_si128());
+		idx = _mm_unpacklo_epi16(idx, _mm_setzero_si128());
+		return _mm_mul_ps(_mm_cvtepi32_ps(idx), _mm_set1_ps(1.0f / 255.0f));
+	case OIL_CS_RGBA:
+	case OIL_CS_RGBA_NOGAMMA:
+	case OIL_CS_RGBA_GAMMA2:
+		return _mm_mul_ps(_mm_set1_ps(i2f_map[in[3]]),
+			_mm_setr_ps(lut[in[0]], lut[in[1]], lut[in[2]], 1.0f));
+	case OIL_CS_ARGB:
+		return _mm_mul_ps(_mm_set1_ps(i2f_map[in[0]]),
+			_mm_setr_ps(lut[in[1]], lut[in[2]], lut[in[3]], 1.0f));
+	case OIL_CS_RGBX:
+	case OIL_CS_RGBX_NOGAMMA:
+	case OIL_CS_RGBX_GAMMA2:
+		return _mm_setr_ps(lut[in[0]], lut[in[1]], lut[in[2]], 1.0f);
+	case OIL_CS_RGB:
+	case OIL_CS_RGB_NOGAMMA:
+	case OIL_CS_RGB_GAMMA2:
+		return _mm_setr_ps(lut[in[0]], lut[in[1]], lut[in[2]], 0.0f);
+	default:
+		return _mm_setzero_ps();
+	}
 }
 
-static void up_scale_in_sse2(struct oil_scale *os, unsigned char *in)
+/* x-downscale a scanline into a line of out_width samples. Each component
+ * keeps the sums of the 4 pending output positions in one vector, as the
+ * scale_down kernels do, so the weights of a sample are a single load.
+ */
+static inline __attribute__((always_inline))
+void xscale_down_sse2_impl(unsigned char *in, int out_width, float *out,
+	float *coeffs_x, int *border_buf, enum oil_colorspace cs, float *lut)
 {
-	float *tmp;
+	int i, j, cmp;
+	__m128 smp, c, s0, s1, s2, s3, px;
+
+	cmp = OIL_CMP(cs);
+	s0 = s1 = s2 = s3 = _mm_setzero_ps();
 
-	tmp = get_rb_line(os, os->in_pos % 4);
-	xscale_up_sse2(in, os->in_width, tmp, os->cs, os->coeffs_x, os->borders_x);
+	for (i=0; i<out_width; i++) {
+		for (j=0; j<border_buf[i]; j++) {
+			smp = oil_xsample_sse2(in, cs, lut);
+			c = _mm_load_ps(coeffs_x);
+			s0 = _mm_add_ps(s0, _mm_mul_ps(c,
+				_mm_shuffle_ps(smp, smp, _MM_SHUFFLE(0,0,0,0))));
+			if (cmp > 1) {
+				s1 = _mm_add_ps(s1, _mm_mul_ps(c,
+					_mm_shuffle_ps(smp, smp, _MM_SHUFFLE(1,1,1,1))));
+			}
+			if (cmp > 2) {
+				s2 = _mm_add_ps(s2, _mm_mul_ps(c,
+					_mm_shuffle_ps(smp, smp, _MM_SHUFFLE(2,2,2,2))));
+			}
+			if (cmp > 3) {
+				s3 = _mm_add_ps(s3, _mm_mul_ps(c,
+					_mm_shuffle_ps(smp, smp, _MM_SHUFFLE(3,3,3,3))));
+			}
+			in += cmp;
+			coeffs_x += 4;
+		}
 
-	os->in_pos++;
-	os->slots_y = os->borders_y[os->in_pos - 1];
+		px = oil_pack_lane0_x4_sse2(s0, s1, s2, s3);
+		switch(cmp) {
+		case 1:
+			_mm_store_ss(out, px);
+			break;
+		case 2:
+			_mm_storel_pi((__m64 *)out, px);
+			break;
+		case 3:
+			_mm_storel_pi((__m64 *)out, px);
+			_mm_store_ss(out + 2, _mm_movehl_ps(px, px));
+			break;
+		default:
+			_mm_storeu_ps(out, px);
+			break;
+		}
+		out += cmp;
+
+		s0 = oil_shift_f_left_sse2(s0);
+		s1 = oil_shift_f_left_sse2(s1);
+		s2 = oil_shift_f_left_sse2(s2);
+		s3 = oil_shift_f_left_sse2(s3);
+	}
 }
 
-int oil_scale_in_sse2(struct oil_scale *os, unsigned char *in)
+static void xscale_down_sse2(unsigned char *in, int heavy, int out_width,
+	float *out, enum oil_colorspace cs, float *coeffs_x, int *border_buf)
+{
+	(void)heavy;
+
+	switch(cs) {
+	case OIL_CS_G:
+		xscale_down_sse2_impl(in, out_width, out, coeffs_x, border_buf, OIL_CS_G, NULL);
+		break;
+	case OIL_CS_GA:
+		xscale_down_sse2_impl(in, out_width, out, coeffs_x, border_buf, OIL_CS_GA, NULL);
+		break;
+	case OIL_CS_RGB:
+		xscale_down_sse2_impl(in, out_width, out, coeffs_x, border_buf, OIL_CS_RGB, s2l_map);
+		break;
+	case OIL_CS_CMYK:
+		xscale_down_sse2_impl(in, out_width, out, coeffs_x, border_buf, OIL_CS_CMYK, NULL);
+		break;
+	case OIL_CS_RGBA:
+		xscale_down_sse2_impl(in, out_width, out, coeffs_x, border_buf, OIL_CS_RGBA, s2l_map);
+		break;
+	case OIL_CS_ARGB:
+		xscale_down_sse2_impl(in, out_width, out, coeffs_x, border_buf, OIL_CS_ARGB, s2l_map);
+		break;
+	case OIL_CS_RGBX:
+		xscale_down_sse2_impl(in, out_width, out, coeffs_x, border_buf, OIL_CS_RGBX, s2l_map);
+		break;
+	case OIL_CS_RGB_NOGAMMA:
+		xscale_down_sse2_impl(in, out_width, out, coeffs_x, border_buf, OIL_CS_RGB_NOGAMMA, i2f_map);
+		break;
+	case OIL_CS_RGBA_NOGAMMA:
+		xscale_down_sse2_impl(in, out_width, out, coeffs_x, border_buf, OIL_CS_RGBA_NOGAMMA, i2f_map);
+		break;
+	case OIL_CS_RGBX_NOGAMMA:
+		xscale_down_sse2_impl(in, out_width, out, coeffs_x, border_buf, OIL_CS_RGBX_NOGAMMA, i2f_map);
+		break;
+	case OIL_CS_RGB_GAMMA2:
+		xscale_down_sse2_impl(in, out_width, out, coeffs_x, border_buf, OIL_CS_RGB_GAMMA2, g2l_map);
+		break;
+	case OIL_CS_RGBA_GAMMA2:
+		xscale_down_sse2_impl(in, out_width, out, coeffs_x, border_buf, OIL_CS_RGBA_GAMMA2, g2l_map);
+		break;
+	case OIL_CS_RGBX_GAMMA2:
+		xscale_down_sse2_impl(in, out_width, out, coeffs_x, border_buf, OIL_CS_RGBX_GAMMA2, g2l_map);
+		break;
+	case OIL_CS_UNKNOWN:
+		break;
+	}
+}
+
+/* Convert len bytes to floats through lut, 4 at a time. */
+static void oil_convert_lut_sse2(unsigned char *in, int len, float *out,
+	float *lut)
 {
-	if (oil_scale_slots(os) == 0) {
-		return -1;
+	int i;
+
+	for (i=0; i+3<len; i+=4) {
+		_mm_storeu_ps(out + i, _mm_setr_ps(lut[in[i]], lut[in[i + 1]],
+			lut[in[i + 2]], lut[in[i + 3]]));
 	}
-	if (os->out_width > os->in_width) {
-		up_scale_in_sse2(os, in);
-	} else {
-		down_scale_in_sse2(os, in);
+	for (; i<len; i++) {
+		out[i] = lut[in[i]];
 	}
-	return 0;
 }
 
-int oil_scale_out_sse2(struct oil_scale *os, unsigned char *out)
+/* Convert len bytes to floats in [0, 1], 16 at a time. The division keeps
+ * them equal to i2f_map.
+ */
+static void oil_convert_i2f_sse2(unsigned char *in, int len, float *out)
 {
-	int i, sl_len;
-	float *in[4];
+	int i;
+	__m128i px, lo, hi, zero;
+	__m128 f255;
 
-	if (oil_scale_slots(os) != 0) {
-		return -1;
+	zero = _mm_setzero_si128();
+	f255 = _mm_set1_ps(255.0f);
+	for (i=0; i+15<len; i+=16) {
+		px = _mm_loadu_si128((__m128i *)(in + i));
+		lo = _mm_unpacklo_epi8(px, zero);
+		hi = _mm_unpackhi_epi8(px, zero);
+		_mm_storeu_ps(out + i, _mm_div_ps(_mm_cvtepi32_ps(
+			_mm_unpacklo_epi16(lo, zero)), f255));
+		_mm_storeu_ps(out + i + 4, _mm_div_ps(_mm_cvtepi32_ps(
+			_mm_unpackhi_epi16(lo, zero)), f255));
+		_mm_storeu_ps(out + i + 8, _mm_div_ps(_mm_cvtepi32_ps(
+			_mm_unpacklo_epi16(hi, zero)), f255));
+		_mm_storeu_ps(out + i + 12, _mm_div_ps(_mm_cvtepi32_ps(
+			_mm_unpackhi_epi16(hi, zero)), f255));
+	}
+	for (; i<len; i++) {
+		out[i] = i2f_map[in[i]];
 	}
+}
 
-	if (os->out_height <= os->in_height) {
-		yscale_out_sse2(os->sums_y, os->out_width, out, os->cs, os->sums_y_tap);
-		os->sums_y_tap = (os->sums_y_tap + 1) & 3;
-	} else {
-		sl_len = OIL_CMP(os->cs) * os->out_width;
-		for (i=0; i<4; i++) {
-			in[i] = get_rb_line(os, (os->in_pos + i) % 4);
+/* Convert the pixels with alpha or a padding byte one at a time. */
+static inline __attribute__((always_inline))
+void xscale_convert_px_sse2(unsigned char *in, int width, float *out,
+	enum oil_colorspace cs, float *lut)
+{
+	int i, cmp;
+	__m128 smp;
+
+	cmp = OIL_CMP(cs);
+	for (i=0; i<width; i++) {
+		smp = oil_xsample_sse2(in, cs, lut);
+		if (cmp == 2) {
+			_mm_storel_pi((__m64 *)out, smp);
+		} else {
+			_mm_storeu_ps(out, smp);
 		}
-		yscale_up_sse2(in, sl_len, os->coeffs_y + os->out_pos * 4, out,
-			os->cs);
-		os->slots_y -= 1;
+		in += cmp;
+		out += cmp;
 	}
+}
 
-	os->out_pos++;
-	if (os->out_height <= os->in_height && os->out_pos < os->out_height) {
-		os->slots_y = os->borders_y[os->out_pos];
+static void xscale_convert_sse2(unsigned char *in, int width, float *out,
+	enum oil_colorspace cs)
+{
+	switch(cs) {
+	case OIL_CS_G:
+	case OIL_CS_CMYK:
+	case OIL_CS_RGB_NOGAMMA:
+		oil_convert_i2f_sse2(in, width * OIL_CMP(cs), out);
+		break;
+	case OIL_CS_RGB:
+		oil_convert_lut_sse2(in, width * 3, out, s2l_map);
+		break;
+	case OIL_CS_RGB_GAMMA2:
+		oil_convert_lut_sse2(in, width * 3, out, g2l_map);
+		break;
+	case OIL_CS_GA:
+		xscale_convert_px_sse2(in, width, out, OIL_CS_GA, NULL);
+		break;
+	case OIL_CS_RGBA:
+		xscale_convert_px_sse2(in, width, out, OIL_CS_RGBA, s2l_map);
+		break;
+	case OIL_CS_ARGB:
+		xscale_convert_px_sse2(in, width, out, OIL_CS_ARGB, s2l_map);
+		break;
+	case OIL_CS_RGBX:
+		xscale_convert_px_sse2(in, width, out, OIL_CS_RGBX, s2l_map);
+		break;
+	case OIL_CS_RGBA_NOGAMMA:
+		xscale_convert_px_sse2(in, width, out, OIL_CS_RGBA_NOGAMMA, i2f_map);
+		break;
+	case OIL_CS_RGBX_NOGAMMA:
+		xscale_convert_px_sse2(in, width, out, OIL_CS_RGBX_NOGAMMA, i2f_map);
+		break;
+	case OIL_CS_RGBA_GAMMA2:
+		xscale_convert_px_sse2(in, width, out, OIL_CS_RGBA_GAMMA2, g2l_map);
+		break;
+	case OIL_CS_RGBX_GAMMA2:
+		xscale_convert_px_sse2(in, width, out, OIL_CS_RGBX_GAMMA2, g2l_map);
+		break;
+	case OIL_CS_UNKNOWN:
+		break;
 	}
-	return 0;
 }
 
+/* Convert a line in the format xscale_up_sse2() writes to an output
+ * scanline with the yscale_up kernels, loading the line instead of a
+ * weighted sum. Their scalar tails use the coefficients, {1, 0, 0, 0}.
+ */
+static void yscale_line_sse2(float *line, int len, unsigned char *out,
+	enum oil_colorspace cs)
+{
+	float *in[4] = { line, line, line, line };
+	float coeffs[4] = { 1.0f, 0.0f, 0.0f, 0.0f };
 
+	switch(cs) {
+	case OIL_CS_G:
+	case OIL_CS_CMYK:
+	case OIL_CS_RGB_NOGAMMA:
+		yscale_up_g_cmyk_sse2_impl(in, len, coeffs, out, 0, 1);
+		break;
+	case OIL_CS_GA:
+		yscale_up_ga_sse2_impl(in, len, coeffs, out, 1);
+		break;
+	case OIL_CS_RGB:
+		yscale_up_gamma_sse2_impl(in, len, coeffs, out, 0, 1);
+		break;
+	case OIL_CS_RGBA:
+		yscale_up_alpha_sse2_impl(in, len, coeffs, out, 3, 0, 1);
+		break;
+	case OIL_CS_ARGB:
+		yscale_up_alpha_sse2_impl(in, len, coeffs, out, 0, 1, 1);
+		break;
+	case OIL_CS_RGBX:
+		yscale_up_gamma_sse2_impl(in, len, coeffs, out, 1, 1);
+		break;
+	case OIL_CS_RGBA_NOGAMMA:
+		yscale_up_nogamma_sse2_impl(in, len, coeffs, out, 0, 0, 1);
+		break;
+	case OIL_CS_RGBX_NOGAMMA:
+		yscale_up_nogamma_sse2_impl(in, len, coeffs, out, 1, 0, 1);
+		break;
+	case OIL_CS_RGB_GAMMA2:
+		yscale_up_g_cmyk_sse2_impl(in, len, coeffs, out, 1, 1);
+		break;
+	case OIL_CS_RGBA_GAMMA2:
+		yscale_up_nogamma_sse2_impl(in, len, coeffs, out, 0, 1, 1);
+		break;
+	case OIL_CS_RGBX_GAMMA2:
+		yscale_up_nogamma_sse2_impl(in, len, coeffs, out, 1, 1, 1);
+		break;
+	case OIL_CS_UNKNOWN:
+		break;
+	}
+}
+
+const struct oil_kernels oil_kernels_sse2 = {
+	"sse2",
+	scale_down_sse2,
+	yscale_out_sse2,
+	xscale_up_sse2,
+	yscale_up_sse2,
+	scale_down_fixed_sse2,
+	yscale_out_fixed_sse2,
+	NULL,
+	NULL,
+	NULL,
+	NULL,
+	NULL,
+	xscale_down_sse2,
+	yscale_line_sse2,
+	xscale_convert_sse2,
+};
+
+int oil_scale_in_sse2(struct oil_scale *os, unsigned char *in)
+{
+	return oil_scale_in_kernels(os, in, &oil_kernels_sse2);
+}
+
+int oil_scale_out_sse2(struct oil_scale *os, unsigned char *out)
+{
+	return oil_scale_out_kernels(os, out, &oil_kernels_sse2);
+}
@@ -0,0 +1,710 @@
+/**
+ * Copyright (c) 2014-2019 Timothy Elliott
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "oil_resample.h"
+#include "oil_resample_internal.h"
+#include <immintrin.h>
+#include <string.h>
+
+/* The SSSE3/SSE4.1 backend only carries the kernels that gain from those
+ * instruction sets: blendvps & blendps in the unpremultiply and clamp of the
+ * alpha colorspaces, packusdw where the output is packed, and pshufb to
+ * deinterleave pixels. Every other colorspace and kernel runs the SSE2
+ * backend's, through oil_kernels_sse2.
+ */
+
+/* 4-tap y-axis dot product: loads 4 floats from each of in[0..3] at offset
+ * `off` and returns c0*in[0] + c1*in[1] + c2*in[2] + c3*in[3].
+ */
+static inline __attribute__((always_inline))
+__m128 oil_ydot4_load_sse41(float **in, int off,
+	__m128 c0, __m128 c1, __m128 c2, __m128 c3)
+{
+	__m128 v0 = _mm_loadu_ps(in[0] + off);
+	__m128 v1 = _mm_loadu_ps(in[1] + off);
+	__m128 v2 = _mm_loadu_ps(in[2] + off);
+	__m128 v3 = _mm_loadu_ps(in[3] + off);
+	return _mm_add_ps(
+		_mm_add_ps(_mm_mul_ps(c0, v0), _mm_mul_ps(c1, v1)),
+		_mm_add_ps(_mm_mul_ps(c2, v2), _mm_mul_ps(c3, v3)));
+}
+
+/* The 4-tap sum of oil_ydot4_load_sse41(), or with `line` set, the 4 floats of
+ * in[0] as they are. yscale_line_sse41() converts single lines that way.
+ */
+static inline __attribute__((always_inline))
+__m128 oil_yload_sse41(float **in, int off, __m128 c0, __m128 c1, __m128 c2,
+	__m128 c3, int line)
+{
+	if (line) {
+		return _mm_loadu_ps(in[0] + off);
+	}
+	return oil_ydot4_load_sse41(in, off, c0, c1, c2, c3);
+}
+
+/* Clamp v to [0,1], take its square root when gamma2 is set to return a
+ * GAMMA2 sample to gamma 2.0, and scale it to a rounded byte value.
+ */
+static inline __attribute__((always_inline))
+__m128i oil_clamp_round_gamma_idx_sse41(__m128 v, __m128 zero, __m128 one,
+	__m128 scale, __m128 half, int gamma2)
+{
+	v = _mm_min_ps(_mm_max_ps(v, zero), one);
+	if (gamma2) {
+		v = _mm_sqrt_ps(v);
+	}
+	return _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(v, scale), half));
+}
+
+/* Divide vals by the clamped alpha in alpha_v, leaving lanes untouched where
+ * alpha is zero. Branchless: the reciprocal product is selected with blendv.
+ */
+static inline __attribute__((always_inline))
+__m128 oil_unpremul_sse41(__m128 vals, __m128 alpha_v, __m128 zero)
+{
+	__m128 nz = _mm_cmpneq_ps(alpha_v, zero);
+	return _mm_blendv_ps(vals, _mm_mul_ps(vals, _mm_rcp_ps(alpha_v)), nz);
+}
+
+/* Unpremultiply a premultiplied RGBA sum (alpha in lane 3), clamp RGB and
+ * alpha to [0,1], then scale to 0..255 (with rounding) for byte packing.
+ * Lane 3 of the result contains the clamped alpha byte, not the reciprocal.
+ * RGB is square-rooted after clamping when gamma2 is set.
+ */
+static inline __attribute__((always_inline))
+__m128i oil_unpremul_rgba_idx_sse41(__m128 vals,
+	__m128 zero, __m128 one, __m128 scale, __m128 half, int gamma2)
+{
+	__m128 alpha_v;
+	alpha_v = _mm_shuffle_ps(vals, vals, _MM_SHUFFLE(3, 3, 3, 3));
+	alpha_v = _mm_min_ps(_mm_max_ps(alpha_v, zero), one);
+	vals = oil_unpremul_sse41(vals, alpha_v, zero);
+	vals = _mm_min_ps(_mm_max_ps(vals, zero), one);
+	if (gamma2) {
+		vals = _mm_sqrt_ps(vals);
+	}
+	vals = _mm_blend_ps(vals, alpha_v, 0x8);
+	return _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(vals, scale), half));
+}
+
+/* Write 3 bytes to out[0..2] by indexing lut with the low three int32 lanes
+ * of idx. Used when the 4th lane is either discarded or handled separately.
+ */
+static inline __attribute__((always_inline))
+void oil_lut_store3_sse41(unsigned char *out, __m128i idx, unsigned char *lut)
+{
+	out[0] = lut[_mm_cvtsi128_si32(idx)];
+	out[1] = lut[_mm_cvtsi128_si32(_mm_srli_si128(idx, 4))];
+	out[2] = lut[_mm_cvtsi128_si32(_mm_srli_si128(idx, 8))];
+}
+
+/* Unpremultiply a premultiplied RGBA sum (alpha in lane 3) and emit one
+ * output pixel: alpha as a rounded byte, RGB via the linear-to-sRGB LUT.
+ * a_off/rgb_off select RGBA vs ARGB output layout.
+ */
+static inline __attribute__((always_inline))
+void oil_unpremul_rgba_lut_sse41(__m128 vals, __m128 zero, __m128 one,
+	__m128 scale, unsigned char *lut, unsigned char *out,
+	int a_off, int rgb_off)
+{
+	__m128 alpha_v;
+	__m128i idx;
+
+	alpha_v = _mm_shuffle_ps(vals, vals, _MM_SHUFFLE(3, 3, 3, 3));
+	alpha_v = _mm_min_ps(_mm_max_ps(alpha_v, zero), one);
+	vals = oil_unpremul_sse41(vals, alpha_v, zero);
+	vals = _mm_min_ps(_mm_max_ps(vals, zero), one);
+	idx = _mm_cvttps_epi32(_mm_mul_ps(vals, scale));
+
+	out[a_off] = (int)(_mm_cvtss_f32(alpha_v) * 255.0f + 0.5f);
+	oil_lut_store3_sse41(out + rgb_off, idx, lut);
+}
+
+/**
+ * Unpremultiply and clamp a GA vector [g0, a0, g1, a1].
+ * Spreads alpha to gray positions, divides gray by alpha (safe when alpha==0),
+ * clamps both to [0,1], and blends the result back to GA layout.
+ */
+static inline __m128 unpremul_clamp_ga_sse41(__m128 sum, __m128 zero, __m128 one)
+{
+	__m128 alpha_spread, safe_alpha, divided, gray_clamped;
+
+	alpha_spread = _mm_shuffle_ps(sum, sum, _MM_SHUFFLE(3, 3, 1, 1));
+	alpha_spread = _mm_min_ps(_mm_max_ps(alpha_spread, zero), one);
+	safe_alpha = _mm_blendv_ps(one, alpha_spread,
+		_mm_cmpneq_ps(alpha_spread, zero));
+	divided = _mm_div_ps(sum, safe_alpha);
+	gray_clamped = _mm_min_ps(_mm_max_ps(divided, zero), one);
+	return _mm_blend_ps(gray_clamped, alpha_spread, 0xA);
+}
+
+/* Alpha & _NOGAMMA output */
+
+static inline __attribute__((always_inline))
+void yscale_up_ga_sse41_impl(float **in, int len, float *coeffs,
+	unsigned char *out, int line)
+{
+	int i;
+	__m128 c0, c1, c2, c3;
+	__m128 sum, sum2;
+	__m128 scale, half, zero, one, result;
+	__m128i idx;
+
+	c0 = _mm_set1_ps(coeffs[0]);
+	c1 = _mm_set1_ps(coeffs[1]);
+	c2 = _mm_set1_ps(coeffs[2]);
+	c3 = _mm_set1_ps(coeffs[3]);
+	scale = _mm_set1_ps(255.0f);
+	half = _mm_set1_ps(0.5f);
+	zero = _mm_setzero_ps();
+	one = _mm_set1_ps(1.0f);
+
+	/* Process 4 GA pixels (8 floats) at a time */
+	for (i=0; i+7<len; i+=8) {
+		sum = oil_yload_sse41(in, i, c0, c1, c2, c3, line);
+		sum2 = oil_yload_sse41(in, i + 4, c0, c1, c2, c3, line);
+
+		/* sum = [g0, a0, g1, a1], sum2 = [g2, a2, g3, a3] */
+		result = unpremul_clamp_ga_sse41(sum, zero, one);
+		idx = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(result, scale), half));
+
+		result = unpremul_clamp_ga_sse41(sum2, zero, one);
+		__m128i idx2 = _mm_cvttps_epi32(
+			_mm_add_ps(_mm_mul_ps(result, scale), half));
+
+		/* Pack 8 ints -> 8 bytes */
+		idx = _mm_packus_epi32(idx, idx2);
+		idx = _mm_packus_epi16(idx, idx);
+		_mm_storel_epi64((__m128i *)(out + i), idx);
+	}
+
+	/* Process 2 GA pixels (4 floats) at a time */
+	for (; i+3<len; i+=4) {
+		sum = oil_yload_sse41(in, i, c0, c1, c2, c3, line);
+
+		result = unpremul_clamp_ga_sse41(sum, zero, one);
+		idx = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(result, scale), half));
+		idx = _mm_packus_epi32(idx, idx);
+		idx = _mm_packus_epi16(idx, idx);
+		*(int *)(out + i) = _mm_cvtsi128_si32(idx);
+	}
+
+	/* Scalar tail for remaining pixel */
+	for (; i<len; i+=2) {
+		float gray, alpha_f;
+		gray = coeffs[0] * in[0][i] + coeffs[1] * in[1][i] +
+			coeffs[2] * in[2][i] + coeffs[3] * in[3][i];
+		alpha_f = coeffs[0] * in[0][i+1] + coeffs[1] * in[1][i+1] +
+			coeffs[2] * in[2][i+1] + coeffs[3] * in[3][i+1];
+		if (alpha_f > 1.0f) alpha_f = 1.0f;
+		else if (alpha_f < 0.0f) alpha_f = 0.0f;
+		if (alpha_f != 0) gray /= alpha_f;
+		if (gray > 1.0f) gray = 1.0f;
+		else if (gray < 0.0f) gray = 0.0f;
+		out[i] = (int)(gray * 255.0f + 0.5f);
+		out[i+1] = (int)(alpha_f * 255.0f + 0.5f);
+	}
+}
+
+static inline __attribute__((always_inline)) void yscale_out_alpha_sse41_impl(
+	float *sums, int width, unsigned char *out, int tap,
+	int a_off, int rgb_off)
+{
+	int i, tap_off;
+	__m128 scale, one, zero;
+	__m128i z;
+	unsigned char *lut;
+
+	lut = l2s_map;
+	tap_off = tap * 4;
+	scale = _mm_set1_ps((float)(l2s_len - 1));
+	one = _mm_set1_ps(1.0f);
+	zero = _mm_setzero_ps();
+	z = _mm_setzero_si128();
+
+	for (i=0; i<width; i++) {
+		oil_unpremul_rgba_lut_sse41(_mm_load_ps(sums + tap_off),
+			zero, one, scale, lut, out, a_off, rgb_off);
+		_mm_store_si128((__m128i *)(sums + tap_off), z);
+		sums += 16;
+		out += 4;
+	}
+}
+
+static inline __attribute__((always_inline)) void yscale_up_alpha_sse41_impl(
+	float **in, int len, float *coeffs, unsigned char *out,
+	int a_off, int rgb_off, int line)
+{
+	int i;
+	__m128 c0, c1, c2, c3;
+	__m128 sum;
+	__m128 scale, one, zero;
+	unsigned char *lut;
+
+	c0 = _mm_set1_ps(coeffs[0]);
+	c1 = _mm_set1_ps(coeffs[1]);
+	c2 = _mm_set1_ps(coeffs[2]);
+	c3 = _mm_set1_ps(coeffs[3]);
+	lut = l2s_map;
+	scale = _mm_set1_ps((float)(l2s_len - 1));
+	one = _mm_set1_ps(1.0f);
+	zero = _mm_setzero_ps();
+
+	for (i=0; i<len; i+=4) {
+		sum = oil_yload_sse41(in, i, c0, c1, c2, c3, line);
+		oil_unpremul_rgba_lut_sse41(sum, zero, one, scale, lut,
+			out + i, a_off, rgb_off);
+	}
+}
+
+/* Per-pixel nogamma y-out conversion: either unpremultiply (RGBA) or clamp
+ * and force the X lane to 255 (RGBX). `is_rgbx` is a compile-time constant
+ * so the branch fully specializes at each call site.
+ */
+static inline __attribute__((always_inline))
+__m128i yscale_out_nogamma_idx_sse41(__m128 vals, __m128 zero, __m128 one,
+	__m128 scale, __m128 half, __m128i rgbx_x_val,
+	int is_rgbx, int gamma2)
+{
+	__m128i idx;
+	if (is_rgbx) {
+		idx = oil_clamp_round_gamma_idx_sse41(vals, zero, one, scale, half,
+			gamma2);
+		return _mm_blend_epi16(idx, rgbx_x_val, 0xC0);
+	}
+	return oil_unpremul_rgba_idx_sse41(vals, zero, one, scale, half, gamma2);
+}
+
+static inline __attribute__((always_inline))
+void yscale_out_nogamma_sse41_impl(float *sums, int width, unsigned char *out,
+	int tap, int is_rgbx, int gamma2)
+{
+	int i, tap_off;
+	__m128 scale, half, one, zero;
+	__m128i idx, idx2, packed, z, x_val;
+
+	tap_off = tap * 4;
+	scale = _mm_set1_ps(255.0f);
+	half = _mm_set1_ps(0.5f);
+	one = _mm_set1_ps(1.0f);
+	zero = _mm_setzero_ps();
+	z = _mm_setzero_si128();
+	x_val = _mm_set_epi32(255, 0, 0, 0);
+
+	for (i=0; i+1<width; i+=2) {
+		idx = yscale_out_nogamma_idx_sse41(_mm_load_ps(sums + tap_off),
+			zero, one, scale, half, x_val, is_rgbx, gamma2);
+		_mm_store_si128((__m128i *)(sums + tap_off), z);
+
+		idx2 = yscale_out_nogamma_idx_sse41(_mm_load_ps(sums + 16 + tap_off),
+			zero, one, scale, half, x_val, is_rgbx, gamma2);
+		_mm_store_si128((__m128i *)(sums + 16 + tap_off), z);
+
+		packed = _mm_packus_epi32(idx, idx2);
+		packed = _mm_packus_epi16(packed, packed);
+		_mm_storel_epi64((__m128i *)out, packed);
+
+		sums += 32;
+		out += 8;
+	}
+
+	for (; i<width; i++) {
+		idx = yscale_out_nogamma_idx_sse41(_mm_load_ps(sums + tap_off),
+			zero, one, scale, half, x_val, is_rgbx, gamma2);
+		packed = _mm_packus_epi32(idx, idx);
+		packed = _mm_packus_epi16(packed, packed);
+		*(int *)out = _mm_cvtsi128_si32(packed);
+
+		_mm_store_si128((__m128i *)(sums + tap_off), z);
+
+		sums += 16;
+		out += 4;
+	}
+}
+
+static inline __attribute__((always_inline)) void yscale_up_nogamma_sse41_impl(
+	float **in, int len, float *coeffs, unsigned char *out, int is_rgbx,
+	int gamma2, int line)
+{
+	int i;
+	__m128 c0, c1, c2, c3;
+	__m128 sum_a, sum_b;
+	__m128 scale, half, one, zero;
+	__m128i idx_a, idx_b, packed, x_val;
+
+	c0 = _mm_set1_ps(coeffs[0]);
+	c1 = _mm_set1_ps(coeffs[1]);
+	c2 = _mm_set1_ps(coeffs[2]);
+	c3 = _mm_set1_ps(coeffs[3]);
+	scale = _mm_set1_ps(255.0f);
+	half = _mm_set1_ps(0.5f);
+	one = _mm_set1_ps(1.0f);
+	zero = _mm_setzero_ps();
+	x_val = _mm_set_epi32(255, 0, 0, 0);
+
+	for (i=0; i+7<len; i+=8) {
+		sum_a = oil_yload_sse41(in, i, c0, c1, c2, c3, line);
+		sum_b = oil_yload_sse41(in, i + 4, c0, c1, c2, c3, line);
+
+		idx_a = yscale_out_nogamma_idx_sse41(sum_a, zero, one, scale, half,
+			x_val, is_rgbx, gamma2);
+		idx_b = yscale_out_nogamma_idx_sse41(sum_b, zero, one, scale, half,
+			x_val, is_rgbx, gamma2);
+
+		packed = _mm_packus_epi32(idx_a, idx_b);
+		packed = _mm_packus_epi16(packed, packed);
+		_mm_storel_epi64((__m128i *)(out + i), packed);
+	}
+
+	for (; i<len; i+=4) {
+		sum_a = oil_yload_sse41(in, i, c0, c1, c2, c3, line);
+
+		idx_a = yscale_out_nogamma_idx_sse41(sum_a, zero, one, scale, half,
+			x_val, is_rgbx, gamma2);
+		packed = _mm_packus_epi32(idx_a, idx_a);
+		packed = _mm_packus_epi16(packed, packed);
+		*(int *)(out + i) = _mm_cvtsi128_si32(packed);
+	}
+}
+
+/* Fixed point */
+
+/* Round lane 0 of a fixed-point x-sum to a sample (see OIL_FIXED_SHIFT()),
+ * accumulate the sample into the 4 sums at sums weighed by coeffs_y, and
+ * shift the x-sum left by one lane. coeffs_y holds one y-coefficient in the
+ * low int16 of each 32-bit lane. */
+static inline __attribute__((always_inline))
+__m128i fixed_out_sse41(__m128i sum, int *sums, __m128i coeffs_y, int shift)
+{
+	__m128i smp;
+
+	smp = _mm_add_epi32(sum, _mm_set1_epi32(1 << (shift - 1)));
+	smp = _mm_shuffle_epi32(_mm_srai_epi32(smp, shift), 0x00);
+	_mm_storeu_si128((__m128i *)sums, _mm_add_epi32(
+		_mm_loadu_si128((__m128i *)sums), _mm_madd_epi16(smp, coeffs_y)));
+	return _mm_srli_si128(sum, 4);
+}
+
+/* Load 1 or 2 pixels of cmp bytes each, zeroing the rest of the vector. */
+static inline __attribute__((always_inline))
+__m128i fixed_load_sse41(unsigned char *in, int npix, int cmp)
+{
+	int px4;
+	short px2;
+
+	if (npix == 1 && cmp == 3) {
+		memcpy(&px2, in, 2);
+		return _mm_insert_epi8(_mm_cvtsi32_si128((unsigned short)px2),
+			in[2], 2);
+	} else if (npix == 1 || cmp == 3) {
+		memcpy(&px4, in, 4);
+		if (cmp == 3) {
+			memcpy(&px2, in + 4, 2);
+			return _mm_insert_epi16(_mm_cvtsi32_si128(px4), px2, 2);
+		}
+		return _mm_cvtsi32_si128(px4);
+	}
+	return _mm_loadl_epi64((__m128i *)in);
+}
+
+/* RGB_NOGAMMA when cmp is 3, RGBX_NOGAMMA when cmp is 4 */
+static inline __attribute__((always_inline))
+void scale_down_fixed_rgb_sse41_impl(unsigned char *in, int out_width,
+	int *sums, short *coeffs_x, int *border_buf, __m128i coeffs_y, int cmp)
+{
+	int i, j, n;
+	__m128i sum_r, sum_g, sum_b, coeffs, px, shuf_r, shuf_g, shuf_b;
+
+	/* pshufb the pair of each channel into every 32-bit lane as int16s,
+	 * to be weighed by a pair of taps with _mm_madd_epi16() */
+	shuf_r = _mm_set1_epi32((int)(0x80008000u | cmp << 16));
+	shuf_g = _mm_add_epi32(shuf_r, _mm_set1_epi32(1 << 16 | 1));
+	shuf_b = _mm_add_epi32(shuf_g, _mm_set1_epi32(1 << 16 | 1));
+	sum_r = sum_g = sum_b = _mm_setzero_si128();
+	for (i=0; i<out_width; i++) {
+		n = border_buf[i];
+		for (j=0; j<n; j+=2) {
+			coeffs = _mm_loadu_si128((__m128i *)coeffs_x);
+			if (j + 1 < n) {
+				px = fixed_load_sse41(in, 2, cmp);
+				in += 2 * cmp;
+			} else {
+				px = fixed_load_sse41(in, 1, cmp);
+				in += cmp;
+			}
+			sum_r = _mm_add_epi32(sum_r, _mm_madd_epi16(
+				_mm_shuffle_epi8(px, shuf_r), coeffs));
+			sum_g = _mm_add_epi32(sum_g, _mm_madd_epi16(
+				_mm_shuffle_epi8(px, shuf_g), coeffs));
+			sum_b = _mm_add_epi32(sum_b, _mm_madd_epi16(
+				_mm_shuffle_epi8(px, shuf_b), coeffs));
+			coeffs_x += 8;
+		}
+		sum_r = fixed_out_sse41(sum_r, sums, coeffs_y, 8);
+		sum_g = fixed_out_sse41(sum_g, sums + 4, coeffs_y, 8);
+		sum_b = fixed_out_sse41(sum_b, sums + 8, coeffs_y, 8);
+		sums += cmp * 4;
+	}
+}
+
+/* Conversion */
+
+/* A pshufb mask that widens the bytes at a, b, c & d to int32s. */
+static inline __attribute__((always_inline))
+__m128i oil_widen_mask_sse41(int a, int b, int c, int d)
+{
+	return _mm_setr_epi8(a, -1, -1, -1, b, -1, -1, -1, c, -1, -1, -1,
+		d, -1, -1, -1);
+}
+
+/* Pixel k of the 4 at px as xscale_convert() stores it: floats in [0, 1],
+ * squared to linear when gamma2 is set, then premultiplied with alpha in lane
+ * 3, or with 1 in lane 3 when is_rgbx is set. The division keeps the samples
+ * equal to i2f_map, and squaring them equal to g2l_map.
+ */
+static inline __attribute__((always_inline))
+__m128 oil_convert_px_sse41(__m128i px, int k, __m128 f255, __m128 one,
+	int is_rgbx, int gamma2)
+{
+	__m128 smp;
+
+	smp = _mm_div_ps(_mm_cvtepi32_ps(_mm_shuffle_epi8(px,
+		oil_widen_mask_sse41(4 * k, 4 * k + 1, 4 * k + 2, 4 * k + 3))),
+		f255);
+	if (gamma2) {
+		smp = _mm_blend_ps(_mm_mul_ps(smp, smp), smp, 0x8);
+	}
+	if (is_rgbx) {
+		return _mm_blend_ps(smp, one, 0x8);
+	}
+	return _mm_blend_ps(_mm_mul_ps(smp, _mm_shuffle_ps(smp, smp,
+		_MM_SHUFFLE(3, 3, 3, 3))), smp, 0x8);
+}
+
+/* RGBA & RGBX in the _NOGAMMA and _GAMMA2 colorspaces, 4 pixels per load. */
+static inline __attribute__((always_inline))
+void xscale_convert_px4_sse41(unsigned char *in, int width, float *out,
+	int is_rgbx, int gamma2)
+{
+	int i, k, px4;
+	__m128i px;
+	__m128 f255, one;
+
+	f255 = _mm_set1_ps(255.0f);
+	one = _mm_set1_ps(1.0f);
+	for (i=0; i+3<width; i+=4) {
+		px = _mm_loadu_si128((__m128i *)(in + i * 4));
+		for (k=0; k<4; k++) {
+			_mm_storeu_ps(out + (i + k) * 4, oil_convert_px_sse41(px,
+				k, f255, one, is_rgbx, gamma2));
+		}
+	}
+	for (; i<width; i++) {
+		memcpy(&px4, in + i * 4, 4);
+		_mm_storeu_ps(out + i * 4, oil_convert_px_sse41(
+			_mm_cvtsi32_si128(px4), 0, f255, one, is_rgbx, gamma2));
+	}
+}
+
+/* SSE4.1 dispatch functions, handing the rest to SSE2 */
+
+static void scale_down_sse41(struct oil_scale *os, unsigned char *in,
+	float *coeffs_y)
+{
+	oil_kernels_sse2.scale_down(os, in, coeffs_y);
+}
+
+static void yscale_out_sse41(float *sums, int width, unsigned char *out,
+	enum oil_colorspace cs, int tap)
+{
+	switch(cs) {
+	case OIL_CS_RGBA:
+		yscale_out_alpha_sse41_impl(sums, width, out, tap, 3, 0);
+		break;
+	case OIL_CS_ARGB:
+		yscale_out_alpha_sse41_impl(sums, width, out, tap, 0, 1);
+		break;
+	case OIL_CS_RGBA_NOGAMMA:
+		yscale_out_nogamma_sse41_impl(sums, width, out, tap, 0, 0);
+		break;
+	case OIL_CS_RGBX_NOGAMMA:
+		yscale_out_nogamma_sse41_impl(sums, width, out, tap, 1, 0);
+		break;
+	case OIL_CS_RGBA_GAMMA2:
+		yscale_out_nogamma_sse41_impl(sums, width, out, tap, 0, 1);
+		break;
+	case OIL_CS_RGBX_GAMMA2:
+		yscale_out_nogamma_sse41_impl(sums, width, out, tap, 1, 1);
+		break;
+	default:
+		oil_kernels_sse2.yscale_out(sums, width, out, cs, tap);
+		break;
+	}
+}
+
+static void xscale_up_sse41(unsigned char *in, int width_in, float *out,
+	enum oil_colorspace cs_in, float *coeff_buf, int *border_buf)
+{
+	oil_kernels_sse2.xscale_up(in, width_in, out, cs_in, coeff_buf,
+		border_buf);
+}
+
+/* The yscale_up kernels, or with line set, the yscale_line ones. */
+static inline __attribute__((always_inline))
+int yscale_up_sse41_impl(float **in, int len, float *coeffs,
+	unsigned char *out, enum oil_colorspace cs, int line)
+{
+	switch(cs) {
+	case OIL_CS_GA:
+		yscale_up_ga_sse41_impl(in, len, coeffs, out, line);
+		return 1;
+	case OIL_CS_RGBA:
+		yscale_up_alpha_sse41_impl(in, len, coeffs, out, 3, 0, line);
+		return 1;
+	case OIL_CS_ARGB:
+		yscale_up_alpha_sse41_impl(in, len, coeffs, out, 0, 1, line);
+		return 1;
+	case OIL_CS_RGBA_NOGAMMA:
+		yscale_up_nogamma_sse41_impl(in, len, coeffs, out, 0, 0, line);
+		return 1;
+	case OIL_CS_RGBX_NOGAMMA:
+		yscale_up_nogamma_sse41_impl(in, len, coeffs, out, 1, 0, line);
+		return 1;
+	case OIL_CS_RGBA_GAMMA2:
+		yscale_up_nogamma_sse41_impl(in, len, coeffs, out, 0, 1, line);
+		return 1;
+	case OIL_CS_RGBX_GAMMA2:
+		yscale_up_nogamma_sse41_impl(in, len, coeffs, out, 1, 1, line);
+		return 1;
+	default:
+		return 0;
+	}
+}
+
+static void yscale_up_sse41(float **in, int len, float *coeffs,
+	unsigned char *out, enum oil_colorspace cs)
+{
+	if (!yscale_up_sse41_impl(in, len, coeffs, out, cs, 0)) {
+		oil_kernels_sse2.yscale_up(in, len, coeffs, out, cs);
+	}
+}
+
+static void scale_down_fixed_sse41(unsigned char *in, int out_width,
+	int *sums, enum oil_colorspace cs, short *coeffs_x, int *border_buf,
+	short *coeffs_y)
+{
+	__m128i cy;
+
+	cy = _mm_unpacklo_epi16(_mm_loadl_epi64((__m128i *)coeffs_y),
+		_mm_setzero_si128());
+	switch(cs) {
+	case OIL_CS_RGB_NOGAMMA:
+		scale_down_fixed_rgb_sse41_impl(in, out_width, sums, coeffs_x,
+			border_buf, cy, 3);
+		break;
+	case OIL_CS_RGBX_NOGAMMA:
+		scale_down_fixed_rgb_sse41_impl(in, out_width, sums, coeffs_x,
+			border_buf, cy, 4);
+		break;
+	default:
+		oil_kernels_sse2.scale_down_fixed(in, out_width, sums, cs,
+			coeffs_x, border_buf, coeffs_y);
+		break;
+	}
+}
+
+static void yscale_out_fixed_sse41(int *sums, int width, unsigned char *out,
+	enum oil_colorspace cs, int tap)
+{
+	oil_kernels_sse2.yscale_out_fixed(sums, width, out, cs, tap);
+}
+
+static void xscale_down_sse41(unsigned char *in, int heavy, int out_width,
+	float *out, enum oil_colorspace cs, float *coeffs_x, int *border_buf)
+{
+	oil_kernels_sse2.xscale_down(in, heavy, out_width, out, cs, coeffs_x,
+		border_buf);
+}
+
+/* Convert a line in the format xscale_up_sse41() writes to an output
+ * scanline with the yscale_up kernels, loading the line instead of a
+ * weighted sum. Their scalar tails use the coefficients, {1, 0, 0, 0}.
+ */
+static void yscale_line_sse41(float *line, int len, unsigned char *out,
+	enum oil_colorspace cs)
+{
+	float *in[4] = { line, line, line, line };
+	float coeffs[4] = { 1.0f, 0.0f, 0.0f, 0.0f };
+
+	if (!yscale_up_sse41_impl(in, len, coeffs, out, cs, 1)) {
+		oil_kernels_sse2.yscale_line(line, len, out, cs);
+	}
+}
+
+static void xscale_convert_sse41(unsigned char *in, int width, float *out,
+	enum oil_colorspace cs)
+{
+	switch(cs) {
+	case OIL_CS_RGBA_NOGAMMA:
+		xscale_convert_px4_sse41(in, width, out, 0, 0);
+		break;
+	case OIL_CS_RGBX_NOGAMMA:
+		xscale_convert_px4_sse41(in, width, out, 1, 0);
+		break;
+	case OIL_CS_RGBA_GAMMA2:
+		xscale_convert_px4_sse41(in, width, out, 0, 1);
+		break;
+	case OIL_CS_RGBX_GAMMA2:
+		xscale_convert_px4_sse41(in, width, out, 1, 1);
+		break;
+	default:
+		oil_kernels_sse2.xscale_convert(in, width, out, cs);
+		break;
+	}
+}
+
+const struct oil_kernels oil_kernels_sse41 = {
+	"sse41",
+	scale_down_sse41,
+	yscale_out_sse41,
+	xscale_up_sse41,
+	yscale_up_sse41,
+	scale_down_fixed_sse41,
+	yscale_out_fixed_sse41,
+	NULL,
+	NULL,
+	NULL,
+	NULL,
+	NULL,
+	xscale_down_sse41,
+	yscale_line_sse41,
+	xscale_convert_sse41,
+};
+
+int oil_scale_in_sse41(struct oil_scale *os, unsigned char *in)
+{
+	return oil_scale_in_kernels(os, in, &oil_kernels_sse41);
+}
+
+int oil_scale_out_sse41(struct oil_scale *os, unsigned char *out)
+{
+	return oil_scale_out_kernels(os, out, &oil_kernels_sse41);
+}
@@ -0,0 +1,1247 @@
+/**
+ * Copyright (c) 2014-2019 Timothy Elliott
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * Portable backend written with GCC/Clang vector extensions. It compiles to
+ * whatever 128-bit vector ISA the target provides (SSE2, AltiVec/VSX, NEON,
+ * RVV) and falls back to scalar code where there is none. It mirrors
+ * oil_resample_sse2.c and keeps the same sums_y layouts.
+ */
+
+#include "oil_resample.h"
+#include "oil_resample_internal.h"
+#include <math.h>
+#include <string.h>
+
+typedef float v4f __attribute__((vector_size(16)));
+typedef int v4i __attribute__((vector_size(16)));
+typedef unsigned char v4u8 __attribute__((vector_size(4)));
+
+/* Two-input lane shuffle; indices 4..7 select lanes of b. */
+#if defined(__clang__) || __GNUC__ >= 12
+#define OIL_SHUFFLE_VEC(a, b, i0, i1, i2, i3) \
+	__builtin_shufflevector(a, b, i0, i1, i2, i3)
+#else
+#define OIL_SHUFFLE_VEC(a, b, i0, i1, i2, i3) \
+	__builtin_shuffle(a, b, (v4i){ i0, i1, i2, i3 })
+#endif
+
+/* Unaligned load/store. Compiles to a single vector move where possible. */
+static inline __attribute__((always_inline))
+v4f oil_load_vec(float *p)
+{
+	v4f v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static inline __attribute__((always_inline))
+void oil_store_vec(float *p, v4f v)
+{
+	memcpy(p, &v, sizeof(v));
+}
+
+static inline __attribute__((always_inline))
+v4f oil_splat_vec(float f)
+{
+	v4f v = { f, f, f, f };
+	return v;
+}
+
+/* Per-lane select: lanes of a where mask is set, lanes of b elsewhere. */
+static inline __attribute__((always_inline))
+v4f oil_select_vec(v4i mask, v4f a, v4f b)
+{
+	return (v4f)((mask & (v4i)a) | (~mask & (v4i)b));
+}
+
+/* Clamp every lane to [0,1]. */
+static inline __attribute__((always_inline))
+v4f oil_clamp_vec(v4f v)
+{
+	v4f zero = { 0.0f, 0.0f, 0.0f, 0.0f };
+	v4f one = { 1.0f, 1.0f, 1.0f, 1.0f };
+	v = oil_select_vec(v > one, one, v);
+	return oil_select_vec(v < zero, zero, v);
+}
+
+/* Shift v left by one float lane, zero-filling the top lane. */
+static inline __attribute__((always_inline))
+v4f oil_shift_f_left_vec(v4f v)
+{
+	v4f zero = { 0.0f, 0.0f, 0.0f, 0.0f };
+	return OIL_SHUFFLE_VEC(v, zero, 1, 2, 3, 4);
+}
+
+/* Shift v left by one float lane and insert f in the top lane. */
+static inline __attribute__((always_inline))
+v4f oil_push_f_vec(v4f v, float f)
+{
+	return OIL_SHUFFLE_VEC(v, oil_splat_vec(f), 1, 2, 3, 4);
+}
+
+/* Horizontal dot product dot(smp, coeffs) as a scalar float. */
+static inline __attribute__((always_inline))
+float oil_dot1_f_vec(v4f smp, v4f coeffs)
+{
+	v4f prod = smp * coeffs;
+	return (prod[0] + prod[2]) + (prod[1] + prod[3]);
+}
+
+/* Clamp v to [0,1], multiply by `scale`, round to nearest, and truncate to
+ * int32. Produces the byte-range index used by sRGB byte packing and LUTs.
+ */
+static inline __attribute__((always_inline))
+v4i oil_clamp_round_idx_vec(v4f v, float scale)
+{
+	return __builtin_convertvector(oil_clamp_vec(v) * scale + 0.5f, v4i);
+}
+
+/* oil_clamp_round_idx_vec() to 0..255, taking the square root of the clamped
+ * value first when gamma2 is set to return a GAMMA2 sample to gamma 2.0.
+ */
+static inline __attribute__((always_inline))
+v4i oil_clamp_round_gamma_idx_vec(v4f v, int gamma2)
+{
+	v = oil_clamp_vec(v);
+	if (gamma2) {
+		v4f r = { sqrtf(v[0]), sqrtf(v[1]), sqrtf(v[2]), sqrtf(v[3]) };
+		v = r;
+	}
+	return __builtin_convertvector(v * 255.0f + 0.5f, v4i);
+}
+
+/* Clamp v to [0,1] and scale it to an index into the linear-to-sRGB LUT. */
+static inline __attribute__((always_inline))
+v4i oil_lut_idx_vec(v4f v)
+{
+	return __builtin_convertvector(oil_clamp_vec(v) * (float)(l2s_len - 1),
+		v4i);
+}
+
+/* Write the four int32 lanes of idx (already in 0..255) as bytes. */
+static inline __attribute__((always_inline))
+void oil_store_bytes4_vec(unsigned char *out, v4i idx)
+{
+	v4u8 b = __builtin_convertvector(idx, v4u8);
+	memcpy(out, &b, sizeof(b));
+}
+
+/* Write 3 bytes to out[0..2] by indexing lut with the low three lanes of idx. */
+static inline __attribute__((always_inline))
+void oil_lut_store3_vec(unsigned char *out, v4i idx, unsigned char *lut)
+{
+	out[0] = lut[idx[0]];
+	out[1] = lut[idx[1]];
+	out[2] = lut[idx[2]];
+}
+
+/* Consume one output pixel across 4 stride-4 channel ring-buffer slots:
+ * gather lane 0 of sums[0..3], sums[4..7], sums[8..11] and sums[12..15],
+ * then shift each slot left (discarding the consumed tap).
+ */
+static inline __attribute__((always_inline))
+v4f oil_consume_ch0_x4_vec(float *sums)
+{
+	v4f f0, f1, f2, f3;
+
+	f0 = oil_load_vec(sums);
+	f1 = oil_load_vec(sums + 4);
+	f2 = oil_load_vec(sums + 8);
+	f3 = oil_load_vec(sums + 12);
+
+	oil_store_vec(sums,      oil_shift_f_left_vec(f0));
+	oil_store_vec(sums + 4,  oil_shift_f_left_vec(f1));
+	oil_store_vec(sums + 8,  oil_shift_f_left_vec(f2));
+	oil_store_vec(sums + 12, oil_shift_f_left_vec(f3));
+
+	return OIL_SHUFFLE_VEC(OIL_SHUFFLE_VEC(f0, f1, 0, 4, 0, 4),
+		OIL_SHUFFLE_VEC(f2, f3, 0, 4, 0, 4), 0, 1, 4, 5);
+}
+
+/* Multiply-accumulate `px` into the four ring-buffer tap slots of a
+ * 4-channel sums_y pixel, starting at slot `tap`.
+ */
+static inline __attribute__((always_inline))
+void oil_vaccum_tap4_vec(float *sums_y_out, v4f px, float *coeffs_y, int tap)
+{
+	int k, off;
+
+	for (k=0; k<4; k++) {
+		off = ((tap + k) & 3) * 4;
+		oil_store_vec(sums_y_out + off,
+			oil_load_vec(sums_y_out + off) + px * coeffs_y[k]);
+	}
+}
+
+/* Multiply-accumulate the first lane of sum into one shift-left sums_y slot. */
+static inline __attribute__((always_inline))
+void oil_vaccum_slot_vec(float *sums_y_out, v4f sum, v4f coeffs_y)
+{
+	oil_store_vec(sums_y_out, oil_load_vec(sums_y_out) + coeffs_y * sum[0]);
+}
+
+/* Broadcast the 4 y-coefficients once per scanline. Keeping them in locals
+ * lets the compiler hold them in registers across the byte stores.
+ */
+static inline __attribute__((always_inline))
+void oil_splat_coeffs_vec(float *coeffs, v4f *c)
+{
+	int k;
+
+	for (k=0; k<4; k++) {
+		c[k] = oil_splat_vec(coeffs[k]);
+	}
+}
+
+/* 4-tap y-axis dot product: loads 4 floats from each of in[0..3] at offset
+ * `off` and returns c[0]*in[0] + c[1]*in[1] + c[2]*in[2] + c[3]*in[3].
+ */
+static inline __attribute__((always_inline))
+v4f oil_ydot4_load_vec(float **in, int off, v4f *c)
+{
+	return (c[0] * oil_load_vec(in[0] + off) +
+		c[1] * oil_load_vec(in[1] + off)) +
+		(c[2] * oil_load_vec(in[2] + off) +
+		c[3] * oil_load_vec(in[3] + off));
+}
+
+/* Scalar 4-tap y-axis dot product for the tails of the vector loops. */
+static inline __attribute__((always_inline))
+float oil_ydot4_f_vec(float **in, int i, float *c)
+{
+	return c[0] * in[0][i] + c[1] * in[1][i] + c[2] * in[2][i] +
+		c[3] * in[3][i];
+}
+
+static inline __attribute__((always_inline))
+float oil_clampf_vec(float f)
+{
+	if (f > 1.0f) {
+		return 1.0f;
+	} else if (f < 0.0f) {
+		return 0.0f;
+	}
+	return f;
+}
+
+/* Unpremultiply a premultiplied RGBA sum (alpha in lane 3) and emit one
+ * output pixel: alpha as a rounded byte, RGB via the linear-to-sRGB LUT, or
+ * rounded to bytes directly when lut is NULL. a_off/rgb_off select RGBA vs
+ * ARGB output layout.
+ */
+static inline __attribute__((always_inline))
+void oil_unpremul_rgba_vec(v4f vals, unsigned char *lut, unsigned char *out,
+	int a_off, int rgb_off, int gamma2)
+{
+	float alpha;
+	v4i idx;
+
+	alpha = oil_clampf_vec(vals[3]);
+	if (alpha != 0) {
+		vals = vals / alpha;
+	}
+
+	if (lut) {
+		idx = oil_lut_idx_vec(vals);
+		oil_lut_store3_vec(out + rgb_off, idx, lut);
+	} else {
+		idx = oil_clamp_round_gamma_idx_vec(vals, gamma2);
+		out[rgb_off] = idx[0];
+		out[rgb_off + 1] = idx[1];
+		out[rgb_off + 2] = idx[2];
+	}
+	out[a_off] = (int)(alpha * 255.0f + 0.5f);
+}
+
+/* Dot product of four 4-channel pixel vectors with per-tap coefficients
+ * c[0..3]. Used by the pixel-major x-upscale windows.
+ */
+static inline __attribute__((always_inline))
+v4f oil_px_dot4_vec(v4f smp0, v4f smp1, v4f smp2, v4f smp3, float *c)
+{
+	return (smp0 * c[0] + smp1 * c[1]) + (smp2 * c[2] + smp3 * c[3]);
+}
+
+/* Emit j x-upscaled 4-channel pixels from the pixel-major tap window
+ * smp0..smp3, advancing out and coeff_buf.
+ */
+static inline __attribute__((always_inline))
+void oil_xscale_up_px4_vec(v4f smp0, v4f smp1, v4f smp2, v4f smp3, int j,
+	float **out, float **coeff_buf)
+{
+	float *o = *out, *c = *coeff_buf;
+
+	for (; j>0; j--) {
+		oil_store_vec(o, oil_px_dot4_vec(smp0, smp1, smp2, smp3, c));
+		o += 4;
+		c += 4;
+	}
+	*out = o;
+	*coeff_buf = c;
+}
+
+static inline __attribute__((always_inline))
+void yscale_out_nonlinear_vec_impl(float *sums, int len, unsigned char *out,
+	int gamma2)
+{
+	int i;
+	float v;
+
+	for (i=0; i+3<len; i+=4) {
+		oil_store_bytes4_vec(out + i, oil_clamp_round_gamma_idx_vec(
+			oil_consume_ch0_x4_vec(sums), gamma2));
+		sums += 16;
+	}
+
+	for (; i<len; i++) {
+		v = oil_clampf_vec(*sums);
+		if (gamma2) v = sqrtf(v);
+		out[i] = (int)(v * 255.0f + 0.5f);
+		oil_store_vec(sums, oil_shift_f_left_vec(oil_load_vec(sums)));
+		sums += 4;
+	}
+}
+
+static void oil_yscale_out_nonlinear_vec(float *sums, int len, unsigned char *out)
+{
+	yscale_out_nonlinear_vec_impl(sums, len, out, 0);
+}
+
+static void oil_yscale_out_gamma2_vec(float *sums, int len, unsigned char *out)
+{
+	yscale_out_nonlinear_vec_impl(sums, len, out, 1);
+}
+
+static void oil_yscale_out_linear_vec(float *sums, int len, unsigned char *out)
+{
+	int i;
+	v4i idx;
+	unsigned char *lut;
+
+	lut = l2s_map;
+
+	for (i=0; i+3<len; i+=4) {
+		idx = oil_lut_idx_vec(oil_consume_ch0_x4_vec(sums));
+		oil_lut_store3_vec(out + i, idx, lut);
+		out[i + 3] = lut[idx[3]];
+		sums += 16;
+	}
+
+	for (; i<len; i++) {
+		out[i] = lut[(int)(oil_clampf_vec(*sums) * (l2s_len - 1))];
+		oil_store_vec(sums, oil_shift_f_left_vec(oil_load_vec(sums)));
+		sums += 4;
+	}
+}
+
+static void oil_yscale_out_ga_vec(float *sums, int width, unsigned char *out)
+{
+	int i;
+	v4f v0, v1;
+	float gray, alpha;
+
+	for (i=0; i<width; i++) {
+		v0 = oil_load_vec(sums);
+		v1 = oil_load_vec(sums + 4);
+
+		alpha = oil_clampf_vec(v1[0]);
+		gray = v0[0];
+		if (alpha != 0) {
+			gray /= alpha;
+		}
+		gray = oil_clampf_vec(gray);
+
+		out[0] = (int)(gray * 255.0f + 0.5f);
+		out[1] = (int)(alpha * 255.0f + 0.5f);
+
+		oil_store_vec(sums,     oil_shift_f_left_vec(v0));
+		oil_store_vec(sums + 4, oil_shift_f_left_vec(v1));
+
+		sums += 8;
+		out += 2;
+	}
+}
+
+static void oil_yscale_out_cmyk_vec(float *sums, int width, unsigned char *out,
+	int tap)
+{
+	int i, tap_off;
+	v4f zero = { 0.0f, 0.0f, 0.0f, 0.0f };
+
+	tap_off = tap * 4;
+
+	for (i=0; i<width; i++) {
+		oil_store_bytes4_vec(out, oil_clamp_round_idx_vec(
+			oil_load_vec(sums + tap_off), 255.0f));
+		oil_store_vec(sums + tap_off, zero);
+		sums += 16;
+		out += 4;
+	}
+}
+
+/* `lut` is the linear-to-sRGB table, or NULL for the nogamma and gamma 2.0
+ * colorspaces.
+ */
+static inline __attribute__((always_inline)) void yscale_out_alpha_vec_impl(
+	float *sums, int width, unsigned char *out, int tap,
+	unsigned char *lut, int a_off, int rgb_off, int gamma2)
+{
+	int i, tap_off;
+	v4f zero = { 0.0f, 0.0f, 0.0f, 0.0f };
+
+	tap_off = tap * 4;
+
+	for (i=0; i<width; i++) {
+		oil_unpremul_rgba_vec(oil_load_vec(sums + tap_off), lut, out,
+			a_off, rgb_off, gamma2);
+		oil_store_vec(sums + tap_off, zero);
+		sums += 16;
+		out += 4;
+	}
+}
+
+static void oil_yscale_out_rgba_vec(float *sums, int width, unsigned char *out,
+	int tap)
+{
+	yscale_out_alpha_vec_impl(sums, width, out, tap, l2s_map, 3, 0, 0);
+}
+
+static void oil_yscale_out_argb_vec(float *sums, int width, unsigned char *out,
+	int tap)
+{
+	yscale_out_alpha_vec_impl(sums, width, out, tap, l2s_map, 0, 1, 0);
+}
+
+static void oil_yscale_out_rgba_nogamma_vec(float *sums, int width,
+	unsigned char *out, int tap, int gamma2)
+{
+	if (gamma2) {
+		yscale_out_alpha_vec_impl(sums, width, out, tap, NULL, 3, 0, 1);
+	} else {
+		yscale_out_alpha_vec_impl(sums, width, out, tap, NULL, 3, 0, 0);
+	}
+}
+
+/* `lut` is the linear-to-sRGB table, or NULL for RGBX_NOGAMMA and
+ * RGBX_GAMMA2.
+ */
+static inline __attribute__((always_inline)) void yscale_out_rgbx_vec_impl(
+	float *sums, int width, unsigned char *out, int tap, unsigned char *lut,
+	int gamma2)
+{
+	int i, tap_off;
+	v4f vals, zero = { 0.0f, 0.0f, 0.0f, 0.0f };
+
+	tap_off = tap * 4;
+
+	for (i=0; i<width; i++) {
+		vals = oil_load_vec(sums + tap_off);
+		if (lut) {
+			oil_lut_store3_vec(out, oil_lut_idx_vec(vals), lut);
+		} else {
+			oil_store_bytes4_vec(out,
+				oil_clamp_round_gamma_idx_vec(vals, gamma2));
+		}
+		out[3] = 255;
+		oil_store_vec(sums + tap_off, zero);
+		sums += 16;
+		out += 4;
+	}
+}
+
+static void oil_yscale_out_rgbx_vec(float *sums, int width, unsigned char *out,
+	int tap)
+{
+	yscale_out_rgbx_vec_impl(sums, width, out, tap, l2s_map, 0);
+}
+
+static void oil_yscale_out_rgbx_nogamma_vec(float *sums, int width,
+	unsigned char *out, int tap, int gamma2)
+{
+	if (gamma2) {
+		yscale_out_rgbx_vec_impl(sums, width, out, tap, NULL, 1);
+	} else {
+		yscale_out_rgbx_vec_impl(sums, width, out, tap, NULL, 0);
+	}
+}
+
+static inline __attribute__((always_inline))
+void yscale_up_g_cmyk_vec_impl(float **in, int len, float *coeffs,
+	unsigned char *out, int gamma2)
+{
+	int i;
+	float v;
+	v4f c[4];
+
+	oil_splat_coeffs_vec(coeffs, c);
+
+	for (i=0; i+3<len; i+=4) {
+		oil_store_bytes4_vec(out + i, oil_clamp_round_gamma_idx_vec(
+			oil_ydot4_load_vec(in, i, c), gamma2));
+	}
+
+	for (; i<len; i++) {
+		v = oil_clampf_vec(oil_ydot4_f_vec(in, i, coeffs));
+		if (gamma2) v = sqrtf(v);
+		out[i] = (int)(v * 255.0f + 0.5f);
+	}
+}
+
+static void oil_yscale_up_g_cmyk_vec(float **in, int len, float *coeffs,
+	unsigned char *out)
+{
+	yscale_up_g_cmyk_vec_impl(in, len, coeffs, out, 0);
+}
+
+static void oil_yscale_up_gamma2_vec(float **in, int len, float *coeffs,
+	unsigned char *out)
+{
+	yscale_up_g_cmyk_vec_impl(in, len, coeffs, out, 1);
+}
+
+static void oil_yscale_up_ga_vec(float **in, int len, float *coeffs,
+	unsigned char *out)
+{
+	int i;
+	float gray, alpha;
+	v4f sum, alpha_spread, divided, result;
+	v4f zero = { 0.0f, 0.0f, 0.0f, 0.0f };
+	v4f one = { 1.0f, 1.0f, 1.0f, 1.0f };
+	v4f c[4];
+
+	oil_splat_coeffs_vec(coeffs, c);
+
+	/* Process 2 GA pixels (4 floats) at a time */
+	for (i=0; i+3<len; i+=4) {
+		sum = oil_ydot4_load_vec(in, i, c);
+
+		/* sum = [g0, a0, g1, a1]; divide gray by alpha unless it is 0 */
+		alpha_spread = oil_clamp_vec(OIL_SHUFFLE_VEC(sum, sum,
+			1, 1, 3, 3));
+		divided = sum / oil_select_vec(alpha_spread != zero,
+			alpha_spread, one);
+		divided = oil_clamp_vec(divided);
+		result = OIL_SHUFFLE_VEC(divided, alpha_spread, 0, 5, 2, 7);
+		oil_store_bytes4_vec(out + i, __builtin_convertvector(
+			result * 255.0f + 0.5f, v4i));
+	}
+
+	/* Scalar tail for remaining pixel */
+	for (; i<len; i+=2) {
+		gray = oil_ydot4_f_vec(in, i, coeffs);
+		alpha = oil_clampf_vec(oil_ydot4_f_vec(in, i + 1, coeffs));
+		if (alpha != 0) {
+			gray /= alpha;
+		}
+		gray = oil_clampf_vec(gray);
+		out[i] = (int)(gray * 255.0f + 0.5f);
+		out[i + 1] = (int)(alpha * 255.0f + 0.5f);
+	}
+}
+
+static inline __attribute__((always_inline)) void yscale_up_gamma_vec_impl(
+	float **in, int len, float *coeffs, unsigned char *out, int is_rgbx)
+{
+	int i;
+	v4i idx;
+	unsigned char *lut;
+	v4f c[4];
+
+	oil_splat_coeffs_vec(coeffs, c);
+
+	lut = l2s_map;
+
+	for (i=0; i+3<len; i+=4) {
+		idx = oil_lut_idx_vec(oil_ydot4_load_vec(in, i, c));
+		oil_lut_store3_vec(out + i, idx, lut);
+		out[i + 3] = is_rgbx ? 255 : lut[idx[3]];
+	}
+
+	/* RGBX len is always a multiple of 4; scalar tail only applies to RGB. */
+	for (; i<len; i++) {
+		out[i] = lut[(int)(oil_clampf_vec(oil_ydot4_f_vec(in, i, coeffs)) *
+			(l2s_len - 1))];
+	}
+}
+
+static void oil_yscale_up_rgb_vec(float **in, int len, float *coeffs,
+	unsigned char *out)
+{
+	yscale_up_gamma_vec_impl(in, len, coeffs, out, 0);
+}
+
+static void oil_yscale_up_rgbx_vec(float **in, int len, float *coeffs,
+	unsigned char *out)
+{
+	yscale_up_gamma_vec_impl(in, len, coeffs, out, 1);
+}
+
+/* `lut` is the linear-to-sRGB table, or NULL for RGBA_NOGAMMA and
+ * RGBA_GAMMA2.
+ */
+static inline __attribute__((always_inline)) void yscale_up_alpha_vec_impl(
+	float **in, int len, float *coeffs, unsigned char *out,
+	unsigned char *lut, int a_off, int rgb_off, int gamma2)
+{
+	int i;
+	v4f c[4];
+
+	oil_splat_coeffs_vec(coeffs, c);
+
+	for (i=0; i<len; i+=4) {
+		oil_unpremul_rgba_vec(oil_ydot4_load_vec(in, i, c), lut,
+			out + i, a_off, rgb_off, gamma2);
+	}
+}
+
+static void oil_yscale_up_rgba_vec(float **in, int len, float *coeffs,
+	unsigned char *out)
+{
+	yscale_up_alpha_vec_impl(in, len, coeffs, out, l2s_map, 3, 0, 0);
+}
+
+static void oil_yscale_up_argb_vec(float **in, int len, float *coeffs,
+	unsigned char *out)
+{
+	yscale_up_alpha_vec_impl(in, len, coeffs, out, l2s_map, 0, 1, 0);
+}
+
+static void oil_yscale_up_rgba_nogamma_vec(float **in, int len, float *coeffs,
+	unsigned char *out, int gamma2)
+{
+	if (gamma2) {
+		yscale_up_alpha_vec_impl(in, len, coeffs, out, NULL, 3, 0, 1);
+	} else {
+		yscale_up_alpha_vec_impl(in, len, coeffs, out, NULL, 3, 0, 0);
+	}
+}
+
+static inline __attribute__((always_inline))
+void yscale_up_rgbx_nogamma_vec_impl(float **in, int len, float *coeffs,
+	unsigned char *out, int gamma2)
+{
+	int i;
+	v4f c[4];
+
+	oil_splat_coeffs_vec(coeffs, c);
+
+	for (i=0; i<len; i+=4) {
+		oil_store_bytes4_vec(out + i, oil_clamp_round_gamma_idx_vec(
+			oil_ydot4_load_vec(in, i, c), gamma2));
+		out[i + 3] = 255;
+	}
+}
+
+static void oil_yscale_up_rgbx_nogamma_vec(float **in, int len, float *coeffs,
+	unsigned char *out, int gamma2)
+{
+	if (gamma2) {
+		yscale_up_rgbx_nogamma_vec_impl(in, len, coeffs, out, 1);
+	} else {
+		yscale_up_rgbx_nogamma_vec_impl(in, len, coeffs, out, 0);
+	}
+}
+
+static void oil_xscale_up_g_vec(unsigned char *in, int width_in, float *out,
+	float *coeff_buf, int *border_buf)
+{
+	int i, j;
+	v4f smp = { 0.0f, 0.0f, 0.0f, 0.0f };
+
+	for (i=0; i<width_in; i++) {
+		smp = oil_push_f_vec(smp, i2f_map[in[i]]);
+		for (j=0; j<border_buf[i]; j++) {
+			out[0] = oil_dot1_f_vec(smp, oil_load_vec(coeff_buf));
+			out += 1;
+			coeff_buf += 4;
+		}
+	}
+}
+
+static void oil_xscale_up_ga_vec(unsigned char *in, int width_in, float *out,
+	float *coeff_buf, int *border_buf)
+{
+	int i, j;
+	float alpha_new;
+	v4f coeffs;
+	v4f smp_g = { 0.0f, 0.0f, 0.0f, 0.0f };
+	v4f smp_a = { 0.0f, 0.0f, 0.0f, 0.0f };
+
+	for (i=0; i<width_in; i++) {
+		alpha_new = in[1] / 255.0f;
+		smp_a = oil_push_f_vec(smp_a, alpha_new);
+		smp_g = oil_push_f_vec(smp_g, alpha_new * i2f_map[in[0]]);
+
+		for (j=0; j<border_buf[i]; j++) {
+			coeffs = oil_load_vec(coeff_buf);
+			out[0] = oil_dot1_f_vec(smp_g, coeffs);
+			out[1] = oil_dot1_f_vec(smp_a, coeffs);
+			out += 2;
+			coeff_buf += 4;
+		}
+
+		in += 2;
+	}
+}
+
+static void oil_xscale_up_rgb_vec(unsigned char *in, int width_in, float *out,
+	float *coeff_buf, int *border_buf, float *lut)
+{
+	int i, j;
+	v4f coeffs;
+	v4f smp_r = { 0.0f, 0.0f, 0.0f, 0.0f };
+	v4f smp_g = { 0.0f, 0.0f, 0.0f, 0.0f };
+	v4f smp_b = { 0.0f, 0.0f, 0.0f, 0.0f };
+
+	for (i=0; i<width_in; i++) {
+		smp_r = oil_push_f_vec(smp_r, lut[in[0]]);
+		smp_g = oil_push_f_vec(smp_g, lut[in[1]]);
+		smp_b = oil_push_f_vec(smp_b, lut[in[2]]);
+
+		for (j=0; j<border_buf[i]; j++) {
+			coeffs = oil_load_vec(coeff_buf);
+			out[0] = oil_dot1_f_vec(smp_r, coeffs);
+			out[1] = oil_dot1_f_vec(smp_g, coeffs);
+			out[2] = oil_dot1_f_vec(smp_b, coeffs);
+			out += 3;
+			coeff_buf += 4;
+		}
+
+		in += 3;
+	}
+}
+
+/* Pixel-major 4-channel x-upscale. Each window entry is one input pixel:
+ * [C, M, Y, K] for CMYK, premultiplied [R, G, B, A] for the alpha
+ * colorspaces and [R, G, B, 0] for RGBX, whose X lane the y-pass overwrites.
+ */
+static inline __attribute__((always_inline)) void xscale_up_px4_vec_impl(
+	unsigned char *in, int width_in, float *out, float *coeff_buf,
+	int *border_buf, float *lut, int a_off, int rgb_off, int is_cmyk)
+{
+	int i;
+	v4f px;
+	v4f smp0 = { 0.0f, 0.0f, 0.0f, 0.0f };
+	v4f smp1 = smp0, smp2 = smp0, smp3 = smp0;
+
+	for (i=0; i<width_in; i++) {
+		if (is_cmyk) {
+			v4f p = { i2f_map[in[0]], i2f_map[in[1]], i2f_map[in[2]],
+				i2f_map[in[3]] };
+			px = p;
+		} else if (a_off < 0) {
+			v4f p = { lut[in[0]], lut[in[1]], lut[in[2]], 0.0f };
+			px = p;
+		} else {
+			v4f p = { lut[in[rgb_off]], lut[in[rgb_off + 1]],
+				lut[in[rgb_off + 2]], 1.0f };
+			px = p * i2f_map[in[a_off]];
+		}
+		smp0 = smp1;
+		smp1 = smp2;
+		smp2 = smp3;
+		smp3 = px;
+
+		oil_xscale_up_px4_vec(smp0, smp1, smp2, smp3, border_buf[i],
+			&out, &coeff_buf);
+
+		in += 4;
+	}
+}
+
+static void oil_xscale_up_cmyk_vec(unsigned char *in, int width_in, float *out,
+	float *coeff_buf, int *border_buf)
+{
+	xscale_up_px4_vec_impl(in, width_in, out, coeff_buf, border_buf,
+		i2f_map, -1, 0, 1);
+}
+
+static void oil_xscale_up_rgba_vec(unsigned char *in, int width_in, float *out,
+	float *coeff_buf, int *border_buf)
+{
+	xscale_up_px4_vec_impl(in, width_in, out, coeff_buf, border_buf,
+		s2l_map, 3, 0, 0);
+}
+
+static void oil_xscale_up_argb_vec(unsigned char *in, int width_in, float *out,
+	float *coeff_buf, int *border_buf)
+{
+	xscale_up_px4_vec_impl(in, width_in, out, coeff_buf, border_buf,
+		s2l_map, 0, 1, 0);
+}
+
+static void oil_xscale_up_rgbx_vec(unsigned char *in, int width_in, float *out,
+	float *coeff_buf, int *border_buf, float *lut)
+{
+	xscale_up_px4_vec_impl(in, width_in, out, coeff_buf, border_buf,
+		lut, -1, 0, 0);
+}
+
+static void oil_xscale_up_rgba_nogamma_vec(unsigned char *in, int width_in,
+	float *out, float *coeff_buf, int *border_buf, float *lut)
+{
+	xscale_up_px4_vec_impl(in, width_in, out, coeff_buf, border_buf,
+		lut, 3, 0, 0);
+}
+
+/* Accumulate `count` horizontal G samples into `sum`, using a 4-way unrolled
+ * inner loop with a 1-way tail. Advances *in_p and *coeffs_x_f_p past the
+ * consumed samples/coefficients. `sum` carries the partial sum shifted in
+ * from the previous output position; the four parallel accumulators are
+ * reduced before returning.
+ */
+static inline __attribute__((always_inline))
+v4f oil_xacc_g_heavy_vec(unsigned char **in_p, float **coeffs_x_f_p,
+	int count, v4f sum)
+{
+	int j;
+	unsigned char *in = *in_p;
+	float *coeffs_x_f = *coeffs_x_f_p;
+	v4f sum2 = { 0.0f, 0.0f, 0.0f, 0.0f };
+	v4f sum3 = sum2, sum4 = sum2;
+
+	for (j=0; j+3<count; j+=4) {
+		sum += oil_load_vec(coeffs_x_f) * i2f_map[in[0]];
+		sum2 += oil_load_vec(coeffs_x_f + 4) * i2f_map[in[1]];
+		sum3 += oil_load_vec(coeffs_x_f + 8) * i2f_map[in[2]];
+		sum4 += oil_load_vec(coeffs_x_f + 12) * i2f_map[in[3]];
+		in += 4;
+		coeffs_x_f += 16;
+	}
+	for (; j<count; j++) {
+		sum += oil_load_vec(coeffs_x_f) * i2f_map[in[0]];
+		in += 1;
+		coeffs_x_f += 4;
+	}
+
+	*in_p = in;
+	*coeffs_x_f_p = coeffs_x_f;
+	return (sum + sum2) + (sum3 + sum4);
+}
+
+static void __attribute__((noinline)) oil_scale_down_g_heavy_vec(
+	unsigned char *in, float *sums_y_out, int out_width, float *coeffs_x_f,
+	int *border_buf, float *coeffs_y_f)
+{
+	int i;
+	v4f coeffs_y, sum = { 0.0f, 0.0f, 0.0f, 0.0f };
+
+	coeffs_y = oil_load_vec(coeffs_y_f);
+
+	for (i=0; i<out_width; i++) {
+		sum = oil_xacc_g_heavy_vec(&in, &coeffs_x_f, border_buf[i], sum);
+
+		oil_vaccum_slot_vec(sums_y_out, sum, coeffs_y);
+		sums_y_out += 4;
+
+		sum = oil_shift_f_left_vec(sum);
+	}
+}
+
+static void oil_scale_down_g_vec(unsigned char *in, float *sums_y_out,
+	int out_width, float *coeffs_x_f, int *border_buf, float *coeffs_y_f)
+{
+	int i, j;
+	v4f coeffs_y, sum = { 0.0f, 0.0f, 0.0f, 0.0f };
+
+	coeffs_y = oil_load_vec(coeffs_y_f);
+
+	for (i=0; i<out_width; i++) {
+		for (j=0; j<border_buf[i]; j++) {
+			sum += oil_load_vec(coeffs_x_f) * i2f_map[in[0]];
+			in += 1;
+			coeffs_x_f += 4;
+		}
+
+		oil_vaccum_slot_vec(sums_y_out, sum, coeffs_y);
+		sums_y_out += 4;
+
+		sum = oil_shift_f_left_vec(sum);
+	}
+}
+
+static void oil_scale_down_ga_vec(unsigned char *in, float *sums_y_out,
+	int out_width, float *coeffs_x_f, int *border_buf, float *coeffs_y_f)
+{
+	int i, j;
+	float alpha;
+	v4f coeffs_x, coeffs_y;
+	v4f sum_g = { 0.0f, 0.0f, 0.0f, 0.0f };
+	v4f sum_a = sum_g;
+
+	coeffs_y = oil_load_vec(coeffs_y_f);
+
+	for (i=0; i<out_width; i++) {
+		for (j=0; j<border_buf[i]; j++) {
+			coeffs_x = oil_load_vec(coeffs_x_f);
+			alpha = i2f_map[in[1]];
+			sum_g += coeffs_x * (i2f_map[in[0]] * alpha);
+			sum_a += coeffs_x * alpha;
+			in += 2;
+			coeffs_x_f += 4;
+		}
+
+		oil_vaccum_slot_vec(sums_y_out, sum_g, coeffs_y);
+		oil_vaccum_slot_vec(sums_y_out + 4, sum_a, coeffs_y);
+		sums_y_out += 8;
+
+		sum_g = oil_shift_f_left_vec(sum_g);
+		sum_a = oil_shift_f_left_vec(sum_a);
+	}
+}
+
+static void oil_scale_down_rgb_vec(unsigned char *in, float *sums_y_out,
+	int out_width, float *coeffs_x_f, int *border_buf, float *coeffs_y_f,
+	float *lut)
+{
+	int i, j;
+	v4f coeffs_x, coeffs_y;
+	v4f sum_r = { 0.0f, 0.0f, 0.0f, 0.0f };
+	v4f sum_g = sum_r, sum_b = sum_r;
+
+	coeffs_y = oil_load_vec(coeffs_y_f);
+
+	for (i=0; i<out_width; i++) {
+		for (j=0; j<border_buf[i]; j++) {
+			coeffs_x = oil_load_vec(coeffs_x_f);
+			sum_r += coeffs_x * lut[in[0]];
+			sum_g += coeffs_x * lut[in[1]];
+			sum_b += coeffs_x * lut[in[2]];
+			in += 3;
+			coeffs_x_f += 4;
+		}
+
+		oil_vaccum_slot_vec(sums_y_out, sum_r, coeffs_y);
+		oil_vaccum_slot_vec(sums_y_out + 4, sum_g, coeffs_y);
+		oil_vaccum_slot_vec(sums_y_out + 8, sum_b, coeffs_y);
+		sums_y_out += 12;
+
+		sum_r = oil_shift_f_left_vec(sum_r);
+		sum_g = oil_shift_f_left_vec(sum_g);
+		sum_b = oil_shift_f_left_vec(sum_b);
+	}
+}
+
+/* 4-channel x-downscale into the tap-rotated sums_y layout. Channels are
+ * accumulated in input order; a_off < 0 means there is no alpha to
+ * premultiply by (CMYK and RGBX), in which case `lut` converts all four
+ * bytes. RGBX passes its X byte through, which the y-pass discards.
+ */
+static inline __attribute__((always_inline)) void scale_down_px4_vec_impl(
+	unsigned char *in, float *sums_y_out, int out_width, float *coeffs_x_f,
+	int *border_buf, float *coeffs_y_f, int tap, float *lut, int a_off,
+	int rgb_off)
+{
+	int i, j;
+	v4f coeffs_x;
+	v4f sum_0 = { 0.0f, 0.0f, 0.0f, 0.0f };
+	v4f sum_1 = sum_0, sum_2 = sum_0, sum_3 = sum_0;
+
+	for (i=0; i<out_width; i++) {
+		for (j=0; j<border_buf[i]; j++) {
+			coeffs_x = oil_load_vec(coeffs_x_f);
+			if (a_off < 0) {
+				sum_0 += coeffs_x * lut[in[0]];
+				sum_1 += coeffs_x * lut[in[1]];
+				sum_2 += coeffs_x * lut[in[2]];
+				sum_3 += coeffs_x * lut[in[3]];
+			} else {
+				coeffs_x = coeffs_x * i2f_map[in[a_off]];
+				sum_0 += coeffs_x * lut[in[rgb_off]];
+				sum_1 += coeffs_x * lut[in[rgb_off + 1]];
+				sum_2 += coeffs_x * lut[in[rgb_off + 2]];
+				sum_3 += coeffs_x;
+			}
+			in += 4;
+			coeffs_x_f += 4;
+		}
+
+		oil_vaccum_tap4_vec(sums_y_out,
+			OIL_SHUFFLE_VEC(OIL_SHUFFLE_VEC(sum_0, sum_1, 0, 4, 0, 4),
+			OIL_SHUFFLE_VEC(sum_2, sum_3, 0, 4, 0, 4), 0, 1, 4, 5),
+			coeffs_y_f, tap);
+		sums_y_out += 16;
+
+		sum_0 = oil_shift_f_left_vec(sum_0);
+		sum_1 = oil_shift_f_left_vec(sum_1);
+		sum_2 = oil_shift_f_left_vec(sum_2);
+		sum_3 = oil_shift_f_left_vec(sum_3);
+	}
+}
+
+static void oil_scale_down_cmyk_vec(unsigned char *in, float *sums_y_out,
+	int out_width, float *coeffs_x_f, int *border_buf, float *coeffs_y_f,
+	int tap)
+{
+	scale_down_px4_vec_impl(in, sums_y_out, out_width, coeffs_x_f,
+		border_buf, coeffs_y_f, tap, i2f_map, -1, 0);
+}
+
+static void oil_scale_down_rgba_vec(unsigned char *in, float *sums_y_out,
+	int out_width, float *coeffs_x_f, int *border_buf, float *coeffs_y_f,
+	int tap)
+{
+	scale_down_px4_vec_impl(in, sums_y_out, out_width, coeffs_x_f,
+		border_buf, coeffs_y_f, tap, s2l_map, 3, 0);
+}
+
+static void oil_scale_down_argb_vec(unsigned char *in, float *sums_y_out,
+	int out_width, float *coeffs_x_f, int *border_buf, float *coeffs_y_f,
+	int tap)
+{
+	scale_down_px4_vec_impl(in, sums_y_out, out_width, coeffs_x_f,
+		border_buf, coeffs_y_f, tap, s2l_map, 0, 1);
+}
+
+static void oil_scale_down_rgbx_vec(unsigned char *in, float *sums_y_out,
+	int out_width, float *coeffs_x_f, int *border_buf, float *coeffs_y_f,
+	int tap, float *lut)
+{
+	scale_down_px4_vec_impl(in, sums_y_out, out_width, coeffs_x_f,
+		border_buf, coeffs_y_f, tap, lut, -1, 0);
+}
+
+static void oil_scale_down_rgba_nogamma_vec(unsigned char *in,
+	float *sums_y_out, int out_width, float *coeffs_x_f, int *border_buf,
+	float *coeffs_y_f, int tap, float *lut)
+{
+	scale_down_px4_vec_impl(in, sums_y_out, out_width, coeffs_x_f,
+		border_buf, coeffs_y_f, tap, lut, 3, 0);
+}
+
+/* Vector-extension dispatch functions */
+
+static void yscale_out_vec(float *sums, int width, unsigned char *out,
+	enum oil_colorspace cs, int tap)
+{
+	int sl_len;
+
+	sl_len = width * OIL_CMP(cs);
+
+	switch(cs) {
+	case OIL_CS_G:
+		oil_yscale_out_nonlinear_vec(sums, sl_len, out);
+		break;
+	case OIL_CS_CMYK:
+		oil_yscale_out_cmyk_vec(sums, width, out, tap);
+		break;
+	case OIL_CS_GA:
+		oil_yscale_out_ga_vec(sums, width, out);
+		break;
+	case OIL_CS_RGB:
+		oil_yscale_out_linear_vec(sums, sl_len, out);
+		break;
+	case OIL_CS_RGBA:
+		oil_yscale_out_rgba_vec(sums, width, out, tap);
+		break;
+	case OIL_CS_ARGB:
+		oil_yscale_out_argb_vec(sums, width, out, tap);
+		break;
+	case OIL_CS_RGBX:
+		oil_yscale_out_rgbx_vec(sums, width, out, tap);
+		break;
+	case OIL_CS_RGB_NOGAMMA:
+		oil_yscale_out_nonlinear_vec(sums, sl_len, out);
+		break;
+	case OIL_CS_RGBA_NOGAMMA:
+		oil_yscale_out_rgba_nogamma_vec(sums, width, out, tap, 0);
+		break;
+	case OIL_CS_RGBX_NOGAMMA:
+		oil_yscale_out_rgbx_nogamma_vec(sums, width, out, tap, 0);
+		break;
+	case OIL_CS_RGB_GAMMA2:
+		oil_yscale_out_gamma2_vec(sums, sl_len, out);
+		break;
+	case OIL_CS_RGBA_GAMMA2:
+		oil_yscale_out_rgba_nogamma_vec(sums, width, out, tap, 1);
+		break;
+	case OIL_CS_RGBX_GAMMA2:
+		oil_yscale_out_rgbx_nogamma_vec(sums, width, out, tap, 1);
+		break;
+	case OIL_CS_UNKNOWN:
+		break;
+	}
+}
+
+static void yscale_up_vec(float **in, int len, float *coeffs,
+	unsigned char *out, enum oil_colorspace cs)
+{
+	switch(cs) {
+	case OIL_CS_G:
+	case OIL_CS_CMYK:
+		oil_yscale_up_g_cmyk_vec(in, len, coeffs, out);
+		break;
+	case OIL_CS_GA:
+		oil_yscale_up_ga_vec(in, len, coeffs, out);
+		break;
+	case OIL_CS_RGB:
+		oil_yscale_up_rgb_vec(in, len, coeffs, out);
+		break;
+	case OIL_CS_RGBA:
+		oil_yscale_up_rgba_vec(in, len, coeffs, out);
+		break;
+	case OIL_CS_ARGB:
+		oil_yscale_up_argb_vec(in, len, coeffs, out);
+		break;
+	case OIL_CS_RGBX:
+		oil_yscale_up_rgbx_vec(in, len, coeffs, out);
+		break;
+	case OIL_CS_RGB_NOGAMMA:
+		oil_yscale_up_g_cmyk_vec(in, len, coeffs, out);
+		break;
+	case OIL_CS_RGBA_NOGAMMA:
+		oil_yscale_up_rgba_nogamma_vec(in, len, coeffs, out, 0);
+		break;
+	case OIL_CS_RGBX_NOGAMMA:
+		oil_yscale_up_rgbx_nogamma_vec(in, len, coeffs, out, 0);
+		break;
+	case OIL_CS_RGB_GAMMA2:
+		oil_yscale_up_gamma2_vec(in, len, coeffs, out);
+		break;
+	case OIL_CS_RGBA_GAMMA2:
+		oil_yscale_up_rgba_nogamma_vec(in, len, coeffs, out, 1);
+		break;
+	case OIL_CS_RGBX_GAMMA2:
+		oil_yscale_up_rgbx_nogamma_vec(in, len, coeffs, out, 1);
+		break;
+	case OIL_CS_UNKNOWN:
+		break;
+	}
+}
+
+static void xscale_up_vec(unsigned char *in, int width_in, float *out,
+	enum oil_colorspace cs_in, float *coeff_buf, int *border_buf)
+{
+	switch(cs_in) {
+	case OIL_CS_RGB:
+		oil_xscale_up_rgb_vec(in, width_in, out, coeff_buf, border_buf, s2l_map);
+		break;
+	case OIL_CS_G:
+		oil_xscale_up_g_vec(in, width_in, out, coeff_buf, border_buf);
+		break;
+	case OIL_CS_CMYK:
+		oil_xscale_up_cmyk_vec(in, width_in, out, coeff_buf, border_buf);
+		break;
+	case OIL_CS_RGBA:
+		oil_xscale_up_rgba_vec(in, width_in, out, coeff_buf, border_buf);
+		break;
+	case OIL_CS_GA:
+		oil_xscale_up_ga_vec(in, width_in, out, coeff_buf, border_buf);
+		break;
+	case OIL_CS_ARGB:
+		oil_xscale_up_argb_vec(in, width_in, out, coeff_buf, border_buf);
+		break;
+	case OIL_CS_RGBX:
+		oil_xscale_up_rgbx_vec(in, width_in, out, coeff_buf, border_buf, s2l_map);
+		break;
+	case OIL_CS_RGB_NOGAMMA:
+		oil_xscale_up_rgb_vec(in, width_in, out, coeff_buf, border_buf, i2f_map);
+		break;
+	case OIL_CS_RGBA_NOGAMMA:
+		oil_xscale_up_rgba_nogamma_vec(in, width_in, out, coeff_buf, border_buf, i2f_map);
+		break;
+	case OIL_CS_RGBX_NOGAMMA:
+		oil_xscale_up_rgbx_vec(in, width_in, out, coeff_buf, border_buf, i2f_map);
+		break;
+	case OIL_CS_RGB_GAMMA2:
+		oil_xscale_up_rgb_vec(in, width_in, out, coeff_buf, border_buf, g2l_map);
+		break;
+	case OIL_CS_RGBA_GAMMA2:
+		oil_xscale_up_rgba_nogamma_vec(in, width_in, out, coeff_buf, border_buf, g2l_map);
+		break;
+	case OIL_CS_RGBX_GAMMA2:
+		oil_xscale_up_rgbx_vec(in, width_in, out, coeff_buf, border_buf, g2l_map);
+		break;
+	case OIL_CS_UNKNOWN:
+		break;
+	}
+}
+
+static void scale_down_vec(struct oil_scale *os, unsigned char *in,
+	float *coeffs_y)
+{
+	switch(os->cs) {
+	case OIL_CS_RGB:
+		oil_scale_down_rgb_vec(in, os->sums_y, os->out_width, os->coeffs_x, os->borders_x, coeffs_y, s2l_map);
+		break;
+	case OIL_CS_G:
+		if (os->in_width / os->out_width >= os->heavy_ratio) {
+			oil_scale_down_g_heavy_vec(in, os->sums_y, os->out_width, os->coeffs_x, os->borders_x, coeffs_y);
+		} else {
+			oil_scale_down_g_vec(in, os->sums_y, os->out_width, os->coeffs_x, os->borders_x, coeffs_y);
+		}
+		break;
+	case OIL_CS_CMYK:
+		oil_scale_down_cmyk_vec(in, os->sums_y, os->out_width, os->coeffs_x, os->borders_x, coeffs_y, os->sums_y_tap);
+		break;
+	case OIL_CS_RGBA:
+		oil_scale_down_rgba_vec(in, os->sums_y, os->out_width, os->coeffs_x, os->borders_x, coeffs_y, os->sums_y_tap);
+		break;
+	case OIL_CS_GA:
+		oil_scale_down_ga_vec(in, os->sums_y, os->out_width, os->coeffs_x, os->borders_x, coeffs_y);
+		break;
+	case OIL_CS_ARGB:
+		oil_scale_down_argb_vec(in, os->sums_y, os->out_width, os->coeffs_x, os->borders_x, coeffs_y, os->sums_y_tap);
+		break;
+	case OIL_CS_RGBX:
+		oil_scale_down_rgbx_vec(in, os->sums_y, os->out_width, os->coeffs_x, os->borders_x, coeffs_y, os->sums_y_tap, s2l_map);
+		break;
+	case OIL_CS_RGB_NOGAMMA:
+		oil_scale_down_rgb_vec(in, os->sums_y, os->out_width, os->coeffs_x, os->borders_x, coeffs_y, i2f_map);
+		break;
+	case OIL_CS_RGBA_NOGAMMA:
+		oil_scale_down_rgba_nogamma_vec(in, os->sums_y, os->out_width, os->coeffs_x, os->borders_x, coeffs_y, os->sums_y_tap, i2f_map);
+		break;
+	case OIL_CS_RGBX_NOGAMMA:
+		oil_scale_down_rgbx_vec(in, os->sums_y, os->out_width, os->coeffs_x, os->borders_x, coeffs_y, os->sums_y_tap, i2f_map);
+		break;
+	case OIL_CS_RGB_GAMMA2:
+		oil_scale_down_rgb_vec(in, os->sums_y, os->out_width, os->coeffs_x, os->borders_x, coeffs_y, g2l_map);
+		break;
+	case OIL_CS_RGBA_GAMMA2:
+		oil_scale_down_rgba_nogamma_vec(in, os->sums_y, os->out_width, os->coeffs_x, os->borders_x, coeffs_y, os->sums_y_tap, g2l_map);
+		break;
+	case OIL_CS_RGBX_GAMMA2:
+		oil_scale_down_rgbx_vec(in, os->sums_y, os->out_width, os->coeffs_x, os->borders_x, coeffs_y, os->sums_y_tap, g2l_map);
+		break;
+	case OIL_CS_UNKNOWN:
+		break;
+	}
+}
+
+const struct oil_kernels oil_kernels_vec = {
+	"vec",
+	scale_down_vec,
+	yscale_out_vec,
+	xscale_up_vec,
+	yscale_up_vec,
+};
+
+int oil_scale_in_vec(struct oil_scale *os, unsigned char *in)
+{
+	return oil_scale_in_kernels(os, in, &oil_kernels_vec);
+}
+
+int oil_scale_out_vec(struct oil_scale *os, unsigned char *out)
+{
+	return oil_scale_out_kernels(os, out, &oil_kernels_vec);
+}
@@ -326,28 +326,16 @@ int main(int argc, char **argv) {
 		return 1;
 	}
 
-	if (backend == BACKEND_DEFAULT) {
-#if defined(__x86_64__)
-		if (__builtin_cpu_supports("avx2")) {
-			backend = BACKEND_AVX2;
-		} else {
-			backend = BACKEND_SSE2;
-		}
-#elif defined(__aarch64__)
-		backend = BACKEND_NEON;
-#else
-		backend = BACKEND_SCALAR;
-#endif
-	}
-
 	switch (backend) {
 	case BACKEND_DEFAULT:
-		/* unreachable */
-		break;
-	case BACKEND_SCALAR:
+		/* oil picks the fastest backend for the CPU at init time */
 		scale_in_fn = oil_scale_in;
 		scale_out_fn = oil_scale_out;
 		break;
+	case BACKEND_SCALAR:
+		scale_in_fn = oil_scale_in_scalar;
+		scale_out_fn = oil_scale_out_scalar;
+		break;
 	case BACKEND_SSE2:
 #if defined(__x86_64__)
 		scale_in_fn = oil_scale_in_sse2;
@@ -2,6 +2,9 @@
 #include <stdio.h>
 #include <math.h>
 #include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
 #include "oil_resample.h"
 
 typedef int (*scale_in_fn)(struct oil_scale *, unsigned char *);
@@ -12,6 +15,14 @@ static scale_in_fn cur_scale_in;
 static scale_out_fn cur_scale_out;
 static scale_out_discard_fn cur_scale_out_discard;
 
+/* Switch scalers to fixed point with oil_scale_set_fixed_point() where it is
+ * supported. */
+static int fixed_point;
+
+/* Switch scalers to half floats with oil_scale_set_half_float() where it is
+ * supported. */
+static int half_float;
+
 static long double srgb_sample_to_linear_reference(long double in_f)
 {
 	long double tmp;
@@ -110,19 +121,286 @@ static long double ref_map(int dim_in, int dim_out, int pos)
 	return (pos + 0.5l) * (long double)dim_in / dim_out - 0.5l;
 }
 
-static double worst;
+static double worst, worst_fixed;
+
+/* Every colorspace, with its name for reports. */
+static const struct {
+	enum oil_colorspace cs;
+	const char *name;
+} all_spaces[] = {
+	{OIL_CS_G, "G"}, {OIL_CS_GA, "GA"}, {OIL_CS_RGB, "RGB"},
+	{OIL_CS_RGBA, "RGBA"}, {OIL_CS_ARGB, "ARGB"}, {OIL_CS_CMYK, "CMYK"},
+	{OIL_CS_RGBX, "RGBX"}, {OIL_CS_RGB_NOGAMMA, "RGB_NOGAMMA"},
+	{OIL_CS_RGBA_NOGAMMA, "RGBA_NOGAMMA"},
+	{OIL_CS_RGBX_NOGAMMA, "RGBX_NOGAMMA"},
+	{OIL_CS_RGB_GAMMA2, "RGB_GAMMA2"}, {OIL_CS_RGBA_GAMMA2, "RGBA_GAMMA2"},
+	{OIL_CS_RGBX_GAMMA2, "RGBX_GAMMA2"},
+};
+#define N_SPACES ((int)(sizeof(all_spaces) / sizeof(all_spaces[0])))
+
+static int cs_index(enum oil_colorspace cs)
+{
+	int i;
+
+	for (i=0; all_spaces[i].cs != cs; i++);
+	return i;
+}
+
+/* Worst error of oil_scale_set_half_float() scalers, by colorspace. */
+static double worst_half[N_SPACES];
+
+/* Worst error of colour under alpha, times alpha. */
+static double worst_half_alpha[N_SPACES];
+
+/**
+ * A random input image and the output of a plain oil_scale_init() scaler fed
+ * it a row at a time, for tests that set up or feed scalers some other way.
+ */
+struct test_image {
+	int in_w, in_h, out_w, out_h;
+	enum oil_colorspace cs;
+	int in_stride, out_stride, out_len;
+	unsigned char *in, *ref, *out;
+};
+
+/**
+ * Feed img through os into out, a row at a time when batch is 1, otherwise
+ * through oil_scale_in_rows() & oil_scale_out_rows() up to batch rows at once.
+ */
+static void feed_image(struct oil_scale *os, struct test_image *img,
+	int batch, unsigned char *out)
+{
+	int i, in_pos, out_pos, n;
+
+	in_pos = out_pos = 0;
+	if (batch == 1) {
+		for (i=0; i<img->out_h; i++) {
+			while (oil_scale_slots(os)) {
+				oil_scale_in(os,
+					img->in + in_pos++ * img->in_stride);
+			}
+			oil_scale_out(os, out + i * img->out_stride);
+		}
+		return;
+	}
+	while (out_pos < img->out_h) {
+		n = img->in_h - in_pos;
+		in_pos += oil_scale_in_rows(os,
+			img->in + in_pos * img->in_stride, img->in_stride,
+			batch < n ? batch : n);
+		out_pos += oil_scale_out_rows(os,
+			out + out_pos * img->out_stride, img->out_stride,
+			batch);
+	}
+}
+
+static void image_init(struct test_image *img, int in_w, int in_h,
+	int out_w, int out_h, enum oil_colorspace cs)
+{
+	struct oil_scale os;
+
+	img->in_w = in_w;
+	img->in_h = in_h;
+	img->out_w = out_w;
+	img->out_h = out_h;
+	img->cs = cs;
+	img->in_stride = OIL_CMP(cs) * in_w;
+	img->out_stride = OIL_CMP(cs) * out_w;
+	img->out_len = img->out_stride * out_h;
+	img->in = malloc(img->in_stride * in_h);
+	img->ref = malloc(img->out_len);
+	img->out = malloc(img->out_len);
+	fill_rand8(img->in, img->in_stride * in_h);
+
+	assert(oil_scale_init(&os, in_h, out_h, in_w, out_w, cs) == 0);
+	feed_image(&os, img, 1, img->ref);
+	oil_scale_free(&os);
+}
+
+static void image_free(struct test_image *img)
+{
+	free(img->in);
+	free(img->ref);
+	free(img->out);
+}
+
+/**
+ * Scales img into out with a scaler set up in a particular way.
+ */
+typedef void (*image_fn)(struct test_image *img, const void *arg,
+	unsigned char *out);
+
+/**
+ * Scale img with scale and check every output byte against the reference,
+ * allowing it to be off by up to tolerance. what names the setup in reports.
+ */
+static void check_image(struct test_image *img, image_fn scale,
+	const void *arg, int tolerance, const char *what)
+{
+	int i;
+
+	memset(img->out, 0, img->out_len);
+	scale(img, arg, img->out);
+	for (i=0; i<img->out_len; i++) {
+		if (abs(img->out[i] - img->ref[i]) > tolerance) {
+			fprintf(stderr, "%s %dx%d->%dx%d %s: byte %d is %d, "
+				"expected %d\n", what, img->in_w, img->in_h,
+				img->out_w, img->out_h,
+				all_spaces[cs_index(img->cs)].name, i,
+				img->out[i], img->ref[i]);
+			assert(0 && "output differs from oil_scale_init()");
+		}
+	}
+}
+
+/* Ways to set up and feed a scaler once it is initialized. */
+struct setup {
+	int half; // call oil_scale_set_half_float().
+	int threads; // call oil_scale_set_threads() with this, unless 0.
+	int batch; // as for feed_image().
+};
+
+static void run_setup(struct oil_scale *os, struct test_image *img,
+	const struct setup *s, unsigned char *out)
+{
+	if (s->half) {
+		assert(oil_scale_set_half_float(os) == 0);
+	}
+	if (s->threads) {
+		assert(oil_scale_set_threads(os, s->threads) == 0);
+	}
+	feed_image(os, img, s->batch, out);
+	oil_scale_free(os);
+}
+
+/* image_fn for a scaler from oil_scale_init(), set up as in arg. */
+static void scale_init(struct test_image *img, const void *arg,
+	unsigned char *out)
+{
+	struct oil_scale os;
+
+	assert(oil_scale_init(&os, img->in_h, img->out_h, img->in_w,
+		img->out_w, img->cs) == 0);
+	run_setup(&os, img, arg, out);
+}
+
+/* image_fn for a scaler from oil_scale_init_plan(), set up as in arg. */
+static void scale_plan(struct test_image *img, const void *arg,
+	unsigned char *out)
+{
+	struct oil_plan plan;
+	struct oil_scale os;
+
+	assert(oil_plan_init(&plan, img->in_h, img->out_h, img->in_w,
+		img->out_w) == 0);
+	assert(oil_scale_init_plan(&os, &plan, img->cs) == 0);
+	run_setup(&os, img, arg, out);
+	oil_plan_free(&plan);
+}
+
+/* image_fn for a scaler on an oil_alloc() buffer passed to
+ * oil_scale_init_allocated(), which oil_scale_free() releases. */
+static void scale_allocated(struct test_image *img, const void *arg,
+	unsigned char *out)
+{
+	struct oil_scale os;
+
+	assert(oil_scale_init_allocated(&os, img->in_h, img->out_h,
+		img->in_w, img->out_w, img->cs,
+		oil_alloc(oil_scale_alloc_size(img->in_h, img->out_h,
+		img->in_w, img->out_w, img->cs))) == 0);
+	run_setup(&os, img, arg, out);
+}
+
+/* Index of the alpha sample of a pixel, or -1 if cs has none. */
+static int alpha_index(enum oil_colorspace cs)
+{
+	switch (cs) {
+	case OIL_CS_GA:
+		return 1;
+	case OIL_CS_ARGB:
+		return 0;
+	case OIL_CS_RGBA:
+	case OIL_CS_RGBA_NOGAMMA:
+	case OIL_CS_RGBA_GAMMA2:
+		return 3;
+	default:
+		return -1;
+	}
+}
+
+/* Documented bounds on the error of oil_scale_set_fixed_point(). Colour
+ * premultiplied by a low alpha keeps fewer bits, so it may be off by up to
+ * FIXED_ALPHA_TOLERANCE / alpha levels more. */
+#define FIXED_TOLERANCE 0.07
+#define FIXED_ALPHA_TOLERANCE 7.0
+
+/* Documented bounds on the error of oil_scale_set_half_float(). Rounding to
+ * half floats costs about 1e-4 in linear light next to bright samples, which
+ * the square root of the GAMMA2 colorspaces blows up near black. Colour under
+ * a low alpha may be off by up to HALF_ALPHA_TOLERANCE / alpha levels more. */
+#define HALF_TOLERANCE 0.5
+#define HALF_GAMMA2_TOLERANCE 2.0
+#define HALF_ALPHA_TOLERANCE 150.0
 
 static void validate_scanline8(unsigned char *oil, long double *ref,
-	int width, int cmp)
+	int width, enum oil_colorspace cs)
 {
-	int i, j, ref_i, pos;
-	double error, ref_f;
+	int i, j, ref_i, pos, cmp, a;
+	double error, ref_f, tolerance, alpha, *worst_cs;
+
+	cmp = OIL_CMP(cs);
 	for (i=0; i<width; i++) {
 		for (j=0; j<cmp; j++) {
 			pos = i * cmp + j;
 			ref_f = ref[pos] * 255.0;
 			ref_i = lround(ref_f);
 			error = fabs(oil[pos] - ref_f) - 0.5;
+			if (fixed_point) {
+				tolerance = FIXED_TOLERANCE;
+				if (cmp == 4 && j < 3) {
+					/* colour under zero alpha is undefined */
+					alpha = lroundl(ref[i * cmp + 3] * 255.0L);
+					if (alpha <= 0) {
+						continue;
+					}
+					tolerance += FIXED_ALPHA_TOLERANCE /
+						fmin(alpha, 255);
+				} else if (error > worst_fixed) {
+					worst_fixed = error;
+				}
+				if (error > tolerance) {
+					fprintf(stderr, "[%d:%d] expected: %d, got %d (%.9f)\n", i, j, ref_i, oil[pos], ref_f);
+					assert(0 && "fixed-point pixel error exceeds tolerance");
+				}
+				continue;
+			}
+			if (half_float) {
+				tolerance = cs == OIL_CS_RGB_GAMMA2 ||
+					cs == OIL_CS_RGBX_GAMMA2 ?
+					HALF_GAMMA2_TOLERANCE : HALF_TOLERANCE;
+				worst_cs = &worst_half[cs_index(cs)];
+				alpha = 1.0;
+				a = alpha_index(cs);
+				if (a >= 0 && j != a) {
+					/* colour under zero alpha is undefined */
+					alpha = lroundl(ref[i * cmp + a] * 255.0L);
+					if (alpha <= 0) {
+						continue;
+					}
+					alpha = fmin(alpha, 255);
+					tolerance += HALF_ALPHA_TOLERANCE / alpha;
+					worst_cs = &worst_half_alpha[cs_index(cs)];
+				}
+				if (error * alpha > *worst_cs) {
+					*worst_cs = error * alpha;
+				}
+				if (error > tolerance) {
+					fprintf(stderr, "[%d:%d] expected: %d, got %d (%.9f)\n", i, j, ref_i, oil[pos], ref_f);
+					assert(0 && "half-float pixel error exceeds tolerance");
+				}
+				continue;
+			}
 			if (error > worst) {
 				worst = error;
 			}
@@ -189,6 +467,22 @@ static void preprocess(long double *in, enum oil_colorspace cs)
 		in[1] *= in[3];
 		in[2] *= in[3];
 		break;
+	case OIL_CS_RGB_GAMMA2:
+		in[0] *= in[0];
+		in[1] *= in[1];
+		in[2] *= in[2];
+		break;
+	case OIL_CS_RGBA_GAMMA2:
+		in[0] *= in[0] * in[3];
+		in[1] *= in[1] * in[3];
+		in[2] *= in[2] * in[3];
+		break;
+	case OIL_CS_RGBX_GAMMA2:
+		in[0] *= in[0];
+		in[1] *= in[1];
+		in[2] *= in[2];
+		in[3] = 1.0L;
+		break;
 	}
 }
 
@@ -271,6 +565,29 @@ static void postprocess(long double *in, enum oil_colorspace cs)
 		in[2] = clamp_f(in[2]);
 		in[3] = alpha;
 		break;
+	case OIL_CS_RGB_GAMMA2:
+		in[0] = sqrtl(clamp_f(in[0]));
+		in[1] = sqrtl(clamp_f(in[1]));
+		in[2] = sqrtl(clamp_f(in[2]));
+		break;
+	case OIL_CS_RGBA_GAMMA2:
+		alpha = clamp_f(in[3]);
+		if (alpha != 0.0L) {
+			in[0] /= alpha;
+			in[1] /= alpha;
+			in[2] /= alpha;
+		}
+		in[0] = sqrtl(clamp_f(in[0]));
+		in[1] = sqrtl(clamp_f(in[1]));
+		in[2] = sqrtl(clamp_f(in[2]));
+		in[3] = alpha;
+		break;
+	case OIL_CS_RGBX_GAMMA2:
+		in[0] = sqrtl(clamp_f(in[0]));
+		in[1] = sqrtl(clamp_f(in[1]));
+		in[2] = sqrtl(clamp_f(in[2]));
+		in[3] = 1.0L;
+		break;
 	case OIL_CS_UNKNOWN:
 		break;
 	}
@@ -452,6 +769,12 @@ static void do_oil_scale(unsigned char **input_image, int in_width,
 	int i, in_line;
 
 	oil_scale_init(&os, in_height, out_height, in_width, out_width, cs);
+	if (fixed_point) {
+		oil_scale_set_fixed_point(&os);
+	}
+	if (half_float) {
+		oil_scale_set_half_float(&os);
+	}
 	in_line = 0;
 	for (i=0; i<out_height; i++) {
 		while(oil_scale_slots(&os)) {
@@ -485,7 +808,7 @@ static void test_scale(int in_width, int in_height,
 	/* compare the two */
 	for (i=0; i<out_height; i++) {
 		validate_scanline8(oil_output_image[i], ref_output_image[i],
-			out_width, OIL_CMP(cs));
+			out_width, cs);
 	}
 
 	free_2d_uchar(oil_output_image, out_height);
@@ -509,6 +832,49 @@ static void test_scale_square_rand(int in_dim, int out_dim,
 	free_2d_uchar(input_image, in_dim);
 }
 
+/* Axes scaled independently: in opposite directions, or one unchanged. */
+static void test_scale_axes(int in_width, int in_height, int out_width,
+	int out_height, enum oil_colorspace cs)
+{
+	int i, in_row_stride;
+	unsigned char **input_image;
+
+	in_row_stride = OIL_CMP(cs) * in_width;
+	input_image = alloc_2d_uchar(in_row_stride, in_height);
+	for (i=0; i<in_height; i++) {
+		fill_rand8(input_image[i], in_row_stride);
+	}
+	test_scale(in_width, in_height, input_image, out_width, out_height,
+		cs);
+	free_2d_uchar(input_image, in_height);
+}
+
+static void test_scale_axes_all(void)
+{
+	static const int dims[][4] = {
+		{5, 40, 17, 9},
+		{40, 5, 9, 17},
+		{2, 100, 99, 1},
+		{100, 2, 1, 99},
+		{99, 100, 100, 99},
+		{30, 9, 30, 40},
+		{30, 40, 30, 9},
+		{9, 30, 40, 30},
+		{40, 30, 9, 30},
+		{1, 20, 1, 7},
+		{7, 1, 20, 1},
+	};
+	int d, c;
+	int n_dims = sizeof(dims) / sizeof(dims[0]);
+
+	for (d=0; d<n_dims; d++) {
+		for (c=0; c<N_SPACES; c++) {
+			test_scale_axes(dims[d][0], dims[d][1], dims[d][2],
+				dims[d][3], all_spaces[c].cs);
+		}
+	}
+}
+
 static void test_scale_catrom_extremes(void)
 {
 	unsigned char **input_image;
@@ -624,35 +990,24 @@ static void test_scale_negative_lobe_all(void)
 		{16, 64},  /* 4x upscale: multiple output samples per input pixel */
 		{16, 33},  /* non-integer upscale */
 	};
-	static const enum oil_colorspace spaces[] = {
-		OIL_CS_G, OIL_CS_GA, OIL_CS_RGB, OIL_CS_RGBA, OIL_CS_ARGB,
-		OIL_CS_CMYK, OIL_CS_RGBX, OIL_CS_RGB_NOGAMMA,
-		OIL_CS_RGBA_NOGAMMA, OIL_CS_RGBX_NOGAMMA,
-	};
 	int d, c;
 	int n_dims = sizeof(dims) / sizeof(dims[0]);
-	int n_spaces = sizeof(spaces) / sizeof(spaces[0]);
 
 	for (d=0; d<n_dims; d++) {
-		for (c=0; c<n_spaces; c++) {
+		for (c=0; c<N_SPACES; c++) {
 			test_scale_negative_lobe_pattern(dims[d][0], dims[d][1],
-				spaces[c]);
+				all_spaces[c].cs);
 		}
 	}
 }
 
 static void test_scale_each_cs(int dim_a, int dim_b)
 {
-	test_scale_square_rand(dim_a, dim_b, OIL_CS_G);
-	test_scale_square_rand(dim_a, dim_b, OIL_CS_GA);
-	test_scale_square_rand(dim_a, dim_b, OIL_CS_RGB);
-	test_scale_square_rand(dim_a, dim_b, OIL_CS_RGBA);
-	test_scale_square_rand(dim_a, dim_b, OIL_CS_ARGB);
-	test_scale_square_rand(dim_a, dim_b, OIL_CS_CMYK);
-	test_scale_square_rand(dim_a, dim_b, OIL_CS_RGBX);
-	test_scale_square_rand(dim_a, dim_b, OIL_CS_RGB_NOGAMMA);
-	test_scale_square_rand(dim_a, dim_b, OIL_CS_RGBA_NOGAMMA);
-	test_scale_square_rand(dim_a, dim_b, OIL_CS_RGBX_NOGAMMA);
+	int c;
+
+	for (c=0; c<N_SPACES; c++) {
+		test_scale_square_rand(dim_a, dim_b, all_spaces[c].cs);
+	}
 }
 
 static void test_scale_all_permutations(int dim_a, int dim_b)
@@ -683,6 +1038,12 @@ static void test_out_discard(int in_dim, int out_dim, enum oil_colorspace cs)
 	/* scale with every other line discarded */
 	discard_line = malloc(out_row_stride);
 	oil_scale_init(&os_discard, in_dim, out_dim, in_dim, out_dim, cs);
+	if (fixed_point) {
+		oil_scale_set_fixed_point(&os_discard);
+	}
+	if (half_float) {
+		oil_scale_set_half_float(&os_discard);
+	}
 	in_line = 0;
 	for (i=0; i<out_dim; i++) {
 		while(oil_scale_slots(&os_discard)) {
@@ -816,32 +1177,105 @@ static void test_scale_all(void)
 	test_scale_all_permutations(8, 3);
 	test_scale_all_permutations(100, 1);
 	test_scale_all_permutations(100, 99);
+	test_scale_all_permutations(200, 9);
 	test_scale_all_permutations(2, 1);
 }
 
+/* Unchanged geometry copies pixels, except for colour under zero alpha and
+ * RGBX padding, which come out as a full scale would produce them. */
+static void test_scale_identity(enum oil_colorspace cs)
+{
+	int i, j, w, h, cmp, stride;
+	unsigned char *in, *out, *img, *px, expect;
+	struct oil_scale os;
+
+	w = 37;
+	h = 9;
+	cmp = OIL_CMP(cs);
+	stride = w * cmp;
+	in = malloc(stride * h);
+	out = malloc(stride);
+	img = malloc(stride * h);
+	fill_rand8(in, stride * h);
+	/* make every fourth pixel transparent */
+	for (i=0; i<w*h; i+=4) {
+		px = in + i * cmp;
+		if (cs == OIL_CS_GA) {
+			px[1] = 0;
+		} else if (cs == OIL_CS_ARGB) {
+			px[0] = 0;
+		} else if (cmp == 4) {
+			px[3] = 0;
+		}
+	}
+
+	assert(oil_scale_init(&os, h, h, w, w, cs) == 0);
+	assert(oil_scale_set_threads(&os, 4) == 0);
+	assert(oil_scale_image(in, stride, img, stride, w, h, w, h, cs, 2) == 0);
+	for (i=0; i<h; i++) {
+		assert(oil_scale_slots(&os) == 1);
+		assert(cur_scale_in(&os, in + i * stride) == 0);
+		assert(cur_scale_out(&os, out) == 0);
+		for (j=0; j<stride; j++) {
+			px = in + i * stride + j / cmp * cmp;
+			expect = in[i * stride + j];
+			switch (cs) {
+			case OIL_CS_GA:
+				expect = j % 2 == 0 && !px[1] ? 0 : expect;
+				break;
+			case OIL_CS_RGBA:
+			case OIL_CS_RGBA_NOGAMMA:
+			case OIL_CS_RGBA_GAMMA2:
+				expect = px[3] ? expect : 0;
+				break;
+			case OIL_CS_ARGB:
+				expect = px[0] ? expect : 0;
+				break;
+			case OIL_CS_RGBX:
+			case OIL_CS_RGBX_NOGAMMA:
+			case OIL_CS_RGBX_GAMMA2:
+				expect = j % 4 == 3 ? 0xFF : expect;
+				break;
+			default:
+				break;
+			}
+			assert(out[j] == expect);
+			assert(img[i * stride + j] == expect);
+		}
+	}
+	oil_scale_free(&os);
+
+	free(in);
+	free(out);
+	free(img);
+}
+
+static void test_scale_identity_all(void)
+{
+	int c;
+
+	for (c=0; c<N_SPACES; c++) {
+		test_scale_identity(all_spaces[c].cs);
+	}
+}
+
 /* Sweep near-identity up/down scales (N <-> N+/-1) across sizes, colorspaces,
  * and seeds. Prior worst-case errors all came from 99<->100; this targets that
  * regime to exercise float accumulation precision in the x/y scale paths. */
 static void test_scale_near_identity(void)
 {
 	static const int sizes[] = {7, 16, 33, 50, 99, 100};
-	static const enum oil_colorspace spaces[] = {
-		OIL_CS_G, OIL_CS_GA, OIL_CS_RGB, OIL_CS_RGBA, OIL_CS_ARGB,
-		OIL_CS_CMYK, OIL_CS_RGBX, OIL_CS_RGB_NOGAMMA,
-		OIL_CS_RGBA_NOGAMMA, OIL_CS_RGBX_NOGAMMA,
-	};
 	static const unsigned int seeds[] = {1531289551u, 0xdeadbeefu};
 	int sz_i, cs_i, seed_i;
 	int n_sizes = sizeof(sizes) / sizeof(sizes[0]);
-	int n_spaces = sizeof(spaces) / sizeof(spaces[0]);
 	int n_seeds = sizeof(seeds) / sizeof(seeds[0]);
 
 	for (seed_i = 0; seed_i < n_seeds; seed_i++) {
 		srand(seeds[seed_i]);
 		for (sz_i = 0; sz_i < n_sizes; sz_i++) {
 			int n = sizes[sz_i];
-			for (cs_i = 0; cs_i < n_spaces; cs_i++) {
-				enum oil_colorspace cs = spaces[cs_i];
+			for (cs_i = 0; cs_i < N_SPACES; cs_i++) {
+				enum oil_colorspace cs = all_spaces[cs_i].cs;
 				test_scale_square_rand(n, n + 1, cs);
 				if (n > 1) {
 					test_scale_square_rand(n, n - 1, cs);
@@ -923,6 +1357,48 @@ static void test_g_linear_ramp_all(void)
 	test_g_linear_ramp(256, 17);   /* ~15x downscale, wide kernel */
 }
 
+/* Interpolating ramps visits linear values between every pair of sRGB levels,
+ * so the linear to sRGB conversion is checked against
+ * linear_sample_to_srgb_reference() across its whole range. */
+static void test_srgb_ramp(int out_width, int out_height,
+	enum oil_colorspace cs)
+{
+	int i, j, k, cmp, in_width, in_height;
+	unsigned char **in;
+
+	in_width = 256;
+	in_height = 8;
+	cmp = OIL_CMP(cs);
+	in = alloc_2d_uchar(in_width * cmp, in_height);
+	for (i=0; i<in_height; i++) {
+		for (j=0; j<in_width; j++) {
+			for (k=0; k<cmp; k++) {
+				in[i][j * cmp + k] = k & 1 ? 255 - j : j + i;
+			}
+			if (cs == OIL_CS_RGBA) {
+				in[i][j * cmp + 3] = 255;
+			} else if (cs == OIL_CS_ARGB) {
+				in[i][j * cmp] = 255;
+			}
+		}
+	}
+	test_scale(in_width, in_height, in, out_width, out_height, cs);
+	free_2d_uchar(in, in_height);
+}
+
+static void test_srgb_ramp_all(void)
+{
+	enum oil_colorspace cs[] = { OIL_CS_RGB, OIL_CS_RGBA, OIL_CS_ARGB,
+		OIL_CS_RGBX };
+	int i;
+
+	for (i=0; i<4; i++) {
+		test_srgb_ramp(4096, 8, cs[i]);
+		test_srgb_ramp(2001, 3, cs[i]);
+		test_srgb_ramp(97, 5, cs[i]);
+	}
+}
+
 /* oil_scale_restart() must leave the scaler in a state equivalent to a fresh
  * init: a second full pass over identical input must produce byte-identical
  * output. Currently fails because borders_y is destructively decremented during
@@ -944,6 +1420,12 @@ static void test_scale_restart(int in_dim, int out_dim, enum oil_colorspace cs)
 	second_pass = alloc_2d_uchar(out_row_stride, out_dim);
 
 	oil_scale_init(&os, in_dim, out_dim, in_dim, out_dim, cs);
+	if (fixed_point) {
+		oil_scale_set_fixed_point(&os);
+	}
+	if (half_float) {
+		oil_scale_set_half_float(&os);
+	}
 
 	/* first pass */
 	in_line = 0;
@@ -1001,6 +1483,759 @@ static void test_scale_restart_all(void)
 	test_scale_restart(50, 100, OIL_CS_RGBA);
 }
 
+/* How scale_rows() feeds a scaler. */
+struct rows_setup {
+	int batch; // rows per call.
+	int bottom_up; // whether the strides are negative.
+};
+
+/**
+ * image_fn for oil_scale_in_rows() & oil_scale_out_rows() on padded strides.
+ */
+static void scale_rows(struct test_image *img, const void *arg,
+	unsigned char *out)
+{
+	const struct rows_setup *rs = arg;
+	struct oil_scale os;
+	int i, in_pos, out_pos, ret;
+	ptrdiff_t in_stride, out_stride;
+	unsigned char *in_buf, *out_buf, *in_base, *out_base;
+
+	in_stride = img->in_stride + 7;
+	out_stride = img->out_stride + 5;
+	in_buf = malloc(in_stride * img->in_h);
+	out_buf = malloc(out_stride * img->out_h);
+
+	in_base = in_buf;
+	out_base = out_buf;
+	if (rs->bottom_up) {
+		in_base += in_stride * (img->in_h - 1);
+		out_base += out_stride * (img->out_h - 1);
+		in_stride = -in_stride;
+		out_stride = -out_stride;
+	}
+	for (i=0; i<img->in_h; i++) {
+		memcpy(in_base + i * in_stride, img->in + i * img->in_stride,
+			img->in_stride);
+	}
+
+	assert(oil_scale_init(&os, img->in_h, img->out_h, img->in_w,
+		img->out_w, img->cs) == 0);
+	in_pos = out_pos = 0;
+	while (out_pos < img->out_h) {
+		ret = oil_scale_in_rows(&os, in_base + in_pos * in_stride,
+			in_stride, rs->batch < img->in_h - in_pos ? rs->batch :
+			img->in_h - in_pos);
+		in_pos += ret;
+		ret = oil_scale_out_rows(&os, out_base + out_pos * out_stride,
+			out_stride, rs->batch);
+		assert(out_pos + ret <= img->out_h);
+		out_pos += ret;
+	}
+	assert(in_pos <= img->in_h);
+	assert(oil_scale_out_rows(&os, out_base, out_stride, 1) == 0);
+	oil_scale_free(&os);
+
+	for (i=0; i<img->out_h; i++) {
+		memcpy(out + i * img->out_stride, out_base + i * out_stride,
+			img->out_stride);
+	}
+	free(in_buf);
+	free(out_buf);
+}
+
+/* oil_scale_in_rows()/oil_scale_out_rows() must match the one-scanline API
+ * byte for byte, including with padded and negative (bottom-up) strides and
+ * batch sizes that don't line up with the slot counts. */
+static void test_scale_rows_all(void)
+{
+	static const int dims[][2] = {
+		{100, 37}, {37, 100}, {50, 50}, {9, 2}, {250, 900},
+	};
+	static const struct rows_setup setups[] = {
+		{3, 0}, {3, 1}, {64, 0}, {1, 1}, {5, 0},
+	};
+	struct test_image img;
+	int d, c;
+
+	for (c=0; c<N_SPACES; c++) {
+		for (d=0; d<(int)(sizeof(dims)/sizeof(dims[0])); d++) {
+			image_init(&img, dims[d][0], dims[d][0], dims[d][1],
+				dims[d][1], all_spaces[c].cs);
+			check_image(&img, scale_rows, &setups[d], 0,
+				"oil_scale_in_rows");
+			image_free(&img);
+		}
+	}
+}
+
+/* image_fn for oil_scale_image() with *arg threads. */
+static void scale_image(struct test_image *img, const void *arg,
+	unsigned char *out)
+{
+	assert(oil_scale_image(img->in, img->in_stride, out, img->out_stride,
+		img->in_w, img->in_h, img->out_w, img->out_h, img->cs,
+		*(const int *)arg) == 0);
+}
+
+/* oil_scale_image() splits the output into bands that each start from their
+ * own seek point; every thread count must reproduce the streaming output
+ * byte for byte. */
+static void test_scale_image_all(void)
+{
+	static const int dims[][4] = {
+		{100, 200, 37, 61},   /* downscale */
+		{13, 9, 40, 47},      /* upscale */
+		{40, 30, 40, 30},     /* identity */
+		{64, 64, 63, 63},     /* near-identity */
+		{300, 12, 5, 2},      /* few output rows */
+		{17, 90, 60, 31},     /* wider & shorter */
+		{17, 400, 60, 23},    /* wider & much shorter */
+		{80, 11, 23, 52},     /* narrower & taller */
+		{20, 45, 20, 16},     /* height only */
+		{17, 30, 50, 30},     /* width only */
+		{5000, 9, 4200, 4},   /* wide enough for a planar sums_y */
+	};
+	static const int thread_counts[] = {1, 2, 3, 8};
+	struct test_image img;
+	int d, c, t;
+	int n_threads = sizeof(thread_counts) / sizeof(thread_counts[0]);
+
+	for (d=0; d<(int)(sizeof(dims)/sizeof(dims[0])); d++) {
+		for (c=0; c<N_SPACES; c++) {
+			image_init(&img, dims[d][0], dims[d][1], dims[d][2],
+				dims[d][3], all_spaces[c].cs);
+			for (t=0; t<n_threads; t++) {
+				check_image(&img, scale_image,
+					&thread_counts[t], 0,
+					"oil_scale_image");
+			}
+			image_free(&img);
+		}
+	}
+}
+
+/**
+ * image_fn for a scaler split across *arg threads, discarding every third
+ * output row on a first pass during which the thread count can't change, then
+ * restarted with 5 - *arg threads to produce every row.
+ */
+static void scale_threads(struct test_image *img, const void *arg,
+	unsigned char *out)
+{
+	struct oil_scale os;
+	int i, in_pos;
+
+	assert(oil_scale_init(&os, img->in_h, img->out_h, img->in_w,
+		img->out_w, img->cs) == 0);
+	assert(oil_scale_set_threads(&os, *(const int *)arg) == 0);
+	in_pos = 0;
+	for (i=0; i<img->out_h; i++) {
+		while (oil_scale_slots(&os)) {
+			oil_scale_in(&os, img->in + in_pos++ * img->in_stride);
+		}
+		if (i % 3 == 1) {
+			oil_scale_out_discard(&os);
+		} else {
+			oil_scale_out(&os, out + i * img->out_stride);
+		}
+		/* the thread count can't change mid-stream */
+		assert(oil_scale_set_threads(&os, 1 + i % 4) == -1);
+	}
+	oil_scale_restart(&os);
+	assert(oil_scale_set_threads(&os, 5 - *(const int *)arg) == 0);
+	feed_image(&os, img, 1, out);
+	oil_scale_free(&os);
+}
+
+static void test_scale_threads_all(void)
+{
+	static const int dims[][4] = {
+		{1000, 20, 301, 7},   /* downscale */
+		{300, 40, 299, 39},   /* near-identity */
+		{97, 10, 311, 23},    /* upscale */
+		{300, 9, 300, 9},     /* identity */
+		{100, 5, 130, 6},     /* too narrow to split */
+		{200, 30, 400, 12},   /* mixed, runs unsplit */
+		{300, 30, 300, 12},   /* height only */
+		{90, 12, 300, 12},    /* width only, runs unsplit */
+	};
+	static const int thread_counts[] = {1, 2, 3, 4};
+	struct test_image img;
+	int d, c, t;
+	int n_threads = sizeof(thread_counts) / sizeof(thread_counts[0]);
+
+	for (d=0; d<(int)(sizeof(dims)/sizeof(dims[0])); d++) {
+		for (c=0; c<N_SPACES; c++) {
+			image_init(&img, dims[d][0], dims[d][1], dims[d][2],
+				dims[d][3], all_spaces[c].cs);
+			for (t=0; t<n_threads; t++) {
+				check_image(&img, scale_threads,
+					&thread_counts[t], 0,
+					"oil_scale_set_threads");
+			}
+			image_free(&img);
+		}
+	}
+}
+
+/**
+ * image_fn for a scaler fed single rows, which never splits it, then the
+ * whole image as one batch, which splits it into cache strips if it is too
+ * wide for L2, then single rows through those strips.
+ */
+static void scale_strips_restart(struct test_image *img, const void *arg,
+	unsigned char *out)
+{
+	struct oil_scale os;
+
+	(void)arg;
+	assert(oil_scale_init(&os, img->in_h, img->out_h, img->in_w,
+		img->out_w, img->cs) == 0);
+	feed_image(&os, img, 1, out);
+	assert(!os.pool);
+	oil_scale_restart(&os);
+	feed_image(&os, img, img->in_h, out);
+	oil_scale_restart(&os);
+	memset(out, 0, img->out_len);
+	feed_image(&os, img, 1, out);
+	oil_scale_free(&os);
+}
+
+/**
+ * image_fn for a scaler on a caller-provided buffer, which batches only split
+ * once oil_scale_set_threads() asks for it.
+ */
+static void scale_strips_allocated(struct test_image *img, const void *arg,
+	unsigned char *out)
+{
+	struct oil_scale os;
+
+	(void)arg;
+	assert(oil_scale_init_allocated(&os, img->in_h, img->out_h,
+		img->in_w, img->out_w, img->cs,
+		oil_alloc(oil_scale_alloc_size(img->in_h, img->out_h,
+		img->in_w, img->out_w, img->cs))) == 0);
+	feed_image(&os, img, img->in_h, out);
+	assert(!os.pool);
+	oil_scale_restart(&os);
+	assert(oil_scale_set_threads(&os, 1) == 0);
+	memset(out, 0, img->out_len);
+	feed_image(&os, img, img->in_h, out);
+	oil_scale_free(&os);
+}
+
+/**
+ * A downscaler too wide for L2 is split into strips that run on the calling
+ * thread on its first batch of scanlines. Once split, fed a row or a batch at
+ * a time, it must match a scaler that was only ever fed single rows. Whether
+ * it splits at all depends on the L2 size, so only the unsplit cases are
+ * checked for a pool.
+ */
+static void test_cache_strips_all(void)
+{
+	static const struct setup batched = { 0, 0, 9 };
+	struct test_image img;
+	int c;
+
+	for (c=0; c<N_SPACES; c++) {
+		image_init(&img, 70000, 9, 60000, 3, all_spaces[c].cs);
+		check_image(&img, scale_init, &batched, 0, "cache strips");
+		check_image(&img, scale_strips_restart, NULL, 0,
+			"cache strips after restart");
+		check_image(&img, scale_strips_allocated, NULL, 0,
+			"cache strips on a caller-provided buffer");
+		image_free(&img);
+	}
+}
+
+static void write_tune_file(const char *path, const char *contents)
+{
+	FILE *f;
+
+	f = fopen(path, "w");
+	assert(f);
+	fputs(contents, f);
+	assert(fclose(f) == 0);
+}
+
+/**
+ * Downscales that straddle the crossover points oil_autotune() moves around.
+ */
+static void tune_scale_all(void)
+{
+	static const int dims[][4] = {
+		{ 300, 40, 150, 20 },
+		{ 100, 20, 97, 10 },
+		{ 1000, 30, 50, 10 },
+		{ 2000, 12, 1000, 6 },
+	};
+	int i, c;
+
+	for (i=0; i<(int)(sizeof(dims)/sizeof(dims[0])); i++) {
+		for (c=0; c<N_SPACES; c++) {
+			test_scale_axes(dims[i][0], dims[i][1], dims[i][2],
+				dims[i][3], all_spaces[c].cs);
+		}
+	}
+}
+
+static void test_autotune(void)
+{
+	char path[] = "/tmp/oil_tune_XXXXXX", buf[256];
+	const char *name;
+	struct oil_scale os;
+	int fd;
+
+	fd = mkstemp(path);
+	assert(fd >= 0);
+	close(fd);
+
+	assert(oil_scale_init(&os, 10, 5, 10, 5, OIL_CS_G) == 0);
+	name = oil_scale_backend(&os);
+	oil_scale_free(&os);
+
+	assert(oil_autotune_load(NULL) == -1);
+	assert(oil_autotune_load("/nonexistent/oil_tune") == -1);
+	assert(oil_autotune("/nonexistent/oil_tune") == -1);
+	assert(oil_autotune(path) == 0);
+	assert(oil_autotune_load(path) == 0);
+	tune_scale_all();
+
+	/* nothing is applied from stale or malformed files */
+	write_tune_file(path, "oil-tune 1 nosuchbackend\nheavy_ratio 1\n");
+	assert(oil_autotune_load(path) == -1);
+	snprintf(buf, sizeof(buf), "oil-tune 1 %s\nheavy_ratio 0\n", name);
+	write_tune_file(path, buf);
+	assert(oil_autotune_load(path) == -1);
+	snprintf(buf, sizeof(buf), "oil-tune 1 %s\nheavy_ratio x\n", name);
+	write_tune_file(path, buf);
+	assert(oil_autotune_load(path) == -1);
+	snprintf(buf, sizeof(buf), "oil-tune 2 %s\n", name);
+	write_tune_file(path, buf);
+	assert(oil_autotune_load(path) == -1);
+
+	/* every variant forced on, then off */
+	snprintf(buf, sizeof(buf), "oil-tune 1 %s\nheavy_ratio 1\n"
+		"planar_len 1\nstrip_bytes 4096\nunknown_key 3\n", name);
+	write_tune_file(path, buf);
+	assert(oil_autotune_load(path) == 0);
+	tune_scale_all();
+
+	snprintf(buf, sizeof(buf), "oil-tune 1 %s\nheavy_ratio 2147483647\n"
+		"planar_len 2147483647\nstrip_bytes 2147483647\n", name);
+	write_tune_file(path, buf);
+	assert(oil_autotune_load(path) == 0);
+	tune_scale_all();
+
+	/* scalers keep the crossover points in effect at init, which a later
+	 * oil_global_init() leaves alone */
+	oil_global_init();
+	assert(oil_scale_init(&os, 10, 5, 10, 5, OIL_CS_G) == 0);
+	assert(os.heavy_ratio == 2147483647 && os.planar_len == 2147483647);
+	snprintf(buf, sizeof(buf), "oil-tune 1 %s\nheavy_ratio 3\n", name);
+	write_tune_file(path, buf);
+	assert(oil_autotune_load(path) == 0);
+	assert(os.heavy_ratio == 2147483647);
+	oil_scale_free(&os);
+
+	unlink(path);
+}
+
+/**
+ * Scalers sharing one plan, fed in lockstep, must match scalers with their own
+ * tables.
+ */
+static void test_scale_plan(int in_w, int in_h, int out_w, int out_h)
+{
+	struct oil_plan plan;
+	struct oil_scale os[N_SPACES];
+	struct test_image img[N_SPACES];
+	int c, i, in_pos;
+
+	for (c=0; c<N_SPACES; c++) {
+		image_init(&img[c], in_w, in_h, out_w, out_h,
+			all_spaces[c].cs);
+	}
+
+	assert(oil_plan_init(&plan, in_h, out_h, in_w, out_w) == 0);
+	for (c=0; c<N_SPACES; c++) {
+		assert(oil_scale_init_plan(&os[c], &plan, img[c].cs) == 0);
+	}
+	in_pos = 0;
+	for (i=0; i<out_h; i++) {
+		while (oil_scale_slots(&os[0])) {
+			for (c=0; c<N_SPACES; c++) {
+				oil_scale_in(&os[c],
+					img[c].in + in_pos * img[c].in_stride);
+			}
+			in_pos++;
+		}
+		for (c=0; c<N_SPACES; c++) {
+			oil_scale_out(&os[c],
+				img[c].out + i * img[c].out_stride);
+		}
+	}
+	for (c=0; c<N_SPACES; c++) {
+		oil_scale_free(&os[c]);
+	}
+	oil_plan_free(&plan);
+
+	for (c=0; c<N_SPACES; c++) {
+		assert(memcmp(img[c].ref, img[c].out, img[c].out_len) == 0);
+		image_free(&img[c]);
+	}
+}
+
+static void test_scale_plan_all(void)
+{
+	struct oil_plan plan;
+
+	test_scale_plan(100, 80, 31, 17);
+	test_scale_plan(9, 7, 40, 33);
+	test_scale_plan(20, 20, 20, 20);
+
+	/* plain scalers calculate y-coefficients in a window as they go;
+	 * tall & extreme ratios must still match the plan's whole table */
+	test_scale_plan(6, 4000, 3, 13);
+	test_scale_plan(6, 3000, 5, 2999);
+	test_scale_plan(5, 2, 9, 300);
+	test_scale_plan(3, 1, 4, 50);
+
+	/* axes scaling in opposite directions */
+	test_scale_plan(40, 9, 13, 30);
+	test_scale_plan(7, 50, 31, 12);
+
+	/* bad geometry is rejected like oil_scale_init() */
+	assert(oil_plan_init(&plan, 0, 20, 20, 10) == -1);
+	assert(oil_plan_init(&plan, 10, 20, 20, 0) == -1);
+}
+
+static int plan_tables_equal(struct oil_plan *a, struct oil_plan *b)
+{
+	int in_w, out_w, in_h, out_h;
+
+	in_w = a->in_width;
+	out_w = a->out_width;
+	in_h = a->in_height;
+	out_h = a->out_height;
+	return !memcmp(a->coeffs_x, b->coeffs_x,
+			4 * (in_w > out_w ? in_w : out_w) * sizeof(float)) &&
+		!memcmp(a->borders_x, b->borders_x,
+			(in_w < out_w ? in_w : out_w) * sizeof(int)) &&
+		!memcmp(a->coeffs_y, b->coeffs_y,
+			4 * (in_h > out_h ? in_h : out_h) * sizeof(float)) &&
+		!memcmp(a->borders_y, b->borders_y,
+			(in_h < out_h ? in_h : out_h) * sizeof(int));
+}
+
+/**
+ * Geometry i of a set large enough to force evictions from the cache.
+ */
+static void cache_geometry(int i, int *in_h, int *out_h, int *in_w, int *out_w)
+{
+	*in_w = 50 + i * 7;
+	*out_w = 10 + i % 13;
+	*in_h = 40 + i % 5 * 11;
+	*out_h = 9 + i % 7;
+	if (i % 4 == 0) {
+		*out_w = *in_w + i + 1;
+		*out_h = *in_h + 3;
+	}
+}
+
+static void *cache_stress(void *arg)
+{
+	struct oil_plan cached, ref;
+	int i, in_h, out_h, in_w, out_w, seed;
+
+	seed = *(int *)arg;
+	for (i=0; i<300; i++) {
+		cache_geometry((seed + i * 37) % 150, &in_h, &out_h, &in_w,
+			&out_w);
+		assert(oil_plan_init_cached(&cached, in_h, out_h, in_w,
+			out_w) == 0);
+		assert(oil_plan_init(&ref, in_h, out_h, in_w, out_w) == 0);
+		assert(plan_tables_equal(&cached, &ref));
+		oil_plan_free(&ref);
+		oil_plan_free(&cached);
+	}
+	return NULL;
+}
+
+static void test_plan_cache(void)
+{
+	static struct oil_plan held[150];
+	struct oil_plan a, b, ref;
+	pthread_t threads[4];
+	int i, seeds[4];
+
+	/* same sizes on both axes share one table */
+	assert(oil_plan_init_cached(&a, 300, 45, 300, 45) == 0);
+	assert(a.coeffs_x == a.coeffs_y && a.borders_x == a.borders_y);
+
+	/* a second plan with an axis in common reuses it */
+	assert(oil_plan_init_cached(&b, 300, 45, 640, 45) == 0);
+	assert(b.coeffs_y == a.coeffs_x);
+	assert(oil_plan_init(&ref, 300, 45, 640, 45) == 0);
+	assert(plan_tables_equal(&b, &ref));
+	oil_plan_free(&ref);
+
+	/* cleared or evicted tables stay valid for plans using them */
+	oil_plan_cache_clear();
+	for (i=0; i<150; i++) {
+		int in_h, out_h, in_w, out_w;
+		cache_geometry(i, &in_h, &out_h, &in_w, &out_w);
+		assert(oil_plan_init_cached(&ref, in_h, out_h, in_w,
+			out_w) == 0);
+		oil_plan_free(&ref);
+	}
+	assert(oil_plan_init(&ref, 300, 45, 640, 45) == 0);
+	assert(plan_tables_equal(&b, &ref));
+	oil_plan_free(&ref);
+	oil_plan_free(&a);
+	oil_plan_free(&b);
+
+	/* more tables in use at once than the cache has entries for */
+	for (i=0; i<150; i++) {
+		int in_h, out_h, in_w, out_w;
+		cache_geometry(i, &in_h, &out_h, &in_w, &out_w);
+		assert(oil_plan_init_cached(&held[i], in_h, out_h, in_w,
+			out_w) == 0);
+	}
+	for (i=0; i<150; i++) {
+		assert(oil_plan_init(&ref, held[i].in_height,
+			held[i].out_height, held[i].in_width,
+			held[i].out_width) == 0);
+		assert(plan_tables_equal(&held[i], &ref));
+		oil_plan_free(&ref);
+		oil_plan_free(&held[i]);
+	}
+
+	assert(oil_plan_init_cached(&a, 10, 20, 0, 10) == -1);
+
+	for (i=0; i<4; i++) {
+		seeds[i] = i * 11;
+		assert(pthread_create(&threads[i], NULL, cache_stress,
+			&seeds[i]) == 0);
+	}
+	for (i=0; i<4; i++) {
+		pthread_join(threads[i], NULL);
+	}
+	oil_plan_cache_clear();
+}
+
+static int dirty_allocs, dirty_frees;
+static size_t dirty_max;
+
+/**
+ * Allocator that hands out garbage-filled memory, so scalers relying on
+ * zeroes they didn't write themselves would produce NaNs.
+ */
+static void *dirty_alloc(void *ctx, size_t size)
+{
+	void *ptr;
+
+	(void)ctx;
+	ptr = malloc(size);
+	if (ptr) {
+		memset(ptr, 0xff, size);
+		dirty_allocs++;
+		if (size > dirty_max) {
+			dirty_max = size;
+		}
+	}
+	return ptr;
+}
+
+static void dirty_free(void *ctx, void *ptr)
+{
+	(void)ctx;
+	dirty_frees++;
+	free(ptr);
+}
+
+static void test_allocator(void)
+{
+	static const struct oil_allocator dirty = { dirty_alloc, dirty_free,
+		NULL };
+	static const int dims[][4] = {
+		{300, 200, 37, 61},
+		{13, 9, 140, 47},
+	};
+	static const struct setup single = { 0, 0, 1 }, threaded = { 0, 2, 1 };
+	struct oil_scale os;
+	struct test_image img;
+	int d, c, allocs, size;
+
+	for (d=0; d<2; d++) {
+		for (c=0; c<N_SPACES; c++) {
+			oil_set_allocator(NULL);
+			image_init(&img, dims[d][0], dims[d][1], dims[d][2],
+				dims[d][3], all_spaces[c].cs);
+
+			dirty_allocs = dirty_frees = 0;
+			oil_set_allocator(&dirty);
+			oil_set_buffer_pool(1 << 24);
+
+			/* fresh and recycled buffers, single & multi-threaded */
+			check_image(&img, scale_init, &threaded, 0,
+				"dirty allocator, threads");
+			check_image(&img, scale_plan, &single, 0,
+				"dirty allocator, plan");
+			allocs = dirty_allocs;
+			check_image(&img, scale_init, &threaded, 0,
+				"dirty allocator, threads again");
+
+			/* the second threaded job is served from the pool */
+			assert(dirty_allocs > 0);
+			assert(dirty_allocs == allocs);
+
+			/* oil_scale_free() releases a caller-provided buffer */
+			check_image(&img, scale_allocated, &single, 0,
+				"dirty allocator, caller-provided buffer");
+
+			oil_set_buffer_pool(0);
+			assert(dirty_allocs == dirty_frees);
+
+			/* without the pool, buffers aren't rounded to a class */
+			dirty_max = 0;
+			size = oil_scale_alloc_size(img.in_h, img.out_h,
+				img.in_w, img.out_w, img.cs);
+			assert(oil_scale_init(&os, img.in_h, img.out_h,
+				img.in_w, img.out_w, img.cs) == 0);
+			oil_scale_free(&os);
+			assert(dirty_max >= (size_t)size);
+			assert(dirty_max <= (size_t)size + 64);
+			image_free(&img);
+		}
+	}
+	oil_set_allocator(NULL);
+}
+
+/* Flat areas must come out unchanged and the downscale overshoot of a
+ * negative-lobe pattern must stay within the fixed-point tolerance, in every
+ * colorspace that supports fixed point. Scalers that don't must say so and
+ * keep working. */
+static void test_fixed_point_downscale_all(void)
+{
+	static const int dims[][2] = {
+		{64, 16}, {64, 31}, {300, 7}, {97, 96}, {1000, 3},
+	};
+	int d, c, i, v, cmp, in_dim, out_dim, fixed;
+	unsigned char **input_image, **output_image;
+	enum oil_colorspace cs;
+	struct oil_scale os;
+
+	for (d=0; d<(int)(sizeof(dims)/sizeof(dims[0])); d++) {
+		in_dim = dims[d][0];
+		out_dim = dims[d][1];
+		for (c=0; c<N_SPACES; c++) {
+			cs = all_spaces[c].cs;
+			assert(oil_scale_init(&os, in_dim, out_dim, in_dim,
+				out_dim, cs) == 0);
+			fixed = oil_scale_set_fixed_point(&os) == 0;
+			oil_scale_free(&os);
+			if (!fixed) {
+				continue;
+			}
+			cmp = OIL_CMP(cs);
+			test_scale_negative_lobe_pattern(in_dim, out_dim, cs);
+
+			input_image = alloc_2d_uchar(in_dim * cmp, in_dim);
+			output_image = alloc_2d_uchar(out_dim * cmp, out_dim);
+			for (v=0; v<256; v+=51) {
+				for (i=0; i<in_dim; i++) {
+					memset(input_image[i], v, in_dim * cmp);
+				}
+				do_oil_scale(input_image, in_dim, in_dim,
+					output_image, out_dim, out_dim, cs);
+				for (i=0; i<out_dim * out_dim * cmp; i++) {
+					assert(output_image[i / (out_dim * cmp)]
+						[i % (out_dim * cmp)] == v ||
+						(cs == OIL_CS_RGBX_NOGAMMA &&
+						i % 4 == 3));
+				}
+			}
+			free_2d_uchar(input_image, in_dim);
+			free_2d_uchar(output_image, out_dim);
+		}
+	}
+
+	assert(oil_scale_init(&os, 20, 10, 20, 10, OIL_CS_G) == 0);
+	assert(oil_scale_set_fixed_point(&os) == 0);
+	assert(oil_scale_set_fixed_point(&os) == 0);
+	output_image = alloc_2d_uchar(20, 1);
+	assert(cur_scale_in(&os, output_image[0]) == 0);
+	assert(oil_scale_set_fixed_point(&os) == -1);
+	free_2d_uchar(output_image, 1);
+	oil_scale_free(&os);
+	assert(oil_scale_init(&os, 20, 10, 20, 10, OIL_CS_RGB) == 0);
+	assert(oil_scale_set_fixed_point(&os) == -1);
+	oil_scale_free(&os);
+	assert(oil_scale_init(&os, 20, 10, 10, 20, OIL_CS_G) == 0);
+	assert(oil_scale_set_fixed_point(&os) == -1);
+	oil_scale_free(&os);
+	assert(oil_scale_init(&os, 20, 20, 20, 20, OIL_CS_G) == 0);
+	assert(oil_scale_set_fixed_point(&os) == -1);
+	oil_scale_free(&os);
+}
+
+/* Half-float scalers match whichever way they were set up and fed, and stay
+ * single-threaded. */
+static void test_half_float_all(void)
+{
+	static const int dims[][4] = {
+		{13, 9, 40, 47},      /* upscale */
+		{700, 20, 900, 53},   /* several blocks of columns */
+		{300, 40, 100, 97},   /* taller & narrower */
+		{200, 90, 900, 31},   /* wider & shorter */
+	};
+	static const struct setup single = { 1, 4, 1 }, batched = { 1, 4, 5 };
+	struct test_image img;
+	struct oil_scale os;
+	unsigned char line[20];
+	int d, c;
+
+	for (d=0; d<(int)(sizeof(dims)/sizeof(dims[0])); d++) {
+		for (c=0; c<N_SPACES; c++) {
+			image_init(&img, dims[d][0], dims[d][1], dims[d][2],
+				dims[d][3], all_spaces[c].cs);
+			/* compare against a half-float scaler instead */
+			scale_init(&img, &single, img.ref);
+			check_image(&img, scale_init, &batched, 0,
+				"half floats, batched");
+			check_image(&img, scale_plan, &single, 0,
+				"half floats, plan");
+			check_image(&img, scale_allocated, &single, 0,
+				"half floats, caller-provided buffer");
+			image_free(&img);
+		}
+	}
+
+	assert(oil_scale_set_half_float(NULL) == -1);
+	assert(oil_scale_init(&os, 10, 20, 10, 20, OIL_CS_G) == 0);
+	assert(oil_scale_set_half_float(&os) == 0);
+	assert(oil_scale_set_half_float(&os) == 0);
+	memset(line, 0, sizeof(line));
+	oil_scale_free(&os);
+	assert(oil_scale_init(&os, 10, 20, 10, 20, OIL_CS_G) == 0);
+	assert(oil_scale_in(&os, line) == 0);
+	assert(oil_scale_set_half_float(&os) == -1);
+	oil_scale_free(&os);
+	assert(oil_scale_init(&os, 10, 20, 200, 400, OIL_CS_G) == 0);
+	assert(oil_scale_set_threads(&os, 2) == 0);
+	assert(oil_scale_set_half_float(&os) == -1);
+	oil_scale_free(&os);
+	/* the fused downscale kernels keep floats */
+	assert(oil_scale_init(&os, 20, 10, 20, 10, OIL_CS_G) == 0);
+	assert(oil_scale_set_half_float(&os) == -1);
+	oil_scale_free(&os);
+	assert(oil_scale_init(&os, 20, 20, 10, 20, OIL_CS_G) == 0);
+	assert(oil_scale_set_half_float(&os) == -1);
+	oil_scale_free(&os);
+}
+
 struct impl {
 	char *name;
 	scale_in_fn in;
@@ -1016,21 +2251,55 @@ static void run_tests(struct impl *impl)
 	cur_scale_out_discard = impl->out_discard;
 
 	test_scale_all();
+	test_scale_axes_all();
 	test_scale_catrom_extremes();
 	test_scale_negative_lobe_all();
 	test_scale_alpha_unpremul_overshoot();
 	test_out_discard_all();
 	test_out_not_ready_all();
+	test_scale_identity_all();
 	test_scale_near_identity();
 	test_g_linear_ramp_all();
+	test_srgb_ramp_all();
+	test_scale_restart_all();
+}
+
+static void run_fixed_tests(struct impl *impl)
+{
+	printf("--- testing %s fixed point ---\n", impl->name);
+	cur_scale_in = impl->in;
+	cur_scale_out = impl->out;
+	cur_scale_out_discard = impl->out_discard;
+
+	fixed_point = 1;
+	test_scale_all();
+	test_scale_axes_all();
+	test_out_discard_all();
+	test_scale_restart_all();
+	test_fixed_point_downscale_all();
+	fixed_point = 0;
+}
+
+static void run_half_tests(struct impl *impl)
+{
+	printf("--- testing %s half floats ---\n", impl->name);
+	cur_scale_in = impl->in;
+	cur_scale_out = impl->out;
+	cur_scale_out_discard = impl->out_discard;
+
+	half_float = 1;
+	test_scale_all();
+	test_scale_axes_all();
+	test_out_discard_all();
 	test_scale_restart_all();
+	half_float = 0;
 }
 
 int main(void)
 {
 	int t = 1531289551;
 	int i, num_impls;
-	struct impl impls[3];
+	struct impl impls[6];
 	//int t = time(NULL);
 	printf("seed: %d\n", t);
 	srand(t);
@@ -1038,8 +2307,14 @@ int main(void)
 
 	num_impls = 0;
 	impls[num_impls].name = "scalar";
-	impls[num_impls].in = oil_scale_in;
-	impls[num_impls].out = oil_scale_out;
+	impls[num_impls].in = oil_scale_in_scalar;
+	impls[num_impls].out = oil_scale_out_scalar;
+	impls[num_impls].out_discard = oil_scale_out_discard;
+	num_impls++;
+
+	impls[num_impls].name = "vec";
+	impls[num_impls].in = oil_scale_in_vec;
+	impls[num_impls].out = oil_scale_out_vec;
 	impls[num_impls].out_discard = oil_scale_out_discard;
 	num_impls++;
 
@@ -1050,6 +2325,12 @@ int main(void)
 	impls[num_impls].out_discard = oil_scale_out_discard;
 	num_impls++;
 
+	impls[num_impls].name = "sse41";
+	impls[num_impls].in = oil_scale_in_sse41;
+	impls[num_impls].out = oil_scale_out_sse41;
+	impls[num_impls].out_discard = oil_scale_out_discard;
+	num_impls++;
+
 	impls[num_impls].name = "avx2";
 	impls[num_impls].in = oil_scale_in_avx2;
 	impls[num_impls].out = oil_scale_out_avx2;
@@ -1063,11 +2344,62 @@ int main(void)
 	num_impls++;
 #endif
 
+	/* runtime dispatch to the best backend for this CPU */
+	impls[num_impls].name = "auto";
+	impls[num_impls].in = oil_scale_in;
+	impls[num_impls].out = oil_scale_out;
+	impls[num_impls].out_discard = oil_scale_out_discard;
+	num_impls++;
+
 	for (i=0; i<num_impls; i++) {
 		run_tests(&impls[i]);
 	}
 
+	for (i=0; i<num_impls; i++) {
+		run_fixed_tests(&impls[i]);
+	}
+
+	for (i=0; i<num_impls; i++) {
+		run_half_tests(&impls[i]);
+	}
+
+	printf("--- testing batched rows ---\n");
+	test_scale_rows_all();
+
+	printf("--- testing whole-image bands ---\n");
+	test_scale_image_all();
+
+	printf("--- testing shared plans ---\n");
+	test_scale_plan_all();
+
+	printf("--- testing plan cache ---\n");
+	test_plan_cache();
+
+	printf("--- testing allocator hooks ---\n");
+	test_allocator();
+
+	printf("--- testing column-split threads ---\n");
+	test_scale_threads_all();
+
+	printf("--- testing cache-sized strips ---\n");
+	test_cache_strips_all();
+
+	printf("--- testing half-float storage ---\n");
+	test_half_float_all();
+
+	printf("--- testing autotuning ---\n");
+	test_autotune();
+
 	printf("worst error: %f\n", worst);
+	printf("worst fixed-point error: %f\n", worst_fixed);
+	for (i=0; i<N_SPACES; i++) {
+		printf("worst half-float error, %s: %f", all_spaces[i].name,
+			worst_half[i]);
+		if (alpha_index(all_spaces[i].cs) >= 0) {
+			printf(", colour: %f / alpha", worst_half_alpha[i]);
+		}
+		printf("\n");
+	}
 	printf("All tests pass.\n");
 	return 0;
 }